@@ -0,0 +1,886 @@
+/*
+ *	bench.cpp
+ *
+ *	Benchmarks of the analysis building blocks.
+ *	See bench.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <math.h>
+
+#include "bench.h"
+#include "kernels.h"
+#include "workers.h"
+#include "fft.h"
+#include "roi.h"
+#include "results.h"
+#include "place.h"
+#include "hostmem.h"
+#include "seqfile.h"
+#include "stack.h"
+#include "vignet.h"
+#include "focus.h"
+#include "distortion.h"
+#include "psf.h"
+#include "lca.h"
+#include "star.h"
+
+#define BENCH_MINMILLIS	300	// run each case at least this long
+
+
+double bench_millis(void)
+{
+	LARGE_INTEGER	pf = { 0,0 };
+	LARGE_INTEGER	pc = { 0,0 };
+
+	QueryPerformanceFrequency(&pf);
+	QueryPerformanceCounter(&pc);
+	if (pf.QuadPart == 0)
+		return(0);
+	return((pc.QuadPart * 1.0E3) / pf.QuadPart);
+}
+
+/*
+ * FFT: the rows of many ROIs, one transform at a time,
+ * each looking up its plan, versus as one batch sharing
+ * a plan on the worker pool; and scalar versus SSE2 butterflies.
+ * Each is checked against a direct DFT, in double, of a row.
+ */
+#define BENCH_FFTROIS	32
+#define BENCH_FFTCHECKS	3	// rows checked
+
+/*
+ * The largest difference of a row's transform from the
+ * direct DFT, relative to the DFT's largest magnitude.
+ */
+static double bench_fftError(int n, const float *in, const struct fftcomplex *out)
+{
+	const double pi = 3.14159265358979323846;
+	double	maxd = 0, maxm = 0;
+
+	for (int k = 0; k <= n / 2; k++) {
+		double	re = 0, im = 0;
+		for (int j = 0; j < n; j++) {
+			int	jk = (int)(((LONGLONG)j * k) % n);	// exact phase
+			re += in[j] * cos(2 * pi * jk / n);
+			im -= in[j] * sin(2 * pi * jk / n);
+		}
+		maxm = max(maxm, sqrt(re * re + im * im));
+		maxd = max(maxd, sqrt((out[k].re - re) * (out[k].re - re) + (out[k].im - im) * (out[k].im - im)));
+	}
+	return(maxm > 0 ? maxd / maxm : maxd);
+}
+
+static void bench_fft(void)
+{
+	printf("fft: %d ROIs, real row transforms, %d threads\n", BENCH_FFTROIS, wrk_threads());
+	printf("  %5s %12s %12s %12s %8s %10s\n", "size", "scalar us", "single us", "batched us", "speedup", "dft error");
+	for (int n = 64; n <= 512; n *= 2) {
+		int	rows = n * BENCH_FFTROIS;
+		float	*in = (float*)_aligned_malloc((size_t)rows * n * sizeof(float), 16);
+		struct	fftcomplex *out = (struct fftcomplex*)_aligned_malloc((size_t)rows * (n / 2 + 1) * sizeof(struct fftcomplex), 16);
+		double	us[3], err = 0;
+
+		if (!in || !out || !fft_plan(n)) {
+			printf("  %5d: no memory\n", n);
+			if (in)
+				_aligned_free(in);
+			if (out)
+				_aligned_free(out);
+			continue;
+		}
+		for (size_t i = 0; i < (size_t)rows * n; i++)
+			in[i] = (float)(rand() & 0xFFF);
+
+		for (int c = 0; c < 3; c++) {
+			int	saved = kern_simd;
+			int	reps = 0;
+			double	t0 = bench_millis(), t;
+			kern_simd = c == 0 ? 0 : saved;
+			do {
+				if (c < 2) {
+					for (int r = 0; r < rows; r++)
+						fft_real(fft_plan(n), in + (size_t)r * n, out + (size_t)r * (n / 2 + 1));
+				}
+				else
+					fft_realBatch(fft_plan(n), in, n, out, n / 2 + 1, rows);
+				reps++;
+			} while ((t = bench_millis() - t0) < BENCH_MINMILLIS);
+			kern_simd = saved;
+			us[c] = t * 1e3 / reps / BENCH_FFTROIS;	    // per ROI
+			for (int k = 0; k < BENCH_FFTCHECKS; k++) {
+				int	r = k * (rows - 1) / (BENCH_FFTCHECKS - 1);
+				err = max(err, bench_fftError(n, in + (size_t)r * n, out + (size_t)r * (n / 2 + 1)));
+			}
+		}
+		printf("  %5d %12.1f %12.1f %12.1f %7.1fx %10.1e\n", n, us[0], us[1], us[2], us[1] / us[2], err);
+		_aligned_free(in);
+		_aligned_free(out);
+	}
+	printf("  (times per %s ROI, i.e. per %s row transforms;\n", "n x n", "n");
+	printf("   error the largest of scalar, single and batched against a direct DFT, relative to its peak)\n");
+}
+
+/*
+ * ROIs: full detection of slanted edges versus tracking them,
+ * on a chart of squares turned 5 degrees, moving 3,2 pixels
+ * between frames.
+ */
+#define BENCH_ROIFRAMES	8
+
+static void bench_chart(struct hostframe *f, int ox, int oy)
+{
+	double	c = cos(5 * 3.14159265358979 / 180), s = sin(5 * 3.14159265358979 / 180);
+
+	for (int y = 0; y < f->ydim; y++) {
+		for (int x = 0; x < f->xdim; x++) {
+			double px = (x - ox + 100000) % 200 - 100.0, py = (y - oy + 100000) % 200 - 100.0;
+			double u = c * px + s * py, v = c * py - s * px;
+			f->pix[(size_t)y * f->xdim + x] = fabs(u) < 50 && fabs(v) < 50 ? 400 : 3600;
+		}
+	}
+}
+
+static void bench_roi(void)
+{
+	struct	hostframe f[BENCH_ROIFRAMES];
+	struct	roiset rs;
+	double	ms[2];
+	int	n = 0;
+
+	memset(f, 0, sizeof(f));
+	for (int i = 0; i < BENCH_ROIFRAMES; i++) {
+		if (frame_alloc(&f[i], 1280, 960, 1, 12) < 0) {
+			printf("roi: no memory\n");
+			goto out;
+		}
+		bench_chart(&f[i], 3 * i, 2 * i);
+	}
+	if (roi_alloc(&rs, 25, 64) < 0) {
+		printf("roi: no memory\n");
+		goto out;
+	}
+	//
+	// Tracking runs back and forth over the frames,
+	// so the chart never moves more than one step.
+	//
+	for (int c = 0; c < 2; c++) {
+		int	reps = 0;
+		double	t0, t;
+		roi_reset(&rs);
+		if (c == 1)
+			roi_update(&rs, &f[0]);
+		t0 = bench_millis();
+		do {
+			int i = reps % (2 * BENCH_ROIFRAMES - 2);
+			if (i >= BENCH_ROIFRAMES)
+				i = 2 * BENCH_ROIFRAMES - 2 - i;
+			if (c == 0)
+				roi_reset(&rs);
+			n = roi_update(&rs, &f[i]);
+			reps++;
+		} while ((t = bench_millis() - t0) < BENCH_MINMILLIS);
+		ms[c] = t / reps;
+	}
+	printf("roi: %d edge ROIs of 64x64, 1280x960 mono, %d threads\n", n, wrk_threads());
+	printf("  detect %.3f ms/frame, track %.3f ms/frame, %.1fx\n", ms[0], ms[1], ms[0] / ms[1]);
+	roi_free(&rs);
+out:
+	for (int i = 0; i < BENCH_ROIFRAMES; i++)
+		frame_free(&f[i]);
+}
+
+/*
+ * Results: appending rows as a shift of live measurement
+ * would, 100 lenses of 200 frames of 25 ROIs by 4 metrics;
+ * then a filtered aggregation of one metric per run, and a
+ * scan of one run.
+ */
+#define BENCH_RESFILE	"bench.sir"
+
+static void bench_countRow(void *ctx, const struct resrow *row)
+{
+	(*(int*)ctx)++;
+}
+
+static void bench_results(void)
+{
+	static const char *metrics[4] = { "lca.rg", "lca.bg", "psf.fwhmx", "psf.fwhmy" };
+	struct	results r;
+	struct	resfilter flt = { -1, NULL, "psf.fwhmx", -1, 0, 0 };
+	struct	resagg *agg;
+	double	t0, ms[3];
+	int	err = 0, rows = 0, n = 0;
+
+	remove(BENCH_RESFILE);
+	if (res_open(&r, BENCH_RESFILE) < 0) {
+		printf("results: can't create %s\n", BENCH_RESFILE);
+		return;
+	}
+	t0 = bench_millis();
+	for (int lens = 0; lens < 100 && err >= 0; lens++) {
+		char	serial[16];
+		int	run = res_newRun(&r);
+		_snprintf(serial, sizeof(serial), "L%05d", lens);
+		for (int frame = 0; frame < 200 && err >= 0; frame++) {
+			err = res_frame(&r, run, serial, frame);
+			for (int roi = 0; roi < 25 && err >= 0; roi++)
+				for (int m = 0; m < 4 && err >= 0; m++, rows++)
+					err = res_add(&r, metrics[m], roi, (rand() & 0xFFF) / 1024.0);
+		}
+	}
+	if (err >= 0)
+		err = res_flush(&r);
+	ms[0] = bench_millis() - t0;
+	res_close(&r);
+
+	agg = (struct resagg*)malloc(1000 * sizeof(struct resagg));
+	t0 = bench_millis();
+	if (err >= 0 && agg)
+		err = res_aggregate(BENCH_RESFILE, &flt, RES_BYRUN, agg, 1000);
+	ms[1] = bench_millis() - t0;
+	flt.metric = NULL;
+	flt.run = 50;
+	t0 = bench_millis();
+	if (err >= 0)
+		err = (int)res_scan(BENCH_RESFILE, &flt, bench_countRow, &n);
+	ms[2] = bench_millis() - t0;
+	free(agg);
+	remove(BENCH_RESFILE);
+	if (err < 0) {
+		printf("results: %s\n", pxd_mesgErrorCode(err));
+		return;
+	}
+	printf("results: %d rows, %d bytes per row\n", rows, (int)((sizeof(__int64) + 3 * sizeof(int) + 3 * sizeof(short))));
+	printf("  append %.0f rows/ms, aggregate one metric by run %.1f ms, scan one run %.1f ms (%d rows)\n",
+		rows / ms[0], ms[1], ms[2], n);
+}
+
+/*
+ * Placement: latency from a trigger to the frame being in
+ * host memory, with the analysis workers and this thread
+ * busy on every processor, unplaced versus placed. The
+ * trigger thread stands in for the driver's interrupt, at
+ * time critical priority either way; the capture thread
+ * waits for it, then copies a 1 MP frame of 16 bits.
+ * Triggers coming while the capture thread is still late
+ * for an earlier one are counted as missed.
+ */
+#define BENCH_TRIGGERS	400
+#define BENCH_TRIGPIX	(1024 * 1024)
+
+static	HANDLE	    benchtrig;
+static	double	    benchstamps[BENCH_TRIGGERS];	// when each was triggered
+static	volatile LONG benchseq;			// triggers so far
+static	volatile LONG benchdone;
+static	double	    benchlat[BENCH_TRIGGERS];
+static	int	    benchwakes;			// latencies in benchlat
+static	int	    benchmissed;		// triggers coalesced into an earlier one
+static	ushort	    *benchsrc, *benchdst;
+
+static DWORD WINAPI bench_trigger(PVOID p)
+{
+	for (int i = 0; i < BENCH_TRIGGERS && !benchdone; i++) {
+		Sleep(1);
+		benchstamps[i] = bench_millis();
+		InterlockedExchange(&benchseq, i + 1);
+		SetEvent(benchtrig);
+	}
+	return(0);
+}
+
+//
+// Each wake consumes every trigger since the last; the latency
+// is from the earliest of them, the one that woke it, and the
+// rest, their events coalesced while it was late, are missed.
+//
+static DWORD WINAPI bench_capture(PVOID p)
+{
+	int	next = 0;	// the first trigger not yet consumed
+
+	while (next < BENCH_TRIGGERS) {
+		LONG	seq;
+		if (WaitForSingleObject(benchtrig, 1000) != WAIT_OBJECT_0)
+			break;
+		seq = benchseq;
+		if (seq <= next)
+			continue;	// set again for a trigger already consumed
+		memcpy(benchdst, benchsrc, BENCH_TRIGPIX * sizeof(ushort));
+		benchlat[benchwakes++] = bench_millis() - benchstamps[next];
+		benchmissed += seq - next - 1;
+		next = seq;
+	}
+	benchdone = 1;
+	return(0);
+}
+
+static void bench_spin(void *ctx, int index)
+{
+	double	x = index;
+
+	for (int i = 0; i < 20000; i++)
+		x = sqrt(x + i);
+	*(volatile double*)ctx = x;
+}
+
+static int bench_cmpdouble(const void *a, const void *b)
+{
+	double	d = *(const double*)a - *(const double*)b;
+	return(d < 0 ? -1 : d > 0);
+}
+
+static void bench_place(void)
+{
+	static const char *names[2] = { "unplaced", "placed" };
+
+	benchsrc = (ushort*)malloc(BENCH_TRIGPIX * sizeof(ushort));
+	benchdst = (ushort*)malloc(BENCH_TRIGPIX * sizeof(ushort));
+	benchtrig = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!benchsrc || !benchdst || !benchtrig) {
+		printf("place: no memory\n");
+		goto out;
+	}
+	memset(benchsrc, 0x5A, BENCH_TRIGPIX * sizeof(ushort));
+	printf("place: trigger to frame in memory, %d triggers, 1 MP 16 bit frame copied, analysis on all processors\n", BENCH_TRIGGERS);
+	printf("  %-9s %9s %9s %9s %9s %9s %8s %8s\n", "", "mean us", "p50 us", "p99 us", "max us", "sd us", "missed", "threads");
+	for (int c = 0; c < 2; c++) {
+		HANDLE	th[2];
+		DWORD	id;
+		volatile double sink;
+		double	mean = 0, var = 0;
+		int	n = 0;
+
+		if (c == 0)
+			place_plan(0, 0, NORMAL_PRIORITY_CLASS);
+		else if (!place_plan(1, 0, HIGH_PRIORITY_CLASS))
+			printf("  (too few cores to pin; prioritized only)\n");
+		wrk_start(0);
+		place_self(PLACE_ANALYSIS, "bench");
+		benchdone = 0;
+		benchseq = 0;
+		benchwakes = 0;
+		benchmissed = 0;
+		th[0] = CreateThread(0, 0, bench_capture, NULL, 0, &id);
+		th[1] = CreateThread(0, 0, bench_trigger, NULL, 0, &id);
+		if (!th[0] || !th[1]) {
+			benchdone = 1;
+			printf("  %-9s can't create threads\n", names[c]);
+		}
+		else {
+			place_thread(th[0], PLACE_CAPTURE, "capture");
+			SetThreadPriority(th[1], THREAD_PRIORITY_TIME_CRITICAL);
+			while (!benchdone)
+				wrk_parallel(4 * wrk_threads(), bench_spin, (void*)&sink);
+			WaitForMultipleObjects(2, th, TRUE, 5000);
+			place_forget(th[0]);
+		}
+		for (int i = 0; i < 2; i++)
+			if (th[i])
+				CloseHandle(th[i]);
+		place_forget(GetCurrentThread());
+		for (; n < benchwakes; n++)
+			mean += benchlat[n];
+		if (!n)
+			continue;
+		mean /= n;
+		for (int i = 0; i < n; i++)
+			var += (benchlat[i] - mean) * (benchlat[i] - mean);
+		qsort(benchlat, n, sizeof(double), bench_cmpdouble);
+		printf("  %-9s %9.1f %9.1f %9.1f %9.1f %9.1f %8d %8d\n", names[c], mean * 1e3, benchlat[n / 2] * 1e3,
+			benchlat[min(n - 1, n * 99 / 100)] * 1e3, benchlat[n - 1] * 1e3, sqrt(var / n) * 1e3, benchmissed, wrk_threads());
+	}
+	place_plan(0, 0, NORMAL_PRIORITY_CLASS);
+	wrk_start(0);
+out:
+	if (benchtrig)
+		CloseHandle(benchtrig);
+	free(benchsrc);
+	free(benchdst);
+}
+
+/*
+ * Memory: flat field correction, and accumulation of a stack
+ * of frames as by calibration, over frames in normal pages
+ * versus large pages. Throughput is of memory traffic: 8 bytes
+ * per pixel for flatfield, 10 for accumulate.
+ */
+#define BENCH_MEMFRAMES	8
+
+static void bench_mem(void)
+{
+	static const int mp[2] = { 5, 25 };
+
+	printf("mem: SIMD kernels over %d frames of 12 bit mono, normal versus large pages\n", BENCH_MEMFRAMES);
+	printf("  %5s %-9s %12s %12s  %s\n", "MP", "pages", "flat GB/s", "accum GB/s", "obtained");
+	for (int m = 0; m < 2; m++) {
+		for (int c = 0; c < 2; c++) {
+			size_t	npix = (size_t)mp[m] * 1024 * 1024;
+			ushort	*pix[BENCH_MEMFRAMES], *dark, *gain;
+			uint	*acc;
+			char	got[256];
+			double	gbs[2];
+			int	ok = 1;
+
+			mem_init(c ? MEM_LARGE : 0);
+			dark = (ushort*)mem_alloc(npix * sizeof(ushort));
+			gain = (ushort*)mem_alloc(npix * sizeof(ushort));
+			acc = (uint*)mem_alloc(npix * sizeof(uint));
+			ok = dark && gain && acc;
+			for (int i = 0; i < BENCH_MEMFRAMES; i++) {
+				pix[i] = (ushort*)mem_alloc(npix * sizeof(ushort));
+				ok = ok && pix[i];
+			}
+			if (mem_format(got, sizeof(got)) < 0)
+				got[0] = 0;
+			if (ok) {
+				for (size_t j = 0; j < npix; j++) {
+					dark[j] = (ushort)(j & 0x3F);
+					gain[j] = (ushort)((1 << KERN_GAINSHIFT) + (j & 0xFF));
+				}
+				for (int i = 0; i < BENCH_MEMFRAMES; i++)
+					for (size_t j = 0; j < npix; j++)
+						pix[i][j] = (ushort)((j * 7 + i) & 0xFFF);
+				for (int k = 0; k < 2; k++) {
+					int	reps = 0;
+					double	t0 = bench_millis(), t;
+					do {
+						memset(acc, 0, npix * sizeof(uint));
+						for (int i = 0; i < BENCH_MEMFRAMES; i++) {
+							if (k == 0)
+								kern_flatfield(pix[i], dark, gain, npix, 12);
+							else
+								kern_accumulate(acc, pix[i], npix);
+						}
+						reps++;
+					} while ((t = bench_millis() - t0) < BENCH_MINMILLIS);
+					gbs[k] = (double)reps * BENCH_MEMFRAMES * npix * (k == 0 ? 8 : 10) / (t * 1e6);
+				}
+				printf("  %5d %-9s %12.2f %12.2f  %s\n", mp[m], c ? "large" : "normal", gbs[0], gbs[1], got);
+			}
+			else
+				printf("  %5d %-9s no memory\n", mp[m], c ? "large" : "normal");
+			mem_free(dark);
+			mem_free(gain);
+			mem_free(acc);
+			for (int i = 0; i < BENCH_MEMFRAMES; i++)
+				mem_free(pix[i]);
+		}
+	}
+	mem_init(0);
+}
+
+/*
+ * Writing: a sequence of frames to disk with fwrite, as by
+ * SaveBinary1 before, versus seqfile buffered and direct. The
+ * time is to the file being closed; fwrite's and buffered writes
+ * may then still be in the file cache, not yet on the disk.
+ */
+#define BENCH_WRITEFILE	"bench.bin"
+#define BENCH_WRITEFRAMES 40
+#define BENCH_WRITEPIX	(2448 * 2048)		// 5 MP, 16 bits
+
+static void bench_write(void)
+{
+	static const char *names[3] = { "fwrite", "buffered", "direct" };
+	size_t	bytes = BENCH_WRITEPIX * sizeof(ushort);
+	ushort	*frame = (ushort*)malloc(bytes);
+
+	if (!frame) {
+		printf("write: no memory\n");
+		return;
+	}
+	for (size_t i = 0; i < BENCH_WRITEPIX; i++)
+		frame[i] = (ushort)(i & 0xFFF);
+	printf("write: %d frames of 5 MP, 16 bit, %.0f MB, to %s\n", BENCH_WRITEFRAMES,
+		(double)bytes * BENCH_WRITEFRAMES / 1048576, BENCH_WRITEFILE);
+	for (int c = 0; c < 3; c++) {
+		double	t0 = bench_millis(), t;
+		int	err = 0;
+
+		remove(BENCH_WRITEFILE);
+		if (c == 0) {
+			FILE *fp = fopen(BENCH_WRITEFILE, "wb");
+			if (!fp)
+				err = PXERNOFILE;
+			for (int i = 0; i < BENCH_WRITEFRAMES && err >= 0; i++)
+				if (fwrite(frame, sizeof(ushort), BENCH_WRITEPIX, fp) != BENCH_WRITEPIX)
+					err = PXERDOSIO;
+			if (fp && fclose(fp) != 0 && err >= 0)
+				err = PXERDOSIO;
+		}
+		else {
+			struct seqfile sf;
+			err = sf_open(&sf, BENCH_WRITEFILE, c == 2);
+			if (err >= 0) {
+				if (c == 2 && !sf.direct)
+					printf("  (unbuffered writes not allowed here; buffered)\n");
+				for (int i = 0; i < BENCH_WRITEFRAMES && err >= 0; i++)
+					err = sf_write(&sf, frame, bytes);
+				if (sf_close(&sf) < 0 && err >= 0)
+					err = PXERDOSIO;
+			}
+		}
+		t = bench_millis() - t0;
+		if (err < 0)
+			printf("  %-9s %s\n", names[c], pxd_mesgErrorCode(err));
+		else
+			printf("  %-9s %8.0f MB/s\n", names[c], (double)bytes * BENCH_WRITEFRAMES / 1048576 / (t / 1e3));
+	}
+	remove(BENCH_WRITEFILE);
+	free(frame);
+}
+
+/*
+ * Kernels: each pixel kernel, and each frame stage built on them,
+ * over synthetic frames of 8 to 16 bits, mono and RGB, from VGA
+ * to 25 MP, scalar versus SIMD. GB/s is of frame pixels in, as
+ * ushort, so that kernels and stages compare; the kernels' own
+ * memory traffic is several times that, see bench_mem. Rows are
+ * also written to BENCH_KERNFILE, to compare runs for regressions.
+ *
+ * Format conversion and display scaling are done by XCLIB, in
+ * pxd_readushort and pxd_render*, and need the frame grabber.
+ */
+#define BENCH_KERNMILLIS 100	// per case, shorter than BENCH_MINMILLIS as there are many
+#define BENCH_KERNFRAMES 2	// per stack
+#define BENCH_KERNFILE	"bench_kernels.csv"
+
+static const struct {
+	const char *name;
+	int	xdim;
+	int	ydim;
+} benchsizes[] = {
+	{ "VGA",    640,  480 },
+	{ "1.2MP",  1280, 960 },
+	{ "5MP",    2448, 2048 },
+	{ "12MP",   4096, 3000 },
+	{ "25MP",   5120, 5120 },
+};
+
+struct benchkern {
+	struct	hostframe f[BENCH_KERNFRAMES];
+	struct	hostframe out;
+	ushort	*dark, *gain;		// flat field
+	ushort	*count, *lo, *hi;	// clipped accumulation
+	uint	*acc;
+	ULONGLONG *accsq;
+	struct	framestack stk;
+	struct	vignet vig;
+	struct	focus foc;
+	struct	roiset rs;
+	struct	distortion dist;
+	struct	psf psf;
+	struct	lca lca;
+	struct	stars stars;
+	ushort	*mono;			// frame_mono() of a frame
+	int	next;			// frame to use next
+};
+
+/*
+ * Synthetic frame: the chart of bench_chart, at 10% and 90%
+ * of full scale for the bits, with noise; colour components
+ * differ in level, as they would under a white light.
+ */
+static void bench_synth(struct hostframe *f, int ox, int oy)
+{
+	double	c = cos(5 * 3.14159265358979 / 180), s = sin(5 * 3.14159265358979 / 180);
+	int	full = (1 << f->bits) - 1;
+	unsigned noise = 12345 + ox;
+	ushort	*p = f->pix;
+
+	for (int y = 0; y < f->ydim; y++) {
+		for (int x = 0; x < f->xdim; x++) {
+			double px = (x - ox + 100000) % 200 - 100.0, py = (y - oy + 100000) % 200 - 100.0;
+			double u = c * px + s * py, v = c * py - s * px;
+			int level = fabs(u) < 50 && fabs(v) < 50 ? full / 10 : full * 9 / 10;
+			for (int k = 0; k < f->cdim; k++) {
+				int	val;
+				noise = noise * 1664525 + 1013904223;
+				val = level * (k == 1 || f->cdim == 1 ? 4 : 3) / 4 + ((int)(noise >> 24) - 128) * full / 8192;
+				*p++ = (ushort)min(max(val, 0), full);
+			}
+		}
+	}
+}
+
+static void bench_kernFree(struct benchkern *b)
+{
+	for (int i = 0; i < BENCH_KERNFRAMES; i++)
+		frame_free(&b->f[i]);
+	frame_free(&b->out);
+	_aligned_free(b->dark);
+	_aligned_free(b->gain);
+	_aligned_free(b->count);
+	_aligned_free(b->lo);
+	_aligned_free(b->hi);
+	_aligned_free(b->acc);
+	_aligned_free(b->accsq);
+	stk_free(&b->stk);
+	vig_free(&b->vig);
+	foc_free(&b->foc);
+	roi_free(&b->rs);
+	dist_free(&b->dist);
+	psf_free(&b->psf);
+	lca_free(&b->lca);
+	star_free(&b->stars);
+	_aligned_free(b->mono);
+	memset(b, 0, sizeof(*b));
+}
+
+static int bench_kernAlloc(struct benchkern *b, int xdim, int ydim, int cdim, int bits)
+{
+	size_t	npix = (size_t)xdim * ydim * cdim;
+	int	err = 0;
+
+	memset(b, 0, sizeof(*b));
+	for (int i = 0; i < BENCH_KERNFRAMES && err >= 0; i++)
+		err = frame_alloc(&b->f[i], xdim, ydim, cdim, bits);
+	if (err >= 0)
+		err = frame_alloc(&b->out, xdim, ydim, cdim, bits);
+	b->dark = (ushort*)_aligned_malloc(npix * sizeof(ushort), 16);
+	b->gain = (ushort*)_aligned_malloc(npix * sizeof(ushort), 16);
+	b->count = (ushort*)_aligned_malloc(npix * sizeof(ushort), 16);
+	b->lo = (ushort*)_aligned_malloc(npix * sizeof(ushort), 16);
+	b->hi = (ushort*)_aligned_malloc(npix * sizeof(ushort), 16);
+	b->acc = (uint*)_aligned_malloc(npix * sizeof(uint), 16);
+	b->accsq = (ULONGLONG*)_aligned_malloc(npix * sizeof(ULONGLONG), 16);
+	b->mono = (ushort*)_aligned_malloc((size_t)xdim * ydim * sizeof(ushort), 16);
+	if (err < 0 || !b->dark || !b->gain || !b->count || !b->lo || !b->hi || !b->acc || !b->accsq || !b->mono
+	 || stk_alloc(&b->stk, npix, BENCH_KERNFRAMES, 3.0) < 0
+	 || vig_alloc(&b->vig, 9, 7) < 0
+	 || foc_alloc(&b->foc, 5, 64, 16, 1.0) < 0
+	 || roi_alloc(&b->rs, 25, 64) < 0
+	 || dist_alloc(&b->dist, 4096, 1) < 0
+	 || psf_alloc(&b->psf, 64, 12, 4) < 0
+	 || lca_alloc(&b->lca, 5, 64) < 0
+	 || star_alloc(&b->stars, 9, 100, 36, 8, 0.1) < 0) {
+		bench_kernFree(b);
+		return(PXERMALLOC);
+	}
+	for (int i = 0; i < BENCH_KERNFRAMES; i++)
+		bench_synth(&b->f[i], 3 * i, 2 * i);
+	for (size_t j = 0; j < npix; j++) {
+		b->dark[j] = (ushort)(j & 0x3F);
+		b->gain[j] = (ushort)((1 << KERN_GAINSHIFT) + (j & 0xFF));
+		b->lo[j] = 0;
+		b->hi[j] = (ushort)((1 << bits) - 1);
+	}
+	return(0);
+}
+
+/*
+ * The cases, each taking the next frame.
+ */
+static void bench_kernFlat(struct benchkern *b, struct hostframe *f)
+{
+	//
+	// On a copy, as the frames are shared by all kernels
+	// and runs, and would otherwise be corrected over and
+	// over; the copy's time is counted too.
+	//
+	memcpy(b->out.pix, f->pix, f->npix * sizeof(*f->pix));
+	kern_flatfield(b->out.pix, b->dark, b->gain, f->npix, f->bits);
+}
+
+static void bench_kernAccum(struct benchkern *b, struct hostframe *f)
+{
+	kern_accumulate(b->acc, f->pix, f->npix);
+}
+
+static void bench_kernAverage(struct benchkern *b, struct hostframe *f)
+{
+	kern_average(b->out.pix, b->acc, f->npix, BENCH_KERNFRAMES);
+}
+
+static void bench_kernClip(struct benchkern *b, struct hostframe *f)
+{
+	kern_accumulateClip(b->acc, b->accsq, b->count, f->pix, b->lo, b->hi, f->npix);
+}
+
+static void bench_kernStack(struct benchkern *b, struct hostframe *f)
+{
+	stk_add(&b->stk, f, &b->out);
+}
+
+static void bench_kernVignet(struct benchkern *b, struct hostframe *f)
+{
+	vig_measure(&b->vig, f);
+}
+
+static void bench_kernFocus(struct benchkern *b, struct hostframe *f)
+{
+	if (b->foc.nsteps >= b->foc.maxsteps)
+		foc_reset(&b->foc);
+	foc_measure(&b->foc, f);
+}
+
+static void bench_kernEdges(struct benchkern *b, struct hostframe *f)
+{
+	roi_reset(&b->rs);
+	roi_update(&b->rs, f);
+}
+
+//
+// The chart's squares are dark dots to distortion; it has
+// no pinholes or Siemens stars, so psf and star time their
+// search of the frame, finding none.
+//
+static void bench_kernDist(struct benchkern *b, struct hostframe *f)
+{
+	dist_measure(&b->dist, f);
+}
+
+static void bench_kernPsf(struct benchkern *b, struct hostframe *f)
+{
+	psf_measure(&b->psf, f);
+}
+
+static void bench_kernLca(struct benchkern *b, struct hostframe *f)
+{
+	lca_measure(&b->lca, f);
+}
+
+static void bench_kernStar(struct benchkern *b, struct hostframe *f)
+{
+	star_measure(&b->stars, f);
+}
+
+static void bench_kernMono(struct benchkern *b, struct hostframe *f)
+{
+	ushort	*m = b->mono;
+
+	for (int y = 0; y < f->ydim; y++)
+		for (int x = 0; x < f->xdim; x++)
+			*m++ = (ushort)frame_mono(f, x, y);
+}
+
+static const struct {
+	const char *name;
+	void	(*fn)(struct benchkern *b, struct hostframe *f);
+	int	simd;		// has kern_* SIMD paths, so is timed both ways
+} benchkernels[] = {
+	{ "flatfield",	bench_kernFlat,	    1 },    // kernels
+	{ "accumulate",	bench_kernAccum,    1 },
+	{ "average",	bench_kernAverage,  1 },
+	{ "clipaccum",	bench_kernClip,	    1 },
+	{ "frame_mono", bench_kernMono,    0 },    // colour to mono, as the stages read it
+	{ "stack",	bench_kernStack,    1 },    // stages: sigma clipped averaging
+	{ "vignet",	bench_kernVignet,   0 },    // statistics, of cells
+	{ "focus",	bench_kernFocus,    0 },    // sharpness, of ROIs
+	{ "edges",	bench_kernEdges,    0 },    // slanted edge detection
+	{ "distortion",	bench_kernDist,	    0 },    // dot detection and grid fit
+	{ "psf",	bench_kernPsf,	    0 },    // pinhole search
+	{ "lca",	bench_kernLca,	    0 },    // colour edge offsets, of ROIs
+	{ "star",	bench_kernStar,	    0 },    // Siemens star search
+};
+
+static void bench_kernels(void)
+{
+	static const int bits[4] = { 8, 10, 12, 16 };
+	FILE	*fp = fopen(BENCH_KERNFILE, "w");
+	int	saved = kern_simd;
+
+	printf("kernels: GB/s of frame pixels in, frames/s, scalar versus SIMD, %d threads%s;\n"
+		"  n/a where there's no SIMD path, the scalar figures being all there is\n",
+		wrk_threads(), KERN_SSE2 ? "" : "; no SIMD in this build");
+	printf("  %-6s %4s %4s %-11s %10s %9s %10s %9s %8s\n",
+		"size", "bits", "mono", "kernel", "GB/s", "fps", "SIMD GB/s", "fps", "speedup");
+	if (fp)
+		fprintf(fp, "size,xdim,ydim,bits,cdim,kernel,scalar_gbs,scalar_fps,simd_gbs,simd_fps\n");
+	for (int z = 0; z < sizeof(benchsizes) / sizeof(benchsizes[0]); z++) {
+		for (int cdim = 1; cdim <= 3; cdim += 2) {
+			for (int bb = 0; bb < 4; bb++) {
+				struct	benchkern b;
+				if (bench_kernAlloc(&b, benchsizes[z].xdim, benchsizes[z].ydim, cdim, bits[bb]) < 0) {
+					printf("  %-6s %4d %4s no memory\n", benchsizes[z].name, bits[bb], cdim == 1 ? "mono" : "RGB");
+					continue;
+				}
+				for (int k = 0; k < sizeof(benchkernels) / sizeof(benchkernels[0]); k++) {
+					double	fps[2] = { 0, 0 };
+					if (benchkernels[k].fn == bench_kernLca && cdim != 3)
+						continue;	// colour only
+					for (int c = 0; c < (benchkernels[k].simd ? 2 : 1); c++) {
+						int	reps = 0;
+						double	t0, t;
+						kern_simd = c == 0 ? 0 : saved;
+						memset(b.acc, 0, b.f[0].npix * sizeof(uint));
+						stk_reset(&b.stk);
+						foc_reset(&b.foc);
+						dist_reset(&b.dist);
+						psf_reset(&b.psf);
+						star_reset(&b.stars);
+						t0 = bench_millis();
+						do {
+							benchkernels[k].fn(&b, &b.f[reps % BENCH_KERNFRAMES]);
+							reps++;
+						} while ((t = bench_millis() - t0) < BENCH_KERNMILLIS);
+						fps[c] = reps * 1000.0 / t;
+					}
+					kern_simd = saved;
+					{
+						double	gb = b.f[0].npix * sizeof(ushort) / 1e9;
+						printf("  %-6s %4d %4s %-11s %10.2f %9.1f",
+							benchsizes[z].name, bits[bb], cdim == 1 ? "mono" : "RGB", benchkernels[k].name,
+							fps[0] * gb, fps[0]);
+						if (benchkernels[k].simd)
+							printf(" %10.2f %9.1f %7.2fx\n", fps[1] * gb, fps[1], fps[1] / fps[0]);
+						else
+							printf(" %10s %9s %8s\n", "n/a", "n/a", "n/a");
+						if (fp && benchkernels[k].simd)
+							fprintf(fp, "%s,%d,%d,%d,%d,%s,%.3f,%.2f,%.3f,%.2f\n",
+								benchsizes[z].name, benchsizes[z].xdim, benchsizes[z].ydim, bits[bb], cdim,
+								benchkernels[k].name, fps[0] * gb, fps[0], fps[1] * gb, fps[1]);
+						else if (fp)
+							fprintf(fp, "%s,%d,%d,%d,%d,%s,%.3f,%.2f,,\n",
+								benchsizes[z].name, benchsizes[z].xdim, benchsizes[z].ydim, bits[bb], cdim,
+								benchkernels[k].name, fps[0] * gb, fps[0]);
+					}
+				}
+				bench_kernFree(&b);
+			}
+		}
+	}
+	if (fp) {
+		fclose(fp);
+		printf("kernels: written to %s\n", BENCH_KERNFILE);
+	}
+}
+
+/*
+ * The benchmarks, by name.
+ */
+static struct {
+	const char *name;
+	void	(*fn)(void);
+} benches[] = {
+	{ "fft",    bench_fft },
+	{ "roi",    bench_roi },
+	{ "results", bench_results },
+	{ "place",  bench_place },
+	{ "mem",    bench_mem },
+	{ "write",  bench_write },
+	{ "kernels", bench_kernels },
+};
+
+int bench_run(const char *args)
+{
+	int	any = 0;
+
+	wrk_start(0);
+	for (int b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+		if (args && strstr(args, benches[b].name)) {
+			benches[b].fn();
+			any++;
+		}
+	}
+	for (int b = 0; !any && b < sizeof(benches) / sizeof(benches[0]); b++)
+		benches[b].fn();
+	wrk_stop();
+	fft_release();
+	return(0);
+}
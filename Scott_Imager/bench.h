@@ -0,0 +1,15 @@
+#pragma once
+/*
+ *	bench.h
+ *
+ *	Benchmarks of the analysis building blocks, on synthetic data,
+ *	run from the command line:
+ *
+ *	    Scott_Imager -bench [name ...]
+ *
+ *	without opening the frame grabber. With no names, all are run.
+ *	Results are printed on the console.
+ */
+
+int	bench_run(const char *args);
+double	bench_millis(void);
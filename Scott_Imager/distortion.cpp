@@ -0,0 +1,722 @@
+/*
+ *	distortion.cpp
+ *
+ *	Radial distortion measurement from a dot grid target.
+ *	See distortion.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "distortion.h"
+#include "results.h"
+#include "workers.h"
+#include "lsq.h"
+
+#define DIST_MINAREA	12	// pixels; smaller blobs are noise
+#define DIST_MINDOTS	9	// fewer can't be fitted
+#define DIST_LOSTFRAC	5	// redetect if more than 1/5 are lost
+#define DIST_BANDS	64	// horizontal bands for parallel run extraction
+#define DIST_CENTRAL	0.35	// radius, normalized, of dots used to seed the ideal grid
+
+
+int dist_alloc(struct distortion *d, int maxdots, int darkdots)
+{
+	memset(d, 0, sizeof(*d));
+	d->dots = (struct dot*)malloc(maxdots * sizeof(struct dot));
+	if (!d->dots)
+		return(PXERMALLOC);
+	d->maxdots = maxdots;
+	d->darkdots = darkdots;
+	return(0);
+}
+
+void dist_free(struct distortion *d)
+{
+	if (d->dots)
+		free(d->dots);
+	memset(d, 0, sizeof(*d));
+}
+
+/*
+ * Forget the dots; the next frame does a full detection.
+ */
+void dist_reset(struct distortion *d)
+{
+	d->ndots = 0;
+	d->tracking = 0;
+}
+
+/*
+ * Threshold midway between the 1st and 99th percentiles,
+ * from a sparse sample of the frame.
+ */
+static int dist_threshold(const struct hostframe *f)
+{
+	uint	*hist = (uint*)calloc(65536, sizeof(uint));
+	size_t	n = 0, acc;
+	int	lo, hi;
+
+	if (!hist)
+		return(-1);
+	for (int y = 0; y < f->ydim; y += 4)
+		for (int x = 0; x < f->xdim; x += 4, n++)
+			hist[frame_mono(f, x, y)]++;
+	for (lo = 0, acc = 0; lo < 65535 && (acc += hist[lo]) < n / 100; lo++)
+		;
+	for (hi = 65535, acc = 0; hi > 0 && (acc += hist[hi]) < n / 100; hi--)
+		;
+	free(hist);
+	return((lo + hi) / 2);
+}
+
+/*
+ * Runs of dot pixels, extracted in parallel over horizontal bands.
+ */
+struct run {
+	int	y;
+	int	x0;	    // inclusive
+	int	x1;	    // inclusive
+};
+struct runband {
+	const struct hostframe *f;
+	int	thr;
+	int	dark;
+	int	y0;
+	int	y1;
+	struct	run *runs;
+	int	nruns;
+	int	maxruns;
+	int	err;
+};
+
+static void dist_runsFn(void *ctx, int index)
+{
+	struct runband *b = (struct runband*)ctx + index;
+
+	for (int y = b->y0; y < b->y1; y++) {
+		for (int x = 0; x < b->f->xdim; ) {
+			int v = frame_mono(b->f, x, y);
+			if (b->dark ? v >= b->thr : v <= b->thr) {
+				x++;
+				continue;
+			}
+			int x0 = x;
+			for (x++; x < b->f->xdim; x++) {
+				v = frame_mono(b->f, x, y);
+				if (b->dark ? v >= b->thr : v <= b->thr)
+					break;
+			}
+			if (b->nruns == b->maxruns) {
+				int m = b->maxruns ? 2 * b->maxruns : 1024;
+				struct run *r = (struct run*)realloc(b->runs, m * sizeof(struct run));
+				if (!r) {
+					b->err = PXERMALLOC;
+					return;
+				}
+				b->runs = r;
+				b->maxruns = m;
+			}
+			b->runs[b->nruns].y = y;
+			b->runs[b->nruns].x0 = x0;
+			b->runs[b->nruns].x1 = x - 1;
+			b->nruns++;
+		}
+	}
+}
+
+static int uf_find(int *parent, int i)
+{
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return(i);
+}
+
+/*
+ * Detect dots over the whole frame: threshold, label
+ * 8-connected runs, and keep blobs of plausible size and shape.
+ * Only the approximate centre and size of each dot result;
+ * centroids are refined separately.
+ */
+static int dist_detect(struct distortion *d, const struct hostframe *f)
+{
+	struct	runband bands[DIST_BANDS];
+	struct	run *runs = NULL;
+	int	*parent = NULL;
+	int	*blob = NULL;	    // per root: area, minx, maxx, miny, maxy
+	int	nruns = 0;
+	int	err = 0;
+	int	thr = dist_threshold(f);
+	int	b, r;
+
+	d->ndots = 0;
+	if (thr < 0)
+		return(PXERMALLOC);
+	memset(bands, 0, sizeof(bands));
+	for (b = 0; b < DIST_BANDS; b++) {
+		bands[b].f = f;
+		bands[b].thr = thr;
+		bands[b].dark = d->darkdots;
+		bands[b].y0 = (int)((long long)f->ydim * b / DIST_BANDS);
+		bands[b].y1 = (int)((long long)f->ydim * (b + 1) / DIST_BANDS);
+	}
+	wrk_parallel(DIST_BANDS, dist_runsFn, bands);
+	for (b = 0; b < DIST_BANDS; b++) {
+		nruns += bands[b].nruns;
+		if (bands[b].err)
+			err = bands[b].err;
+	}
+	if (!err) {
+		runs = (struct run*)malloc((nruns + 1) * sizeof(struct run));
+		parent = (int*)malloc((nruns + 1) * sizeof(int));
+		blob = (int*)malloc((nruns + 1) * 5 * sizeof(int));
+		if (!runs || !parent || !blob)
+			err = PXERMALLOC;
+	}
+	if (!err) {
+		nruns = 0;
+		for (b = 0; b < DIST_BANDS; b++) {
+			memcpy(runs + nruns, bands[b].runs, bands[b].nruns * sizeof(struct run));
+			nruns += bands[b].nruns;
+		}
+		for (r = 0; r < nruns; r++)
+			parent[r] = r;
+
+		//
+		// Union runs overlapping, 8-connected, a run on the previous line.
+		// Runs are in line order and, within a line, in x order.
+		//
+		int prev0 = 0, prev1 = 0;	// runs of previous line
+		for (r = 0; r < nruns; ) {
+			int y = runs[r].y;
+			int cur0 = r;
+			while (r < nruns && runs[r].y == y)
+				r++;
+			if (prev1 > prev0 && runs[prev0].y == y - 1) {
+				int p = prev0;
+				for (int c = cur0; c < r; c++) {
+					while (p < prev1 && runs[p].x1 < runs[c].x0 - 1)
+						p++;
+					for (int q = p; q < prev1 && runs[q].x0 <= runs[c].x1 + 1; q++) {
+						int a = uf_find(parent, q), e = uf_find(parent, c);
+						if (a != e)
+							parent[e] = a;
+					}
+				}
+			}
+			prev0 = cur0;
+			prev1 = r;
+		}
+
+		for (r = 0; r < nruns; r++) {
+			int *s = blob + 5 * r;
+			s[0] = 0;
+			s[1] = s[3] = INT_MAX;
+			s[2] = s[4] = -1;
+		}
+		for (r = 0; r < nruns; r++) {
+			int *s = blob + 5 * uf_find(parent, r);
+			s[0] += runs[r].x1 - runs[r].x0 + 1;
+			s[1] = min(s[1], runs[r].x0);
+			s[2] = max(s[2], runs[r].x1);
+			s[3] = min(s[3], runs[r].y);
+			s[4] = max(s[4], runs[r].y);
+		}
+
+		//
+		// Dots are roughly round: a filled, square bounding box.
+		// Blobs touching the frame edge are partial.
+		//
+		size_t maxarea = f->npix / f->cdim / 200;
+		for (r = 0; r < nruns && d->ndots < d->maxdots; r++) {
+			if (parent[r] != r)
+				continue;
+			int *s = blob + 5 * r;
+			int w = s[2] - s[1] + 1, h = s[4] - s[3] + 1;
+			if (s[0] < DIST_MINAREA || (size_t)s[0] > maxarea)
+				continue;
+			if (2 * w < h || 2 * h < w || 2 * s[0] < w * h)
+				continue;
+			if (s[1] == 0 || s[3] == 0 || s[2] == f->xdim - 1 || s[4] == f->ydim - 1)
+				continue;
+			struct dot *p = &d->dots[d->ndots++];
+			memset(p, 0, sizeof(*p));
+			p->x = (s[1] + s[2]) / 2.0;
+			p->y = (s[3] + s[4]) / 2.0;
+			p->radius = max(w, h);
+		}
+	}
+	for (b = 0; b < DIST_BANDS; b++)
+		free(bands[b].runs);
+	free(runs);
+	free(parent);
+	free(blob);
+	return(err);
+}
+
+/*
+ * Refine one dot's centroid, in parallel over dots.
+ * The window, twice the dot's size, is centred on the previous
+ * estimate; its border gives the local background, so that
+ * uneven illumination doesn't bias the centroid. Weights are
+ * the pixels' contrast against that background. The window is
+ * re-centred until the centroid settles.
+ */
+struct centroidctx {
+	const struct hostframe *f;
+	struct	distortion *d;
+	int	tracking;
+};
+
+static void dist_centroidFn(void *ctx, int index)
+{
+	struct	centroidctx *c = (struct centroidctx*)ctx;
+	const struct hostframe *f = c->f;
+	struct	dot *p = &c->d->dots[index];
+	int	r = p->radius;
+	double	x = p->x, y = p->y, sw = 0;
+
+	if (c->tracking && p->mass0 <= 0)
+		return;
+	for (int iter = 0; iter < 3; iter++) {
+		int x0 = (int)(x + 0.5) - r, x1 = x0 + 2 * r;
+		int y0 = (int)(y + 0.5) - r, y1 = y0 + 2 * r;
+		double bg = 0, sx = 0, sy = 0;
+		if (x0 < 0 || y0 < 0 || x1 >= f->xdim || y1 >= f->ydim) {
+			sw = 0;
+			break;
+		}
+		for (int xx = x0; xx <= x1; xx++)
+			bg += frame_mono(f, xx, y0) + frame_mono(f, xx, y1);
+		for (int yy = y0 + 1; yy < y1; yy++)
+			bg += frame_mono(f, x0, yy) + frame_mono(f, x1, yy);
+		bg /= 8 * r;
+		sw = 0;
+		for (int yy = y0; yy <= y1; yy++) {
+			for (int xx = x0; xx <= x1; xx++) {
+				double w = c->d->darkdots ? bg - frame_mono(f, xx, yy) : frame_mono(f, xx, yy) - bg;
+				if (w <= 0)
+					continue;
+				sw += w;
+				sx += w * xx;
+				sy += w * yy;
+			}
+		}
+		if (sw <= 0)
+			break;
+		double moved = fabs(sx / sw - x) + fabs(sy / sw - y);
+		x = sx / sw;
+		y = sy / sw;
+		if (moved < 0.05)
+			break;
+	}
+	if (c->tracking && sw < 0.3 * p->mass0) {
+		p->mass = 0;
+		return;
+	}
+	p->x = x;
+	p->y = y;
+	p->mass = sw;
+	if (!c->tracking)
+		p->mass0 = sw;
+}
+
+/*
+ * Bucket dots by position, with buckets the size of the grid pitch,
+ * for finding the dot nearest to a predicted position.
+ */
+struct dothash {
+	double	cell;
+	int	nx;
+	int	ny;
+	int	*head;
+	int	*next;
+};
+
+static int hash_build(struct dothash *h, const struct distortion *d, const struct hostframe *f, double cell)
+{
+	h->cell = max(cell, 4.0);
+	h->nx = (int)(f->xdim / h->cell) + 1;
+	h->ny = (int)(f->ydim / h->cell) + 1;
+	h->head = (int*)malloc(h->nx * h->ny * sizeof(int));
+	h->next = (int*)malloc(d->ndots * sizeof(int));
+	if (!h->head || !h->next)
+		return(PXERMALLOC);
+	for (int i = 0; i < h->nx * h->ny; i++)
+		h->head[i] = -1;
+	for (int k = 0; k < d->ndots; k++) {
+		int cx = min(max((int)(d->dots[k].x / h->cell), 0), h->nx - 1);
+		int cy = min(max((int)(d->dots[k].y / h->cell), 0), h->ny - 1);
+		h->next[k] = h->head[cy * h->nx + cx];
+		h->head[cy * h->nx + cx] = k;
+	}
+	return(0);
+}
+
+static void hash_free(struct dothash *h)
+{
+	free(h->head);
+	free(h->next);
+}
+
+static int hash_nearest(const struct dothash *h, const struct distortion *d, double x, double y, double within)
+{
+	int	cx = (int)(x / h->cell), cy = (int)(y / h->cell);
+	int	best = -1;
+	double	bestd = within * within;
+
+	for (int j = max(cy - 1, 0); j <= min(cy + 1, h->ny - 1); j++) {
+		for (int i = max(cx - 1, 0); i <= min(cx + 1, h->nx - 1); i++) {
+			for (int k = h->head[j * h->nx + i]; k >= 0; k = h->next[k]) {
+				double dx = d->dots[k].x - x, dy = d->dots[k].y - y;
+				if (d->dots[k].mass > 0 && dx * dx + dy * dy < bestd) {
+					bestd = dx * dx + dy * dy;
+					best = k;
+				}
+			}
+		}
+	}
+	return(best);
+}
+
+/*
+ * Assign grid indices. The dot nearest the image centre is (0,0);
+ * its nearest neighbour, and the nearest roughly perpendicular to
+ * that, give the grid's basis vectors. Indices then spread outward,
+ * breadth first, each step predicting a neighbour from the local
+ * spacing found so far, so that the prediction follows the
+ * distortion towards the corners.
+ */
+static int dist_index(struct distortion *d, const struct hostframe *f)
+{
+	struct	dothash h = { 0 };
+	int	*queue;
+	double	*basis;	    // per dot: local a, local b
+	int	c = -1, na = -1, nb = -1;
+	double	best, ax, ay, bx, by;
+	int	k, qhead = 0, qtail = 0;
+
+	for (k = 0, best = 1e300; k < d->ndots; k++) {
+		double dx = d->dots[k].x - d->cx, dy = d->dots[k].y - d->cy;
+		d->dots[k].indexed = 0;
+		if (d->dots[k].mass > 0 && dx * dx + dy * dy < best) {
+			best = dx * dx + dy * dy;
+			c = k;
+		}
+	}
+	if (c < 0)
+		return(0);
+	for (k = 0, best = 1e300; k < d->ndots; k++) {
+		double dx = d->dots[k].x - d->dots[c].x, dy = d->dots[k].y - d->dots[c].y;
+		if (k != c && d->dots[k].mass > 0 && dx * dx + dy * dy < best) {
+			best = dx * dx + dy * dy;
+			na = k;
+		}
+	}
+	if (na < 0)
+		return(0);
+	ax = d->dots[na].x - d->dots[c].x;
+	ay = d->dots[na].y - d->dots[c].y;
+	for (k = 0, best = 1e300; k < d->ndots; k++) {
+		double dx = d->dots[k].x - d->dots[c].x, dy = d->dots[k].y - d->dots[c].y;
+		double dd = dx * dx + dy * dy;
+		if (k == c || d->dots[k].mass <= 0 || dd >= best)
+			continue;
+		if (fabs(dx * ax + dy * ay) > 0.5 * sqrt(dd * (ax * ax + ay * ay)))
+			continue;
+		best = dd;
+		nb = k;
+	}
+	if (nb < 0)
+		return(0);
+	bx = d->dots[nb].x - d->dots[c].x;
+	by = d->dots[nb].y - d->dots[c].y;
+	//
+	// Let i run left to right and j top to bottom.
+	//
+	if (fabs(ay) > fabs(ax)) {
+		double t;
+		t = ax; ax = bx; bx = t;
+		t = ay; ay = by; by = t;
+	}
+	if (ax < 0) {
+		ax = -ax;
+		ay = -ay;
+	}
+	if (by < 0) {
+		bx = -bx;
+		by = -by;
+	}
+
+	queue = (int*)malloc(d->ndots * sizeof(int));
+	basis = (double*)malloc(d->ndots * 4 * sizeof(double));
+	if (!queue || !basis || hash_build(&h, d, f, sqrt(ax * ax + ay * ay)) < 0) {
+		free(queue);
+		free(basis);
+		hash_free(&h);
+		return(PXERMALLOC);
+	}
+	d->dots[c].indexed = 1;
+	d->dots[c].i = 0;
+	d->dots[c].j = 0;
+	basis[4 * c + 0] = ax;
+	basis[4 * c + 1] = ay;
+	basis[4 * c + 2] = bx;
+	basis[4 * c + 3] = by;
+	queue[qtail++] = c;
+	while (qhead < qtail) {
+		int p = queue[qhead++];
+		double *pb = basis + 4 * p;
+		static const int di[4] = { 1, -1, 0, 0 };
+		static const int dj[4] = { 0, 0, 1, -1 };
+		for (int s = 0; s < 4; s++) {
+			double vx = di[s] ? di[s] * pb[0] : dj[s] * pb[2];
+			double vy = di[s] ? di[s] * pb[1] : dj[s] * pb[3];
+			int n = hash_nearest(&h, d, d->dots[p].x + vx, d->dots[p].y + vy, 0.3 * sqrt(vx * vx + vy * vy));
+			if (n < 0 || d->dots[n].indexed)
+				continue;
+			d->dots[n].indexed = 1;
+			d->dots[n].i = d->dots[p].i + di[s];
+			d->dots[n].j = d->dots[p].j + dj[s];
+			double *nbv = basis + 4 * n;
+			memcpy(nbv, pb, 4 * sizeof(double));
+			if (di[s]) {
+				nbv[0] = (d->dots[n].x - d->dots[p].x) * di[s];
+				nbv[1] = (d->dots[n].y - d->dots[p].y) * di[s];
+			}
+			else {
+				nbv[2] = (d->dots[n].x - d->dots[p].x) * dj[s];
+				nbv[3] = (d->dots[n].y - d->dots[p].y) * dj[s];
+			}
+			queue[qtail++] = n;
+		}
+	}
+	free(queue);
+	free(basis);
+	hash_free(&h);
+	return(qtail);
+}
+
+/*
+ * Displacement, in pixels, of an ideal point by the current model.
+ */
+static void dist_displace(const struct distortion *d, double xu, double yu, double *dx, double *dy)
+{
+	double	x = (xu - d->cx) / d->norm;
+	double	y = (yu - d->cy) / d->norm;
+	double	r2 = x * x + y * y;
+	double	radial = r2 * (d->k1 + r2 * (d->k2 + r2 * d->k3));
+
+	*dx = (x * radial + 2 * d->p1 * x * y + d->p2 * (r2 + 2 * x * x)) * d->norm;
+	*dy = (y * radial + d->p1 * (r2 + 2 * y * y) + 2 * d->p2 * x * y) * d->norm;
+}
+
+static inline int dist_usable(const struct dot *p)
+{
+	return(p->indexed && p->mass > 0);
+}
+
+/*
+ * Fit the ideal grid o + i*a + j*b to the observed dots,
+ * less the current model's displacement; optionally only
+ * to the central, least distorted, dots.
+ * Used to seed the combined fit.
+ */
+static int dist_fitGrid(struct distortion *d, int central)
+{
+	double	m[9] = { 0 }, rx[3] = { 0 }, ry[3] = { 0 };
+	int	n = 0;
+
+	for (int k = 0; k < d->ndots; k++) {
+		const struct dot *p = &d->dots[k];
+		double dx = 0, dy = 0;
+		if (!dist_usable(p))
+			continue;
+		if (central) {
+			double x = (p->x - d->cx) / d->norm, y = (p->y - d->cy) / d->norm;
+			if (x * x + y * y > DIST_CENTRAL * DIST_CENTRAL)
+				continue;
+		}
+		else
+			dist_displace(d, d->ox + p->i * d->ax + p->j * d->bx,
+					 d->oy + p->i * d->ay + p->j * d->by, &dx, &dy);
+		double v[3] = { 1.0, (double)p->i, (double)p->j };
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++)
+				m[r * 3 + c] += v[r] * v[c];
+			rx[r] += v[r] * (p->x - dx);
+			ry[r] += v[r] * (p->y - dy);
+		}
+		n++;
+	}
+	if (n < 4)
+		return(-1);
+	double m2[9];
+	memcpy(m2, m, sizeof(m));
+	if (lsq_solve(m, rx, 3) < 0 || lsq_solve(m2, ry, 3) < 0)
+		return(-1);
+	d->ox = rx[0]; d->ax = rx[1]; d->bx = rx[2];
+	d->oy = ry[0]; d->ay = ry[1]; d->by = ry[2];
+	return(n);
+}
+
+/*
+ * Fit grid and k1, k2, k3, p1, p2 together, by linear least
+ * squares with the model's terms evaluated at the current
+ * ideal grid positions. Fitting them together, rather than in
+ * turn, matters as the grid's scale and k1 are correlated.
+ */
+static int dist_fitModel(struct distortion *d)
+{
+	double	m[11 * 11] = { 0 }, r[11] = { 0 };
+	int	n = 0;
+
+	for (int k = 0; k < d->ndots; k++) {
+		const struct dot *p = &d->dots[k];
+		if (!dist_usable(p))
+			continue;
+		double x = (d->ox + p->i * d->ax + p->j * d->bx - d->cx) / d->norm;
+		double y = (d->oy + p->i * d->ay + p->j * d->by - d->cy) / d->norm;
+		double r2 = x * x + y * y, q = d->norm;
+		double vx[11] = { 1, (double)p->i, (double)p->j, 0, 0, 0,
+				  q * x * r2, q * x * r2 * r2, q * x * r2 * r2 * r2, q * 2 * x * y, q * (r2 + 2 * x * x) };
+		double vy[11] = { 0, 0, 0, 1, (double)p->i, (double)p->j,
+				  q * y * r2, q * y * r2 * r2, q * y * r2 * r2 * r2, q * (r2 + 2 * y * y), q * 2 * x * y };
+		lsq_add(m, r, vx, p->x, 11);
+		lsq_add(m, r, vy, p->y, 11);
+		n++;
+	}
+	if (n < DIST_MINDOTS || lsq_solve(m, r, 11) < 0)
+		return(-1);
+	d->ox = r[0]; d->ax = r[1]; d->bx = r[2];
+	d->oy = r[3]; d->ay = r[4]; d->by = r[5];
+	d->k1 = r[6];
+	d->k2 = r[7];
+	d->k3 = r[8];
+	d->p1 = r[9];
+	d->p2 = r[10];
+	return(n);
+}
+
+/*
+ * Seed the grid from the central dots, then refine grid and
+ * model together; a few rounds converge.
+ */
+static int dist_fit(struct distortion *d)
+{
+	double	sum = 0;
+	int	n = 0;
+
+	d->k1 = d->k2 = d->k3 = d->p1 = d->p2 = 0;
+	if (dist_fitGrid(d, 1) < 0 && dist_fitGrid(d, 0) < 0)
+		return(-1);
+	for (int iter = 0; iter < 4; iter++)
+		if (dist_fitModel(d) < 0)
+			return(-1);
+	for (int k = 0; k < d->ndots; k++) {
+		const struct dot *p = &d->dots[k];
+		double xu, yu, dx, dy;
+		if (!dist_usable(p))
+			continue;
+		xu = d->ox + p->i * d->ax + p->j * d->bx;
+		yu = d->oy + p->i * d->ay + p->j * d->by;
+		dist_displace(d, xu, yu, &dx, &dy);
+		dx = p->x - xu - dx;
+		dy = p->y - yu - dy;
+		sum += dx * dx + dy * dy;
+		n++;
+	}
+	d->nfit = n;
+	d->rms = n ? sqrt(sum / n) : 0;
+	return(n);
+}
+
+/*
+ * Measure one frame.
+ */
+int dist_measure(struct distortion *d, const struct hostframe *f)
+{
+	struct	centroidctx c;
+	int	err;
+
+	d->cx = (f->xdim - 1) / 2.0;
+	d->cy = (f->ydim - 1) / 2.0;
+	d->norm = sqrt(d->cx * d->cx + d->cy * d->cy);
+	c.f = f;
+	c.d = d;
+
+	//
+	// Track the previous frame's dots, if any.
+	//
+	d->lost = 0;
+	if (d->tracking) {
+		c.tracking = 1;
+		wrk_parallel(d->ndots, dist_centroidFn, &c);
+		for (int k = 0; k < d->ndots; k++)
+			if (d->dots[k].mass <= 0 && d->dots[k].mass0 > 0)
+				d->lost++;
+		if (d->lost * DIST_LOSTFRAC > d->ndots)
+			d->tracking = 0;
+	}
+
+	//
+	// Otherwise, or if too many were lost, start afresh.
+	//
+	if (!d->tracking) {
+		err = dist_detect(d, f);
+		if (err < 0)
+			return(err);
+		c.tracking = 0;
+		wrk_parallel(d->ndots, dist_centroidFn, &c);
+		err = dist_index(d, f);
+		if (err < 0)
+			return(err);
+		d->tracking = err >= DIST_MINDOTS;
+	}
+	d->frames++;
+	if (dist_fit(d) < 0)
+		d->nfit = 0;
+	return(0);
+}
+
+/*
+ * Summarize, for display. The distortion is given as the
+ * relative radial displacement at the frame corner.
+ */
+int dist_format(const struct distortion *d, char *buf, size_t bufsize)
+{
+	if (!d->nfit)
+		return(_snprintf(buf, bufsize, "dist: %d dots, no fit", d->ndots));
+	return(_snprintf(buf, bufsize, "dist: %.2f%%  k1 %.4f k2 %.4f k3 %.4f p1 %.5f p2 %.5f  rms %.2f px  dots %d/%d",
+		100.0 * (d->k1 + d->k2 + d->k3), d->k1, d->k2, d->k3, d->p1, d->p2, d->rms, d->nfit, d->ndots));
+}
+
+/*
+ * Record the fitted model, once fitted.
+ */
+int dist_record(const struct distortion *d, struct results *r)
+{
+	int	err = 0;
+
+	if (!d->nfit)
+		return(0);
+	err = res_add(r, "dist.k1", 0, d->k1);
+	if (err >= 0)
+		err = res_add(r, "dist.k2", 0, d->k2);
+	if (err >= 0)
+		err = res_add(r, "dist.k3", 0, d->k3);
+	if (err >= 0)
+		err = res_add(r, "dist.p1", 0, d->p1);
+	if (err >= 0)
+		err = res_add(r, "dist.p2", 0, d->p2);
+	if (err >= 0)
+		err = res_add(r, "dist.rms", 0, d->rms);
+	return(err);
+}
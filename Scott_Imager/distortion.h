@@ -0,0 +1,60 @@
+#pragma once
+/*
+ *	distortion.h
+ *
+ *	Radial distortion measurement from a dot grid target.
+ *
+ *	Dots are located by thresholding and connected run labelling,
+ *	refined to sub-pixel weighted centroids, indexed into a grid
+ *	from the dot nearest the image centre outwards, and the grid
+ *	fitted with a Brown-Conrady model (radial k1, k2, k3 and
+ *	tangential p1, p2) about the image centre, in coordinates
+ *	normalized to the half diagonal.
+ *
+ *	Between frames, the previous frame's dots seed the next;
+ *	each dot is only re-centred within a small window, so that
+ *	the measurement keeps up with live video while the operator
+ *	aligns the chart. Full detection is repeated only when too
+ *	many dots are lost.
+ */
+
+#include "frame.h"
+
+struct	results;
+
+struct dot {
+	double	x;	    // sub-pixel centroid
+	double	y;
+	double	mass;	    // sum of centroid weights; 0 if lost
+	double	mass0;	    // at detection
+	int	radius;	    // centroid window half size
+	int	i;	    // grid index, relative to the centre dot
+	int	j;
+	int	indexed;
+};
+
+struct distortion {
+	int	darkdots;   // dark dots on a bright ground, or vice versa
+	int	maxdots;
+	int	ndots;
+	struct	dot *dots;
+	int	tracking;   // dots are valid seeds for the next frame
+	int	lost;	    // dots lost in the last frame
+	int	frames;	    // frames measured
+	//
+	// Fitted model. The ideal grid is o + i*a + j*b in pixels;
+	// distortion is applied about (cx,cy), normalized by norm.
+	//
+	double	cx, cy, norm;
+	double	ox, oy, ax, ay, bx, by;
+	double	k1, k2, k3, p1, p2;
+	double	rms;	    // fit residual, pixels
+	int	nfit;	    // dots used in the fit
+};
+
+int	dist_alloc(struct distortion *d, int maxdots, int darkdots);
+void	dist_free(struct distortion *d);
+void	dist_reset(struct distortion *d);
+int	dist_measure(struct distortion *d, const struct hostframe *f);
+int	dist_format(const struct distortion *d, char *buf, size_t bufsize);
+int	dist_record(const struct distortion *d, struct results *r);
@@ -0,0 +1,255 @@
+/*
+ *	fault.cpp
+ *
+ *	Errors and asynchronous capture faults, without modal dialogs.
+ *	See fault.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "xcliball.h"
+}
+#include "fault.h"
+#include "place.h"
+#include "metrics.h"
+
+static	const char *kindnames[FAULT_KINDS] = { "error", "video" };
+static	const char *actionnames[FAULT_ABORT + 1] = { "ignored", "retry", "reopen", "abort" };
+
+static	CRITICAL_SECTION faultsect;
+static	int	    faultopen = 0;
+static	struct	    faultpolicy policy;
+static	struct	    faultrec queue[FAULT_QUEUE];
+static	unsigned    head = 0;			// records posted
+static	unsigned    tail = 0;			// records logged
+static	unsigned    lost = 0;			// not queued, the queue being full
+static	int	    pending = FAULT_IGNORE;	// most severe action not yet collected
+static	struct {
+	DWORD	start;				// of the window
+	int	count;				// taken within
+}		    recent[FAULT_ABORT + 1];
+static	FILE	    *logfp = NULL;
+static	HANDLE	    logevent = NULL;
+static	HANDLE	    logthread = NULL;
+static	volatile LONG logstop = 0;
+static	int	    metfaults[FAULT_KINDS] = { -1, -1 };
+static	int	    metqueue = -1;
+
+
+static void fault_write(const struct faultrec *r)
+{
+	char	line[FAULT_TEXTLEN + 128];
+
+	line[sizeof(line) - 1] = 0;
+	_snprintf(line, sizeof(line) - 1, "%04d-%02d-%02d %02d:%02d:%02d.%03d unit %d %s %s: %s -> %s\n",
+		r->time.wYear, r->time.wMonth, r->time.wDay, r->time.wHour, r->time.wMinute, r->time.wSecond,
+		r->time.wMilliseconds, r->unit, kindnames[r->kind], r->where, r->text, actionnames[r->action]);
+	fputs(line, stdout);
+	if (logfp)
+		fputs(line, logfp);
+}
+
+/*
+ * Write queued records, as they come, so that
+ * posting never waits on the console or the disk.
+ */
+static DWORD WINAPI fault_logThread(PVOID p)
+{
+	for (;;) {
+		struct	faultrec r;
+		unsigned n;
+
+		WaitForSingleObject(logevent, INFINITE);
+		for (;;) {
+			EnterCriticalSection(&faultsect);
+			if (tail == head) {
+				LeaveCriticalSection(&faultsect);
+				break;
+			}
+			r = queue[tail % FAULT_QUEUE];
+			tail++;
+			met_set(metqueue, head - tail);
+			LeaveCriticalSection(&faultsect);
+			fault_write(&r);
+		}
+		EnterCriticalSection(&faultsect);
+		n = lost;
+		lost = 0;
+		LeaveCriticalSection(&faultsect);
+		if (n) {
+			printf("%u fault records lost, the queue being full\n", n);
+			if (logfp)
+				fprintf(logfp, "%u fault records lost, the queue being full\n", n);
+		}
+		if (logfp)
+			fflush(logfp);
+		if (logstop)
+			break;
+	}
+	return(0);
+}
+
+/*
+ * Start the queue and the logging thread; a NULL
+ * logpath logs to the console only.
+ */
+int fault_open(const char *logpath, const struct faultpolicy *p)
+{
+	DWORD	id;
+
+	if (faultopen)
+		return(0);
+	policy = *p;
+	if (logpath && !(logfp = fopen(logpath, "a")))
+		return(PXERNOFILE);
+	InitializeCriticalSection(&faultsect);
+	logstop = 0;
+	logevent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (logevent)
+		logthread = CreateThread(0, 0x4000, fault_logThread, NULL, 0, &id);
+	if (!logevent || !logthread) {
+		if (logevent)
+			CloseHandle(logevent);
+		if (logfp)
+			fclose(logfp);
+		logevent = NULL;
+		logfp = NULL;
+		DeleteCriticalSection(&faultsect);
+		return(PXERMALLOC);
+	}
+	place_thread(logthread, PLACE_WRITER, "fault log");
+	metfaults[FAULT_ERROR] = met_counter("scott_faults_total", "kind=\"error\"", "Errors and capture faults posted");
+	metfaults[FAULT_VIDEO] = met_counter("scott_faults_total", "kind=\"video\"", NULL);
+	metqueue = met_gauge("scott_fault_queue_depth", NULL, "Fault records queued, not yet logged");
+	head = tail = lost = 0;
+	pending = FAULT_IGNORE;
+	memset(recent, 0, sizeof(recent));
+	faultopen = 1;
+	return(0);
+}
+
+/*
+ * Log whatever is still queued, and stop.
+ */
+void fault_close(void)
+{
+	if (!faultopen)
+		return;
+	logstop = 1;
+	SetEvent(logevent);
+	WaitForSingleObject(logthread, 5000);
+	place_forget(logthread);
+	CloseHandle(logthread);
+	CloseHandle(logevent);
+	logthread = logevent = NULL;
+	if (logfp)
+		fclose(logfp);
+	logfp = NULL;
+	DeleteCriticalSection(&faultsect);
+	faultopen = 0;
+}
+
+/*
+ * The action for a kind of fault, escalated if taken
+ * too often lately.
+ */
+static int fault_escalate(int kind)
+{
+	DWORD	now = GetTickCount();
+	int	a = policy.action[kind];
+
+	while (a != FAULT_IGNORE && a < FAULT_ABORT) {
+		if (now - recent[a].start > policy.window) {
+			recent[a].start = now;
+			recent[a].count = 0;
+		}
+		if (++recent[a].count <= policy.retries)
+			break;
+		a++;
+	}
+	return(a);
+}
+
+/*
+ * Record a fault; from any thread.
+ */
+void fault_post(int kind, int unit, int code, const char *where, const char *text)
+{
+	struct	faultrec r;
+
+	memset(&r, 0, sizeof(r));
+	GetLocalTime(&r.time);
+	r.kind = kind;
+	r.unit = unit;
+	r.code = code;
+	strncpy(r.where, where ? where : "", sizeof(r.where) - 1);
+	strncpy(r.text, text ? text : "", sizeof(r.text) - 1);
+	if (!faultopen) {
+		r.action = policy.action[kind];
+		fault_write(&r);
+		return;
+	}
+	EnterCriticalSection(&faultsect);
+	r.action = fault_escalate(kind);
+	pending = max(pending, r.action);
+	if (head - tail < FAULT_QUEUE)
+		queue[head++ % FAULT_QUEUE] = r;
+	else
+		lost++;
+	met_set(metqueue, head - tail);
+	LeaveCriticalSection(&faultsect);
+	met_add(metfaults[kind], 1);
+	SetEvent(logevent);
+}
+
+/*
+ * Record an error code returned by a function, in place
+ * of a MessageBox of pxd_mesgErrorCode().
+ */
+void fault_error(int code, const char *where)
+{
+	fault_post(FAULT_ERROR, -1, code, where, pxd_mesgErrorCode(code));
+}
+
+/*
+ * Check for asynchronous faults of the selected units, such as
+ * video loss while capturing. Returns the number found.
+ */
+int fault_check(int unitmap)
+{
+	char	text[FAULT_TEXTLEN];
+	int	n = 0;
+
+	for (int u = 0; u < 32 && (unitmap >> u); u++) {
+		if (!(unitmap & (1 << u)))
+			continue;
+		text[0] = 0;
+		if (pxd_mesgFaultText(1 << u, text, sizeof(text)) > 0) {
+			text[sizeof(text) - 1] = 0;
+			fault_post(FAULT_VIDEO, u, 0, "pxd_mesgFaultText", text);
+			n++;
+		}
+	}
+	return(n);
+}
+
+/*
+ * The most severe action due since the last call.
+ */
+int fault_action(void)
+{
+	int	a;
+
+	if (!faultopen)
+		return(FAULT_IGNORE);
+	EnterCriticalSection(&faultsect);
+	a = pending;
+	pending = FAULT_IGNORE;
+	LeaveCriticalSection(&faultsect);
+	return(a);
+}
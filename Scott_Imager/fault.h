@@ -0,0 +1,56 @@
+#pragma once
+/*
+ *	fault.h
+ *
+ *	Errors and asynchronous capture faults, without modal dialogs.
+ *
+ *	Any thread may post a fault record; posting only copies the
+ *	record into a queue, and never waits on I/O or the user. A
+ *	logging thread writes the records to the console and to a
+ *	log file. Each record's kind selects a recovery action from
+ *	the policy: ignore, retry (restart capture), reopen (close and
+ *	reopen the frame grabber, then restart capture) or abort the
+ *	run. An action taken more than the policy's retries within its
+ *	window is escalated to the next, so a transient video loss is
+ *	retried, but a persistent one ends the run rather than looping.
+ *	The dialog thread collects the action due with fault_action().
+ *
+ *	Asynchronous faults, such as video loss while capturing, are
+ *	read with pxd_mesgFaultText() by fault_check(), rather than
+ *	shown by pxd_mesgFault().
+ */
+
+#define FAULT_ERROR	0	// kinds: an XCLIB or other error code
+#define FAULT_VIDEO	1	// asynchronous capture fault
+#define FAULT_KINDS	2
+
+#define FAULT_IGNORE	0	// actions, in order of severity
+#define FAULT_RETRY	1
+#define FAULT_REOPEN	2
+#define FAULT_ABORT	3
+
+#define FAULT_QUEUE	256	// records awaiting the log; more are counted, not kept
+#define FAULT_TEXTLEN	160
+
+struct faultpolicy {
+	int	action[FAULT_KINDS];	// per kind
+	int	retries;		// of an action within window, before escalating
+	DWORD	window;			// millis
+};
+
+struct faultrec {
+	SYSTEMTIME time;
+	int	kind;
+	int	unit;			// -1: not known, or all
+	int	code;
+	int	action;			// as taken, after escalation
+	char	where[32];
+	char	text[FAULT_TEXTLEN];
+};
+
+int	fault_open(const char *logpath, const struct faultpolicy *policy);
+void	fault_close(void);
+void	fault_post(int kind, int unit, int code, const char *where, const char *text);
+void	fault_error(int code, const char *where);
+int	fault_check(int unitmap);
+int	fault_action(void);
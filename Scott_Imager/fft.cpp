@@ -0,0 +1,298 @@
+/*
+ *	fft.cpp
+ *
+ *	Fast Fourier transforms for ROI spectral analysis.
+ *	See fft.h.
+ */
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <math.h>
+
+#include "fft.h"
+#include "kernels.h"
+#include "workers.h"
+
+#if KERN_SSE2
+#include <emmintrin.h>
+#endif
+
+#define FFT_MAXLOG2	16
+
+static	struct	fftplan *plans[FFT_MAXLOG2 + 1];    // cache, by log2 of size
+
+
+static void fft_freePlan(struct fftplan *p)
+{
+	if (!p)
+		return;
+	free(p->rev);
+	if (p->tw)
+		_aligned_free(p->tw);
+	if (p->rtw)
+		_aligned_free(p->rtw);
+	free(p);
+}
+
+/*
+ * Plan for size n, from the cache or built.
+ * NULL if n isn't a power of two from 2 to 65536,
+ * or memory is short.
+ */
+const struct fftplan *fft_plan(int n)
+{
+	struct	fftplan *p;
+	int	lg = 0;
+
+	while ((1 << lg) < n && lg < FFT_MAXLOG2)
+		lg++;
+	if (n < 2 || (1 << lg) != n)
+		return(NULL);
+	if (plans[lg])
+		return(plans[lg]);
+
+	p = (struct fftplan*)calloc(1, sizeof(struct fftplan));
+	if (!p)
+		return(NULL);
+	p->n = n;
+	p->rev = (int*)malloc(n * sizeof(int));
+	p->tw = (struct fftcomplex*)_aligned_malloc(n * sizeof(struct fftcomplex), 16);
+	p->rtw = (struct fftcomplex*)_aligned_malloc(n / 2 * sizeof(struct fftcomplex), 16);
+	p->half = n >= 4 ? fft_plan(n / 2) : NULL;
+	if (!p->rev || !p->tw || !p->rtw || (n >= 4 && !p->half)) {
+		fft_freePlan(p);
+		return(NULL);
+	}
+	for (int i = 0; i < n; i++) {
+		int r = 0;
+		for (int b = 0; b < lg; b++)
+			r |= ((i >> b) & 1) << (lg - 1 - b);
+		p->rev[i] = r;
+	}
+	p->tw[0].re = 1;
+	p->tw[0].im = 0;
+	for (int h = 1; h < n; h <<= 1) {
+		for (int k = 0; k < h; k++) {
+			double a = -3.14159265358979 * k / h;
+			p->tw[h + k].re = (float)cos(a);
+			p->tw[h + k].im = (float)sin(a);
+		}
+	}
+	for (int k = 0; k < n / 2; k++) {
+		double a = -2 * 3.14159265358979 * k / n;
+		p->rtw[k].re = (float)cos(a);
+		p->rtw[k].im = (float)sin(a);
+	}
+	plans[lg] = p;
+	return(p);
+}
+
+void fft_release(void)
+{
+	for (int lg = 0; lg <= FFT_MAXLOG2; lg++) {
+		fft_freePlan(plans[lg]);
+		plans[lg] = NULL;
+	}
+}
+
+/*
+ * In place forward transform of p->n complex values;
+ * iterative radix 2, decimation in time.
+ */
+void fft_complex(const struct fftplan *p, struct fftcomplex *x)
+{
+	int	n = p->n;
+	int	h = 1;
+
+	for (int i = 0; i < n; i++) {
+		int r = p->rev[i];
+		if (i < r) {
+			struct fftcomplex t = x[i];
+			x[i] = x[r];
+			x[r] = t;
+		}
+	}
+
+#if KERN_SSE2
+	if (kern_simd && n >= 4) {
+		//
+		// First stage, h == 1: one butterfly per register,
+		// (a, b) -> (a + b, a - b).
+		//
+		const __m128 neghi = _mm_set_ps(-0.0f, -0.0f, 0.0f, 0.0f);
+		const __m128 negre = _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f);
+		for (int i = 0; i < n; i += 2) {
+			__m128 v = _mm_loadu_ps(&x[i].re);
+			__m128 lo = _mm_movelh_ps(v, v);
+			__m128 hi = _mm_movehl_ps(v, v);
+			_mm_storeu_ps(&x[i].re, _mm_add_ps(lo, _mm_xor_ps(hi, neghi)));
+		}
+		//
+		// Later stages: two butterflies per register, with
+		// b * w = (br*wr - bi*wi, bi*wr + br*wi).
+		//
+		for (h = 2; h < n; h <<= 1) {
+			const struct fftcomplex *tw = p->tw + h;
+			for (int i = 0; i < n; i += 2 * h) {
+				struct fftcomplex *xa = x + i, *xb = x + i + h;
+				for (int k = 0; k < h; k += 2) {
+					__m128 a = _mm_loadu_ps(&xa[k].re);
+					__m128 b = _mm_loadu_ps(&xb[k].re);
+					__m128 w = _mm_load_ps(&tw[k].re);
+					__m128 wr = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 0, 0));
+					__m128 wi = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 1, 1));
+					__m128 bs = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+					__m128 t = _mm_add_ps(_mm_mul_ps(b, wr), _mm_xor_ps(_mm_mul_ps(bs, wi), negre));
+					_mm_storeu_ps(&xa[k].re, _mm_add_ps(a, t));
+					_mm_storeu_ps(&xb[k].re, _mm_sub_ps(a, t));
+				}
+			}
+		}
+		return;
+	}
+#endif
+	for (h = 1; h < n; h <<= 1) {
+		const struct fftcomplex *tw = p->tw + h;
+		for (int i = 0; i < n; i += 2 * h) {
+			for (int k = 0; k < h; k++) {
+				struct fftcomplex *a = &x[i + k], *b = &x[i + k + h];
+				float tr = b->re * tw[k].re - b->im * tw[k].im;
+				float ti = b->im * tw[k].re + b->re * tw[k].im;
+				b->re = a->re - tr;
+				b->im = a->im - ti;
+				a->re += tr;
+				a->im += ti;
+			}
+		}
+	}
+}
+
+/*
+ * Forward transform of p->n real values to the
+ * p->n/2+1 non-negative frequencies.
+ * The even and odd samples are transformed together as one
+ * complex signal of half the size, then untangled:
+ *
+ *	X[k] = E[k] + exp(-2 pi i k/n) O[k]
+ *	E[k] = (Z[k] + conj Z[m-k]) / 2
+ *	O[k] = (Z[k] - conj Z[m-k]) / 2i
+ */
+void fft_real(const struct fftplan *p, const float *in, struct fftcomplex *out)
+{
+	int	m = p->n / 2;
+
+	memcpy(out, in, p->n * sizeof(float));
+	if (m == 1) {
+		float a = out[0].re, b = out[0].im;
+		out[0].re = a + b;
+		out[0].im = 0;
+		out[1].re = a - b;
+		out[1].im = 0;
+		return;
+	}
+	fft_complex(p->half, out);
+
+	float	z0r = out[0].re, z0i = out[0].im;
+	out[0].re = z0r + z0i;
+	out[0].im = 0;
+	out[m].re = z0r - z0i;
+	out[m].im = 0;
+	for (int k = 1; k <= m / 2; k++) {
+		struct fftcomplex zk = out[k], zm = out[m - k];
+		//
+		// For k and m-k together, as each needs both.
+		//
+		float er = (zk.re + zm.re) * 0.5f, ei = (zk.im - zm.im) * 0.5f;
+		float or_ = (zk.im + zm.im) * 0.5f, oi = (zm.re - zk.re) * 0.5f;
+		const struct fftcomplex *w = &p->rtw[k];
+		float tr = or_ * w->re - oi * w->im, ti = or_ * w->im + oi * w->re;
+		out[k].re = er + tr;
+		out[k].im = ei + ti;
+		if (k != m - k) {
+			//
+			// X[m-k]: E[m-k] = conj E[k], O[m-k] = conj O[k],
+			// and exp(-2 pi i (m-k)/n) = -conj w.
+			//
+			float tr2 = -(or_ * w->re - oi * w->im), ti2 = or_ * w->im + oi * w->re;
+			out[m - k].re = er + tr2;
+			out[m - k].im = -ei + ti2;
+		}
+	}
+}
+
+/*
+ * Batches, on the worker pool.
+ */
+struct batchctx {
+	const struct fftplan *p;
+	const float *in;
+	size_t	instride;
+	struct	fftcomplex *out;
+	size_t	outstride;
+};
+
+static void fft_realFn(void *ctx, int index)
+{
+	struct batchctx *c = (struct batchctx*)ctx;
+	fft_real(c->p, c->in + c->instride * index, c->out + c->outstride * index);
+}
+
+static void fft_complexFn(void *ctx, int index)
+{
+	struct batchctx *c = (struct batchctx*)ctx;
+	fft_complex(c->p, c->out + c->outstride * index);
+}
+
+void fft_realBatch(const struct fftplan *p, const float *in, size_t instride,
+		   struct fftcomplex *out, size_t outstride, int count)
+{
+	struct	batchctx c = { p, in, instride, out, outstride };
+
+	wrk_parallel(count, fft_realFn, &c);
+}
+
+void fft_complexBatch(const struct fftplan *p, struct fftcomplex *x, size_t stride, int count)
+{
+	struct	batchctx c = { p, NULL, 0, x, stride };
+
+	wrk_parallel(count, fft_complexFn, &c);
+}
+
+/*
+ * 2-D transform of nx by ny real values, in lines of nx, to
+ * ny lines of nx/2+1 frequencies: lines, then columns.
+ */
+struct columnctx {
+	const struct fftplan *p;
+	struct	fftcomplex *x;
+	int	stride;
+};
+
+static void fft_columnFn(void *ctx, int index)
+{
+	struct	columnctx *c = (struct columnctx*)ctx;
+	int	n = c->p->n;
+	struct	fftcomplex *t = (struct fftcomplex*)_alloca(n * sizeof(struct fftcomplex));
+
+	for (int y = 0; y < n; y++)
+		t[y] = c->x[(size_t)y * c->stride + index];
+	fft_complex(c->p, t);
+	for (int y = 0; y < n; y++)
+		c->x[(size_t)y * c->stride + index] = t[y];
+}
+
+int fft_real2d(int nx, int ny, const float *in, struct fftcomplex *out)
+{
+	const struct fftplan *px = fft_plan(nx), *py = fft_plan(ny);
+	struct	columnctx c;
+
+	if (!px || !py || nx < 4)
+		return(PXERNOMODE);
+	fft_realBatch(px, in, nx, out, nx / 2 + 1, ny);
+	c.p = py;
+	c.x = out;
+	c.stride = nx / 2 + 1;
+	wrk_parallel(nx / 2 + 1, fft_columnFn, &c);
+	return(0);
+}
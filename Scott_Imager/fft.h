@@ -0,0 +1,43 @@
+#pragma once
+/*
+ *	fft.h
+ *
+ *	Fast Fourier transforms for ROI spectral analysis, e.g. MTF
+ *	from sine patterns and noise power spectra.
+ *
+ *	Sizes are powers of two, as ROIs are. Plans, the bit reversal
+ *	permutation and twiddle factors for a size, are built on first
+ *	use and cached by size until fft_release. Twiddles are stored
+ *	per stage, contiguously, so the SSE2 butterflies load two at a
+ *	time. Real input of size n is transformed as a complex
+ *	transform of size n/2 and an untangling pass, giving the
+ *	n/2+1 non-negative frequencies.
+ *
+ *	The batch forms run many same sized transforms, e.g. all the
+ *	rows of many ROIs, on the worker pool, sharing one plan.
+ *	fft_plan, and so the transforms which build plans, are to be
+ *	called from one thread only; the transforms themselves are
+ *	safe to run concurrently on built plans.
+ */
+
+struct fftcomplex {
+	float	re;
+	float	im;
+};
+
+struct fftplan {
+	int	n;
+	int	*rev;		    // bit reversal permutation
+	struct	fftcomplex *tw;	    // stage with half size h uses tw[h .. 2h-1]
+	struct	fftcomplex *rtw;    // real untangling, exp(-2 pi i k / n), k < n/2
+	const struct fftplan *half; // for real transforms
+};
+
+const struct fftplan *fft_plan(int n);
+void	fft_release(void);
+void	fft_complex(const struct fftplan *p, struct fftcomplex *x);
+void	fft_real(const struct fftplan *p, const float *in, struct fftcomplex *out);
+void	fft_realBatch(const struct fftplan *p, const float *in, size_t instride,
+		      struct fftcomplex *out, size_t outstride, int count);
+void	fft_complexBatch(const struct fftplan *p, struct fftcomplex *x, size_t stride, int count);
+int	fft_real2d(int nx, int ny, const float *in, struct fftcomplex *out);
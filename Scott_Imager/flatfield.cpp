@@ -0,0 +1,159 @@
+/*
+ *	flatfield.cpp
+ *
+ *	Dark frame and flat field correction.
+ *	See flatfield.h.
+ */
+#include <windows.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+#include "flatfield.h"
+#include "kernels.h"
+#include "hostmem.h"
+
+
+/*
+ * Allocate master frames, initialized to 'no correction':
+ * zero dark and unity gain.
+ */
+int ffc_alloc(struct flatfield *ff, int xdim, int ydim, int cdim, int bits)
+{
+	memset(ff, 0, sizeof(*ff));
+	ff->xdim = xdim;
+	ff->ydim = ydim;
+	ff->cdim = cdim;
+	ff->bits = bits;
+	ff->npix = (size_t)xdim * ydim * cdim;
+	ff->dark = (ushort*)mem_alloc(ff->npix * sizeof(ushort));
+	ff->gain = (ushort*)mem_alloc(ff->npix * sizeof(ushort));
+	if (!ff->dark || !ff->gain) {
+		ffc_free(ff);
+		return(PXERMALLOC);
+	}
+	memset(ff->dark, 0, ff->npix * sizeof(ushort));
+	for (size_t i = 0; i < ff->npix; i++)
+		ff->gain[i] = 1 << KERN_GAINSHIFT;
+	return(0);
+}
+
+void ffc_free(struct flatfield *ff)
+{
+	mem_free(ff->accum);
+	mem_free(ff->dark);
+	mem_free(ff->gain);
+	memset(ff, 0, sizeof(*ff));
+}
+
+/*
+ * Start accumulating calibration frames.
+ * The accumulator is only held during calibration;
+ * at 4 bytes per pixel it isn't small.
+ */
+int ffc_begin(struct flatfield *ff)
+{
+	if (!ff->accum)
+		ff->accum = (uint*)mem_alloc(ff->npix * sizeof(uint));
+	if (!ff->accum)
+		return(PXERMALLOC);
+	memset(ff->accum, 0, ff->npix * sizeof(uint));
+	ff->naccum = 0;
+	return(0);
+}
+
+void ffc_add(struct flatfield *ff, const struct hostframe *f)
+{
+	if (!ff->accum || f->npix != ff->npix)
+		return;
+	kern_accumulate(ff->accum, f->pix, ff->npix);
+	ff->naccum++;
+}
+
+static void ffc_end(struct flatfield *ff)
+{
+	mem_free(ff->accum);
+	ff->accum = NULL;
+	ff->naccum = 0;
+}
+
+/*
+ * Reduce the accumulated frames to the master dark.
+ */
+int ffc_endDark(struct flatfield *ff)
+{
+	if (!ff->accum || !ff->naccum)
+		return(PXERNOMODE);
+	kern_average(ff->dark, ff->accum, ff->npix, ff->naccum);
+	ff->havedark = 1;
+	ffc_end(ff);
+	return(0);
+}
+
+/*
+ * Reduce the accumulated frames to the master flat,
+ * less the master dark, and from it to the gain map.
+ * The master flat need not be kept; the averaged, dark
+ * subtracted value is computed in the gain map's storage.
+ * Pixels with no response (dead, or fully dark) are
+ * left at unity gain rather than amplified without bound.
+ */
+int ffc_endFlat(struct flatfield *ff)
+{
+	double	sum[3] = { 0, 0, 0 };
+	double	mean[3];
+	size_t	i;
+	int	c;
+
+	if (!ff->accum || !ff->naccum)
+		return(PXERNOMODE);
+	kern_average(ff->gain, ff->accum, ff->npix, ff->naccum);
+	for (i = 0; i < ff->npix; i++) {
+		ff->gain[i] = ff->gain[i] > ff->dark[i] ? ff->gain[i] - ff->dark[i] : 0;
+		sum[i % ff->cdim] += ff->gain[i];
+	}
+	for (c = 0; c < ff->cdim; c++)
+		mean[c] = sum[c] * ff->cdim / ff->npix;
+	for (i = 0; i < ff->npix; i++) {
+		double g = 1.0;
+		if (ff->gain[i])
+			g = mean[i % ff->cdim] / ff->gain[i];
+		g = g * (1 << KERN_GAINSHIFT) + 0.5;
+		ff->gain[i] = (ushort)(g > 0xFFFF ? 0xFFFF : g);
+	}
+	ff->haveflat = 1;
+	ffc_end(ff);
+	return(0);
+}
+
+/*
+ * Correct a frame in place.
+ * Without any calibration, the frame is left untouched.
+ */
+void ffc_apply(const struct flatfield *ff, struct hostframe *f)
+{
+	if (!ff->havedark && !ff->haveflat)
+		return;
+	if (f->npix != ff->npix)
+		return;
+	kern_flatfield(f->pix, ff->dark, ff->gain, ff->npix, ff->bits);
+}
+
+/*
+ * Correct just the spans of a partially read frame; the rest
+ * is left as it was, i.e. as corrected when last read.
+ */
+void ffc_applyRects(const struct flatfield *ff, struct hostframe *f, const struct framerect *spans, int nspans)
+{
+	if (!ff->havedark && !ff->haveflat)
+		return;
+	if (f->npix != ff->npix)
+		return;
+	for (int i = 0; i < nspans; i++) {
+		const struct framerect *s = &spans[i];
+		size_t	w = (size_t)(s->x1 - s->x0) * f->cdim;
+		for (int y = s->y0; y < s->y1; y++) {
+			size_t o = ((size_t)y * f->xdim + s->x0) * f->cdim;
+			kern_flatfield(f->pix + o, ff->dark + o, ff->gain + o, w, ff->bits);
+		}
+	}
+}
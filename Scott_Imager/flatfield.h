@@ -0,0 +1,37 @@
+#pragma once
+/*
+ *	flatfield.h
+ *
+ *	Dark frame and flat field correction.
+ *
+ *	Calibration accumulates N dark frames (lens capped) and N flat
+ *	frames (integrating sphere) into master frames. The master flat
+ *	is reduced to a per pixel gain map, normalized per colour
+ *	component to the mean response, so that correction is a
+ *	subtraction and a fixed point multiply per pixel.
+ */
+
+#include "frame.h"
+
+struct flatfield {
+	int	xdim;
+	int	ydim;
+	int	cdim;
+	int	bits;
+	size_t	npix;
+	uint	*accum;	    // only while calibrating
+	int	naccum;
+	ushort	*dark;	    // master dark frame
+	ushort	*gain;	    // gain map, KERN_GAINSHIFT fixed point
+	int	havedark;
+	int	haveflat;
+};
+
+int	ffc_alloc(struct flatfield *ff, int xdim, int ydim, int cdim, int bits);
+void	ffc_free(struct flatfield *ff);
+int	ffc_begin(struct flatfield *ff);
+void	ffc_add(struct flatfield *ff, const struct hostframe *f);
+int	ffc_endDark(struct flatfield *ff);
+int	ffc_endFlat(struct flatfield *ff);
+void	ffc_apply(const struct flatfield *ff, struct hostframe *f);
+void	ffc_applyRects(const struct flatfield *ff, struct hostframe *f, const struct framerect *spans, int nspans);
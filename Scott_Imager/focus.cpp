@@ -0,0 +1,222 @@
+/*
+ *	focus.cpp
+ *
+ *	Field curvature and astigmatism from a through-focus sequence.
+ *	See focus.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "focus.h"
+#include "results.h"
+#include "workers.h"
+
+
+int foc_alloc(struct focus *t, int grid, int size, int maxsteps, double step)
+{
+	memset(t, 0, sizeof(*t));
+	t->grid = grid;
+	t->size = size;
+	t->nrois = grid * grid;
+	t->maxsteps = maxsteps;
+	t->step = step;
+	t->rois = (struct focusroi*)calloc(t->nrois, sizeof(struct focusroi));
+	t->curves = (double*)malloc((size_t)2 * maxsteps * t->nrois * sizeof(double));
+	if (!t->rois || !t->curves) {
+		foc_free(t);
+		return(PXERMALLOC);
+	}
+	for (int i = 0; i < t->nrois; i++) {
+		t->rois[i].sag = t->curves + (size_t)2 * maxsteps * i;
+		t->rois[i].tan = t->rois[i].sag + maxsteps;
+	}
+	return(0);
+}
+
+void foc_free(struct focus *t)
+{
+	if (t->rois)
+		free(t->rois);
+	if (t->curves)
+		free(t->curves);
+	memset(t, 0, sizeof(*t));
+}
+
+/*
+ * Start a new sequence.
+ */
+void foc_reset(struct focus *t)
+{
+	t->nsteps = 0;
+	for (int i = 0; i < t->nrois; i++)
+		t->rois[i].sagok = t->rois[i].tanok = 0;
+}
+
+/*
+ * Lay out the ROIs, centred on a regular grid,
+ * for the frame's geometry.
+ */
+static void foc_layout(struct focus *t, const struct hostframe *f)
+{
+	double	cx = (f->xdim - 1) / 2.0, cy = (f->ydim - 1) / 2.0;
+	double	norm = sqrt(cx * cx + cy * cy);
+
+	if (t->xdim == f->xdim && t->ydim == f->ydim)
+		return;
+	t->xdim = f->xdim;
+	t->ydim = f->ydim;
+	for (int j = 0; j < t->grid; j++) {
+		for (int i = 0; i < t->grid; i++) {
+			struct focusroi *r = &t->rois[j * t->grid + i];
+			int x = (int)((i + 0.5) * f->xdim / t->grid) - t->size / 2;
+			int y = (int)((j + 0.5) * f->ydim / t->grid) - t->size / 2;
+			r->x0 = min(max(x, 1), f->xdim - 1 - t->size);
+			r->y0 = min(max(y, 1), f->ydim - 1 - t->size);
+			double dx = r->x0 + t->size / 2.0 - cx, dy = r->y0 + t->size / 2.0 - cy;
+			double d = sqrt(dx * dx + dy * dy);
+			r->field = d / norm;
+			//
+			// At the centre, radial is undefined; take x.
+			//
+			r->ux = d > t->size / 2.0 ? dx / d : 1.0;
+			r->uy = d > t->size / 2.0 ? dy / d : 0.0;
+		}
+	}
+}
+
+/*
+ * Reduce one ROI of one frame; in parallel over ROIs.
+ */
+struct roictx {
+	struct	focus *t;
+	const struct hostframe *f;
+};
+
+static void foc_roiFn(void *ctx, int index)
+{
+	struct	roictx *c = (struct roictx*)ctx;
+	const struct hostframe *f = c->f;
+	struct	focusroi *r = &c->t->rois[index];
+	int	n = c->t->size;
+	double	s = 0, ss = 0, er = 0, et = 0;
+
+	for (int y = r->y0; y < r->y0 + n; y++) {
+		for (int x = r->x0; x < r->x0 + n; x++) {
+			double v = frame_mono(f, x, y);
+			double gx = (frame_mono(f, x + 1, y) - frame_mono(f, x - 1, y)) * 0.5;
+			double gy = (frame_mono(f, x, y + 1) - frame_mono(f, x, y - 1)) * 0.5;
+			double dr = gx * r->ux + gy * r->uy;	// along radial
+			double dt = gy * r->ux - gx * r->uy;	// along tangential
+			s += v;
+			ss += v * v;
+			er += dr * dr;
+			et += dt * dt;
+		}
+	}
+	double var = ss / (n * n) - (s / (n * n)) * (s / (n * n));
+	if (var <= 0)
+		var = 1;
+	//
+	// Sagittal detail varies along the tangential direction,
+	// tangential detail along the radial.
+	//
+	r->sag[c->t->nsteps] = et / (n * n) / var;
+	r->tan[c->t->nsteps] = er / (n * n) / var;
+}
+
+/*
+ * Peak of a sampled curve, in steps, by fitting a Gaussian
+ * through the highest sample and its neighbours.
+ * Returns -1 if the peak isn't bracketed.
+ */
+static double foc_peak(const double *v, int n)
+{
+	int	k = 0;
+
+	for (int i = 1; i < n; i++)
+		if (v[i] > v[k])
+			k = i;
+	if (k == 0 || k == n - 1 || v[k - 1] <= 0 || v[k + 1] <= 0)
+		return(-1);
+	double a = log(v[k - 1]), b = log(v[k]), c = log(v[k + 1]);
+	double den = a - 2 * b + c;
+	if (den >= 0)
+		return(k);
+	return(k + 0.5 * (a - c) / den);
+}
+
+/*
+ * Add one frame, the next focus step, and refit.
+ */
+int foc_measure(struct focus *t, const struct hostframe *f)
+{
+	struct	roictx c;
+
+	if (t->nsteps >= t->maxsteps || f->xdim < t->size + 2 || f->ydim < t->size + 2)
+		return(0);
+	foc_layout(t, f);
+	c.t = t;
+	c.f = f;
+	wrk_parallel(t->nrois, foc_roiFn, &c);
+	t->nsteps++;
+	for (int i = 0; i < t->nrois; i++) {
+		struct focusroi *r = &t->rois[i];
+		double p = foc_peak(r->sag, t->nsteps);
+		r->sagok = p >= 0;
+		r->sagpeak = p * t->step;
+		p = foc_peak(r->tan, t->nsteps);
+		r->tanok = p >= 0;
+		r->tanpeak = p * t->step;
+	}
+	return(0);
+}
+
+/*
+ * Summarize, for display: field curvature and astigmatism
+ * at the outermost ROI with both peaks bracketed, and the
+ * largest astigmatism anywhere.
+ */
+int foc_format(const struct focus *t, char *buf, size_t bufsize)
+{
+	const struct focusroi *in = NULL, *out = NULL, *astig = NULL;
+
+	for (int i = 0; i < t->nrois; i++) {
+		const struct focusroi *r = &t->rois[i];
+		if (!r->sagok || !r->tanok)
+			continue;
+		if (!in || r->field < in->field)
+			in = r;
+		if (!out || r->field > out->field)
+			out = r;
+		if (!astig || fabs(r->tanpeak - r->sagpeak) > fabs(astig->tanpeak - astig->sagpeak))
+			astig = r;
+	}
+	if (!in)
+		return(_snprintf(buf, bufsize, "focus: %d steps, no peaks", t->nsteps));
+	return(_snprintf(buf, bufsize, "focus: %d steps  centre %.2f  @%.2f curvature %+.2f astig %+.2f  max astig %+.2f @%.2f",
+		t->nsteps, (in->sagpeak + in->tanpeak) / 2, out->field,
+		(out->sagpeak + out->tanpeak) / 2 - (in->sagpeak + in->tanpeak) / 2,
+		out->tanpeak - out->sagpeak, astig->tanpeak - astig->sagpeak, astig->field));
+}
+
+/*
+ * Record each ROI's best focus found so far; the ROI is its index.
+ */
+int foc_record(const struct focus *t, struct results *r)
+{
+	int	err = 0;
+
+	for (int i = 0; i < t->nrois && err >= 0; i++) {
+		const struct focusroi *o = &t->rois[i];
+		if (o->sagok)
+			err = res_add(r, "foc.sag", i, o->sagpeak);
+		if (err >= 0 && o->tanok)
+			err = res_add(r, "foc.tan", i, o->tanpeak);
+	}
+	return(err);
+}
@@ -0,0 +1,62 @@
+#pragma once
+/*
+ *	focus.h
+ *
+ *	Field curvature and astigmatism from a through-focus sequence.
+ *
+ *	Each frame of a sequence capture is taken as one focus step,
+ *	the focus being moved by a fixed increment between frames.
+ *	For each ROI of a grid across the field, the sagittal and
+ *	tangential sharpness of each frame is reduced to one number
+ *	each, as the frames stream by; the frames themselves aren't
+ *	kept. The sharpness is the energy of the intensity derivative
+ *	along the tangential (sagittal detail) or radial (tangential
+ *	detail) direction, relative to the ROI's variance, a proxy for
+ *	MTF at mid frequencies which peaks at best focus.
+ *
+ *	The peak of each curve is located to a fraction of a step;
+ *	the mean of the sagittal and tangential peaks, relative to
+ *	the centre ROI's, maps field curvature, and their difference
+ *	maps astigmatism.
+ */
+
+#include "frame.h"
+
+struct	results;
+
+struct focusroi {
+	int	x0;	    // top left, pixels
+	int	y0;
+	double	field;	    // distance of the ROI centre from the image centre, relative to the half diagonal
+	double	ux, uy;	    // radial unit vector
+	double	*sag;	    // sharpness per step
+	double	*tan;
+	//
+	// Results, in focus units; valid only if the
+	// peak is bracketed by the steps measured.
+	//
+	int	sagok;
+	int	tanok;
+	double	sagpeak;
+	double	tanpeak;
+};
+
+struct focus {
+	int	grid;	    // ROIs per side
+	int	size;	    // ROI side, pixels
+	int	nrois;
+	int	maxsteps;
+	int	nsteps;	    // steps measured so far
+	double	step;	    // focus change per frame, e.g. um
+	struct	focusroi *rois;
+	double	*curves;    // all ROIs' sag and tan curves
+	int	xdim;	    // frame geometry the ROIs are laid out for
+	int	ydim;
+};
+
+int	foc_alloc(struct focus *t, int grid, int size, int maxsteps, double step);
+void	foc_free(struct focus *t);
+void	foc_reset(struct focus *t);
+int	foc_measure(struct focus *t, const struct hostframe *f);
+int	foc_format(const struct focus *t, char *buf, size_t bufsize);
+int	foc_record(const struct focus *t, struct results *r);
@@ -0,0 +1,204 @@
+/*
+ *	frame.cpp
+ *
+ *	Host side copies of captured frame buffers.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "frame.h"
+#include "hostmem.h"
+#include "trace.h"
+
+
+/*
+ * Allocate pixel storage for a frame of the given dimensions.
+ * The storage is aligned for the SSE2 kernels.
+ */
+int frame_alloc(struct hostframe *f, int xdim, int ydim, int cdim, int bits)
+{
+	memset(f, 0, sizeof(*f));
+	f->npix = (size_t)xdim * ydim * cdim;
+	f->pix = (ushort*)mem_alloc(f->npix * sizeof(ushort));
+	if (!f->pix)
+		return(PXERMALLOC);
+	f->xdim = xdim;
+	f->ydim = ydim;
+	f->cdim = cdim;
+	f->bits = bits;
+	return(0);
+}
+
+void frame_free(struct hostframe *f)
+{
+	mem_free(f->pix);
+	if (f->aoi)
+		_aligned_free(f->aoi);
+	memset(f, 0, sizeof(*f));
+}
+
+/*
+ * Read an entire frame buffer of a unit into the host frame.
+ * One pxd_readushort of the whole image is considerably quicker
+ * than reading line by line, as done by SaveBinary1.
+ */
+int frame_read(struct hostframe *f, int unit, pxbuffer_t buf)
+{
+	int	err;
+
+	TRACE_SPAN("pxd_readushort", err = pxd_readushort(1 << unit, buf, 0, 0, -1, -1, f->pix, f->npix, f->cdim == 1 ? "Grey" : "RGB"));
+	if (err < 0)
+		return(err);
+	f->unit = unit;
+	f->buf = buf;
+	f->fieldcount = pxd_buffersFieldCount(1 << unit, buf);
+	f->partial = 0;
+	f->nread = f->npix;
+	return(0);
+}
+
+static int frame_cmpInt(const void *a, const void *b)
+{
+	return(*(const int*)a - *(const int*)b);
+}
+
+static int frame_cmpX0(const void *a, const void *b)
+{
+	return(((const struct framerect*)a)->x0 - ((const struct framerect*)b)->x0);
+}
+
+/*
+ * Merge rectangles, clipped to the frame, into non-overlapping
+ * spans which cover just their union. The frame is cut into
+ * bands at each rectangle's top and bottom; within each band
+ * the rectangles' extents are merged, and a span is extended
+ * down while the next band has the same extent. Returns the
+ * number of spans; if more than maxspans would be needed, the
+ * one bounding box of the rectangles.
+ */
+int frame_spans(const struct hostframe *f, const struct framerect *rects, int nrects, struct framerect *spans, int maxspans)
+{
+	struct	framerect clip[FRAME_MAXRECTS];
+	struct	framerect iv[FRAME_MAXRECTS];
+	int	ys[2 * FRAME_MAXRECTS];
+	struct	framerect box = { f->xdim, f->ydim, 0, 0 };
+	int	n = 0, ny = 0, nys, nspans = 0;
+
+	for (int i = 0; i < nrects; i++) {
+		struct framerect r = rects[i];
+		r.x0 = max(r.x0, 0);
+		r.y0 = max(r.y0, 0);
+		r.x1 = min(r.x1, f->xdim);
+		r.y1 = min(r.y1, f->ydim);
+		if (r.x0 >= r.x1 || r.y0 >= r.y1)
+			continue;
+		box.x0 = min(box.x0, r.x0);
+		box.y0 = min(box.y0, r.y0);
+		box.x1 = max(box.x1, r.x1);
+		box.y1 = max(box.y1, r.y1);
+		if (n < FRAME_MAXRECTS)
+			clip[n] = r;
+		n++;
+	}
+	if (!n || maxspans < 1)
+		return(0);
+	if (n > FRAME_MAXRECTS)
+		goto whole;
+
+	for (int i = 0; i < n; i++) {
+		ys[ny++] = clip[i].y0;
+		ys[ny++] = clip[i].y1;
+	}
+	qsort(ys, ny, sizeof(ys[0]), frame_cmpInt);
+	nys = 1;
+	for (int i = 1; i < ny; i++)
+		if (ys[i] != ys[nys - 1])
+			ys[nys++] = ys[i];
+
+	for (int b = 0; b + 1 < nys; b++) {
+		int	ya = ys[b], yb = ys[b + 1];
+		int	niv = 0, m = 0;
+
+		for (int i = 0; i < n; i++)
+			if (clip[i].y0 <= ya && clip[i].y1 >= yb)
+				iv[niv++] = clip[i];
+		qsort(iv, niv, sizeof(iv[0]), frame_cmpX0);
+		for (int i = 1; i < niv; i++) {
+			if (iv[i].x0 <= iv[m].x1)
+				iv[m].x1 = max(iv[m].x1, iv[i].x1);
+			else
+				iv[++m] = iv[i];
+		}
+		if (niv)
+			niv = m + 1;
+		for (int i = 0; i < niv; i++) {
+			int j;
+			for (j = 0; j < nspans; j++)
+				if (spans[j].y1 == ya && spans[j].x0 == iv[i].x0 && spans[j].x1 == iv[i].x1)
+					break;
+			if (j < nspans) {
+				spans[j].y1 = yb;
+				continue;
+			}
+			if (nspans == maxspans)
+				goto whole;
+			spans[nspans].x0 = iv[i].x0;
+			spans[nspans].y0 = ya;
+			spans[nspans].x1 = iv[i].x1;
+			spans[nspans].y1 = yb;
+			nspans++;
+		}
+	}
+	return(nspans);
+
+whole:
+	spans[0] = box;
+	return(1);
+}
+
+/*
+ * Read just the given spans of a frame buffer, such as from
+ * frame_spans(), each into its place in the host frame; the
+ * rest of the host frame is left as it was. Each span is one
+ * pxd_readushort, so only its pixels cross the bus.
+ */
+int frame_readRects(struct hostframe *f, int unit, pxbuffer_t buf, const struct framerect *spans, int nspans)
+{
+	const char *cs = f->cdim == 1 ? "Grey" : "RGB";
+	size_t	most = 0, n = 0;
+	int	err;
+
+	for (int i = 0; i < nspans; i++)
+		most = max(most, (size_t)(spans[i].x1 - spans[i].x0) * (spans[i].y1 - spans[i].y0) * f->cdim);
+	if (most > f->naoi) {
+		if (f->aoi)
+			_aligned_free(f->aoi);
+		f->naoi = 0;
+		f->aoi = (ushort*)_aligned_malloc(most * sizeof(ushort), 16);
+		if (!f->aoi)
+			return(PXERMALLOC);
+		f->naoi = most;
+	}
+	for (int i = 0; i < nspans; i++) {
+		const struct framerect *s = &spans[i];
+		size_t	w = (size_t)(s->x1 - s->x0) * f->cdim;
+
+		TRACE_SPAN("pxd_readushort", err = pxd_readushort(1 << unit, buf, s->x0, s->y0, s->x1, s->y1, f->aoi, w * (s->y1 - s->y0), cs));
+		if (err < 0)
+			return(err);
+		for (int y = s->y0; y < s->y1; y++)
+			memcpy(f->pix + ((size_t)y * f->xdim + s->x0) * f->cdim, f->aoi + (y - s->y0) * w, w * sizeof(ushort));
+		n += w * (s->y1 - s->y0);
+	}
+	f->unit = unit;
+	f->buf = buf;
+	f->fieldcount = pxd_buffersFieldCount(1 << unit, buf);
+	f->partial = 1;
+	f->nread = n;
+	return(0);
+}
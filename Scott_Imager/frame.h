@@ -0,0 +1,65 @@
+#pragma once
+/*
+ *	frame.h
+ *
+ *	Host side copies of captured frame buffers.
+ *
+ *	The frame grabber's buffers are only reachable through the
+ *	pxd_read* functions; analysis works on a host copy read
+ *	once per captured frame. Pixels are always held as ushort,
+ *	regardless of pxd_imageBdim(), with colour components
+ *	interleaved as delivered by the "RGB" colour space.
+ *
+ *	When only parts of the frame are analysed, such as tracked
+ *	ROIs, just those rectangles may be read, merged into as few
+ *	non-overlapping spans as cover them; the rest of the frame is
+ *	left as it was, and the frame is marked partial.
+ */
+
+extern "C" {
+#include "xcliball.h"
+}
+
+struct hostframe {
+	ushort	    *pix;	    // xdim*ydim*cdim pixels, from mem_alloc()
+	int	    xdim;
+	int	    ydim;
+	int	    cdim;	    // 1: "Grey", 3: "RGB"
+	int	    bits;	    // significant bits per pixel component
+	size_t	    npix;	    // xdim*ydim*cdim
+	int	    unit;	    // source of the last frame read
+	pxbuffer_t  buf;
+	pxvbtime_t  fieldcount;	    // pxd_buffersFieldCount() of the last frame read
+	int	    partial;	    // only some rectangles of the last frame were read
+	size_t	    nread;	    // pixel components read of the last frame
+	ushort	    *aoi;	    // for rectangles read, before placing in pix
+	size_t	    naoi;
+};
+
+#define FRAME_MAXRECTS	256	// merged by frame_spans(); more are read as their bounding box
+
+/*
+ * Rectangle of a frame, as for pxd_readushort:
+ * x1, y1 exclusive.
+ */
+struct framerect {
+	int	    x0;
+	int	    y0;
+	int	    x1;
+	int	    y1;
+};
+
+int	frame_alloc(struct hostframe *f, int xdim, int ydim, int cdim, int bits);
+void	frame_free(struct hostframe *f);
+int	frame_read(struct hostframe *f, int unit, pxbuffer_t buf);
+int	frame_spans(const struct hostframe *f, const struct framerect *rects, int nrects, struct framerect *spans, int maxspans);
+int	frame_readRects(struct hostframe *f, int unit, pxbuffer_t buf, const struct framerect *spans, int nspans);
+
+/*
+ * Pixel value for monochrome analyses: the green
+ * component of colour frames.
+ */
+static inline int frame_mono(const struct hostframe *f, int x, int y)
+{
+	return(f->pix[((size_t)y * f->xdim + x) * f->cdim + (f->cdim == 3 ? 1 : 0)]);
+}
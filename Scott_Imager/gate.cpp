@@ -0,0 +1,137 @@
+/*
+ *	gate.cpp
+ *
+ *	Pass/fail gating of a lens against spec limits.
+ *	See gate.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "xcliball.h"
+}
+#include "gate.h"
+
+
+/*
+ * Read the limits; PXERNOFILE if the file can't be read,
+ * PXERNOMODE if a line can't be understood.
+ */
+int gate_load(struct gate *g, const char *path)
+{
+	FILE	*fp;
+	char	line[256];
+	int	err = 0;
+
+	memset(g, 0, sizeof(*g));
+	fp = fopen(path, "r");
+	if (!fp)
+		return(PXERNOFILE);
+	while (fgets(line, sizeof(line), fp)) {
+		struct	gatelimit *l = &g->limits[g->nlimits];
+		char	roi[16];
+		char	*p = strchr(line, '#');
+		int	n;
+
+		if (p)
+			*p = 0;
+		l->need = l->maxbad = 1;
+		n = sscanf(line, " %31s %15s %lf %lf %d %d", l->metric, roi, &l->lo, &l->hi, &l->need, &l->maxbad);
+		if (n <= 0)
+			continue;
+		if (n < 4 || g->nlimits >= GATE_MAXLIMITS || l->need < 0 || l->maxbad < 1) {
+			err = PXERNOMODE;
+			break;
+		}
+		l->roi = strcmp(roi, "*") == 0 ? -1 : atoi(roi);
+		g->nlimits++;
+	}
+	fclose(fp);
+	gate_reset(g);
+	return(err);
+}
+
+/*
+ * Start on a new lens.
+ */
+void gate_reset(struct gate *g)
+{
+	for (int i = 0; i < g->nlimits; i++)
+		g->limits[i].ok = g->limits[i].bad = 0;
+	g->verdict = GATE_PENDING;
+	g->failed = -1;
+	g->frames = 0;
+	g->start = GetTickCount();
+	g->millis = 0;
+}
+
+void gate_frame(struct gate *g)
+{
+	if (g->verdict == GATE_PENDING)
+		g->frames++;
+}
+
+static void gate_decide(struct gate *g, int verdict)
+{
+	g->verdict = verdict;
+	g->millis = GetTickCount() - g->start;
+	g->lenses++;
+	g->passed += verdict == GATE_PASS;
+	g->summillis += g->millis;
+}
+
+/*
+ * Count one result; returns the verdict.
+ */
+int gate_check(struct gate *g, const char *metric, int roi, double value)
+{
+	int	matched = 0;
+
+	if (g->verdict != GATE_PENDING)
+		return(g->verdict);
+	for (int i = 0; i < g->nlimits; i++) {
+		struct gatelimit *l = &g->limits[i];
+		if ((l->roi >= 0 && l->roi != roi) || strcmp(l->metric, metric) != 0)
+			continue;
+		matched++;
+		if (value >= l->lo && value <= l->hi)
+			l->ok++;
+		else {
+			l->worst = value;
+			if (++l->bad >= l->maxbad) {
+				g->failed = i;
+				gate_decide(g, GATE_FAIL);
+				return(g->verdict);
+			}
+		}
+	}
+	if (!matched)
+		return(g->verdict);
+	for (int i = 0; i < g->nlimits; i++)
+		if (g->limits[i].ok < g->limits[i].need)
+			return(g->verdict);
+	gate_decide(g, GATE_PASS);
+	return(g->verdict);
+}
+
+int gate_format(const struct gate *g, char *buf, size_t bufsize)
+{
+	char	stats[64];
+
+	stats[0] = 0;
+	if (g->lenses)
+		_snprintf(stats, sizeof(stats), "; %d of %d passed, mean %.0f ms", g->passed, g->lenses, g->summillis / g->lenses);
+	stats[sizeof(stats) - 1] = 0;
+	if (g->verdict == GATE_FAIL) {
+		const struct gatelimit *l = &g->limits[g->failed];
+		return(_snprintf(buf, bufsize, "gate: FAIL %s %g outside %g..%g, after %u frames, %lu ms%s",
+			l->metric, l->worst, l->lo, l->hi, g->frames, (unsigned long)g->millis, stats));
+	}
+	if (g->verdict == GATE_PASS)
+		return(_snprintf(buf, bufsize, "gate: PASS after %u frames, %lu ms%s", g->frames, (unsigned long)g->millis, stats));
+	return(_snprintf(buf, bufsize, "gate: pending, %u frames%s", g->frames, stats));
+}
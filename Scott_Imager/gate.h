@@ -0,0 +1,59 @@
+#pragma once
+/*
+ *	gate.h
+ *
+ *	Pass/fail gating of a lens against spec limits, as results
+ *	come out of the analysis stages.
+ *
+ *	Limits are read from a text file, one per line:
+ *
+ *	    metric roi lo hi [need [maxbad]]
+ *
+ *	e.g. "psf.fwhmx * 0 3.5 20 2"; roi "*" is any ROI, '#' starts a
+ *	comment. Each result of a limit's metric and ROI is counted as in
+ *	or out of [lo,hi]. The lens fails as soon as any limit has had
+ *	maxbad (default 1) results out of spec, and passes as soon as
+ *	every limit has had need (default 1) results in spec. Once either
+ *	is decided, the verdict stands until gate_reset, and the caller
+ *	can stop capturing and analysing; the time to the verdict is kept
+ *	for the test time statistics.
+ */
+
+#include "results.h"
+
+#define GATE_MAXLIMITS	64
+
+#define GATE_PENDING	0
+#define GATE_PASS	1
+#define GATE_FAIL	(-1)
+
+struct gatelimit {
+	char	metric[RES_NAMELEN];
+	int	roi;	    // -1: any
+	double	lo;
+	double	hi;
+	int	need;	    // results in spec, to pass
+	int	maxbad;	    // results out of spec, to fail
+	int	ok;	    // counts since gate_reset
+	int	bad;
+	double	worst;	    // last value out of spec
+};
+
+struct gate {
+	int	nlimits;
+	struct	gatelimit limits[GATE_MAXLIMITS];
+	int	verdict;
+	int	failed;	    // limit that failed, if so
+	unsigned frames;    // frames analysed, to the verdict
+	DWORD	start;	    // GetTickCount at gate_reset
+	DWORD	millis;	    // to the verdict
+	int	lenses;	    // verdicts since gate_load, and their test times
+	int	passed;
+	double	summillis;
+};
+
+int	gate_load(struct gate *g, const char *path);
+void	gate_reset(struct gate *g);
+void	gate_frame(struct gate *g);
+int	gate_check(struct gate *g, const char *metric, int roi, double value);
+int	gate_format(const struct gate *g, char *buf, size_t bufsize);
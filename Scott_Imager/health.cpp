@@ -0,0 +1,183 @@
+/*
+ *	health.cpp
+ *
+ *	Capture health: missed frames and consumer lag.
+ *	See health.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "health.h"
+#include "metrics.h"
+
+static const char *health_names[HEALTH_CONSUMERS] = { "analysis", "display" };
+static	int	metmillis[HEALTH_CONSUMERS] = { -1, -1 };
+
+
+void health_reset(struct health *h)
+{
+	memset(h, 0, sizeof(*h));
+	metmillis[HEALTH_ANALYSIS] = met_histogram("scott_consume_ms", "consumer=\"analysis\"",
+		"Time to consume a captured frame", met_millis, MET_NMILLIS);
+	metmillis[HEALTH_DISPLAY] = met_histogram("scott_consume_ms", "consumer=\"display\"",
+		NULL, met_millis, MET_NMILLIS);
+	h->fpf = max(pxd_videoFieldsPerFrame(), 1);
+	h->interval = GetTickCount();
+	for (int u = 0; u < HEALTH_MAXUNITS && u < pxd_infoUnits(); u++) {
+		h->units[u].videofield = pxd_videoFieldCount(1 << u);
+		h->units[u].captfield = pxd_capturedFieldCount(1 << u);
+	}
+}
+
+/*
+ * Whether a consumer should skip the frame of the given field
+ * count, as throttled; only optional consumers are. Throttled
+ * to every 2^throttle'th frame, the frames passed over since
+ * the last consumed or skipped are counted as skipped; these
+ * may be several, as a consumer taking the latest frame sees
+ * only some.
+ */
+int health_skip(struct health *h, int unit, int stage, int optional, pxvbtime_t field)
+{
+	struct	healthunit *hu = &h->units[unit];
+	struct	healthstage *s = &hu->stages[stage];
+
+	if (!optional || !hu->throttle || !s->consumed || field <= s->lastfield
+	 || (field - s->usedfield) / h->fpf >= (1u << hu->throttle))
+		return(0);
+	s->skipped += (unsigned)((field - s->lastfield) / h->fpf);
+	s->lastfield = field;
+	return(1);
+}
+
+/*
+ * Count a frame consumed, given its field count, and the time
+ * taken. Frames captured since the last consumed or skipped,
+ * other than this, were missed; or superseded, if the consumer
+ * takes the latest frame. Returns the number of frames missed
+ * or superseded before it, or -1 if it was overwritten while
+ * queued.
+ */
+int health_consume(struct health *h, int unit, int stage, pxvbtime_t field, double millis, int latest)
+{
+	struct	healthstage *s = &h->units[unit].stages[stage];
+	int	missed = 0;
+
+	s->millis += millis;
+	s->millisnow += millis;
+	met_observe(metmillis[stage], millis);
+	s->lag = (int)((pxd_capturedFieldCount(1 << unit) - field) / h->fpf);
+	s->maxlag = max(s->maxlag, s->lag);
+	if (s->consumed && field <= s->lastfield) {
+		s->late++;
+		s->missednow++;
+		return(-1);
+	}
+	if (s->consumed) {
+		missed = (int)((field - s->lastfield) / h->fpf) - 1;
+		missed = max(missed, 0);
+	}
+	if (latest)
+		s->superseded += missed;
+	else {
+		s->missed += missed;
+		s->missednow += missed;
+	}
+	s->lastfield = s->usedfield = field;
+	s->consumed++;
+	return(missed);
+}
+
+/*
+ * Once per interval: capture rates and stalls, and throttling
+ * of optional consumers as per frames missed by analysis, or
+ * analysis busy for longer than the interval. Throttling
+ * changes how many frames analysis takes, not what each
+ * costs, so its whole load is what must fit.
+ * To be called periodically.
+ */
+void health_poll(struct health *h, int capturing)
+{
+	DWORD	now = GetTickCount();
+	DWORD	dt = now - h->interval;
+
+	if (dt < HEALTH_INTERVAL)
+		return;
+	for (int u = 0; u < HEALTH_MAXUNITS && u < pxd_infoUnits(); u++) {
+		struct healthunit *hu = &h->units[u];
+		pxvbtime_t video = pxd_videoFieldCount(1 << u);
+		pxvbtime_t capt = pxd_capturedFieldCount(1 << u);
+		struct healthstage *a = &hu->stages[HEALTH_ANALYSIS];
+		int	behind;
+
+		hu->videofps = 1000.0 * (video - hu->videofield) / (dt * h->fpf);
+		hu->captfps = 1000.0 * (capt - hu->captfield) / (dt * h->fpf);
+		if (capturing && video != hu->videofield && capt == hu->captfield)
+			hu->stalls++;
+		hu->videofield = video;
+		hu->captfield = capt;
+		behind = a->missednow || a->millisnow > dt;
+		for (int i = 0; i < HEALTH_CONSUMERS; i++) {
+			hu->stages[i].missednow = 0;
+			hu->stages[i].millisnow = 0;
+		}
+		if (behind) {
+			hu->throttle = min(hu->throttle + 1, HEALTH_MAXTHROTTLE);
+			hu->calm = 0;
+		}
+		else if (hu->throttle && ++hu->calm >= HEALTH_CALM) {
+			hu->throttle--;
+			hu->calm = 0;
+		}
+	}
+	h->interval = now;
+}
+
+int health_format(const struct health *h, int unit, char *buf, size_t bufsize)
+{
+	const struct healthunit *hu = &h->units[unit];
+	int	n;
+
+	n = _snprintf(buf, bufsize, "health: capture %.1f of %.1f fps, %u stalls",
+		hu->captfps, hu->videofps, hu->stalls);
+	for (int i = 0; i < HEALTH_CONSUMERS && n >= 0 && (size_t)n < bufsize; i++) {
+		const struct healthstage *s = &hu->stages[i];
+		int m = _snprintf(buf + n, bufsize - n, "; %s %u, %u missed, %u late, %u superseded, %u skipped, lag %d (max %d), %.1f ms",
+			health_names[i], s->consumed, s->missed, s->late, s->superseded, s->skipped, s->lag, s->maxlag,
+			s->consumed ? s->millis / s->consumed : 0.0);
+		n = m < 0 ? -1 : n + m;
+	}
+	if (n >= 0 && (size_t)n < bufsize && hu->throttle)
+		n += _snprintf(buf + n, bufsize - n, "; throttled to 1/%d", 1 << hu->throttle);
+	return(n);
+}
+
+/*
+ * Export a unit's health as metrics. The counts, kept
+ * since the last reset, i.e. the run's start, are counters.
+ */
+void health_metrics(const struct health *h, int unit)
+{
+	const struct healthunit *hu = &h->units[unit];
+	char	labels[MET_LABELLEN];
+
+	labels[sizeof(labels) - 1] = 0;
+	_snprintf(labels, sizeof(labels) - 1, "unit=\"%d\"", unit);
+	met_set(met_gauge("scott_capture_fps", labels, "Frames captured per second"), hu->captfps);
+	met_set(met_gauge("scott_video_fps", labels, "Video frames per second, captured or not"), hu->videofps);
+	met_set(met_counter("scott_capture_stalls_total", labels, "Intervals with video but no capture"), hu->stalls);
+	met_set(met_gauge("scott_throttle", labels, "Optional consumers take every 2^throttle'th frame"), hu->throttle);
+	for (int i = 0; i < HEALTH_CONSUMERS; i++) {
+		const struct healthstage *s = &hu->stages[i];
+		_snprintf(labels, sizeof(labels) - 1, "unit=\"%d\",consumer=\"%s\"", unit, health_names[i]);
+		met_set(met_counter("scott_frames_consumed_total", labels, "Frames consumed"), s->consumed);
+		met_set(met_counter("scott_frames_missed_total", labels, "Frames overwritten before consumed"), s->missed + s->late);
+		met_set(met_counter("scott_frames_superseded_total", labels, "Frames captured anew before consumed, taking the latest"), s->superseded);
+		met_set(met_counter("scott_frames_skipped_total", labels, "Frames skipped by choice, throttled"), s->skipped);
+		met_set(met_gauge("scott_consumer_lag_frames", labels, "Frames behind capture, when last consumed"), s->lag);
+	}
+}
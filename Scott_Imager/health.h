@@ -0,0 +1,79 @@
+#pragma once
+/*
+ *	health.h
+ *
+ *	Capture health: missed frames and consumer lag.
+ *
+ *	Each consumer of captured frames, i.e. analysis and display,
+ *	reports the field count of each frame it consumes, from
+ *	pxd_buffersFieldCount(). Consecutive frames are a frame's
+ *	fields apart; a larger step means frames were captured but
+ *	overwritten before this consumer got to them, and a step
+ *	backwards means the buffer was overwritten by a newer frame
+ *	while queued. Frames a consumer chose to skip aren't counted
+ *	as missed. Nor are they for a consumer which takes only the
+ *	latest frame, as in live capture; frames captured anew
+ *	meanwhile were superseded, as intended, and are counted so.
+ *	The grabber's own video field count, advancing whether or not
+ *	frames are captured, shows capture stalls.
+ *
+ *	Optional consumers, such as the display or the analysis of
+ *	live preview, can be throttled: once analysis misses frames,
+ *	or is busy for longer than the interval its frames came in,
+ *	they take only every 2nd, 4th, ... frame, and return to every
+ *	frame once analysis has kept up for a while. The display missing frames
+ *	is of no concern.
+ */
+
+extern "C" {
+#include "xcliball.h"
+}
+
+#define HEALTH_MAXUNITS	    4
+
+#define HEALTH_ANALYSIS	    0	// consumers
+#define HEALTH_DISPLAY	    1
+#define HEALTH_CONSUMERS    2
+
+#define HEALTH_MAXTHROTTLE  4	// every 16th frame, at most
+#define HEALTH_CALM	    5	// intervals keeping up, to throttle less
+#define HEALTH_INTERVAL	    1000	// millis
+
+struct healthstage {
+	pxvbtime_t lastfield;	// field count of the last frame consumed or skipped
+	pxvbtime_t usedfield;	// of the last frame consumed
+	unsigned consumed;
+	unsigned missed;	// overwritten before consumed
+	unsigned late;		// overwritten while queued
+	unsigned superseded;	// captured anew before consumed, taking the latest
+	unsigned skipped;	// by choice, throttled
+	unsigned missednow;	// missed in this interval
+	double	millisnow;	// consuming, in this interval
+	int	lag;		// frames behind the last captured, when last consumed
+	int	maxlag;
+	double	millis;		// consuming, in total
+};
+
+struct healthunit {
+	pxvbtime_t videofield;	// pxd_videoFieldCount, at the interval's start
+	pxvbtime_t captfield;	// pxd_capturedFieldCount, likewise
+	double	videofps;	// in the last interval
+	double	captfps;
+	unsigned stalls;	// intervals with video but no capture
+	int	throttle;	// optional consumers take every 2^throttle'th frame
+	int	calm;		// intervals keeping up
+	struct	healthstage stages[HEALTH_CONSUMERS];
+};
+
+struct health {
+	int	fpf;		// fields per frame
+	DWORD	interval;	// start of the interval, GetTickCount
+	struct	healthunit units[HEALTH_MAXUNITS];
+};
+
+void	health_reset(struct health *h);
+int	health_skip(struct health *h, int unit, int stage, int optional, pxvbtime_t field);
+int	health_consume(struct health *h, int unit, int stage, pxvbtime_t field, double millis, int latest);
+void	health_poll(struct health *h, int capturing);
+int	health_format(const struct health *h, int unit, char *buf, size_t bufsize);
+void	health_metrics(const struct health *h, int unit);
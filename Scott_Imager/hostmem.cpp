@@ -0,0 +1,187 @@
+/*
+ *	hostmem.cpp
+ *
+ *	Memory for host frames and accumulators.
+ *	See hostmem.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hostmem.h"
+
+#define MEM_HEADER	64		// before each block, keeping it aligned
+#define MEM_MAGIC	0x314D454DU
+
+#define MEM_KLARGE	0		// kinds of block
+#define MEM_KLOCKED	1
+#define MEM_KPAGED	2
+#define MEM_KINDS	3
+
+struct memblock {
+	unsigned magic;
+	int	kind;
+	size_t	size;			// of the region, header included
+	size_t	bytes;			// as asked for
+};
+
+static	const char *kindnames[MEM_KINDS] = { "in large pages", "locked", "pageable" };
+
+static	int	    memflags = 0;
+static	size_t	    largemin = 0;	// large page size; 0: not to be used
+static	int	    noright = 0;	// large pages asked for, but not allowed
+static	unsigned    largefails = 0;	// fell back to normal pages
+static	unsigned    lockfails = 0;	// couldn't be locked
+static	struct {
+	unsigned blocks;
+	size_t	bytes;
+}		    held[MEM_KINDS];
+
+
+/*
+ * Enable SeLockMemoryPrivilege for the process, as needed for
+ * large pages; the user must have been granted the right.
+ */
+static int mem_privilege(void)
+{
+	HANDLE	token;
+	TOKEN_PRIVILEGES tp;
+	int	ok;
+
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		return(0);
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	ok = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+	  && AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL)
+	  && GetLastError() == ERROR_SUCCESS;	// not ERROR_NOT_ALL_ASSIGNED
+	CloseHandle(token);
+	return(ok);
+}
+
+/*
+ * Select what is to be tried for blocks allocated from now
+ * on. Returns the flags which can be had, as far as known
+ * before allocating.
+ */
+int mem_init(int flags)
+{
+	memflags = flags;
+	largemin = 0;
+	noright = 0;
+	if (flags & MEM_LARGE) {
+		largemin = GetLargePageMinimum();
+		if (largemin && !mem_privilege()) {
+			largemin = 0;
+			noright = 1;
+		}
+	}
+	return((largemin ? MEM_LARGE : 0) | (flags & MEM_LOCK));
+}
+
+/*
+ * Lock a region in the working set, which must first
+ * be grown to hold it.
+ */
+static int mem_lock(void *p, size_t size)
+{
+	SIZE_T	lo, hi;
+
+	if (!GetProcessWorkingSetSize(GetCurrentProcess(), &lo, &hi))
+		return(0);
+	if (!SetProcessWorkingSetSize(GetCurrentProcess(), lo + size, hi + size))
+		return(0);
+	if (VirtualLock(p, size))
+		return(1);
+	SetProcessWorkingSetSize(GetCurrentProcess(), lo, hi);
+	return(0);
+}
+
+/*
+ * Allocate a block, in large pages if possible and worth it,
+ * i.e. at least half a large page, else in normal pages,
+ * locked if so selected. Returns NULL if out of memory.
+ */
+void *mem_alloc(size_t bytes)
+{
+	size_t	size = bytes + MEM_HEADER;
+	struct	memblock *b = NULL;
+	int	kind = MEM_KPAGED;
+
+	if (largemin && size >= largemin / 2) {
+		size_t	rsize = (size + largemin - 1) / largemin * largemin;
+		b = (struct memblock*)VirtualAlloc(NULL, rsize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (b) {
+			size = rsize;
+			kind = MEM_KLARGE;
+		}
+		else
+			largefails++;
+	}
+	if (!b) {
+		b = (struct memblock*)VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (!b)
+			return(NULL);
+		if (memflags & MEM_LOCK) {
+			if (mem_lock(b, size))
+				kind = MEM_KLOCKED;
+			else
+				lockfails++;
+		}
+	}
+	b->magic = MEM_MAGIC;
+	b->kind = kind;
+	b->size = size;
+	b->bytes = bytes;
+	held[kind].blocks++;
+	held[kind].bytes += size;
+	return((char*)b + MEM_HEADER);
+}
+
+void mem_free(void *p)
+{
+	struct	memblock *b;
+
+	if (!p)
+		return;
+	b = (struct memblock*)((char*)p - MEM_HEADER);
+	if (b->magic != MEM_MAGIC)
+		return;
+	held[b->kind].blocks--;
+	held[b->kind].bytes -= b->size;
+	b->magic = 0;
+	if (b->kind == MEM_KLOCKED) {
+		SIZE_T	lo, hi;
+		size_t	size = b->size;
+		VirtualUnlock(b, size);
+		if (GetProcessWorkingSetSize(GetCurrentProcess(), &lo, &hi) && lo > size)
+			SetProcessWorkingSetSize(GetCurrentProcess(), lo - size, hi - size);
+	}
+	VirtualFree(b, 0, MEM_RELEASE);
+}
+
+/*
+ * What was obtained, of the blocks now held, and what
+ * fell back.
+ */
+int mem_format(char *buf, size_t bufsize)
+{
+	int	n;
+
+	if (largemin)
+		n = _snprintf(buf, bufsize, "memory: large pages of %u KB", (unsigned)(largemin >> 10));
+	else if (noright)
+		n = _snprintf(buf, bufsize, "memory: no large pages, lacking the Lock pages in memory right");
+	else
+		n = _snprintf(buf, bufsize, "memory: %s", memflags & MEM_LARGE ? "no large pages" : "large pages not used");
+	for (int k = 0; k < MEM_KINDS && n >= 0 && (size_t)n < bufsize; k++) {
+		int m = _snprintf(buf + n, bufsize - n, "; %.1f MB %s (%u)", held[k].bytes / 1048576.0, kindnames[k], held[k].blocks);
+		n = m < 0 ? -1 : n + m;
+	}
+	if (n >= 0 && (size_t)n < bufsize && (largefails || lockfails))
+		n += _snprintf(buf + n, bufsize - n, "; %u not in large pages, %u not locked", largefails, lockfails);
+	return(n);
+}
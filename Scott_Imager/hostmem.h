@@ -0,0 +1,29 @@
+#pragma once
+/*
+ *	hostmem.h
+ *
+ *	Memory for host frames and accumulators.
+ *
+ *	A multi-megapixel frame spans thousands of 4 KB pages, more
+ *	than the TLB holds, so a kernel streaming over a few frames
+ *	misses the TLB every page. Large pages (2 MB on x64) cut the
+ *	misses by 512. They need the "Lock pages in memory" user
+ *	right (SeLockMemoryPrivilege), and enough contiguous free
+ *	memory, which becomes scarce the longer Windows has run.
+ *	Large pages are never paged out; other buffers may be locked
+ *	into the working set, so that a long run isn't paged out
+ *	while idle. Whatever can't be had falls back quietly: to
+ *	normal pages, then to unlocked memory. mem_format() reports
+ *	what was obtained.
+ *
+ *	Blocks are aligned to at least 64 bytes. To be used from one
+ *	thread, such as the dialog's.
+ */
+
+#define MEM_LARGE	1	// mem_init flags: large pages, if possible
+#define MEM_LOCK	2	// lock other blocks in the working set
+
+int	mem_init(int flags);
+void	*mem_alloc(size_t bytes);
+void	mem_free(void *p);
+int	mem_format(char *buf, size_t bufsize);
@@ -0,0 +1,181 @@
+/*
+ *	kernels.cpp
+ *
+ *	Pixel kernels used by the lens characterisation pipeline.
+ *	See kernels.h.
+ */
+#include <stdlib.h>
+
+#include "kernels.h"
+
+#if KERN_SSE2
+#include <emmintrin.h>
+#endif
+
+int kern_simd = KERN_SSE2;
+
+
+/*
+ * Add n pixels into 32 bit accumulators.
+ */
+void kern_accumulate(uint *acc, const ushort *src, size_t n)
+{
+	size_t	i = 0;
+
+#if KERN_SSE2
+	if (kern_simd) {
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 8 <= n; i += 8) {
+			__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+			__m128i a0 = _mm_loadu_si128((const __m128i*)(acc + i));
+			__m128i a1 = _mm_loadu_si128((const __m128i*)(acc + i + 4));
+			a0 = _mm_add_epi32(a0, _mm_unpacklo_epi16(s, zero));
+			a1 = _mm_add_epi32(a1, _mm_unpackhi_epi16(s, zero));
+			_mm_storeu_si128((__m128i*)(acc + i), a0);
+			_mm_storeu_si128((__m128i*)(acc + i + 4), a1);
+		}
+	}
+#endif
+	for (; i < n; i++)
+		acc[i] += src[i];
+}
+
+/*
+ * Convert accumulated sums of count frames back to rounded pixel means.
+ */
+void kern_average(ushort *dst, const uint *acc, size_t n, int count)
+{
+	size_t	i = 0;
+
+	if (count <= 0)
+		return;
+#if KERN_SSE2
+	if (kern_simd) {
+		//
+		// Rounded half up, as the scalar form: the sums, made
+		// signed by flipping the top bit, are exact in double;
+		// (sum + count/2) / count is truncated, i.e. floored.
+		// SSE2 lacks an unsigned 32->16 pack; bias into signed
+		// range, pack with signed saturation, and unbias.
+		//
+		const __m128d half = _mm_set1_pd(2147483648.0 + count / 2);
+		const __m128d divisor = _mm_set1_pd((double)count);
+		const __m128i flip = _mm_set1_epi32((int)0x80000000);
+		const __m128i bias32 = _mm_set1_epi32(32768);
+		const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+		for (; i + 8 <= n; i += 8) {
+			__m128i a0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(acc + i)), flip);
+			__m128i a1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(acc + i + 4)), flip);
+			a0 = _mm_unpacklo_epi64(
+				_mm_cvttpd_epi32(_mm_div_pd(_mm_add_pd(_mm_cvtepi32_pd(a0), half), divisor)),
+				_mm_cvttpd_epi32(_mm_div_pd(_mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(a0, 8)), half), divisor)));
+			a1 = _mm_unpacklo_epi64(
+				_mm_cvttpd_epi32(_mm_div_pd(_mm_add_pd(_mm_cvtepi32_pd(a1), half), divisor)),
+				_mm_cvttpd_epi32(_mm_div_pd(_mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(a1, 8)), half), divisor)));
+			a0 = _mm_sub_epi32(a0, bias32);
+			a1 = _mm_sub_epi32(a1, bias32);
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(a0, a1), bias16));
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		uint	v = (acc[i] + count / 2) / count;
+		dst[i] = (ushort)(v > 0xFFFF ? 0xFFFF : v);	// saturated, as by the pack
+	}
+}
+
+/*
+ * Add those of n pixels which lie within [lo, hi] into 32 bit
+ * accumulators, their squares into 64 bit accumulators, and
+ * count them. Used for sigma clipped averaging; the squares
+ * are kept exactly, a float's 24 bits being too few for the
+ * variance of 14 and 16 bit pixels.
+ */
+void kern_accumulateClip(uint *acc, ULONGLONG *accsq, ushort *count, const ushort *src,
+			 const ushort *lo, const ushort *hi, size_t n)
+{
+	size_t	i = 0;
+
+#if KERN_SSE2
+	if (kern_simd) {
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 8 <= n; i += 8) {
+			__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+			__m128i l = _mm_loadu_si128((const __m128i*)(lo + i));
+			__m128i h = _mm_loadu_si128((const __m128i*)(hi + i));
+			//
+			// Both saturating differences are zero
+			// only if lo <= s <= hi.
+			//
+			__m128i m = _mm_cmpeq_epi16(_mm_or_si128(_mm_subs_epu16(l, s), _mm_subs_epu16(s, h)), zero);
+			__m128i c = _mm_loadu_si128((const __m128i*)(count + i));
+			_mm_storeu_si128((__m128i*)(count + i), _mm_sub_epi16(c, m));
+			s = _mm_and_si128(s, m);
+			__m128i s0 = _mm_unpacklo_epi16(s, zero);
+			__m128i s1 = _mm_unpackhi_epi16(s, zero);
+			__m128i a0 = _mm_loadu_si128((const __m128i*)(acc + i));
+			__m128i a1 = _mm_loadu_si128((const __m128i*)(acc + i + 4));
+			_mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi32(a0, s0));
+			_mm_storeu_si128((__m128i*)(acc + i + 4), _mm_add_epi32(a1, s1));
+			//
+			// 32 bit squares from their low and high halves,
+			// widened to 64 bits, two to a register.
+			//
+			__m128i ql = _mm_mullo_epi16(s, s);
+			__m128i qh = _mm_mulhi_epu16(s, s);
+			__m128i q[2] = { _mm_unpacklo_epi16(ql, qh), _mm_unpackhi_epi16(ql, qh) };
+			for (int k = 0; k < 2; k++) {
+				__m128i *p = (__m128i*)(accsq + i + 4 * k);
+				_mm_storeu_si128(p, _mm_add_epi64(_mm_loadu_si128(p), _mm_unpacklo_epi32(q[k], zero)));
+				_mm_storeu_si128(p + 1, _mm_add_epi64(_mm_loadu_si128(p + 1), _mm_unpackhi_epi32(q[k], zero)));
+			}
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		if (src[i] < lo[i] || src[i] > hi[i])
+			continue;
+		acc[i] += src[i];
+		accsq[i] += (uint)src[i] * src[i];
+		count[i]++;
+	}
+}
+
+/*
+ * Flat field correction, in place:
+ *	pix = clamp((pix - dark) * gain)
+ * with gain in KERN_GAINSHIFT fixed point.
+ *
+ * For up to 14 bit pixels the dark subtracted value can be
+ * pre-shifted so that a single 16x16 high multiply yields the
+ * corrected value, 8 pixels at a time.
+ */
+void kern_flatfield(ushort *pix, const ushort *dark, const ushort *gain, size_t n, int bits)
+{
+	size_t	i = 0;
+	uint	maxval = (1u << bits) - 1;
+
+#if KERN_SSE2
+	if (kern_simd && bits <= KERN_GAINSHIFT) {
+		//
+		// SSE2 also lacks an unsigned 16 bit min;
+		// clamp by saturating up and back down.
+		//
+		const __m128i ceil = _mm_set1_epi16((short)(0xFFFF - maxval));
+		for (; i + 8 <= n; i += 8) {
+			__m128i p = _mm_loadu_si128((const __m128i*)(pix + i));
+			__m128i d = _mm_loadu_si128((const __m128i*)(dark + i));
+			__m128i g = _mm_loadu_si128((const __m128i*)(gain + i));
+			p = _mm_slli_epi16(_mm_subs_epu16(p, d), 16 - KERN_GAINSHIFT);
+			p = _mm_mulhi_epu16(p, g);
+			p = _mm_subs_epu16(_mm_adds_epu16(p, ceil), ceil);
+			_mm_storeu_si128((__m128i*)(pix + i), p);
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		uint v = pix[i] > dark[i] ? pix[i] - dark[i] : 0;
+		v = (v * gain[i]) >> KERN_GAINSHIFT;
+		pix[i] = (ushort)(v > maxval ? maxval : v);
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+/*
+ *	kernels.h
+ *
+ *	Pixel kernels used by the lens characterisation pipeline.
+ *
+ *	Each kernel has a portable scalar form and, where it pays,
+ *	an SSE2 form. SSE2 is always present on Win64 builds; kern_simd
+ *	selects between the two at run time so both can be compared.
+ */
+
+extern "C" {
+#include "xcliball.h"
+}
+
+#if !defined(KERN_SSE2)
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define KERN_SSE2   1
+#else
+#define KERN_SSE2   0
+#endif
+#endif
+
+/*
+ * Fixed point precision of gain maps, i.e. 1.0 == 1<<KERN_GAINSHIFT.
+ */
+#define KERN_GAINSHIFT	14
+
+extern int  kern_simd;	    // 0: force scalar kernels
+
+void	kern_accumulate(uint *acc, const ushort *src, size_t n);
+void	kern_average(ushort *dst, const uint *acc, size_t n, int count);
+void	kern_accumulateClip(uint *acc, ULONGLONG *accsq, ushort *count, const ushort *src,
+			    const ushort *lo, const ushort *hi, size_t n);
+void	kern_flatfield(ushort *pix, const ushort *dark, const ushort *gain, size_t n, int bits);
@@ -0,0 +1,266 @@
+/*
+ *	lca.cpp
+ *
+ *	Lateral chromatic aberration from edges in colour frames.
+ *	See lca.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <math.h>
+
+#include "lca.h"
+#include "results.h"
+#include "workers.h"
+
+#define LCA_WINDOW	6	// half width of the centroid window about the edge
+#define LCA_MINRISE	0.2	// edge step, relative to the ROI's range
+#define LCA_MINRADIAL	0.3	// least radial component of the edge normal
+
+
+int lca_alloc(struct lca *l, int grid, int size)
+{
+	memset(l, 0, sizeof(*l));
+	l->grid = grid;
+	l->size = size;
+	l->nrois = grid * grid;
+	l->rois = (struct lcaroi*)calloc(l->nrois, sizeof(struct lcaroi));
+	l->planes = (ushort*)_aligned_malloc((size_t)3 * size * size * l->nrois * sizeof(ushort), 16);
+	if (!l->rois || !l->planes) {
+		lca_free(l);
+		return(PXERMALLOC);
+	}
+	return(0);
+}
+
+void lca_free(struct lca *l)
+{
+	if (l->rois)
+		free(l->rois);
+	if (l->planes)
+		_aligned_free(l->planes);
+	memset(l, 0, sizeof(*l));
+}
+
+/*
+ * Place one ROI, centred at x, y as far as the frame allows.
+ */
+static void lca_centre(struct lca *l, struct lcaroi *r, const struct hostframe *f, int x, int y)
+{
+	double	cx = (f->xdim - 1) / 2.0, cy = (f->ydim - 1) / 2.0;
+	double	norm = sqrt(cx * cx + cy * cy);
+
+	r->x0 = min(max(x - l->size / 2, 0), f->xdim - l->size);
+	r->y0 = min(max(y - l->size / 2, 0), f->ydim - l->size);
+	x = r->x0 + l->size / 2;
+	y = r->y0 + l->size / 2;
+	r->field = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy)) / norm;
+}
+
+/*
+ * Lay out the ROIs, centred on a regular grid,
+ * for the frame's geometry.
+ */
+static void lca_layout(struct lca *l, const struct hostframe *f)
+{
+	if (l->xdim == f->xdim && l->ydim == f->ydim)
+		return;
+	l->xdim = f->xdim;
+	l->ydim = f->ydim;
+	l->nrois = l->grid * l->grid;
+	for (int j = 0; j < l->grid; j++) {
+		for (int i = 0; i < l->grid; i++) {
+			l->rois[j * l->grid + i].id = j * l->grid + i;
+			lca_centre(l, &l->rois[j * l->grid + i], f,
+				   (int)((i + 0.5) * f->xdim / l->grid), (int)((j + 0.5) * f->ydim / l->grid));
+		}
+	}
+}
+
+/*
+ * Use found edges, such as tracked by roi_update(), instead
+ * of the grid, for the next lca_measure() of the same frame;
+ * at most grid*grid of them. With none, the grid is restored.
+ * Each is centred where its edge ROI is centred, and keeps
+ * that ROI's index as its id, so that results of an edge
+ * stay together as others are lost.
+ */
+void lca_place(struct lca *l, const struct hostframe *f, const struct roiset *rs)
+{
+	int	n = 0;
+
+	for (int i = 0; i < rs->nrois && n < l->grid * l->grid; i++) {
+		const struct roi *e = &rs->rois[i];
+		if (!e->valid)
+			continue;
+		l->rois[n].id = i;
+		lca_centre(l, &l->rois[n++], f, e->x0 + rs->size / 2, e->y0 + rs->size / 2);
+	}
+	l->nrois = n;
+	l->xdim = n ? f->xdim : 0;	// no grid layout; or, with none, lay out again
+	l->ydim = n ? f->ydim : 0;
+}
+
+/*
+ * Measure one ROI; in parallel over ROIs.
+ */
+struct roictx {
+	struct	lca *l;
+	const struct hostframe *f;
+};
+
+static void lca_roiFn(void *ctx, int index)
+{
+	struct	roictx *c = (struct roictx*)ctx;
+	struct	lca *l = c->l;
+	const struct hostframe *f = c->f;
+	struct	lcaroi *r = &l->rois[index];
+	int	n = l->size;
+	ushort	*R = l->planes + (size_t)3 * n * n * index, *G = R + n * n, *B = G + n * n;
+	int	glo = 65535, ghi = 0;
+	double	sx = 0, sy = 0;
+
+	r->valid = 0;
+
+	//
+	// Deinterleave, in one pass over the ROI's pixels,
+	// noting the green range and gradient as we go.
+	//
+	for (int y = 0; y < n; y++) {
+		const ushort *p = f->pix + ((size_t)(r->y0 + y) * f->xdim + r->x0) * 3;
+		ushort *pr = R + y * n, *pg = G + y * n, *pb = B + y * n;
+		for (int x = 0; x < n; x++, p += 3) {
+			pr[x] = p[0];
+			pg[x] = p[1];
+			pb[x] = p[2];
+			glo = min(glo, (int)p[1]);
+			ghi = max(ghi, (int)p[1]);
+		}
+		for (int x = 1; x < n; x++)
+			sx += abs(pg[x] - pg[x - 1]);
+		if (y)
+			for (int x = 0; x < n; x++)
+				sy += abs(pg[x] - pg[x - n]);
+	}
+	if (ghi - glo < 16)
+		return;
+
+	//
+	// Scan across the edge: along x for a vertical edge,
+	// along y for a horizontal one.
+	//
+	int	vertical = sx > sy;
+	int	kstride = vertical ? 1 : n;	// along the scan
+	int	lstride = vertical ? n : 1;	// from scan to scan
+	double	srg = 0, sbg = 0, sedge = 0;
+	int	lines = 0;
+
+	for (int ln = 0; ln < n; ln++) {
+		int off = ln * lstride, pk = 0, dpk = -1;
+		for (int k = 0; k < n - 1; k++) {
+			int d = abs(G[off + (k + 1) * kstride] - G[off + k * kstride]);
+			if (d > dpk) {
+				dpk = d;
+				pk = k;
+			}
+		}
+		if (dpk < LCA_MINRISE * (ghi - glo) / 4)
+			continue;
+		int k0 = max(pk - LCA_WINDOW, 0), k1 = min(pk + LCA_WINDOW, n - 2);
+		double w[3] = { 0, 0, 0 }, m[3] = { 0, 0, 0 };
+		for (int k = k0; k <= k1; k++) {
+			int a = off + k * kstride, b = a + kstride;
+			double dr = abs(R[b] - R[a]), dg = abs(G[b] - G[a]), db = abs(B[b] - B[a]);
+			w[0] += dr; m[0] += dr * k;
+			w[1] += dg; m[1] += dg * k;
+			w[2] += db; m[2] += db * k;
+		}
+		if (w[0] <= 0 || w[1] <= 0 || w[2] <= 0)
+			continue;
+		srg += m[0] / w[0] - m[1] / w[1];
+		sbg += m[2] / w[2] - m[1] / w[1];
+		sedge += m[1] / w[1] + 0.5;
+		lines++;
+	}
+	if (lines < n / 4)
+		return;
+
+	//
+	// Project onto the radial direction at the ROI.
+	//
+	double	rx = r->x0 + n / 2.0 - (f->xdim - 1) / 2.0;
+	double	ry = r->y0 + n / 2.0 - (f->ydim - 1) / 2.0;
+	double	rr = sqrt(rx * rx + ry * ry);
+	double	radial = rr > 0 ? (vertical ? rx : ry) / rr : 0;
+	if (fabs(radial) < LCA_MINRADIAL)
+		return;
+	r->vertical = vertical;
+	r->edge = sedge / lines;
+	r->rg = srg / lines / radial;
+	r->bg = sbg / lines / radial;
+	r->valid = 1;
+}
+
+/*
+ * Measure one frame. Monochrome frames have no lateral colour.
+ */
+int lca_measure(struct lca *l, const struct hostframe *f)
+{
+	struct	roictx c;
+
+	if (f->cdim != 3 || f->xdim < l->size || f->ydim < l->size)
+		return(0);
+	lca_layout(l, f);
+	c.l = l;
+	c.f = f;
+	wrk_parallel(l->nrois, lca_roiFn, &c);
+	return(0);
+}
+
+/*
+ * Summarize, for display: the outermost ROI with
+ * a usable edge, and the largest offsets anywhere.
+ */
+int lca_format(const struct lca *l, char *buf, size_t bufsize)
+{
+	const struct lcaroi *out = NULL;
+	double	maxrg = 0, maxbg = 0;
+	int	valid = 0;
+
+	for (int i = 0; i < l->nrois; i++) {
+		const struct lcaroi *r = &l->rois[i];
+		if (!r->valid)
+			continue;
+		valid++;
+		if (!out || r->field > out->field)
+			out = r;
+		maxrg = max(maxrg, fabs(r->rg));
+		maxbg = max(maxbg, fabs(r->bg));
+	}
+	if (!out)
+		return(_snprintf(buf, bufsize, "lca: no edges"));
+	return(_snprintf(buf, bufsize, "lca: @%.2f R-G %+.2f B-G %+.2f px  max |R-G| %.2f |B-G| %.2f px  rois %d/%d",
+		out->field, out->rg, out->bg, maxrg, maxbg, valid, l->nrois));
+}
+
+/*
+ * Record each ROI's offsets; the ROI is its id.
+ */
+int lca_record(const struct lca *l, struct results *r)
+{
+	int	err = 0;
+
+	for (int i = 0; i < l->nrois && err >= 0; i++) {
+		const struct lcaroi *o = &l->rois[i];
+		if (!o->valid)
+			continue;
+		err = res_add(r, "lca.rg", o->id, o->rg);
+		if (err >= 0)
+			err = res_add(r, "lca.bg", o->id, o->bg);
+	}
+	return(err);
+}
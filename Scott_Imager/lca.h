@@ -0,0 +1,53 @@
+#pragma once
+/*
+ *	lca.h
+ *
+ *	Lateral chromatic aberration from edges in colour frames.
+ *
+ *	Regions of interest are laid out as a grid across the field.
+ *	Each ROI's interleaved RGB pixels are split into planar R, G
+ *	and B in a single pass, and then, line by line across the
+ *	dominant edge, the edge's sub-pixel position is found in all
+ *	three planes together, as the centroid of the line's derivative
+ *	within a window about the green edge. The R-G and B-G offsets,
+ *	averaged over the lines, are projected onto the radial direction,
+ *	as lateral colour displaces the channels radially.
+ *	ROIs are measured in parallel.
+ *
+ *	Alternatively, the ROIs can be placed on edges found and
+ *	tracked by roi.h, with lca_place().
+ */
+
+#include "frame.h"
+#include "roi.h"
+
+struct	results;
+
+struct lcaroi {
+	int	id;	    // grid index, or the index of the roi.h ROI placed on
+	int	x0;	    // top left, pixels
+	int	y0;
+	double	field;	    // distance of the ROI centre from the image centre, relative to the half diagonal
+	int	valid;	    // an edge was found, with a usable radial component
+	int	vertical;   // edge runs vertically, so is located along x
+	double	edge;	    // green edge position within the ROI, along x or y
+	double	rg;	    // red less green, radial, pixels
+	double	bg;	    // blue less green, radial, pixels
+};
+
+struct lca {
+	int	grid;	    // ROIs per side
+	int	size;	    // ROI side, pixels
+	int	nrois;
+	struct	lcaroi *rois;
+	ushort	*planes;    // per ROI: R, G and B planes, size*size each
+	int	xdim;	    // frame geometry the ROIs are laid out for
+	int	ydim;
+};
+
+int	lca_alloc(struct lca *l, int grid, int size);
+void	lca_free(struct lca *l);
+void	lca_place(struct lca *l, const struct hostframe *f, const struct roiset *rs);
+int	lca_measure(struct lca *l, const struct hostframe *f);
+int	lca_format(const struct lca *l, char *buf, size_t bufsize);
+int	lca_record(const struct lca *l, struct results *r);
@@ -0,0 +1,60 @@
+/*
+ *	lsq.cpp
+ *
+ *	Small dense linear least squares, for the analysis stages' model fits.
+ *	See lsq.h.
+ */
+#include <math.h>
+
+#include "lsq.h"
+
+
+/*
+ * Add one observation y = v . x to normal equations m, r.
+ */
+void lsq_add(double *m, double *r, const double *v, double y, int n)
+{
+	for (int a = 0; a < n; a++) {
+		for (int b = 0; b < n; b++)
+			m[a * n + b] += v[a] * v[b];
+		r[a] += v[a] * y;
+	}
+}
+
+/*
+ * Solve n x n linear system a x = b in place, b <- x,
+ * by Gaussian elimination with partial pivoting.
+ */
+int lsq_solve(double *a, double *b, int n)
+{
+	for (int c = 0; c < n; c++) {
+		int p = c;
+		for (int r = c + 1; r < n; r++)
+			if (fabs(a[r * n + c]) > fabs(a[p * n + c]))
+				p = r;
+		if (fabs(a[p * n + c]) < 1e-300)
+			return(-1);
+		if (p != c) {
+			for (int k = 0; k < n; k++) {
+				double t = a[c * n + k];
+				a[c * n + k] = a[p * n + k];
+				a[p * n + k] = t;
+			}
+			double t = b[c];
+			b[c] = b[p];
+			b[p] = t;
+		}
+		for (int r = c + 1; r < n; r++) {
+			double m = a[r * n + c] / a[c * n + c];
+			for (int k = c; k < n; k++)
+				a[r * n + k] -= m * a[c * n + k];
+			b[r] -= m * b[c];
+		}
+	}
+	for (int c = n - 1; c >= 0; c--) {
+		for (int k = c + 1; k < n; k++)
+			b[c] -= a[c * n + k] * b[k];
+		b[c] /= a[c * n + c];
+	}
+	return(0);
+}
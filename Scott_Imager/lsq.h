@@ -0,0 +1,12 @@
+#pragma once
+/*
+ *	lsq.h
+ *
+ *	Small dense linear least squares, for the analysis stages' model fits.
+ *
+ *	Observations are accumulated into the n x n normal equations,
+ *	which are then solved in place; n is at most a dozen or so.
+ */
+
+void	lsq_add(double *m, double *r, const double *v, double y, int n);
+int	lsq_solve(double *a, double *b, int n);
@@ -172,6 +172,9 @@
 #define SAVE_TIFF	1
 #define SAVE_BINARY 0
 #define SAVE_AVI	0
+#endif
+#if !defined(SAVE_DIRECT)
+#define SAVE_DIRECT 1	// binary saves, incl. ring capture, bypass the file cache; see seqfile.h
 #endif
 
 
@@ -212,6 +215,140 @@
 					// trigger before ending sequence capture
 
 
+/*
+ *  4c) Select the number of frames averaged into each master
+ *	frame by the dark frame and flat field calibrations.
+ *	More frames reduce the temporal noise left in the
+ *	master frames; the calibration takes proportionally longer.
+ *	Which processing stages are applied to each captured
+ *	frame is selected in PIPELINE.CPP.
+ */
+#if !defined(FLATFIELD_FRAMES)
+#define FLATFIELD_FRAMES    16
+#endif
+
+
+/*
+ *  4d) Select the frames kept around a trigger by ring capture
+ *	(IDRINGCAPTURE). Capture runs continuously through the
+ *	frame buffers until a G.P. trigger on an input of RING_GPIN, or
+ *	IDRINGTRIGGER; RING_POST more frames are then captured,
+ *	and the RING_PRE frames before the trigger, its frame, and
+ *	the RING_POST frames after are saved per unit to RING_FILE
+ *	(with the trigger's tick count and the unit). Frames aren't
+ *	read from the frame buffers until then. Needs at least
+ *	RING_PRE + RING_POST + 3 frame buffers; see ring.h.
+ */
+#if !defined(RING_PRE)
+#define RING_PRE	    8
+#define RING_POST	    8
+#endif
+#if !defined(RING_GPIN)
+#define RING_GPIN	    0x01	// which G.P. trigger inputs, as a bitmap; 0: software only
+#endif
+#if !defined(RING_FILE)
+#define RING_FILE	    "ring_%lu_unit%d.bin"
+#endif
+
+
+/*
+ *  4e) Select whether, once analysis falls behind capture, i.e.
+ *	misses frames, or takes longer per frame than a frame lasts,
+ *	the display and the analysis of live video should take only
+ *	every 2nd, 4th, ... frame, until analysis keeps up again.
+ *	Analysis of sequence capture always takes every frame.
+ *	Missed frames and consumer lag are reported regardless;
+ *	see health.h.
+ */
+#if !defined(CAPTURE_THROTTLE)
+#define CAPTURE_THROTTLE    1
+#endif
+
+
+/*
+ *  4f) Select how errors and asynchronous faults, such as video
+ *	loss while capturing, are handled during a run. Rather than
+ *	stopping the run in a dialog awaiting the operator, each is
+ *	logged to the console and appended to FAULT_LOG, and capture
+ *	is, as per its kind, left as is, restarted (FAULT_RETRY), or
+ *	restarted after closing and reopening the frame grabber
+ *	(FAULT_REOPEN), or the run is stopped (FAULT_ABORT). Taken
+ *	more than FAULT_RETRIES times within FAULT_WINDOW millis,
+ *	an action escalates to the next. See fault.h.
+ */
+#if !defined(FAULT_LOG)
+#define FAULT_LOG	    "faults.log"	// NULL: console only
+#endif
+#if !defined(FAULT_VIDEO_ACTION)
+#define FAULT_VIDEO_ACTION  FAULT_RETRY	// asynchronous faults, such as video loss
+#define FAULT_ERROR_ACTION  FAULT_IGNORE	// errors returned by functions
+#endif
+#if !defined(FAULT_RETRIES)
+#define FAULT_RETRIES	    3
+#define FAULT_WINDOW	    60000
+#endif
+
+
+/*
+ *  4g) Select the cores set aside for capture: the highest
+ *	CAPTURE_CORES cores are kept free of the analysis workers,
+ *	the writer threads are pinned to the next WRITER_CORES, if
+ *	any, and the analysis workers to the remaining cores, one
+ *	worker per core. The dialog's thread, which notices each
+ *	captured frame but also analyses and displays it, is left
+ *	unpinned at normal priority, so as not to starve capture
+ *	threads, and finds the cores set aside idle. 0 leaves
+ *	threads unplaced.
+ *	The CPU time used by each thread is reported at the end of
+ *	each run. See place.h.
+ */
+#if !defined(CAPTURE_CORES)
+#define CAPTURE_CORES	    1
+#define WRITER_CORES	    0
+#define CAPTURE_PRIORITY    HIGH_PRIORITY_CLASS	// of the process; 0: as is
+#endif
+
+
+/*
+ *  4h) Select whether host frames, calibration masters and
+ *	accumulators are to be in large pages, which needs the
+ *	"Lock pages in memory" user right, and whether otherwise
+ *	they are to be locked in memory, so as not to be paged out
+ *	during long runs. What was obtained is reported at startup;
+ *	see hostmem.h.
+ */
+#if !defined(HOST_LARGEPAGES)
+#define HOST_LARGEPAGES	    1
+#endif
+#if !defined(HOST_LOCKED)
+#define HOST_LOCKED	    1
+#endif
+
+
+/*
+ *  4i) Select where the trace of each run is written, as
+ *	Chrome trace-event JSON, when tracing is compiled in with
+ *	TRACE defined as 1; see trace.h. The file is rewritten at
+ *	the end of each run, with the spans of that run.
+ */
+#if !defined(TRACE_FILE)
+#define TRACE_FILE	    "Scott_Imager.trace.json"
+#endif
+
+
+/*
+ *  4j) Select where metrics are written once per second, in the
+ *	Prometheus text format: capture rates, missed frames, consumer
+ *	lag and latency, writer throughput, worker pool usage and
+ *	faults. Point the node exporter's textfile collector at its
+ *	directory, naming the file *.prom. NULL to not write
+ *	them. See metrics.h.
+ */
+#if !defined(METRICS_FILE)
+#define METRICS_FILE	    "Scott_Imager.prom"
+#endif
+
+
 /*
  *  4)	Compile
  *	    XCLIBEX4.CPP
@@ -247,6 +384,7 @@
 #include <windowsx.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #if SHOWIM_DRAWDIBDRAW || SHOWIM_DRAWDIBDISPLAY
 #include <vfw.h>
 #endif
@@ -263,6 +401,19 @@ extern "C" {
 #include "pximages.h"           
 #endif
 }
+#include "pipeline.h"
+#include "bench.h"
+#include "results.h"
+#include "ring.h"
+#include "health.h"
+#include "fault.h"
+#include "place.h"
+#include "hostmem.h"
+#include "seqfile.h"
+#include "serve.h"
+#include "session.h"
+#include "trace.h"
+#include "metrics.h"
 
 /*
  * Global variables.
@@ -287,6 +438,7 @@ void DisplayBuffer(int unit, pxbuffer_t buf, HWND hWndImage, struct pxywindow wi
 {
 	HDC     hDC;
 	int     err = 0;
+	TRACE_BEGIN(t);
 
 	hDC = GetDC(hWndImage);
 
@@ -300,7 +452,7 @@ void DisplayBuffer(int unit, pxbuffer_t buf, HWND hWndImage, struct pxywindow wi
 		windImage[unit].se.x - windImage[unit].nw.x,
 		windImage[unit].se.y - windImage[unit].nw.y, 0);
 	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_renderStretchDIBits", MB_OK | MB_TASKMODAL);
+		fault_error(err, "pxd_renderStretchDIBits");
 #endif
 
 	//
@@ -312,7 +464,7 @@ void DisplayBuffer(int unit, pxbuffer_t buf, HWND hWndImage, struct pxywindow wi
 	err = pxio8_GDIDisplay(NULL, pxd_defineImage(1 << unit, buf, 0, 0, -1, -1, "Display"),
 		NULL, 0, 'n', 0, 0, hDC, &windImage[unit], NULL, NULL);
 	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_GDIDisplay", MB_OK | MB_TASKMODAL);
+		fault_error(err, "pxio8_GDIDisplay");
 #endif
 
 	//
@@ -362,7 +514,7 @@ void DisplayBuffer(int unit, pxbuffer_t buf, HWND hWndImage, struct pxywindow wi
 			}
 		}
 		if (err < 0)
-			MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_DirectXDisplay", MB_OK | MB_TASKMODAL);
+			fault_error(err, "pxio8_DirectXDisplay");
 	}
 #endif
 
@@ -387,7 +539,7 @@ void DisplayBuffer(int unit, pxbuffer_t buf, HWND hWndImage, struct pxywindow wi
 		pxd_renderDIBFree(hDIB);
 	}
 	else
-		MessageBox(NULL, "Error", "pxd_renderDIBCreate", MB_OK | MB_TASKMODAL);
+		fault_post(FAULT_ERROR, unit, 0, "pxd_renderDIBCreate", "Error");
 #endif
 
 	//
@@ -399,10 +551,11 @@ void DisplayBuffer(int unit, pxbuffer_t buf, HWND hWndImage, struct pxywindow wi
 	err = pxio8_DrawDibDisplay(NULL, pxd_defineImage(1 << unit, buf, 0, 0, -1, -1, "Display"),
 		NULL, 0, 'n', 0, 0, hDrawDib, hDC, &windImage[unit], NULL, NULL);
 	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_DrawDibDisplay", MB_OK | MB_TASKMODAL);
+		fault_error(err, "pxio8_DrawDibDisplay");
 #endif
 
 	ReleaseDC(hWndImage, hDC);
+	TRACE_END(t, "DisplayBuffer");
 }
 
 /*
@@ -439,7 +592,7 @@ void SaveTiff1()
 				pxd_defineImage3(1 << u, 1, -1, 0, 0, -1, -1, "Default"),
 				NULL, pathname, pxd_imageBdim(), 0, 0, NULL);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_tifwriteseq", MB_OK | MB_TASKMODAL);
+				fault_error(err, "pxio8_tifwriteseq");
 		}
 	}
 #endif
@@ -486,7 +639,7 @@ void SaveTiffN()
 				else {
 					err = pxd_saveTiff(1 << u, pathname2, z, 0, 0, -1, -1, 0, 0);
 					if (err < 0)
-						MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_saveTiff", MB_OK | MB_TASKMODAL);
+						fault_error(err, "pxd_saveTiff");
 				}
 			}
 		}
@@ -537,7 +690,7 @@ void SaveAvi1()
 				pxd_defineImage3(1 << u, 1, -1, 0, 0, -1, -1, "Default"),
 				NULL, pathname, 8, &parm);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_aviwriteseq", MB_OK | MB_TASKMODAL);
+				fault_error(err, "pxio8_aviwriteseq");
 		}
 	}
 #endif
@@ -549,8 +702,8 @@ void SaveAvi1()
  * Save all frame buffers in simple binary format,
  * using one file per unit with multiple images per file,
  * without using PXIPL.
- * Checking for file I/O errors via the C/Windows library
- * is left as an exercise for the reader.
+ * Written through seqfile, bypassing the file cache
+ * if SAVE_DIRECT.
  */
 void SaveBinary1()
 {
@@ -583,30 +736,39 @@ void SaveBinary1()
 			// inbetween. Reading one line at a time is a common compromise.
 			//
 			void* buffer = malloc(pxd_imageXdim() * pxd_imageCdim() * (pxd_imageBdim() <= 8 ? 1 : 2));
-			FILE* fp = fopen(pathname, "wb");
-			if (!fp)
-				MessageBox(NULL, "Can't create file", "fopen", MB_OK | MB_TASKMODAL);
+			struct seqfile sf;
+			int	fileerr = sf_open(&sf, pathname, SAVE_DIRECT);
+			int	opened = fileerr >= 0;
+			if (!opened)
+				fault_error(fileerr, "sf_open");
 			if (!buffer)
-				MessageBox(NULL, "Can't alloc memory", "malloc", MB_OK | MB_TASKMODAL);
-			if (fp && buffer) {
-				for (int z = 1; z <= pxd_imageZdim(); z++) {
-					for (int y = 0; y < pxd_imageYdim(); y++) {
+				fault_error(PXERMALLOC, "malloc");
+			if (fileerr >= 0 && buffer) {
+				for (int z = 1; z <= pxd_imageZdim() && fileerr >= 0; z++) {
+					TRACE_BEGIN(t);
+					for (int y = 0; y < pxd_imageYdim() && fileerr >= 0; y++) {
 						if (pxd_imageBdim() <= 8) {
 							err = pxd_readuchar(1 << u, z, 0, y, -1, y + 1, (uchar*)buffer, pxd_imageXdim() * pxd_imageCdim(), pxd_imageCdim() == 1 ? "Grey" : "RGB");
 							if (err < 0)
-								MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_readuchar", MB_OK | MB_TASKMODAL);
+								fault_error(err, "pxd_readuchar");
 						}
 						else {
 							err = pxd_readushort(1 << u, z, 0, y, -1, y + 1, (ushort*)buffer, pxd_imageXdim() * pxd_imageCdim(), pxd_imageCdim() == 1 ? "Grey" : "RGB");
 							if (err < 0)
-								MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_readushort", MB_OK | MB_TASKMODAL);
+								fault_error(err, "pxd_readushort");
 						}
-						fwrite(buffer, pxd_imageXdim() * pxd_imageCdim(), (pxd_imageBdim() <= 8 ? 1 : 2), fp);
+						fileerr = sf_write(&sf, buffer, pxd_imageXdim() * pxd_imageCdim() * (pxd_imageBdim() <= 8 ? 1 : 2));
 					}
+					TRACE_END(t, "SaveBinary1 frame");
 				}
 			}
-			if (fp)
-				fclose(fp);
+			if (opened) {
+				int e;
+				TRACE_SPAN("sf_close", e = sf_close(&sf));
+				fileerr = fileerr < 0 ? fileerr : e;
+				if (fileerr < 0)
+					fault_error(fileerr, "sf_write");
+			}
 			if (buffer)
 				free(buffer);
 		}
@@ -615,6 +777,67 @@ void SaveBinary1()
 
 
 
+/*
+ * Open the PIXCI(R) frame grabber(s), as selected above.
+ * Used at startup, and to reopen after a fault.
+ */
+int OpenPIXCI()
+{
+	int	err;
+
+	//
+	// If this program were to only support a single PIXCI(R)
+	// frame grabber, the first parameter could be simplified to:
+	//
+	//	if (pxd_PIXCIopen("", FORMAT, NULL) < 0)
+	//	    pxd__mesgFault(1);
+	//
+	// But, for the sake of multiple PIXCI(R) frame grabbers
+	// specify which units are to be used.
+	//
+	char driverparms[80];
+	driverparms[sizeof(driverparms) - 1] = 0; // this & snprintf: overly conservative - avoids warning messages
+	_snprintf(driverparms, sizeof(driverparms) - 1, "-DM 0x%x %s", UNITSOPENMAP, DRIVERPARMS);
+	//
+	// Either FORMAT or FORMATFILE_LOAD or FORMATFILE_COMP
+	// should have been selected above.
+	//
+#if defined(FORMAT)
+	err = pxd_PIXCIopen(driverparms, FORMAT, "");
+#elif defined(FORMATFILE_LOAD)
+	//
+	// The FORMATFILE can be read and loaded
+	// during the pxd_PIXCIopen(), for convenience
+	// of changing the format file without recompiling.
+	//
+	err = pxd_PIXCIopen(driverparms, "", FORMATFILE_LOAD);
+#elif defined(FORMATFILE_COMP)
+	//
+	// Or the FORMATFILE can be compiled into this application,
+	// reducing the number of files that must be distributed, or
+	// possibly lost.
+	//
+	// Note: On MSVC 6.0, if the precompiled header option is used,
+	// the compiler objects to this code (C2006) when FORMATFILE_COMP
+	// is not defined, even though this shouldn't be compiled
+	// when FORMATFILE_COMP is not defined.
+	// Either turn off the 'Use Precompiled Headers' option,
+	// remove this code, or choose to use the FORMATFILE_COMP option.
+	//
+	err = pxd_PIXCIopen(driverparms, "Default", "");
+	if (err >= 0) {
+#include FORMATFILE_COMP
+		pxd_videoFormatAsIncludedInit(0);
+		err = pxd_videoFormatAsIncluded(0);
+		if (err < 0)
+			fault_error(err, "pxd_videoFormatAsIncluded");
+	}
+#endif
+	return(err);
+}
+
+
+
 /*
  * The Dialog
  */
@@ -624,8 +847,16 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 	static  UINT	svgaBits;			    // pixel format of S/VGA
 	static  int 	liveon = 0;
 	static  int 	seqdisplayon = 0;
+	static  int 	seqcaptureon = 0;
+	static  pxbuffer_t	lastprocbuf[UNITS] = { 0 };	    // last buffer processed in sequence capture
 	static  pxbuffer_t	seqdisplaybuf = 1;		    // which buffer being displayed?
 	static  DWORD	seqdisplaytime; 		    // when was last buffer displayed
+	static  DWORD	statustime;			    // when were results last reported
+	static  int	gatedmap = 0;			    // units whose lens is decided
+	static  int	ringon = 0;
+	static  struct	ring ring;			    // ring capture, when ringon
+	static  struct	health health;			    // missed frames, per unit and consumer
+	static	BOOL	metricsfailed;			    // reported already
 	static  pxvbtime_t	lastcapttime[UNITS] = { 0 };	    // when was image last captured
 	static  struct	pxywindow windImage[max(4, UNITS)];  // subwindow of child window for image display
 	static  HWND	hWndImage;			    // child window of dialog for image display
@@ -637,57 +868,46 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 		RECT	rectImage;
 
 		//
-		// Open the PIXCI(R) frame grabber.
-		// If this program were to only support a single PIXCI(R)
-		// frame grabber, the first parameter could be simplified to:
+		// Set cores aside for capture. This thread, which also
+		// analyses and displays, stays unpinned; threads started
+		// later are placed as started.
 		//
-		//	if (pxd_PIXCIopen("", FORMAT, NULL) < 0)
-		//	    pxd__mesgFault(1);
+		place_plan(CAPTURE_CORES, WRITER_CORES, CAPTURE_PRIORITY);
+		TRACE_THREAD("dialog");
+
 		//
-		// But, for the sake of multiple PIXCI(R) frame grabbers
-		// specify which units are to be used.
+		// Faults are logged rather than shown, from here on.
 		//
-		char driverparms[80];
-		driverparms[sizeof(driverparms) - 1] = 0; // this & snprintf: overly conservative - avoids warning messages
-		_snprintf(driverparms, sizeof(driverparms) - 1, "-DM 0x%x %s", UNITSOPENMAP, DRIVERPARMS);
+		{
+			struct faultpolicy policy;
+			policy.action[FAULT_ERROR] = FAULT_ERROR_ACTION;
+			policy.action[FAULT_VIDEO] = FAULT_VIDEO_ACTION;
+			policy.retries = FAULT_RETRIES;
+			policy.window = FAULT_WINDOW;
+			err = fault_open(FAULT_LOG, &policy);
+			if (err < 0)
+				MessageBox(NULL, pxd_mesgErrorCode(err), "fault_open", MB_OK | MB_TASKMODAL);
+		}
+
 		//
-		// Either FORMAT or FORMATFILE_LOAD or FORMATFILE_COMP
-		// should have been selected above.
+		// Open the PIXCI(R) frame grabber.
 		//
-#if defined(FORMAT)
-		if (pxd_PIXCIopen(driverparms, FORMAT, "") < 0)
-			pxd_mesgFault(UNITSMAP);
-#elif defined(FORMATFILE_LOAD)
-	//
-	// The FORMATFILE can be read and loaded
-	// during the pxd_PIXCIopen(), for convenience
-	// of changing the format file without recompiling.
-	//
-		if (pxd_PIXCIopen(driverparms, "", FORMATFILE_LOAD) < 0)
-			pxd_mesgFault(UNITSMAP);
-#elif defined(FORMATFILE_COMP)
-	//
-	// Or the FORMATFILE can be compiled into this application,
-	// reducing the number of files that must be distributed, or
-	// possibly lost.
-	//
-	// Note: On MSVC 6.0, if the precompiled header option is used,
-	// the compiler objects to this code (C2006) when FORMATFILE_COMP
-	// is not defined, even though this shouldn't be compiled
-	// when FORMATFILE_COMP is not defined.
-	// Either turn off the 'Use Precompiled Headers' option,
-	// remove this code, or choose to use the FORMATFILE_COMP option.
-	//
-		if (pxd_PIXCIopen(driverparms, "Default", "") < 0)
+		if (OpenPIXCI() < 0)
 			pxd_mesgFault(UNITSMAP);
+
+		//
+		// Allocate host frames for processing captured images.
+		//
+		mem_init((HOST_LARGEPAGES ? MEM_LARGE : 0) | (HOST_LOCKED ? MEM_LOCK : 0));
+		err = pipe_open(UNITS);
+		if (err < 0)
+			MessageBox(NULL, pxd_mesgErrorCode(err), "pipe_open", MB_OK | MB_TASKMODAL);
 		{
-#include FORMATFILE_COMP
-			pxd_videoFormatAsIncludedInit(0);
-			err = pxd_videoFormatAsIncluded(0);
-			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_videoFormatAsIncluded", MB_OK | MB_TASKMODAL);
+			char	status[256];
+			if (mem_format(status, sizeof(status)) > 0)
+				printf("%s\n", status);
 		}
-#endif
+		health_reset(&health);
 
 		//
 		// Set our title.
@@ -820,9 +1040,10 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			liveon = FALSE;
 			seqdisplaybuf = FALSE;
+			seqcaptureon = FALSE;
 			err = pxd_goSnap(UNITSMAP, 1);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goSnap", MB_OK | MB_TASKMODAL);
+				fault_error(err, "pxd_goSnap");
 			EnableWindow(GetDlgItem(hDlg, IDLIVE), TRUE);
 			EnableWindow(GetDlgItem(hDlg, IDSNAP), TRUE);
 			EnableWindow(GetDlgItem(hDlg, IDSEQCAPTURE), TRUE);
@@ -836,9 +1057,15 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			liveon = TRUE;
 			seqdisplaybuf = FALSE;
+			seqcaptureon = FALSE;
+			for (int u = 0; u < UNITS; u++)
+				pipe_restart(u);
+			gatedmap = 0;
+			health_reset(&health);
+			TRACE_RESET();
 			err = pxd_goLive(UNITSMAP, 1L);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goLive", MB_OK | MB_TASKMODAL);
+				fault_error(err, "pxd_goLive");
 			EnableWindow(GetDlgItem(hDlg, IDLIVE), FALSE);
 			EnableWindow(GetDlgItem(hDlg, IDSNAP), FALSE);
 			EnableWindow(GetDlgItem(hDlg, IDSEQCAPTURE), FALSE);
@@ -852,8 +1079,22 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			if (HIWORD(wParam) != BN_CLICKED)
 				return(FALSE);
 			pxd_goUnLive(UNITSMAP);
+			if (ringon)
+				ring_stop(&ring);
+			//
+			// Where the time went, per thread.
+			//
+			if (liveon || seqcaptureon || ringon) {
+				char	status[256];
+				for (int i = 0; place_format(i, status, sizeof(status)) >= 0; i++)
+					printf("%s\n", status);
+				if (TRACE_WRITE(TRACE_FILE) < 0)
+					fault_error(PXERNOFILE, "trace_write");
+			}
 			liveon = FALSE;
 			seqdisplayon = FALSE;
+			seqcaptureon = FALSE;
+			ringon = FALSE;
 			EnableWindow(GetDlgItem(hDlg, IDLIVE), TRUE);
 			EnableWindow(GetDlgItem(hDlg, IDSNAP), TRUE);
 			EnableWindow(GetDlgItem(hDlg, IDSEQCAPTURE), TRUE);
@@ -900,9 +1141,17 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			err = pxd_goLiveSeq(UNITSMAP, 1, pxd_imageZdim(), 1, 0, 1);
 #endif
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goLiveSeq", MB_OK | MB_TASKMODAL);
+				fault_error(err, "pxd_goLiveSeq");
 			liveon = FALSE;
 			seqdisplayon = FALSE;
+			seqcaptureon = TRUE;
+			for (int u = 0; u < UNITS; u++) {
+				lastprocbuf[u] = 0;
+				pipe_restart(u);
+			}
+			gatedmap = 0;
+			health_reset(&health);
+			TRACE_RESET();
 			EnableWindow(GetDlgItem(hDlg, IDLIVE), FALSE);
 			EnableWindow(GetDlgItem(hDlg, IDSNAP), FALSE);
 			EnableWindow(GetDlgItem(hDlg, IDSEQCAPTURE), FALSE);
@@ -914,12 +1163,43 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			SetScrollPos(GetDlgItem(hDlg, IDBUFFERSCROLL), SB_CTL, 1, TRUE);
 			return(TRUE);
 
+		case IDRINGCAPTURE:
+			if (HIWORD(wParam) != BN_CLICKED)
+				return(FALSE);
+			pxd_goUnLive(UNITSMAP);
+			err = ring_arm(&ring, UNITSMAP, RING_PRE, RING_POST, RING_GPIN);
+			if (err < 0) {
+				fault_error(err, "ring_arm");
+				return(TRUE);
+			}
+			liveon = FALSE;
+			seqdisplayon = FALSE;
+			seqcaptureon = FALSE;
+			ringon = TRUE;
+			health_reset(&health);
+			TRACE_RESET();
+			EnableWindow(GetDlgItem(hDlg, IDLIVE), FALSE);
+			EnableWindow(GetDlgItem(hDlg, IDSNAP), FALSE);
+			EnableWindow(GetDlgItem(hDlg, IDSEQCAPTURE), FALSE);
+			EnableWindow(GetDlgItem(hDlg, IDSEQDISPLAY), FALSE);
+			EnableWindow(GetDlgItem(hDlg, IDSTOP), TRUE);
+			EnableWindow(GetDlgItem(hDlg, IDBUFFERSCROLL), TRUE);
+			return(TRUE);
+
+		case IDRINGTRIGGER:
+			if (HIWORD(wParam) != BN_CLICKED)
+				return(FALSE);
+			if (ringon)
+				ring_trigger(&ring);
+			return(TRUE);
+
 		case IDSEQDISPLAY:
 			if (HIWORD(wParam) != BN_CLICKED)
 				return(FALSE);
 			seqdisplaybuf = 1;
 			liveon = FALSE;
 			seqdisplayon = TRUE;
+			seqcaptureon = FALSE;
 			seqdisplaytime = GetTickCount();
 			EnableWindow(GetDlgItem(hDlg, IDLIVE), FALSE);
 			EnableWindow(GetDlgItem(hDlg, IDSNAP), FALSE);
@@ -954,6 +1234,31 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			SaveAvi1();
 #endif
 			return(TRUE);
+
+		case IDDARKCAL:
+		case IDFLATCAL:
+			if (HIWORD(wParam) != BN_CLICKED)
+				return(FALSE);
+			//
+			// Calibration captures its own sequence into the
+			// frame buffers; stop whatever else is running.
+			// The lens should be capped for the dark calibration,
+			// and viewing the integrating sphere for the flat.
+			//
+			pxd_goUnLive(UNITSMAP);
+			liveon = FALSE;
+			seqdisplayon = FALSE;
+			seqcaptureon = FALSE;
+			err = pipe_calibrate(UNITSMAP, LOWORD(wParam) == IDDARKCAL ? 'd' : 'f', FLATFIELD_FRAMES);
+			if (err < 0)
+				fault_error(err, "pipe_calibrate");
+			EnableWindow(GetDlgItem(hDlg, IDLIVE), TRUE);
+			EnableWindow(GetDlgItem(hDlg, IDSNAP), TRUE);
+			EnableWindow(GetDlgItem(hDlg, IDSEQCAPTURE), TRUE);
+			EnableWindow(GetDlgItem(hDlg, IDSEQDISPLAY), TRUE);
+			EnableWindow(GetDlgItem(hDlg, IDSTOP), FALSE);
+			EnableWindow(GetDlgItem(hDlg, IDBUFFERSCROLL), TRUE);
+			return(TRUE);
 		}
 		break;
 
@@ -994,7 +1299,9 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 	}
 
 	case WM_CLOSE:
+		pipe_close();
 		pxd_PIXCIclose();
+		fault_close();
 		//DestroyWindow(GetParent(hDlg));
 #if SHOWIM_DIRECTXDISPLAY
 		if (lpDD)
@@ -1021,17 +1328,46 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 		// can't be reported by functions such as pxd_goLive()
 		// which initiate capture and return immediately.
 		//
-		// Should there be a fault and pxd_mesgFault() pop up a dialog,
-		// the Windows TIMER will continue in a new thread. Thus the
-		// 'faulting' variable and logic to limit to one dialog at a time.
+		// Faults are queued and logged, rather than shown by
+		// pxd_mesgFault(), so that an unattended run isn't held
+		// up by a dialog. Recover as per the policy: restart
+		// whichever capture was running, having reopened the
+		// frame grabber if so, or stop.
 		//
-		if (pxd_infoUnits()) {	 // implies whether library is open
-			static int faulting = 0;
-			if (!faulting) {
-				faulting++;
-				pxd_mesgFault(UNITSMAP);
-				faulting--;
+		if (pxd_infoUnits())	 // implies whether library is open
+			fault_check(UNITSMAP);
+		{
+			int action = fault_action();
+			int cmd = liveon ? IDLIVE : seqcaptureon ? IDSEQCAPTURE : ringon ? IDRINGCAPTURE : 0;
+			if (action != FAULT_IGNORE && cmd) {
+				pxd_goUnLive(UNITSMAP);
+				if (ringon)
+					ring_stop(&ring);
+			}
+			//
+			// The host frames and calibrations are kept
+			// over a reopen; the video format, and so
+			// their size, is the same.
+			//
+			if (action == FAULT_REOPEN && cmd) {
+				pxd_PIXCIclose();
+				err = OpenPIXCI();
+				if (err < 0) {
+					fault_error(err, "pxd_PIXCIopen");
+					action = FAULT_ABORT;
+				}
 			}
+			//
+			// Stop while capture is still flagged as running,
+			// so that IDSTOP reports the run; or restart.
+			//
+			if (action == FAULT_ABORT && cmd)
+				SendMessage(hDlg, WM_COMMAND, MAKEWPARAM(IDSTOP, BN_CLICKED), 0);
+			else if (action != FAULT_IGNORE && cmd) {
+				liveon = seqcaptureon = ringon = FALSE;
+				PostMessage(hDlg, WM_COMMAND, MAKEWPARAM(cmd, BN_CLICKED), 0);
+			}
+			err = 0;
 		}
 
 		//
@@ -1047,6 +1383,7 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 		// and it what order, each previously captured buffer
 		// should be displayed.
 		//
+		TRACE_BEGIN(tupdate);
 		pxbuffer_t  buf = 1;
 		for (int u = 0; u < UNITS; u++) {
 			if (seqdisplayon) {
@@ -1065,8 +1402,64 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 					continue;
 				lastcapttime[u] = lasttime;
 				buf = pxd_capturedBuffer(1 << u);
+				//
+				// Correct and analyse each newly captured
+				// buffer before it is overwritten.
+				// In sequence capture several buffers may have
+				// been captured since the last check; process
+				// each of them, in order, so that stacking
+				// sees consecutive frames.
+				//
+				// Note how many frames each consumer missed,
+				// and how far behind capture it is; in live
+				// capture, skip frames if throttled.
+				//
+				if (seqcaptureon) {
+					pxbuffer_t b = lastprocbuf[u];
+					while (b != buf && err >= 0 && !pipe_verdict(u)) {
+						pxvbtime_t field;
+						double	t = bench_millis();
+						b = b % pxd_imageZdim() + 1;
+						field = pxd_buffersFieldCount(1 << u, b);
+						err = pipe_process(u, b);
+						health_consume(&health, u, HEALTH_ANALYSIS, field, bench_millis() - t, 0);
+					}
+					lastprocbuf[u] = buf;
+				}
+				else if (!ringon) {
+					pxvbtime_t field = pxd_buffersFieldCount(1 << u, buf);
+					if (!health_skip(&health, u, HEALTH_ANALYSIS, CAPTURE_THROTTLE, field)) {
+						double	t = bench_millis();
+						err = pipe_process(u, buf);
+						health_consume(&health, u, HEALTH_ANALYSIS, field, bench_millis() - t, 1);
+					}
+				}
+				if (err < 0)
+					fault_error(err, "pipe_process");
+				//
+				// Once the lens is passed or failed, there's
+				// no need to capture any more of it.
+				//
+				if (pipe_verdict(u) && (liveon || seqcaptureon) && !(gatedmap & (1 << u))) {
+					char	status[512];
+					pxd_goUnLive(1 << u);
+					gatedmap |= 1 << u;
+					if (pipe_status(u, status, sizeof(status)))
+						printf("unit %d: %s\n", u, status);
+					if (gatedmap == UNITSMAP)
+						PostMessage(hDlg, WM_COMMAND, MAKEWPARAM(IDSTOP, BN_CLICKED), 0);
+				}
+			}
+			if (seqdisplayon)
+				DisplayBuffer(u, buf, hWndImage, windImage);
+			else {
+				pxvbtime_t field = pxd_buffersFieldCount(1 << u, buf);
+				if (!health_skip(&health, u, HEALTH_DISPLAY, CAPTURE_THROTTLE, field)) {
+					double	t = bench_millis();
+					DisplayBuffer(u, buf, hWndImage, windImage);
+					health_consume(&health, u, HEALTH_DISPLAY, field, bench_millis() - t, 1);
+				}
 			}
-			DisplayBuffer(u, buf, hWndImage, windImage);
 			//
 			// Let buffer scroll bar show sequence capture activity.
 			// Especially useful in triggered sequence mode, as it
@@ -1076,6 +1469,49 @@ PIXCIDialogProc(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			SetScrollPos(GetDlgItem(hDlg, IDBUFFERSCROLL), SB_CTL, buf, TRUE);
 		}
 
+		//
+		// In ring capture, watch for the trigger; once the
+		// frames after it are in, save the window.
+		//
+		if (ringon && ring_poll(&ring) == RING_DONE) {
+			ringon = FALSE;
+			for (int u = 0; u < UNITS; u++) {
+				char	pathname[_MAX_PATH];
+				pathname[sizeof(pathname) - 1] = 0;
+				_snprintf(pathname, sizeof(pathname) - 1, RING_FILE, (unsigned long)ring.trigtime, u);
+				TRACE_SPAN("ring_save", err = ring_save(&ring, u, pathname, SAVE_DIRECT));
+				if (err < 0)
+					fault_error(err, "ring_save");
+				else
+					printf("unit %d: %d frames around trigger saved to %s\n", u, err, pathname);
+			}
+			PostMessage(hDlg, WM_COMMAND, MAKEWPARAM(IDSTOP, BN_CLICKED), 0);
+		}
+
+		health_poll(&health, liveon || seqcaptureon || ringon);
+
+		//
+		// Report analysis results and capture health
+		// on the console, once per second.
+		//
+		if (statustime + 1000 <= GetTickCount()) {
+			char	status[512];
+			statustime = GetTickCount();
+			for (int u = 0; u < UNITS; u++) {
+				if (pipe_status(u, status, sizeof(status)))
+					printf("unit %d: %s\n", u, status);
+				if ((liveon || seqcaptureon || ringon) && health_format(&health, u, status, sizeof(status)) > 0)
+					printf("unit %d: %s\n", u, status);
+				health_metrics(&health, u);
+			}
+			met_set(met_gauge("scott_capturing", NULL, "Whether capture is running"), liveon || seqcaptureon || ringon);
+			if (METRICS_FILE && met_write(METRICS_FILE) < 0 && !metricsfailed) {
+				fault_error(PXERDOSIO, "met_write");
+				metricsfailed = TRUE;
+			}
+		}
+		TRACE_END(tupdate, "capture update");
+
 		return(TRUE);
 
 	}
@@ -1111,6 +1547,34 @@ int APIENTRY WinMain(
 	MSG       msg;
 	WNDCLASS  wc;
 
+	//
+	// Scott_Imager -bench [name ...]: benchmark the analysis
+	// code on synthetic data, without the frame grabber.
+	//
+	if (strncmp(lpCmdLine, "-bench", 6) == 0)
+		return(bench_run(lpCmdLine + 6));
+	//
+	// Scott_Imager -report file [metric [run|serial|roi]]:
+	// summarize stored results, see results.h.
+	//
+	if (strncmp(lpCmdLine, "-report", 7) == 0)
+		return(res_report(lpCmdLine + 7));
+	//
+	// Scott_Imager -serve [sim|stop], -attach [secs]: run the
+	// capture service, sharing frames with other processes,
+	// or read from it; see serve.h.
+	//
+	if (strncmp(lpCmdLine, "-serve", 6) == 0)
+		return(serve_run(lpCmdLine + 6, OpenPIXCI, UNITSMAP));
+	if (strncmp(lpCmdLine, "-attach", 7) == 0)
+		return(serve_attach(lpCmdLine + 7));
+	//
+	// Scott_Imager -startup [sim] [n]: time start to first
+	// frame, cold versus warm; see session.h.
+	//
+	if (strncmp(lpCmdLine, "-startup", 8) == 0)
+		return(sess_measure(lpCmdLine + 8));
+
 	wc.style = CS_BYTEALIGNWINDOW;
 	wc.lpfnWndProc = MainWndProc;
 	wc.cbClsExtra = 0;
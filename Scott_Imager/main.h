@@ -58,3 +58,7 @@
 // From now on is my new code
 #define RUNBUTTON 200
 #define FUNNYBUTTON 201
+#define IDDARKCAL	202
+#define IDFLATCAL	203
+#define IDRINGCAPTURE	204
+#define IDRINGTRIGGER	205
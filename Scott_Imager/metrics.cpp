@@ -0,0 +1,220 @@
+/*
+ *	metrics.cpp
+ *
+ *	Registry of metrics, written in the Prometheus text format.
+ *	See metrics.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "xcliball.h"
+}
+#include "metrics.h"
+
+struct metric {
+	int	kind;
+	char	name[MET_NAMELEN];
+	char	labels[MET_LABELLEN];
+	const char *help;
+	int	nbounds;
+	double	bounds[MET_MAXBOUNDS];
+	volatile LONGLONG value;		// counter; gauge and sum, as double bits
+	volatile LONGLONG buckets[MET_MAXBOUNDS + 1];	// not cumulative; the last is +Inf
+};
+
+const	double met_millis[MET_NMILLIS] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+static	struct	    metric metrics[MET_MAXMETRICS];
+static	volatile LONG nmetrics = 0;
+static	CRITICAL_SECTION metsect;
+static	volatile LONG metinit = 0;
+static	const char *kindnames[] = { "counter", "gauge", "histogram" };
+
+
+static LONGLONG met_bits(double v)
+{
+	LONGLONG b;
+
+	memcpy(&b, &v, sizeof(b));
+	return(b);
+}
+
+static double met_double(LONGLONG b)
+{
+	double	v;
+
+	memcpy(&v, &b, sizeof(v));
+	return(v);
+}
+
+/*
+ * Registration, rare, is serialized; updates aren't.
+ */
+static int met_register(int kind, const char *name, const char *labels, const char *help, const double *bounds, int nbounds)
+{
+	int	id = -1;
+
+	if (InterlockedCompareExchange(&metinit, 1, 0) == 0) {
+		InitializeCriticalSection(&metsect);
+		InterlockedExchange(&metinit, 2);
+	}
+	while (metinit != 2)
+		Sleep(0);
+	if (!labels)
+		labels = "";
+	EnterCriticalSection(&metsect);
+	for (int i = 0; i < nmetrics && id < 0; i++)
+		if (!strcmp(metrics[i].name, name) && !strcmp(metrics[i].labels, labels))
+			id = metrics[i].kind == kind ? i : PXERNOMODE;
+	if (id == -1 && nmetrics < MET_MAXMETRICS) {
+		struct	metric *m = &metrics[nmetrics];
+		m->kind = kind;
+		strncpy(m->name, name, sizeof(m->name) - 1);
+		strncpy(m->labels, labels, sizeof(m->labels) - 1);
+		m->help = help;
+		m->nbounds = min(nbounds, MET_MAXBOUNDS);
+		for (int b = 0; b < m->nbounds; b++)
+			m->bounds[b] = bounds[b];
+		id = nmetrics;
+		InterlockedIncrement(&nmetrics);
+	}
+	LeaveCriticalSection(&metsect);
+	return(id == -1 ? PXERMALLOC : id);
+}
+
+/*
+ * Register a metric; its id, or PXERMALLOC if there are too
+ * many, or PXERNOMODE if registered already as another kind.
+ * Help is kept by pointer, so must be a literal.
+ */
+int met_counter(const char *name, const char *labels, const char *help)
+{
+	return(met_register(MET_COUNTER, name, labels, help, NULL, 0));
+}
+
+int met_gauge(const char *name, const char *labels, const char *help)
+{
+	return(met_register(MET_GAUGE, name, labels, help, NULL, 0));
+}
+
+int met_histogram(const char *name, const char *labels, const char *help, const double *bounds, int nbounds)
+{
+	return(met_register(MET_HISTOGRAM, name, labels, help, bounds, nbounds));
+}
+
+/*
+ * Updates; ignored for ids not registered, so
+ * a failed registration costs no more checks.
+ */
+void met_add(int id, LONGLONG n)
+{
+	if (id >= 0 && id < nmetrics)
+		InterlockedExchangeAdd64(&metrics[id].value, n);
+}
+
+void met_set(int id, double value)
+{
+	if (id < 0 || id >= nmetrics)
+		return;
+	if (metrics[id].kind == MET_COUNTER)
+		InterlockedExchange64(&metrics[id].value, (LONGLONG)value);
+	else
+		InterlockedExchange64(&metrics[id].value, met_bits(value));
+}
+
+void met_observe(int id, double value)
+{
+	struct	metric *m;
+	LONGLONG old;
+	int	b = 0;
+
+	if (id < 0 || id >= nmetrics)
+		return;
+	m = &metrics[id];
+	while (b < m->nbounds && value > m->bounds[b])
+		b++;
+	InterlockedIncrement64(&m->buckets[b]);
+	do {
+		old = m->value;
+	} while (InterlockedCompareExchange64(&m->value, met_bits(met_double(old) + value), old) != old);
+}
+
+/*
+ * A sample line, with the metric's labels and any extra one.
+ */
+static void met_sample(FILE *fp, const struct metric *m, const char *suffix, const char *extra, double value)
+{
+	const char *sep = m->labels[0] && extra ? "," : "";
+
+	if (m->labels[0] || extra)
+		fprintf(fp, "%s%s{%s%s%s} %.17g\n", m->name, suffix, m->labels, sep, extra ? extra : "", value);
+	else
+		fprintf(fp, "%s%s %.17g\n", m->name, suffix, value);
+}
+
+static void met_print(FILE *fp, const struct metric *m)
+{
+	LONGLONG cum = 0;
+	char	le[40];
+
+	switch (m->kind) {
+	case MET_COUNTER:
+		met_sample(fp, m, "", NULL, (double)m->value);
+		break;
+	case MET_GAUGE:
+		met_sample(fp, m, "", NULL, met_double(m->value));
+		break;
+	case MET_HISTOGRAM:
+		for (int b = 0; b <= m->nbounds; b++) {
+			cum += m->buckets[b];
+			if (b < m->nbounds)
+				_snprintf(le, sizeof(le) - 1, "le=\"%g\"", m->bounds[b]);
+			else
+				strcpy(le, "le=\"+Inf\"");
+			le[sizeof(le) - 1] = 0;
+			met_sample(fp, m, "_bucket", le, (double)cum);
+		}
+		met_sample(fp, m, "_sum", NULL, met_double(m->value));
+		met_sample(fp, m, "_count", NULL, (double)cum);
+		break;
+	}
+}
+
+/*
+ * Write all metrics, each name's samples together.
+ */
+int met_write(const char *path)
+{
+	char	tmp[_MAX_PATH];
+	FILE	*fp;
+	int	n = nmetrics;
+
+	tmp[sizeof(tmp) - 1] = 0;
+	_snprintf(tmp, sizeof(tmp) - 1, "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (!fp)
+		return(PXERNOFILE);
+	for (int i = 0; i < n; i++) {
+		int	first = 1;
+		for (int j = 0; j < i && first; j++)
+			first = strcmp(metrics[j].name, metrics[i].name) != 0;
+		if (!first)
+			continue;
+		if (metrics[i].help)
+			fprintf(fp, "# HELP %s %s\n", metrics[i].name, metrics[i].help);
+		fprintf(fp, "# TYPE %s %s\n", metrics[i].name, kindnames[metrics[i].kind]);
+		for (int j = i; j < n; j++)
+			if (!strcmp(metrics[j].name, metrics[i].name))
+				met_print(fp, &metrics[j]);
+	}
+	if (fclose(fp) != 0 || !MoveFileEx(tmp, path, MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFile(tmp);
+		return(PXERDOSIO);
+	}
+	return(n);
+}
@@ -0,0 +1,39 @@
+#pragma once
+/*
+ *	metrics.h
+ *
+ *	Registry of counters, gauges and histograms, written in the
+ *	Prometheus text format, to a file to be picked up by the node
+ *	exporter's textfile collector, so that a rack of benches can be
+ *	watched from one place.
+ *
+ *	Metrics are registered by name and optional labels, such as
+ *	"unit=\"0\""; registering again returns the same metric. Once
+ *	registered, they are updated without locks, from any thread,
+ *	so may be updated on hot paths: counters add, gauges are set,
+ *	histograms count each observation into buckets. Counters kept
+ *	elsewhere, such as by health.cpp, may be set instead.
+ *
+ *	The file is written whole under another name, then renamed,
+ *	so the collector never sees it half written.
+ */
+
+#define MET_COUNTER	0	// kinds
+#define MET_GAUGE	1
+#define MET_HISTOGRAM	2
+
+#define MET_MAXMETRICS	128
+#define MET_MAXBOUNDS	16	// histogram buckets, less the +Inf bucket
+#define MET_NAMELEN	64
+#define MET_LABELLEN	64
+
+extern	const double met_millis[];	// buckets for latencies in millis
+#define MET_NMILLIS	10
+
+int	met_counter(const char *name, const char *labels, const char *help);
+int	met_gauge(const char *name, const char *labels, const char *help);
+int	met_histogram(const char *name, const char *labels, const char *help, const double *bounds, int nbounds);
+void	met_add(int id, LONGLONG n);
+void	met_set(int id, double value);
+void	met_observe(int id, double value);
+int	met_write(const char *path);
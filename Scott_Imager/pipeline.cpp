@@ -0,0 +1,698 @@
+/*
+ *	pipeline.cpp
+ *
+ *	Per frame processing between capture and analysis.
+ *	See pipeline.h.
+ */
+
+/*
+ *  1)	Select which processing stages are applied
+ *	to each captured frame.
+ */
+#if !defined(PIPE_FLATFIELD)
+#define PIPE_FLATFIELD	1	// dark frame & flat field correction,
+				// once calibrated
+#endif
+#if !defined(PIPE_STACK)
+#define PIPE_STACK	0	// average each PIPE_STACK_FRAMES consecutive
+				// frames, only the averages are analysed
+#endif
+#if !defined(PIPE_STACK_FRAMES)
+#define PIPE_STACK_FRAMES   8
+#endif
+#if !defined(PIPE_STACK_CLIP)
+#define PIPE_STACK_CLIP	    0.0 // reject outliers beyond this many
+				// standard deviations; 0.0: don't
+#endif
+#if !defined(PIPE_DISTORTION)
+#define PIPE_DISTORTION 0	// measure distortion from a dot grid chart
+#endif
+#if !defined(PIPE_DARKDOTS)
+#define PIPE_DARKDOTS	1	// dark dots on a white ground, or vice versa
+#endif
+#if !defined(PIPE_MAXDOTS)
+#define PIPE_MAXDOTS	4096
+#endif
+#if !defined(PIPE_PSF)
+#define PIPE_PSF	0	// measure PSF from a pinhole chart,
+				// accumulated until restarted
+#endif
+#if !defined(PIPE_PSF_RADIUS)
+#define PIPE_PSF_RADIUS 12	// patch half size, pixels
+#endif
+#if !defined(PIPE_PSF_OVERSAMPLE)
+#define PIPE_PSF_OVERSAMPLE 4
+#endif
+#if !defined(PIPE_PSF_MAXSPOTS)
+#define PIPE_PSF_MAXSPOTS   64
+#endif
+#if !defined(PIPE_VIGNET)
+#define PIPE_VIGNET	0	// measure relative illumination
+				// from a flat field, e.g. a sphere
+#endif
+#if !defined(PIPE_VIGNET_GRIDX)
+#define PIPE_VIGNET_GRIDX   16	// grid cells
+#define PIPE_VIGNET_GRIDY   12
+#endif
+#if !defined(PIPE_LCA)
+#define PIPE_LCA	0	// measure lateral colour from edges,
+				// colour cameras only
+#endif
+#if !defined(PIPE_LCA_GRID)
+#define PIPE_LCA_GRID	5	// ROIs per side
+#define PIPE_LCA_SIZE	64	// ROI side, pixels
+#endif
+#if !defined(PIPE_FOCUS)
+#define PIPE_FOCUS	0	// field curvature & astigmatism: each frame
+				// since restart is the next focus step
+#endif
+#if !defined(PIPE_FOCUS_STEP)
+#define PIPE_FOCUS_STEP	    1.0 // focus change per frame, e.g. um
+#endif
+#if !defined(PIPE_FOCUS_STEPS)
+#define PIPE_FOCUS_STEPS    64	// most steps per sequence
+#endif
+#if !defined(PIPE_FOCUS_GRID)
+#define PIPE_FOCUS_GRID	5	// ROIs per side
+#define PIPE_FOCUS_SIZE	64	// ROI side, pixels
+#endif
+#if !defined(PIPE_STAR)
+#define PIPE_STAR	0	// resolution from Siemens stars
+#endif
+#if !defined(PIPE_STAR_RADIUS)
+#define PIPE_STAR_RADIUS    100 // analysed radius, pixels
+#endif
+#if !defined(PIPE_STAR_CYCLES)
+#define PIPE_STAR_CYCLES    36	// spoke pairs
+#endif
+#if !defined(PIPE_STAR_SECTORS)
+#define PIPE_STAR_SECTORS   8
+#endif
+#if !defined(PIPE_STAR_LIMIT)
+#define PIPE_STAR_LIMIT	    0.1 // MTF at the resolution limit
+#endif
+#if !defined(PIPE_STAR_MAX)
+#define PIPE_STAR_MAX	    9	// most stars per frame
+#endif
+#if !defined(PIPE_ROIS)
+#define PIPE_ROIS	0	// find slanted edges on the first frame and
+				// track them; PIPE_LCA then measures these
+#endif
+#if !defined(PIPE_ROIS_MAX)
+#define PIPE_ROIS_MAX	    25
+#define PIPE_ROIS_SIZE	    64	// ROI side, pixels
+#endif
+#if !defined(PIPE_AOI)
+#define PIPE_AOI	0	// while PIPE_ROIS is tracking, read only the
+				// ROIs of each frame, not the whole frame;
+				// unless another stage than PIPE_LCA needs it
+#endif
+#if !defined(PIPE_RESULTS)
+#define PIPE_RESULTS	0	// append each frame's results to
+				// PIPE_RESULTS_FILE, see results.h
+#endif
+#if !defined(PIPE_RESULTS_FILE)
+#define PIPE_RESULTS_FILE   "results.sir"
+#endif
+#if !defined(PIPE_GATE)
+#define PIPE_GATE	0	// pass/fail each lens against the limits in
+				// PIPE_GATE_FILE as results come, see gate.h;
+				// stop analysis and capture once decided
+#endif
+#if !defined(PIPE_GATE_FILE)
+#define PIPE_GATE_FILE	    "spec.txt"
+#endif
+
+/*
+ *  2)	Number of worker threads for analysis;
+ *	0: one per processor.
+ */
+#if !defined(PIPE_WORKERS)
+#define PIPE_WORKERS	0
+#endif
+
+#define PIPE_RECORD	(PIPE_RESULTS || PIPE_GATE)	// results are passed on
+#define PIPE_PARTIAL	(PIPE_AOI && PIPE_ROIS && !(PIPE_STACK || PIPE_DISTORTION || PIPE_PSF \
+			    || PIPE_VIGNET || PIPE_FOCUS || PIPE_STAR))	// frames may be read in part
+#if PIPE_PARTIAL && PIPE_LCA && PIPE_LCA_SIZE > PIPE_ROIS_SIZE
+#define PIPE_AOI_MARGIN ((PIPE_LCA_SIZE - PIPE_ROIS_SIZE + 1) / 2)	// about the ROIs read
+#else
+#define PIPE_AOI_MARGIN 0
+#endif
+
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "flatfield.h"
+#include "stack.h"
+#include "workers.h"
+#include "fft.h"
+#include "distortion.h"
+#include "psf.h"
+#include "vignet.h"
+#include "roi.h"
+#include "lca.h"
+#include "focus.h"
+#include "star.h"
+#include "results.h"
+#include "gate.h"
+#include "trace.h"
+
+static	int	    npipeunits = 0;
+static	struct	    hostframe frames[PIPE_MAXUNITS];	// last frame read, per unit
+static	struct	    flatfield flats[PIPE_MAXUNITS];	// calibration, per unit
+#if PIPE_STACK
+static	struct	    framestack stacks[PIPE_MAXUNITS];
+static	struct	    hostframe stacked[PIPE_MAXUNITS];	// last average, per unit
+#endif
+static	struct	    hostframe *analysed[PIPE_MAXUNITS];	// last frame analysed, per unit
+#if PIPE_RECORD
+static	struct	    results results;
+static	int	    runs[PIPE_MAXUNITS];		// per unit: run, frames analysed, lens
+static	unsigned    nframes[PIPE_MAXUNITS];
+static	char	    serials[PIPE_MAXUNITS][RES_NAMELEN];
+#endif
+#if PIPE_GATE
+static	struct	    gate gates[PIPE_MAXUNITS];
+static	int	    gated[PIPE_MAXUNITS];		// verdict recorded
+#endif
+#if PIPE_DISTORTION
+static	struct	    distortion dists[PIPE_MAXUNITS];
+#endif
+#if PIPE_PSF
+static	struct	    psf psfs[PIPE_MAXUNITS];
+#endif
+#if PIPE_VIGNET
+static	struct	    vignet vignets[PIPE_MAXUNITS];
+#endif
+#if PIPE_ROIS
+static	struct	    roiset roisets[PIPE_MAXUNITS];
+#endif
+#if PIPE_LCA
+static	struct	    lca lcas[PIPE_MAXUNITS];
+#endif
+#if PIPE_FOCUS
+static	struct	    focus focuses[PIPE_MAXUNITS];
+#endif
+#if PIPE_STAR
+static	struct	    stars starss[PIPE_MAXUNITS];
+#endif
+
+
+#if PIPE_GATE
+static void pipe_gateTap(void *ctx, const char *metric, int roi, double value)
+{
+	gate_check((struct gate*)ctx, metric, roi, value);
+}
+#endif
+
+/*
+ * Allocate host frames and calibration state
+ * for the current video format.
+ * Must follow pxd_PIXCIopen.
+ */
+int pipe_open(int units)
+{
+	int	err;
+	int	bits = pxd_imageBdim();
+
+	pipe_close();
+	for (int u = 0; u < units && u < PIPE_MAXUNITS; u++) {
+		err = frame_alloc(&frames[u], pxd_imageXdim(), pxd_imageYdim(), pxd_imageCdim(), bits);
+		if (err >= 0)
+			err = ffc_alloc(&flats[u], pxd_imageXdim(), pxd_imageYdim(), pxd_imageCdim(), bits);
+#if PIPE_STACK
+		if (err >= 0)
+			err = frame_alloc(&stacked[u], pxd_imageXdim(), pxd_imageYdim(), pxd_imageCdim(), bits);
+		if (err >= 0)
+			err = stk_alloc(&stacks[u], frames[u].npix, PIPE_STACK_FRAMES, PIPE_STACK_CLIP);
+#endif
+#if PIPE_DISTORTION
+		if (err >= 0)
+			err = dist_alloc(&dists[u], PIPE_MAXDOTS, PIPE_DARKDOTS);
+#endif
+#if PIPE_PSF
+		if (err >= 0)
+			err = psf_alloc(&psfs[u], PIPE_PSF_MAXSPOTS, PIPE_PSF_RADIUS, PIPE_PSF_OVERSAMPLE);
+#endif
+#if PIPE_VIGNET
+		if (err >= 0)
+			err = vig_alloc(&vignets[u], PIPE_VIGNET_GRIDX, PIPE_VIGNET_GRIDY);
+#endif
+#if PIPE_ROIS
+		if (err >= 0)
+			err = roi_alloc(&roisets[u], PIPE_ROIS_MAX, PIPE_ROIS_SIZE);
+#endif
+#if PIPE_LCA
+		if (err >= 0)
+			err = lca_alloc(&lcas[u], PIPE_LCA_GRID, PIPE_LCA_SIZE);
+#endif
+#if PIPE_FOCUS
+		if (err >= 0)
+			err = foc_alloc(&focuses[u], PIPE_FOCUS_GRID, PIPE_FOCUS_SIZE, PIPE_FOCUS_STEPS, PIPE_FOCUS_STEP);
+#endif
+#if PIPE_STAR
+		if (err >= 0)
+			err = star_alloc(&starss[u], PIPE_STAR_MAX, PIPE_STAR_RADIUS, PIPE_STAR_CYCLES, PIPE_STAR_SECTORS, PIPE_STAR_LIMIT);
+#endif
+		if (err < 0) {
+			pipe_close();
+			return(err);
+		}
+		npipeunits = u + 1;
+	}
+#if PIPE_GATE
+	err = 0;
+	for (int u = 0; u < npipeunits && err >= 0; u++)
+		err = gate_load(&gates[u], PIPE_GATE_FILE);
+	if (err < 0) {
+		pipe_close();
+		return(err);
+	}
+#endif
+#if PIPE_RECORD
+	err = res_open(&results, PIPE_RESULTS ? PIPE_RESULTS_FILE : NULL);
+	if (err < 0) {
+		pipe_close();
+		return(err);
+	}
+#if PIPE_GATE
+	results.tap = pipe_gateTap;
+#endif
+	for (int u = 0; u < npipeunits; u++)
+		pipe_restart(u);
+#endif
+	wrk_start(PIPE_WORKERS);
+	return(0);
+}
+
+void pipe_close(void)
+{
+	wrk_stop();
+	fft_release();
+#if PIPE_RECORD
+	res_close(&results);
+#endif
+	for (int u = 0; u < npipeunits; u++) {
+		frame_free(&frames[u]);
+		ffc_free(&flats[u]);
+#if PIPE_STACK
+		frame_free(&stacked[u]);
+		stk_free(&stacks[u]);
+#endif
+#if PIPE_DISTORTION
+		dist_free(&dists[u]);
+#endif
+#if PIPE_PSF
+		psf_free(&psfs[u]);
+#endif
+#if PIPE_VIGNET
+		vig_free(&vignets[u]);
+#endif
+#if PIPE_ROIS
+		roi_free(&roisets[u]);
+#endif
+#if PIPE_LCA
+		lca_free(&lcas[u]);
+#endif
+#if PIPE_FOCUS
+		foc_free(&focuses[u]);
+#endif
+#if PIPE_STAR
+		star_free(&starss[u]);
+#endif
+		analysed[u] = NULL;
+	}
+	npipeunits = 0;
+}
+
+/*
+ * The last frame handed to analysis, if any.
+ */
+const struct hostframe *pipe_frame(int unit)
+{
+	if (unit < 0 || unit >= npipeunits)
+		return(NULL);
+	return(analysed[unit]);
+}
+
+/*
+ * Discard partially accumulated state, such as a partial
+ * stack, e.g. when capture is (re)started.
+ */
+void pipe_restart(int unit)
+{
+	if (unit < 0 || unit >= npipeunits)
+		return;
+#if PIPE_STACK
+	stk_reset(&stacks[unit]);
+#endif
+#if PIPE_DISTORTION
+	dist_reset(&dists[unit]);
+#endif
+#if PIPE_PSF
+	psf_reset(&psfs[unit]);
+#endif
+#if PIPE_ROIS
+	roi_reset(&roisets[unit]);
+#endif
+#if PIPE_FOCUS
+	foc_reset(&focuses[unit]);
+#endif
+#if PIPE_STAR
+	star_reset(&starss[unit]);
+#endif
+#if PIPE_RECORD
+	runs[unit] = res_newRun(&results);
+	nframes[unit] = 0;
+#endif
+#if PIPE_GATE
+	gate_reset(&gates[unit]);
+	gated[unit] = 0;
+#endif
+}
+
+/*
+ * Serial number of the lens now on a unit, for the results;
+ * from the next restart on.
+ */
+void pipe_lens(int unit, const char *serial)
+{
+#if PIPE_RECORD
+	if (unit < 0 || unit >= PIPE_MAXUNITS)
+		return;
+	strncpy(serials[unit], serial ? serial : "", RES_NAMELEN - 1);
+	serials[unit][RES_NAMELEN - 1] = 0;
+#endif
+}
+
+/*
+ * Append one stage's summary to a status line.
+ */
+static void statusAdd(char *buf, size_t bufsize, const char *part)
+{
+	size_t	n = strlen(buf);
+
+	if (!part[0] || n + 1 >= bufsize)
+		return;
+	_snprintf(buf + n, bufsize - n, n ? "; %s" : "%s", part);
+	buf[bufsize - 1] = 0;
+}
+
+/*
+ * Summarize the latest analysis results, for display.
+ * Returns the length of the summary; 0 if none.
+ */
+int pipe_status(int unit, char *buf, size_t bufsize)
+{
+	char	part[512];
+
+	if (!bufsize)
+		return(0);
+	buf[0] = 0;
+	if (unit < 0 || unit >= npipeunits || !analysed[unit])
+		return(0);
+	part[sizeof(part) - 1] = 0;
+#if PIPE_DISTORTION
+	dist_format(&dists[unit], part, sizeof(part) - 1);
+	statusAdd(buf, bufsize, part);
+#endif
+#if PIPE_PSF
+	psf_format(&psfs[unit], part, sizeof(part) - 1);
+	statusAdd(buf, bufsize, part);
+#endif
+#if PIPE_VIGNET
+	vig_format(&vignets[unit], part, sizeof(part) - 1);
+	statusAdd(buf, bufsize, part);
+#endif
+#if PIPE_ROIS
+	roi_format(&roisets[unit], part, sizeof(part) - 1);
+	statusAdd(buf, bufsize, part);
+#endif
+#if PIPE_LCA
+	lca_format(&lcas[unit], part, sizeof(part) - 1);
+	statusAdd(buf, bufsize, part);
+#endif
+#if PIPE_FOCUS
+	foc_format(&focuses[unit], part, sizeof(part) - 1);
+	statusAdd(buf, bufsize, part);
+#endif
+#if PIPE_STAR
+	star_format(&starss[unit], part, sizeof(part) - 1);
+	statusAdd(buf, bufsize, part);
+#endif
+#if PIPE_PARTIAL
+	_snprintf(part, sizeof(part) - 1, "read: %.1f%% of frame", 100.0 * frames[unit].nread / max(frames[unit].npix, 1));
+	statusAdd(buf, bufsize, part);
+#endif
+#if PIPE_GATE
+	gate_format(&gates[unit], part, sizeof(part) - 1);
+	statusAdd(buf, bufsize, part);
+#endif
+	return((int)strlen(buf));
+}
+
+/*
+ * Whether a unit's lens has been passed or failed, so there's no
+ * need to go on analysing; the verdict is recorded once.
+ */
+static int pipe_decided(int unit)
+{
+#if PIPE_GATE
+	struct	gate *g = &gates[unit];
+
+	if (g->verdict == GATE_PENDING)
+		return(0);
+	if (!gated[unit]) {
+		gated[unit] = 1;
+		res_add(&results, "gate.verdict", 0, g->verdict);
+		res_add(&results, "gate.millis", 0, g->millis);
+		res_add(&results, "gate.frames", 0, g->frames);
+	}
+	return(1);
+#else
+	return(0);
+#endif
+}
+
+/*
+ * Analyse a corrected, possibly averaged, frame. Each stage's
+ * results are passed on as soon as measured, so the remaining
+ * stages are skipped once the lens is decided.
+ */
+static int pipe_analyse(int unit, struct hostframe *f)
+{
+	int	err = 0;
+
+	analysed[unit] = f;
+#if PIPE_RECORD
+	err = res_frame(&results, runs[unit], serials[unit], nframes[unit]++);
+	if (err < 0)
+		return(err);
+#endif
+#if PIPE_GATE
+	results.tapctx = &gates[unit];
+	gate_frame(&gates[unit]);
+#endif
+#if PIPE_DISTORTION
+	TRACE_SPAN("distortion", err = dist_measure(&dists[unit], f));
+#if PIPE_RECORD
+	if (err >= 0)
+		err = dist_record(&dists[unit], &results);
+#endif
+	if (err < 0 || pipe_decided(unit))
+		return(err);
+#endif
+#if PIPE_PSF
+	TRACE_SPAN("psf", err = psf_measure(&psfs[unit], f));
+#if PIPE_RECORD
+	if (err >= 0)
+		err = psf_record(&psfs[unit], &results);
+#endif
+	if (err < 0 || pipe_decided(unit))
+		return(err);
+#endif
+#if PIPE_VIGNET
+	TRACE_SPAN("vignetting", err = vig_measure(&vignets[unit], f));
+#if PIPE_RECORD
+	if (err >= 0)
+		err = vig_record(&vignets[unit], &results);
+#endif
+	if (err < 0 || pipe_decided(unit))
+		return(err);
+#endif
+#if PIPE_ROIS
+	TRACE_SPAN("roi_update", err = roi_update(&roisets[unit], f));
+	if (err < 0)
+		return(err);
+#if PIPE_LCA
+	lca_place(&lcas[unit], f, &roisets[unit]);
+#endif
+#endif
+#if PIPE_LCA
+	TRACE_SPAN("lca", err = lca_measure(&lcas[unit], f));
+#if PIPE_RECORD
+	if (err >= 0)
+		err = lca_record(&lcas[unit], &results);
+#endif
+	if (err < 0 || pipe_decided(unit))
+		return(err);
+#endif
+#if PIPE_FOCUS
+	TRACE_SPAN("focus", err = foc_measure(&focuses[unit], f));
+#if PIPE_RECORD
+	if (err >= 0)
+		err = foc_record(&focuses[unit], &results);
+#endif
+	if (err < 0 || pipe_decided(unit))
+		return(err);
+#endif
+#if PIPE_STAR
+	TRACE_SPAN("star", err = star_measure(&starss[unit], f));
+#if PIPE_RECORD
+	if (err >= 0)
+		err = star_record(&starss[unit], &results);
+#endif
+	if (err < 0 || pipe_decided(unit))
+		return(err);
+#endif
+	return(err);
+}
+
+/*
+ * The verdict on a unit's lens: 1 passed, -1 failed,
+ * 0 not (yet) decided or not gating.
+ */
+int pipe_verdict(int unit)
+{
+	if (unit < 0 || unit >= npipeunits)
+		return(0);
+#if PIPE_GATE
+	return(gates[unit].verdict);
+#else
+	return(0);
+#endif
+}
+
+/*
+ * Process a newly captured buffer.
+ */
+int pipe_process(int unit, pxbuffer_t buf)
+{
+	int	err;
+	struct	hostframe *f;
+#if PIPE_PARTIAL
+	struct	framerect rects[PIPE_ROIS_MAX];
+	struct	framerect spans[4 * PIPE_ROIS_MAX];
+	int	nspans;
+#endif
+#if PIPE_STACK
+	int	added;
+#endif
+
+	if (unit >= npipeunits || pipe_decided(unit))
+		return(0);
+	f = &frames[unit];
+#if PIPE_PARTIAL
+	//
+	// While tracking, read just the ROIs; merged, as they
+	// may well overlap once widened by the search margin.
+	//
+	nspans = roi_rects(&roisets[unit], PIPE_AOI_MARGIN, rects, PIPE_ROIS_MAX);
+	nspans = frame_spans(f, rects, nspans, spans, sizeof(spans) / sizeof(spans[0]));
+	if (nspans > 0)
+		err = frame_readRects(f, unit, buf, spans, nspans);
+	else
+		err = frame_read(f, unit, buf);
+#else
+	err = frame_read(f, unit, buf);
+#endif
+	if (err < 0)
+		return(err);
+#if PIPE_FLATFIELD && PIPE_PARTIAL
+	if (f->partial)
+		TRACE_SPAN("flatfield", ffc_applyRects(&flats[unit], f, spans, nspans));
+	else
+		TRACE_SPAN("flatfield", ffc_apply(&flats[unit], f));
+#elif PIPE_FLATFIELD
+	TRACE_SPAN("flatfield", ffc_apply(&flats[unit], f));
+#endif
+#if PIPE_STACK
+	TRACE_SPAN("stack", added = stk_add(&stacks[unit], f, &stacked[unit]));
+	if (!added)
+		return(0);
+	f = &stacked[unit];
+#endif
+	return(pipe_analyse(unit, f));
+}
+
+/*
+ * Wait for capture of the selected units to have stopped.
+ */
+static int waitUnLive(int unitmap, DWORD millis)
+{
+	for (DWORD t = GetTickCount(); GetTickCount() - t < millis; Sleep(1))
+		if (pxd_goneLive(unitmap, 0) == 0)
+			break;
+	return(pxd_goneLive(unitmap, 0) == 0);
+}
+
+/*
+ * Capture and average nframes dark ('d') or flat ('f') frames
+ * for each of the selected units.
+ *
+ * Frames are captured as a sequence, at full camera rate,
+ * into as many frame buffers as are available; then read
+ * back and accumulated. Larger counts are done in batches.
+ * The flat calibration should follow the dark calibration,
+ * as the gain map is computed relative to the master dark.
+ */
+int pipe_calibrate(int unitmap, int kind, int nframes)
+{
+	int	err = 0;
+	int	u;
+
+	if (!waitUnLive(unitmap, 15000))
+		return(PXERTIMEOUT);
+	for (u = 0; u < npipeunits; u++) {
+		if (!(unitmap & (1 << u)))
+			continue;
+		err = ffc_begin(&flats[u]);
+		if (err < 0)
+			return(err);
+	}
+	while (nframes > 0) {
+		int n = min(nframes, pxd_imageZdim());
+		err = pxd_goLiveSeq(unitmap, 1, n, 1, n, 1);
+		if (err < 0)
+			return(err);
+		if (!waitUnLive(unitmap, 15000)) {
+			pxd_goAbortLive(unitmap);
+			return(PXERTIMEOUT);
+		}
+		for (pxbuffer_t b = 1; b <= n; b++) {
+			for (u = 0; u < npipeunits; u++) {
+				if (!(unitmap & (1 << u)))
+					continue;
+				err = frame_read(&frames[u], u, b);
+				if (err < 0)
+					return(err);
+				ffc_add(&flats[u], &frames[u]);
+			}
+		}
+		nframes -= n;
+	}
+	for (u = 0; u < npipeunits; u++) {
+		if (!(unitmap & (1 << u)))
+			continue;
+		err = kind == 'd' ? ffc_endDark(&flats[u]) : ffc_endFlat(&flats[u]);
+		if (err < 0)
+			return(err);
+	}
+	return(0);
+}
@@ -0,0 +1,25 @@
+#pragma once
+/*
+ *	pipeline.h
+ *
+ *	Per frame processing between capture and analysis.
+ *
+ *	Each newly captured buffer is read once into a host frame
+ *	per unit, corrected, and then handed to the analysis stages.
+ *	All functions are to be called from the thread which
+ *	otherwise uses XCLIB, i.e. the dialog's.
+ */
+
+#include "frame.h"
+
+#define PIPE_MAXUNITS	4
+
+int	pipe_open(int units);
+void	pipe_close(void);
+int	pipe_process(int unit, pxbuffer_t buf);
+void	pipe_restart(int unit);
+void	pipe_lens(int unit, const char *serial);
+int	pipe_calibrate(int unitmap, int kind, int nframes);
+const struct hostframe *pipe_frame(int unit);
+int	pipe_status(int unit, char *buf, size_t bufsize);
+int	pipe_verdict(int unit);
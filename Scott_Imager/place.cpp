@@ -0,0 +1,207 @@
+/*
+ *	place.cpp
+ *
+ *	Placement of threads on processors, by role.
+ *	See place.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "xcliball.h"
+}
+#include "place.h"
+#include "trace.h"
+
+static	const char *rolenames[PLACE_ROLES] = { "capture", "writer", "analysis" };
+static	const int   priorities[PLACE_ROLES] = {
+	THREAD_PRIORITY_TIME_CRITICAL, THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_NORMAL
+};
+
+static	int	    enabled = 0;		// prioritize, by role
+static	int	    pinned = 0;			// and pin, there being enough cores
+static	DWORD_PTR   masks[PLACE_ROLES];
+static	int	    nthreads = 0;
+static	struct {
+	HANDLE	h;				// our own duplicate
+	DWORD	id;
+	int	role;
+	char	name[32];
+}		    threads[PLACE_MAXTHREADS];
+
+
+/*
+ * The process's processors, grouped by core, in
+ * order. Returns the number of cores.
+ */
+static int place_cores(DWORD_PTR procmask, DWORD_PTR *cores, int maxcores)
+{
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info;
+	DWORD	len = 0;
+	int	n = 0;
+
+	GetLogicalProcessorInformation(NULL, &len);
+	info = len ? (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(len) : NULL;
+	if (info && GetLogicalProcessorInformation(info, &len)) {
+		for (DWORD i = 0; i < len / sizeof(*info) && n < maxcores; i++)
+			if (info[i].Relationship == RelationProcessorCore && (info[i].ProcessorMask & procmask))
+				cores[n++] = info[i].ProcessorMask & procmask;
+	}
+	free(info);
+	//
+	// Else, each processor is taken to be a core.
+	//
+	for (int b = 0; !n && b < (int)sizeof(DWORD_PTR) * 8; b++)
+		if (procmask & ((DWORD_PTR)1 << b))
+			cores[n++] = (DWORD_PTR)1 << b;
+	return(n);
+}
+
+static int place_apply(int i)
+{
+	int	role = threads[i].role;
+
+	if (!SetThreadAffinityMask(threads[i].h, masks[role]))
+		return(PXERROR);
+	if (!SetThreadPriority(threads[i].h, enabled ? priorities[role] : THREAD_PRIORITY_NORMAL))
+		return(PXERROR);
+	return(0);
+}
+
+/*
+ * Divide the process's cores among the roles: capturecores for
+ * capture, writercores for writers (with none, they share the
+ * analysis cores), the rest for analysis, and re-place threads
+ * already placed. With capturecores <= 0, placement is off: all
+ * threads may run anywhere, at normal priority. A priorityclass
+ * other than 0 is set for the process, e.g. HIGH_PRIORITY_CLASS.
+ * Returns whether threads are pinned.
+ */
+int place_plan(int capturecores, int writercores, DWORD priorityclass)
+{
+	DWORD_PTR procmask, sysmask;
+	DWORD_PTR cores[sizeof(DWORD_PTR) * 8];
+	int	n;
+
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &procmask, &sysmask))
+		return(PXERROR);
+	if (priorityclass)
+		SetPriorityClass(GetCurrentProcess(), priorityclass);
+	n = place_cores(procmask, cores, sizeof(cores) / sizeof(cores[0]));
+	writercores = max(writercores, 0);
+	enabled = capturecores > 0;
+	pinned = enabled && capturecores + writercores < n;
+	for (int r = 0; r < PLACE_ROLES; r++)
+		masks[r] = procmask;
+	if (pinned) {
+		masks[PLACE_CAPTURE] = masks[PLACE_WRITER] = masks[PLACE_ANALYSIS] = 0;
+		for (int k = 0; k < capturecores; k++)
+			masks[PLACE_CAPTURE] |= cores[--n];
+		for (int k = 0; k < writercores; k++)
+			masks[PLACE_WRITER] |= cores[--n];
+		while (n > 0)
+			masks[PLACE_ANALYSIS] |= cores[--n];
+		if (!writercores)
+			masks[PLACE_WRITER] = masks[PLACE_ANALYSIS];
+	}
+	for (int i = 0; i < nthreads; i++)
+		place_apply(i);
+	return(pinned);
+}
+
+/*
+ * The number of processors a role's threads may run on.
+ */
+int place_processors(int role)
+{
+	int	n = 0;
+
+	if (!masks[role])
+		place_plan(0, 0, 0);
+	for (int b = 0; b < (int)sizeof(DWORD_PTR) * 8; b++)
+		if (masks[role] & ((DWORD_PTR)1 << b))
+			n++;
+	return(n);
+}
+
+/*
+ * Place a thread as per its role, and remember it
+ * by name. The handle needn't outlive the call.
+ */
+int place_thread(HANDLE thread, int role, const char *name)
+{
+	HANDLE	h;
+	int	i;
+
+	if (role < 0 || role >= PLACE_ROLES)
+		return(PXERNOMODE);
+	if (nthreads >= PLACE_MAXTHREADS)
+		return(PXERMALLOC);
+	if (!DuplicateHandle(GetCurrentProcess(), thread, GetCurrentProcess(), &h, 0, FALSE, DUPLICATE_SAME_ACCESS))
+		return(PXERROR);
+	if (!masks[role])
+		place_plan(0, 0, 0);	// not planned: anywhere
+	i = nthreads++;
+	threads[i].h = h;
+	threads[i].id = GetThreadId(h);
+	threads[i].role = role;
+	threads[i].name[sizeof(threads[i].name) - 1] = 0;
+	strncpy(threads[i].name, name ? name : "", sizeof(threads[i].name) - 1);
+	return(place_apply(i));
+}
+
+/*
+ * Place the calling thread.
+ */
+int place_self(int role, const char *name)
+{
+	TRACE_THREAD(name);
+	return(place_thread(GetCurrentThread(), role, name));
+}
+
+/*
+ * Forget a thread, such as before it ends.
+ */
+void place_forget(HANDLE thread)
+{
+	DWORD	id = GetThreadId(thread);
+
+	for (int i = 0; i < nthreads; i++) {
+		if (threads[i].id != id)
+			continue;
+		CloseHandle(threads[i].h);
+		threads[i] = threads[--nthreads];
+		return;
+	}
+}
+
+/*
+ * Describe the i'th thread placed: its role, processors,
+ * and CPU time used, in total and as a share of its life.
+ * Returns -1 past the last thread.
+ */
+int place_format(int i, char *buf, size_t bufsize)
+{
+	FILETIME created, exited, kernel, user, now;
+	ULARGE_INTEGER k, u, c, t;
+	double	cpu, life;
+
+	if (i < 0 || i >= nthreads)
+		return(-1);
+	if (!GetThreadTimes(threads[i].h, &created, &exited, &kernel, &user))
+		return(_snprintf(buf, bufsize, "thread %s: %s, ended", threads[i].name, rolenames[threads[i].role]));
+	GetSystemTimeAsFileTime(&now);
+	k.LowPart = kernel.dwLowDateTime;   k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;	    u.HighPart = user.dwHighDateTime;
+	c.LowPart = created.dwLowDateTime;  c.HighPart = created.dwHighDateTime;
+	t.LowPart = now.dwLowDateTime;	    t.HighPart = now.dwHighDateTime;
+	cpu = (k.QuadPart + u.QuadPart) / 1.0E4;	// 100ns -> millis
+	life = (t.QuadPart - c.QuadPart) / 1.0E4;
+	return(_snprintf(buf, bufsize, "thread %s: %s, cpus 0x%llx, priority %d, cpu %.0f ms (%.1f%%), %.0f ms kernel",
+		threads[i].name, rolenames[threads[i].role], (unsigned long long)masks[threads[i].role],
+		GetThreadPriority(threads[i].h), cpu, life > 0 ? 100.0 * cpu / life : 0.0, k.QuadPart / 1.0E4));
+}
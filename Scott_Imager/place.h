@@ -0,0 +1,34 @@
+#pragma once
+/*
+ *	place.h
+ *
+ *	Placement of threads on processors, by role.
+ *
+ *	Capture service threads, which must notice each captured frame
+ *	or trigger promptly, are pinned to cores of their own and run
+ *	at high priority, so that analysis can't delay them. Writer
+ *	threads get the next cores, if asked for, and analysis workers
+ *	the remaining cores. Cores are taken whole, with their hyper-
+ *	threaded siblings, from the highest numbered down, leaving
+ *	core 0, which usually services most interrupts, to analysis.
+ *	Where there aren't enough cores, threads are prioritized but
+ *	not pinned.
+ *
+ *	Placed threads are remembered until forgotten, so that their
+ *	CPU time can be reported; planning again re-places them. To
+ *	be used from one thread, such as the dialog's.
+ */
+
+#define PLACE_CAPTURE	    0	// roles
+#define PLACE_WRITER	    1
+#define PLACE_ANALYSIS	    2
+#define PLACE_ROLES	    3
+
+#define PLACE_MAXTHREADS    80
+
+int	place_plan(int capturecores, int writercores, DWORD priorityclass);
+int	place_thread(HANDLE thread, int role, const char *name);
+int	place_self(int role, const char *name);
+void	place_forget(HANDLE thread);
+int	place_processors(int role);
+int	place_format(int i, char *buf, size_t bufsize);
@@ -0,0 +1,472 @@
+/*
+ *	psf.cpp
+ *
+ *	Point spread function measurement from a pinhole target.
+ *	See psf.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <limits.h>
+#include <math.h>
+
+#include "psf.h"
+#include "results.h"
+#include "workers.h"
+
+#define PSF_LOSTFRAC	5	// redetect if more than 1/5 are lost
+#define PSF_MINRISE	0.25	// spots rise this fraction of the brightest above background
+
+
+int psf_alloc(struct psf *p, int maxspots, int radius, int oversample)
+{
+	size_t	patch;
+
+	memset(p, 0, sizeof(*p));
+	p->radius = radius;
+	p->oversample = oversample;
+	p->side = 2 * radius * oversample;
+	patch = (size_t)p->side * p->side;
+	p->spots = (struct psfspot*)calloc(maxspots, sizeof(struct psfspot));
+	p->patches = (float*)_aligned_malloc(2 * patch * maxspots * sizeof(float), 64);
+	if (!p->spots || !p->patches) {
+		psf_free(p);
+		return(PXERMALLOC);
+	}
+	p->maxspots = maxspots;
+	for (int s = 0; s < maxspots; s++) {
+		p->spots[s].sum = p->patches + 2 * patch * s;
+		p->spots[s].weight = p->spots[s].sum + patch;
+	}
+	return(0);
+}
+
+void psf_free(struct psf *p)
+{
+	if (p->spots)
+		free(p->spots);
+	if (p->patches)
+		_aligned_free(p->patches);
+	memset(p, 0, sizeof(*p));
+}
+
+/*
+ * Forget the spots and their accumulated patches;
+ * the next frame does a full detection.
+ */
+void psf_reset(struct psf *p)
+{
+	p->nspots = 0;
+	p->tracking = 0;
+}
+
+/*
+ * Brightest pixel and darkest pixel of each tile,
+ * in parallel over tiles.
+ */
+struct tilectx {
+	const struct hostframe *f;
+	int	tile;
+	int	ntx;
+	int	*maxv;
+	int	*maxx;
+	int	*maxy;
+	int	*minv;
+};
+
+static void psf_tileFn(void *ctx, int index)
+{
+	struct	tilectx *t = (struct tilectx*)ctx;
+	int	x0 = (index % t->ntx) * t->tile, y0 = (index / t->ntx) * t->tile;
+	int	x1 = min(x0 + t->tile, t->f->xdim), y1 = min(y0 + t->tile, t->f->ydim);
+	int	hi = -1, lo = INT_MAX, hx = x0, hy = y0;
+
+	for (int y = y0; y < y1; y++) {
+		for (int x = x0; x < x1; x++) {
+			int v = frame_mono(t->f, x, y);
+			if (v > hi) {
+				hi = v;
+				hx = x;
+				hy = y;
+			}
+			if (v < lo)
+				lo = v;
+		}
+	}
+	t->maxv[index] = hi;
+	t->maxx[index] = hx;
+	t->maxy[index] = hy;
+	t->minv[index] = lo;
+}
+
+static int cmpint(const void *a, const void *b)
+{
+	return(*(const int*)a - *(const int*)b);
+}
+
+static int cmpspot(const void *a, const void *b)
+{
+	double d = ((const struct psfspot*)b)->mass - ((const struct psfspot*)a)->mass;
+	return(d > 0 ? 1 : d < 0 ? -1 : 0);
+}
+
+/*
+ * Locate spots: the brightest pixel of each tile, if well above
+ * the background, and not within a patch of a brighter spot
+ * or of the frame's edge. Tiles are the patch size, so no
+ * pinhole spacing that allows whole patches is missed.
+ */
+static int psf_detect(struct psf *p, const struct hostframe *f)
+{
+	struct	tilectx t;
+	struct	psfspot *cand;
+	int	ntiles, ncand = 0, bg, peak = 0;
+
+	p->nspots = 0;
+	t.f = f;
+	t.tile = 2 * p->radius;
+	t.ntx = (f->xdim + t.tile - 1) / t.tile;
+	ntiles = t.ntx * ((f->ydim + t.tile - 1) / t.tile);
+	t.maxv = (int*)malloc(4 * ntiles * sizeof(int));
+	cand = (struct psfspot*)malloc(ntiles * sizeof(struct psfspot));
+	if (!t.maxv || !cand) {
+		free(t.maxv);
+		free(cand);
+		return(PXERMALLOC);
+	}
+	t.maxx = t.maxv + ntiles;
+	t.maxy = t.maxx + ntiles;
+	t.minv = t.maxy + ntiles;
+	wrk_parallel(ntiles, psf_tileFn, &t);
+
+	for (int i = 0; i < ntiles; i++)
+		peak = max(peak, t.maxv[i]);
+	qsort(t.minv, ntiles, sizeof(int), cmpint);
+	bg = t.minv[ntiles / 2];
+
+	for (int i = 0; i < ntiles; i++) {
+		if (t.maxv[i] - bg < PSF_MINRISE * (peak - bg) || t.maxv[i] <= bg)
+			continue;
+		if (t.maxx[i] <= p->radius || t.maxy[i] <= p->radius
+		 || t.maxx[i] >= f->xdim - 1 - p->radius || t.maxy[i] >= f->ydim - 1 - p->radius)
+			continue;
+		memset(&cand[ncand], 0, sizeof(cand[ncand]));
+		cand[ncand].x = t.maxx[i];
+		cand[ncand].y = t.maxy[i];
+		cand[ncand].mass = t.maxv[i];
+		ncand++;
+	}
+	qsort(cand, ncand, sizeof(struct psfspot), cmpspot);
+	for (int i = 0; i < ncand && p->nspots < p->maxspots; i++) {
+		int s;
+		for (s = 0; s < p->nspots; s++) {
+			double dx = cand[i].x - p->spots[s].x, dy = cand[i].y - p->spots[s].y;
+			if (dx * dx + dy * dy < 4.0 * p->radius * p->radius)
+				break;
+		}
+		if (s < p->nspots)
+			continue;
+		struct psfspot *sp = &p->spots[p->nspots++];
+		float *sum = sp->sum, *weight = sp->weight;
+		memset(sp, 0, sizeof(*sp));
+		sp->sum = sum;
+		sp->weight = weight;
+		sp->x = cand[i].x;
+		sp->y = cand[i].y;
+		memset(sum, 0, 2 * (size_t)p->side * p->side * sizeof(float));
+	}
+	free(t.maxv);
+	free(cand);
+	return(p->nspots);
+}
+
+/*
+ * Half maximum width of a profile, by linear
+ * interpolation either side of its peak.
+ */
+static double fwhm(const double *v, int n)
+{
+	int	pk = 0, l, r;
+	double	half, wl, wr;
+
+	for (int i = 1; i < n; i++)
+		if (v[i] > v[pk])
+			pk = i;
+	if (v[pk] <= 0)
+		return(0);
+	half = v[pk] / 2;
+	for (l = pk; l > 0 && v[l - 1] > half; l--)
+		;
+	for (r = pk; r < n - 1 && v[r + 1] > half; r++)
+		;
+	if (l == 0 || r == n - 1)
+		return(n);	// wider than the patch
+	wl = l - (v[l] - half) / (v[l] - v[l - 1]);
+	wr = r + (v[r] - half) / (v[r] - v[r + 1]);
+	return(wr - wl);
+}
+
+/*
+ * Derive FWHM and encircled energy from a spot's patch.
+ */
+static void psf_results(const struct psf *p, struct psfspot *sp)
+{
+	int	side = p->side, nr = side / 2;
+	double	*prof = (double*)_alloca((2 * side + nr + 1) * sizeof(double));
+	double	*profy = prof + side, *ring = profy + side;
+	double	cx = 0, cy = 0, tot = 0, acc, vmax = 0;
+	int	pk = 0;
+
+	//
+	// Centroid, and peak bin, of the averaged patch.
+	//
+	for (int i = 0; i < side * side; i++) {
+		double v = sp->weight[i] > 0 ? sp->sum[i] / sp->weight[i] : 0;
+		if (v > 0) {
+			cx += v * (i % side + 0.5);
+			cy += v * (i / side + 0.5);
+			tot += v;
+		}
+		if (v > vmax) {
+			vmax = v;
+			pk = i;
+		}
+	}
+	if (tot <= 0)
+		return;
+	cx /= tot;
+	cy /= tot;
+
+	//
+	// Profiles through the peak.
+	//
+	for (int i = 0; i < side; i++) {
+		int a = (pk / side) * side + i, b = i * side + pk % side;
+		prof[i] = sp->weight[a] > 0 ? sp->sum[a] / sp->weight[a] : 0;
+		profy[i] = sp->weight[b] > 0 ? sp->sum[b] / sp->weight[b] : 0;
+	}
+	sp->fwhmx = fwhm(prof, side) / p->oversample;
+	sp->fwhmy = fwhm(profy, side) / p->oversample;
+
+	//
+	// Encircled energy, within the patch's inscribed circle,
+	// from rings one bin wide about the centroid.
+	//
+	for (int r = 0; r <= nr; r++)
+		ring[r] = 0;
+	for (int i = 0; i < side * side; i++) {
+		double dx = i % side + 0.5 - cx, dy = i / side + 0.5 - cy;
+		int r = (int)sqrt(dx * dx + dy * dy);
+		if (r < nr && sp->weight[i] > 0)
+			ring[r] += sp->sum[i] / sp->weight[i];
+	}
+	tot = 0;
+	for (int r = 0; r < nr; r++)
+		tot += ring[r];
+	sp->ee50 = sp->ee80 = 0;
+	if (tot <= 0)
+		return;
+	acc = 0;
+	for (int r = 0; r < nr; r++) {
+		double prev = acc;
+		acc += ring[r];
+		if (!sp->ee50 && acc >= 0.5 * tot)
+			sp->ee50 = (r + (0.5 * tot - prev) / ring[r]) / p->oversample;
+		if (!sp->ee80 && acc >= 0.8 * tot)
+			sp->ee80 = (r + (0.8 * tot - prev) / ring[r]) / p->oversample;
+	}
+}
+
+/*
+ * Centroid one spot, and spread its background corrected pixels
+ * over the patch's oversampled bins; in parallel over spots.
+ */
+struct spotctx {
+	struct	psf *p;
+	const struct hostframe *f;
+	int	tracking;
+};
+
+static void psf_spotFn(void *ctx, int index)
+{
+	struct	spotctx *c = (struct spotctx*)ctx;
+	const struct hostframe *f = c->f;
+	struct	psf *p = c->p;
+	struct	psfspot *sp = &p->spots[index];
+	int	r = p->radius, os = p->oversample, side = p->side;
+	double	x = sp->x, y = sp->y, bg = 0, sw = 0;
+	int	x0 = 0, y0 = 0;
+
+	if (c->tracking && sp->mass0 <= 0)
+		return;
+
+	//
+	// Centroid within the patch, against the background
+	// along the patch's border.
+	//
+	for (int iter = 0; iter < 3; iter++) {
+		double sx = 0, sy = 0;
+		int x1, y1;
+		x0 = (int)(x + 0.5) - r;
+		y0 = (int)(y + 0.5) - r;
+		x1 = x0 + 2 * r;
+		y1 = y0 + 2 * r;
+		if (x0 < 0 || y0 < 0 || x1 >= f->xdim || y1 >= f->ydim) {
+			sw = 0;
+			break;
+		}
+		bg = 0;
+		for (int xx = x0; xx <= x1; xx++)
+			bg += frame_mono(f, xx, y0) + frame_mono(f, xx, y1);
+		for (int yy = y0 + 1; yy < y1; yy++)
+			bg += frame_mono(f, x0, yy) + frame_mono(f, x1, yy);
+		bg /= 8 * r;
+		sw = 0;
+		for (int yy = y0; yy <= y1; yy++) {
+			for (int xx = x0; xx <= x1; xx++) {
+				double w = frame_mono(f, xx, yy) - bg;
+				if (w <= 0)
+					continue;
+				sw += w;
+				sx += w * xx;
+				sy += w * yy;
+			}
+		}
+		if (sw <= 0)
+			break;
+		double moved = fabs(sx / sw - x) + fabs(sy / sw - y);
+		x = sx / sw;
+		y = sy / sw;
+		if (moved < 0.02)
+			break;
+	}
+	if (sw <= 0 || (c->tracking && sw < 0.3 * sp->mass0)) {
+		sp->mass = 0;
+		return;
+	}
+	sp->x = x;
+	sp->y = y;
+	sp->mass = sw;
+	if (!c->tracking)
+		sp->mass0 = sw;
+	sp->field = sqrt((x - p->cx) * (x - p->cx) + (y - p->cy) * (y - p->cy)) / p->norm;
+
+	//
+	// Pixel xx covers bins [u, u+os) where u = (xx - 0.5 - (x - r)) * os.
+	// The fractional offset is the same for every pixel, so each
+	// pixel's coverage of its os+1 bins, in each direction, is too.
+	//
+	double	ux = (x0 - 0.5 - (x - r)) * os, uy = (y0 - 0.5 - (y - r)) * os;
+	int	bx0 = (int)floor(ux), by0 = (int)floor(uy);
+	double	*wx = (double*)_alloca(2 * (os + 1) * sizeof(double)), *wy = wx + os + 1;
+	for (int k = 0; k <= os; k++) {
+		wx[k] = min(bx0 + k + 1.0, ux + os) - max((double)bx0 + k, ux);
+		wy[k] = min(by0 + k + 1.0, uy + os) - max((double)by0 + k, uy);
+	}
+	for (int yy = 0; yy <= 2 * r; yy++) {
+		for (int ky = 0; ky <= os; ky++) {
+			int by = by0 + yy * os + ky;
+			if (by < 0 || by >= side || wy[ky] <= 0)
+				continue;
+			float *srow = sp->sum + (size_t)by * side, *wrow = sp->weight + (size_t)by * side;
+			for (int xx = 0; xx <= 2 * r; xx++) {
+				double v = frame_mono(f, x0 + xx, y0 + yy) - bg;
+				for (int kx = 0; kx <= os; kx++) {
+					int bx = bx0 + xx * os + kx;
+					if (bx < 0 || bx >= side)
+						continue;
+					double w = wy[ky] * wx[kx];
+					srow[bx] += (float)(v * w);
+					wrow[bx] += (float)w;
+				}
+			}
+		}
+	}
+	sp->frames++;
+	psf_results(p, sp);
+}
+
+/*
+ * Accumulate one frame.
+ */
+int psf_measure(struct psf *p, const struct hostframe *f)
+{
+	struct	spotctx c;
+
+	p->cx = (f->xdim - 1) / 2.0;
+	p->cy = (f->ydim - 1) / 2.0;
+	p->norm = sqrt(p->cx * p->cx + p->cy * p->cy);
+	c.p = p;
+	c.f = f;
+
+	p->lost = 0;
+	if (p->tracking) {
+		c.tracking = 1;
+		wrk_parallel(p->nspots, psf_spotFn, &c);
+		for (int s = 0; s < p->nspots; s++)
+			if (p->spots[s].mass <= 0 && p->spots[s].mass0 > 0)
+				p->lost++;
+		if (p->lost * PSF_LOSTFRAC > p->nspots)
+			p->tracking = 0;
+	}
+	if (!p->tracking) {
+		int n = psf_detect(p, f);
+		if (n < 0)
+			return(n);
+		c.tracking = 0;
+		wrk_parallel(p->nspots, psf_spotFn, &c);
+		p->tracking = n > 0;
+	}
+	return(0);
+}
+
+/*
+ * Summarize, for display: the spots nearest
+ * the centre and furthest into the field.
+ */
+int psf_format(const struct psf *p, char *buf, size_t bufsize)
+{
+	const struct psfspot *in = NULL, *out = NULL;
+
+	for (int s = 0; s < p->nspots; s++) {
+		const struct psfspot *sp = &p->spots[s];
+		if (!sp->frames || sp->mass0 <= 0)
+			continue;
+		if (!in || sp->field < in->field)
+			in = sp;
+		if (!out || sp->field > out->field)
+			out = sp;
+	}
+	if (!in)
+		return(_snprintf(buf, bufsize, "psf: no spots"));
+	return(_snprintf(buf, bufsize, "psf: %d spots  @%.2f fwhm %.2fx%.2f ee50 %.2f ee80 %.2f px, %d frames"
+				       "  @%.2f fwhm %.2fx%.2f ee50 %.2f ee80 %.2f px, %d frames",
+		p->nspots, in->field, in->fwhmx, in->fwhmy, in->ee50, in->ee80, in->frames,
+		out->field, out->fwhmx, out->fwhmy, out->ee50, out->ee80, out->frames));
+}
+
+/*
+ * Record each spot's results; the ROI is the spot's index.
+ */
+int psf_record(const struct psf *p, struct results *r)
+{
+	int	err = 0;
+
+	for (int s = 0; s < p->nspots && err >= 0; s++) {
+		const struct psfspot *sp = &p->spots[s];
+		if (!sp->frames || sp->mass0 <= 0)
+			continue;
+		err = res_add(r, "psf.fwhmx", s, sp->fwhmx);
+		if (err >= 0)
+			err = res_add(r, "psf.fwhmy", s, sp->fwhmy);
+		if (err >= 0)
+			err = res_add(r, "psf.ee50", s, sp->ee50);
+		if (err >= 0)
+			err = res_add(r, "psf.ee80", s, sp->ee80);
+	}
+	return(err);
+}
@@ -0,0 +1,60 @@
+#pragma once
+/*
+ *	psf.h
+ *
+ *	Point spread function measurement from a pinhole target.
+ *
+ *	Bright spots are located across the field, and around each
+ *	an oversampled patch is accumulated, frame after frame, to
+ *	build up signal to noise. Each pixel is spread over the
+ *	oversampled bins it covers, offset by the spot's sub-pixel
+ *	centroid, so the patch is the PSF as integrated by the pixel
+ *	aperture. Encircled energy and FWHM are derived from the
+ *	accumulated patch.
+ *
+ *	Work is per spot, in parallel; each spot's patch is held
+ *	contiguously so that a worker's accumulation stays within
+ *	its own cache lines rather than striding over whole frames.
+ */
+
+#include "frame.h"
+
+struct	results;
+
+struct psfspot {
+	double	x;	    // centroid, last frame
+	double	y;
+	double	mass;	    // background corrected sum; 0 if lost
+	double	mass0;	    // at detection
+	double	field;	    // distance from the image centre, relative to the half diagonal
+	int	frames;	    // frames accumulated
+	float	*sum;	    // oversampled patch, side*side
+	float	*weight;    // coverage of each bin, side*side
+	//
+	// Results, in pixels.
+	//
+	double	fwhmx;
+	double	fwhmy;
+	double	ee50;	    // radius of 50% encircled energy
+	double	ee80;	    // radius of 80% encircled energy
+};
+
+struct psf {
+	int	radius;	    // patch half size, pixels
+	int	oversample; // bins per pixel
+	int	side;	    // patch side, bins
+	int	maxspots;
+	int	nspots;
+	struct	psfspot *spots;
+	float	*patches;   // all spots' sum and weight arrays
+	int	tracking;   // spots are valid seeds for the next frame
+	int	lost;	    // spots lost in the last frame
+	double	cx, cy, norm;
+};
+
+int	psf_alloc(struct psf *p, int maxspots, int radius, int oversample);
+void	psf_free(struct psf *p);
+void	psf_reset(struct psf *p);
+int	psf_measure(struct psf *p, const struct hostframe *f);
+int	psf_format(const struct psf *p, char *buf, size_t bufsize);
+int	psf_record(const struct psf *p, struct results *r);
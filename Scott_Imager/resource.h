@@ -7,6 +7,10 @@
 #define FunnyButton                     1002
 #define FUNNYBUTTON                     1002
 #define IDIMAGE                         1003
+#define IDDARKCAL                       202
+#define IDFLATCAL                       203
+#define IDRINGCAPTURE                   204
+#define IDRINGTRIGGER                   205
 
 // Next default values for new objects
 // 
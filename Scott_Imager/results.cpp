@@ -0,0 +1,655 @@
+/*
+ *	results.cpp
+ *
+ *	Append only, column oriented store of measurement results.
+ *	See results.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <io.h>
+
+extern "C" {
+#include "xcliball.h"
+}
+#include "results.h"
+
+#define RES_TAG		"SIR1"
+
+/*
+ * Block header; followed by the columns, each of nrows:
+ * time, run, frame, value, serial, roi, metric.
+ */
+struct resheader {
+	int	nrows;
+	int	runmin, runmax;
+	unsigned short serialmin, serialmax;
+	unsigned short metricmin, metricmax;
+	int	pad;
+	__int64	tmin, tmax;
+};
+
+#define RES_ROWBYTES	(sizeof(__int64) + sizeof(int) + sizeof(unsigned) + sizeof(float) + 3 * sizeof(unsigned short))
+
+
+/*
+ * Reading: the records of a file, in order. Blocks are skipped
+ * unless the filter might select rows of them, else read whole
+ * and handed to the block function, with the filter's names
+ * resolved to dictionary indices; -1 for any, -2 for not yet
+ * in the dictionary, so matching nothing.
+ */
+struct resblock {
+	struct	resheader h;
+	__int64	*time;
+	int	*run;
+	unsigned *frame;
+	float	*value;
+	unsigned short *serial;
+	unsigned short *roi;
+	unsigned short *metric;
+};
+
+struct resreader {
+	const struct resfilter *flt;
+	int	serial;
+	int	metric;
+	char	(*serials)[RES_NAMELEN];
+	char	(*metrics)[RES_NAMELEN];
+	int	nserials;
+	int	nmetrics;
+	int	maxserials;
+	int	maxmetrics;
+	int	lastrun;
+	__int64	good;	    // bytes of the file up to the last complete record
+	__int64	torn;	    // bytes after, of a record cut short, e.g. by a crash
+	void	(*fn)(struct resreader *rd, const struct resblock *b);
+	void	*ctx;
+};
+
+static int res_matches(const struct resreader *rd, const struct resblock *b, int i)
+{
+	const struct resfilter *f = rd->flt;
+
+	if (!f)
+		return(1);
+	return((rd->metric < 0 || b->metric[i] == rd->metric)
+	    && (rd->serial < 0 || b->serial[i] == rd->serial)
+	    && (f->run < 0 || b->run[i] == f->run)
+	    && (f->roi < 0 || b->roi[i] == f->roi)
+	    && (!f->from || b->time[i] >= f->from)
+	    && (!f->to || b->time[i] <= f->to));
+}
+
+static int res_skip(const struct resreader *rd, const struct resheader *h)
+{
+	const struct resfilter *f = rd->flt;
+
+	if (!f)
+		return(0);
+	return(rd->metric == -2 || (rd->metric >= 0 && (rd->metric < h->metricmin || rd->metric > h->metricmax))
+	    || rd->serial == -2 || (rd->serial >= 0 && (rd->serial < h->serialmin || rd->serial > h->serialmax))
+	    || (f->run >= 0 && (f->run < h->runmin || f->run > h->runmax))
+	    || (f->from && h->tmax < f->from)
+	    || (f->to && h->tmin > f->to));
+}
+
+/*
+ * Make room for one more name in a dictionary, doubling it if full.
+ */
+static int res_grow(char (**names)[RES_NAMELEN], int *room, int n)
+{
+	char	(*p)[RES_NAMELEN];
+	int	m;
+
+	if (n < *room)
+		return(0);
+	if (*room >= RES_MAXNAMES)
+		return(PXERMALLOC);
+	m = min(*room * 2, RES_MAXNAMES);
+	p = (char(*)[RES_NAMELEN])realloc(*names, (size_t)m * RES_NAMELEN);
+	if (!p)
+		return(PXERMALLOC);
+	*names = p;
+	*room = m;
+	return(0);
+}
+
+/*
+ * Read a file's records. A last record cut short, as by a
+ * crash while it was written, ends the file; rd->good and
+ * rd->torn tell where, and how much is left over.
+ */
+static int res_read(const char *path, struct resreader *rd)
+{
+	FILE	*fp;
+	char	tag[4];
+	char	*data = NULL;
+	size_t	datasize = 0;
+	int	rec[2];
+	int	err = 0;
+	__int64	size;
+
+	rd->serial = rd->flt && rd->flt->serial ? -2 : -1;
+	rd->metric = rd->flt && rd->flt->metric ? -2 : -1;
+	rd->nserials = rd->nmetrics = 0;
+	rd->lastrun = 0;
+	rd->good = rd->torn = 0;
+	fp = fopen(path, "rb");
+	if (!fp)
+		return(PXERNOFILE);
+	if (_fseeki64(fp, 0, SEEK_END) != 0 || (size = _ftelli64(fp)) < 0 || _fseeki64(fp, 0, SEEK_SET) != 0
+	 || fread(tag, 4, 1, fp) != 1 || memcmp(tag, RES_TAG, 4) != 0) {
+		fclose(fp);
+		return(PXERDOSIO);
+	}
+	rd->good = 4;
+	while (fread(rec, sizeof(rec), 1, fp) == 1) {
+		if (rec[1] < 0 || rd->good + (__int64)sizeof(rec) + rec[1] > size)
+			break;		// cut short
+		rd->good += sizeof(rec) + rec[1];
+		if (rec[0] == 'S' || rec[0] == 'M') {
+			int	serial = rec[0] == 'S';
+			int	*n = serial ? &rd->nserials : &rd->nmetrics;
+			const char *want = !rd->flt ? NULL : serial ? rd->flt->serial : rd->flt->metric;
+			char	*name;
+			err = serial ? res_grow(&rd->serials, &rd->maxserials, *n) : res_grow(&rd->metrics, &rd->maxmetrics, *n);
+			if (err < 0)
+				break;
+			name = serial ? rd->serials[*n] : rd->metrics[*n];
+			if (rec[1] != RES_NAMELEN || fread(name, RES_NAMELEN, 1, fp) != 1) {
+				err = PXERDOSIO;
+				break;
+			}
+			name[RES_NAMELEN - 1] = 0;
+			if (want && strcmp(want, name) == 0)
+				*(serial ? &rd->serial : &rd->metric) = *n;
+			(*n)++;
+		}
+		else if (rec[0] == 'B') {
+			struct resblock b;
+			if (rec[1] < (int)sizeof(b.h) || fread(&b.h, sizeof(b.h), 1, fp) != 1
+			 || rec[1] != (int)(sizeof(b.h) + b.h.nrows * RES_ROWBYTES)) {
+				err = PXERDOSIO;
+				break;
+			}
+			rd->lastrun = max(rd->lastrun, b.h.runmax);
+			if (!rd->fn || res_skip(rd, &b.h)) {
+				if (fseek(fp, rec[1] - (long)sizeof(b.h), SEEK_CUR) != 0) {
+					err = PXERDOSIO;
+					break;
+				}
+				continue;
+			}
+			if ((size_t)(rec[1] - sizeof(b.h)) > datasize) {
+				free(data);
+				datasize = rec[1] - sizeof(b.h);
+				data = (char*)malloc(datasize);
+				if (!data) {
+					err = PXERMALLOC;
+					break;
+				}
+			}
+			if (fread(data, rec[1] - sizeof(b.h), 1, fp) != 1) {
+				err = PXERDOSIO;
+				break;
+			}
+			b.time = (__int64*)data;
+			b.run = (int*)(b.time + b.h.nrows);
+			b.frame = (unsigned*)(b.run + b.h.nrows);
+			b.value = (float*)(b.frame + b.h.nrows);
+			b.serial = (unsigned short*)(b.value + b.h.nrows);
+			b.roi = b.serial + b.h.nrows;
+			b.metric = b.roi + b.h.nrows;
+			rd->fn(rd, &b);
+		}
+		else if (fseek(fp, rec[1], SEEK_CUR) != 0) {
+			err = PXERDOSIO;
+			break;
+		}
+	}
+	if (err >= 0)
+		rd->torn = size - rd->good;
+	free(data);
+	fclose(fp);
+	return(err);
+}
+
+/*
+ * Cut a file short, to drop a torn last record.
+ */
+static int res_truncate(const char *path, __int64 size)
+{
+	FILE	*fp = fopen(path, "r+b");
+	int	err = 0;
+
+	if (!fp)
+		return(PXERDOSIO);	// not PXERNOFILE: it's there
+	if (_chsize_s(_fileno(fp), size) != 0)
+		err = PXERDOSIO;
+	if (fclose(fp) != 0)
+		err = PXERDOSIO;
+	return(err);
+}
+
+static int res_names(struct resreader *rd)
+{
+	rd->serials = (char(*)[RES_NAMELEN])malloc(RES_NAMES * RES_NAMELEN);
+	rd->metrics = (char(*)[RES_NAMELEN])malloc(RES_NAMES * RES_NAMELEN);
+	if (!rd->serials || !rd->metrics) {
+		free(rd->serials);
+		free(rd->metrics);
+		rd->serials = rd->metrics = NULL;
+		return(PXERMALLOC);
+	}
+	rd->maxserials = rd->maxmetrics = RES_NAMES;
+	return(0);
+}
+
+/*
+ * Writing.
+ */
+static int res_record(FILE *fp, int type, const void *p, int size)
+{
+	int	rec[2] = { type, size };
+
+	if (fwrite(rec, sizeof(rec), 1, fp) != 1 || (size && fwrite(p, size, 1, fp) != 1))
+		return(PXERDOSIO);
+	return(0);
+}
+
+/*
+ * Open a store for appending; created if need be.
+ * With no path, rows are only passed to the tap.
+ */
+int res_open(struct results *r, const char *path)
+{
+	struct	resreader rd;
+	int	err;
+
+	memset(r, 0, sizeof(*r));
+	memset(&rd, 0, sizeof(rd));
+	r->ctime = (__int64*)malloc(RES_BLOCKROWS * sizeof(__int64));
+	r->crun = (int*)malloc(RES_BLOCKROWS * sizeof(int));
+	r->cframe = (unsigned*)malloc(RES_BLOCKROWS * sizeof(unsigned));
+	r->cvalue = (float*)malloc(RES_BLOCKROWS * sizeof(float));
+	r->cserial = (unsigned short*)malloc(RES_BLOCKROWS * sizeof(unsigned short));
+	r->croi = (unsigned short*)malloc(RES_BLOCKROWS * sizeof(unsigned short));
+	r->cmetric = (unsigned short*)malloc(RES_BLOCKROWS * sizeof(unsigned short));
+	err = res_names(&rd);
+	r->serials = rd.serials;
+	r->metrics = rd.metrics;
+	r->maxserials = rd.maxserials;
+	r->maxmetrics = rd.maxmetrics;
+	if (err < 0 || !r->ctime || !r->crun || !r->cframe || !r->cvalue || !r->cserial || !r->croi || !r->cmetric) {
+		res_close(r);
+		return(PXERMALLOC);
+	}
+	r->serial = r->lastmetric = -1;
+	if (!path)
+		return(0);
+
+	//
+	// Continue an existing file's dictionaries and runs,
+	// after its last complete record; one torn by a crash
+	// is dropped, so that later rows can still be read.
+	//
+	err = res_read(path, &rd);
+	if (err >= 0 && rd.torn) {
+		printf("results: %s: %lld bytes of a record not completely written dropped\n", path, (long long)rd.torn);
+		err = res_truncate(path, rd.good);
+	}
+	if (err == PXERNOFILE) {
+		r->fp = fopen(path, "wb");
+		if (r->fp && fwrite(RES_TAG, 4, 1, r->fp) != 1)
+			err = PXERDOSIO;
+		else
+			err = 0;
+	}
+	else if (err >= 0)
+		r->fp = fopen(path, "ab");
+	if (err >= 0 && !r->fp)
+		err = PXERNOFILE;
+	r->serials = rd.serials;	// as grown reading
+	r->metrics = rd.metrics;
+	if (err < 0) {
+		res_close(r);
+		return(err);
+	}
+	r->maxserials = rd.maxserials;
+	r->maxmetrics = rd.maxmetrics;
+	r->nserials = rd.nserials;
+	r->nmetrics = rd.nmetrics;
+	r->lastrun = rd.lastrun;
+	return(0);
+}
+
+void res_close(struct results *r)
+{
+	if (r->fp) {
+		res_flush(r);
+		fclose(r->fp);
+	}
+	free(r->serials);
+	free(r->metrics);
+	free(r->ctime);
+	free(r->crun);
+	free(r->cframe);
+	free(r->cvalue);
+	free(r->cserial);
+	free(r->croi);
+	free(r->cmetric);
+	memset(r, 0, sizeof(*r));
+}
+
+/*
+ * Index of a name in a dictionary, added if new.
+ */
+static int res_name(struct results *r, int type, const char *name)
+{
+	char	(**names)[RES_NAMELEN] = type == 'S' ? &r->serials : &r->metrics;
+	int	*n = type == 'S' ? &r->nserials : &r->nmetrics;
+	int	i, err;
+
+	for (i = *n - 1; i >= 0; i--)
+		if (strncmp((*names)[i], name, RES_NAMELEN - 1) == 0)
+			return(i);
+	err = res_grow(names, type == 'S' ? &r->maxserials : &r->maxmetrics, *n);
+	if (err < 0)
+		return(err);
+	memset((*names)[*n], 0, RES_NAMELEN);
+	strncpy((*names)[*n], name, RES_NAMELEN - 1);
+	if (r->fp && res_record(r->fp, type, (*names)[*n], RES_NAMELEN) < 0)
+		return(PXERDOSIO);
+	return((*n)++);
+}
+
+int res_newRun(struct results *r)
+{
+	return(++r->lastrun);
+}
+
+/*
+ * Set the run, lens and frame of the rows that follow;
+ * timestamped now. With no file, the serial isn't kept.
+ */
+int res_frame(struct results *r, int run, const char *serial, unsigned frame)
+{
+	FILETIME ft;
+	__int64	t;
+	int	s = 0;
+
+	if (r->fp)
+		s = res_name(r, 'S', serial ? serial : "");
+	if (s < 0)
+		return(s);
+	GetSystemTimeAsFileTime(&ft);
+	t = ((__int64)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	r->time = (t - 116444736000000000LL) / 10000;
+	r->run = run;
+	r->serial = s;
+	r->frame = frame;
+	return(0);
+}
+
+int res_add(struct results *r, const char *metric, int roi, double value)
+{
+	int	m = r->lastmetric;
+	int	n = r->nrows;
+
+	if (r->serial < 0)
+		return(PXERROR);
+	if (r->tap)
+		r->tap(r->tapctx, metric, roi, value);
+	if (!r->fp)
+		return(0);
+	if (m < 0 || strncmp(r->metrics[m], metric, RES_NAMELEN - 1) != 0) {
+		m = res_name(r, 'M', metric);
+		if (m < 0)
+			return(m);
+		r->lastmetric = m;
+	}
+	r->ctime[n] = r->time;
+	r->crun[n] = r->run;
+	r->cframe[n] = r->frame;
+	r->cvalue[n] = (float)value;
+	r->cserial[n] = (unsigned short)r->serial;
+	r->croi[n] = (unsigned short)roi;
+	r->cmetric[n] = (unsigned short)m;
+	if (++r->nrows == RES_BLOCKROWS)
+		return(res_flush(r));
+	return(0);
+}
+
+/*
+ * Write the rows gathered as a block.
+ */
+int res_flush(struct results *r)
+{
+	struct	resheader h;
+	int	n = r->nrows;
+	int	rec[2];
+	int	err = 0;
+
+	if (!r->fp || !n)
+		return(0);
+	memset(&h, 0, sizeof(h));
+	h.nrows = n;
+	h.runmin = h.runmax = r->crun[0];
+	h.serialmin = h.serialmax = r->cserial[0];
+	h.metricmin = h.metricmax = r->cmetric[0];
+	h.tmin = h.tmax = r->ctime[0];
+	for (int i = 1; i < n; i++) {
+		h.runmin = min(h.runmin, r->crun[i]);
+		h.runmax = max(h.runmax, r->crun[i]);
+		h.serialmin = min(h.serialmin, r->cserial[i]);
+		h.serialmax = max(h.serialmax, r->cserial[i]);
+		h.metricmin = min(h.metricmin, r->cmetric[i]);
+		h.metricmax = max(h.metricmax, r->cmetric[i]);
+		h.tmin = min(h.tmin, r->ctime[i]);
+		h.tmax = max(h.tmax, r->ctime[i]);
+	}
+	rec[0] = 'B';
+	rec[1] = (int)(sizeof(h) + n * RES_ROWBYTES);
+	if (fwrite(rec, sizeof(rec), 1, r->fp) != 1
+	 || fwrite(&h, sizeof(h), 1, r->fp) != 1
+	 || fwrite(r->ctime, sizeof(__int64), n, r->fp) != (size_t)n
+	 || fwrite(r->crun, sizeof(int), n, r->fp) != (size_t)n
+	 || fwrite(r->cframe, sizeof(unsigned), n, r->fp) != (size_t)n
+	 || fwrite(r->cvalue, sizeof(float), n, r->fp) != (size_t)n
+	 || fwrite(r->cserial, sizeof(unsigned short), n, r->fp) != (size_t)n
+	 || fwrite(r->croi, sizeof(unsigned short), n, r->fp) != (size_t)n
+	 || fwrite(r->cmetric, sizeof(unsigned short), n, r->fp) != (size_t)n
+	 || fflush(r->fp) != 0)
+		err = PXERDOSIO;
+	r->rows += n;
+	r->nrows = 0;
+	return(err);
+}
+
+/*
+ * Scan: the selected rows, in order, to a function.
+ * Returns the number of rows selected.
+ */
+struct scanctx {
+	res_fn_t fn;
+	void	*ctx;
+	__int64	count;
+};
+
+static void res_scanBlock(struct resreader *rd, const struct resblock *b)
+{
+	struct	scanctx *c = (struct scanctx*)rd->ctx;
+	struct	resrow row;
+
+	for (int i = 0; i < b->h.nrows; i++) {
+		if (!res_matches(rd, b, i))
+			continue;
+		row.run = b->run[i];
+		row.serial = b->serial[i] < rd->nserials ? rd->serials[b->serial[i]] : "";
+		row.frame = b->frame[i];
+		row.time = b->time[i];
+		row.roi = b->roi[i];
+		row.metric = b->metric[i] < rd->nmetrics ? rd->metrics[b->metric[i]] : "";
+		row.value = b->value[i];
+		c->fn(c->ctx, &row);
+		c->count++;
+	}
+}
+
+__int64 res_scan(const char *path, const struct resfilter *flt, res_fn_t fn, void *ctx)
+{
+	struct	resreader rd;
+	struct	scanctx c = { fn, ctx, 0 };
+	int	err;
+
+	memset(&rd, 0, sizeof(rd));
+	rd.flt = flt;
+	rd.fn = res_scanBlock;
+	rd.ctx = &c;
+	err = res_names(&rd);
+	if (err >= 0)
+		err = res_read(path, &rd);
+	free(rd.serials);
+	free(rd.metrics);
+	return(err < 0 ? err : c.count);
+}
+
+/*
+ * Aggregate the selected rows' values, all together or grouped
+ * by run, serial index or ROI; groups beyond nout are ignored.
+ * Returns the number of groups used.
+ */
+struct aggctx {
+	int	by;
+	struct	resagg *out;
+	int	nout;
+	int	used;
+};
+
+static void res_aggBlock(struct resreader *rd, const struct resblock *b)
+{
+	struct	aggctx *c = (struct aggctx*)rd->ctx;
+
+	for (int i = 0; i < b->h.nrows; i++) {
+		int	g;
+		double	v = b->value[i];
+		if (!res_matches(rd, b, i))
+			continue;
+		g = c->by == RES_BYRUN ? b->run[i] : c->by == RES_BYSERIAL ? b->serial[i] : c->by == RES_BYROI ? b->roi[i] : 0;
+		if (g < 0 || g >= c->nout)
+			continue;
+		struct resagg *a = &c->out[g];
+		if (!a->count++)
+			a->min = a->max = v;
+		a->sum += v;
+		a->sumsq += v * v;
+		a->min = min(a->min, v);
+		a->max = max(a->max, v);
+		c->used = max(c->used, g + 1);
+	}
+}
+
+int res_aggregate(const char *path, const struct resfilter *flt, int by, struct resagg *out, int nout)
+{
+	struct	resreader rd;
+	struct	aggctx c = { by, out, nout, 0 };
+	int	err;
+
+	memset(out, 0, nout * sizeof(struct resagg));
+	memset(&rd, 0, sizeof(rd));
+	rd.flt = flt;
+	rd.fn = res_aggBlock;
+	rd.ctx = &c;
+	err = res_names(&rd);
+	if (err >= 0)
+		err = res_read(path, &rd);
+	free(rd.serials);
+	free(rd.metrics);
+	return(err < 0 ? err : c.used);
+}
+
+/*
+ * Command line report: with no metric, the metrics and their
+ * row counts; else the metric's statistics per run, serial or ROI.
+ */
+#define RES_MAXGROUPS	65536
+
+static void res_listBlock(struct resreader *rd, const struct resblock *b)
+{
+	__int64	*counts = (__int64*)rd->ctx;
+
+	for (int i = 0; i < b->h.nrows; i++)
+		if (b->metric[i] < rd->nmetrics)
+			counts[b->metric[i]]++;
+}
+
+int res_report(const char *args)
+{
+	char	path[MAX_PATH], metric[RES_NAMELEN], by[16];
+	struct	resreader rd;
+	struct	resfilter flt = { -1, NULL, NULL, -1, 0, 0 };
+	struct	resagg *agg;
+	int	n, err, g = RES_BYRUN;
+
+	memset(&rd, 0, sizeof(rd));
+	metric[0] = by[0] = 0;
+	n = sscanf(args, " %259s %31s %15s", path, metric, by);
+	if (n < 1) {
+		printf("usage: -report file [metric [run|serial|roi]]\n");
+		return(1);
+	}
+	err = res_names(&rd);
+	if (err < 0)
+		return(1);
+	if (n < 2) {
+		__int64 *counts = (__int64*)calloc(RES_MAXNAMES, sizeof(__int64));
+		rd.fn = res_listBlock;
+		rd.ctx = counts;
+		err = counts ? res_read(path, &rd) : PXERMALLOC;
+		for (int m = 0; err >= 0 && m < rd.nmetrics; m++)
+			printf("%-*s %12lld\n", RES_NAMELEN, rd.metrics[m], (long long)counts[m]);
+		printf("%d runs, %d lenses\n", rd.lastrun, rd.nserials);
+		free(counts);
+	}
+	else {
+		if (strcmp(by, "serial") == 0)
+			g = RES_BYSERIAL;
+		else if (strcmp(by, "roi") == 0)
+			g = RES_BYROI;
+		flt.metric = metric;
+		agg = (struct resagg*)malloc(RES_MAXGROUPS * sizeof(struct resagg));
+		err = agg ? res_aggregate(path, &flt, g, agg, RES_MAXGROUPS) : PXERMALLOC;
+		if (err >= 0 && g == RES_BYSERIAL)
+			res_read(path, &rd);	// for the serials' names
+		printf("%s by %s:\n%-*s %10s %12s %12s %12s %12s\n", metric, g == RES_BYSERIAL ? "serial" : g == RES_BYROI ? "roi" : "run",
+			RES_NAMELEN, g == RES_BYSERIAL ? "serial" : g == RES_BYROI ? "roi" : "run", "count", "mean", "sd", "min", "max");
+		for (int i = 0; i < err; i++) {
+			struct resagg *a = &agg[i];
+			char	key[RES_NAMELEN];
+			double	mean, sd;
+			if (!a->count)
+				continue;
+			mean = a->sum / a->count;
+			sd = sqrt(max(a->sumsq / a->count - mean * mean, 0.0));
+			if (g == RES_BYSERIAL)
+				_snprintf(key, sizeof(key), "%s", i < rd.nserials ? rd.serials[i] : "?");
+			else
+				_snprintf(key, sizeof(key), "%d", i);
+			key[sizeof(key) - 1] = 0;
+			printf("%-*s %10lld %12.5g %12.5g %12.5g %12.5g\n", RES_NAMELEN, key, (long long)a->count, mean, sd, a->min, a->max);
+		}
+		free(agg);
+	}
+	free(rd.serials);
+	free(rd.metrics);
+	if (err < 0) {
+		printf("%s: %s\n", path, pxd_mesgErrorCode(err));
+		return(1);
+	}
+	return(0);
+}
@@ -0,0 +1,117 @@
+#pragma once
+/*
+ *	results.h
+ *
+ *	Append only, column oriented store of measurement results.
+ *
+ *	Each result is a row: run, lens serial, frame index, timestamp,
+ *	ROI, metric and value. Rows are gathered in memory, column by
+ *	column, and each block of RES_BLOCKROWS rows is written to the
+ *	file at once. Lens serials and metric names are stored once, as
+ *	dictionary records, and rows hold their index. Each block's
+ *	header holds the range of runs, serials, metrics and timestamps
+ *	within, so scans skip whole blocks without reading them.
+ *
+ *	The file is a "SIR1" tag followed by records, each a type and
+ *	a length: 'S' and 'M' records add a lens serial and a metric
+ *	name to the dictionaries; 'B' records are blocks. Files are only
+ *	ever appended to, also by later sessions.
+ *
+ *	Each row added is also passed to the tap function, if set, e.g.
+ *	for pass/fail gating. With no file, rows are only passed on,
+ *	and no dictionaries are kept.
+ *
+ *	Reports and trend plots scan the file, filtered, or aggregate
+ *	a metric per run, serial or ROI; from the command line:
+ *
+ *	    Scott_Imager -report file [metric [run|serial|roi]]
+ */
+
+#include <stdio.h>
+
+#define RES_BLOCKROWS	4096
+#define RES_NAMES	1024	// of each of serials and metrics, to start with
+#define RES_MAXNAMES	65536	// of each, as rows index them in 16 bits
+#define RES_NAMELEN	32
+
+typedef void (*res_tap_t)(void *ctx, const char *metric, int roi, double value);
+
+struct results {
+	FILE	*fp;	    // NULL: rows are only passed to the tap
+	res_tap_t tap;
+	void	*tapctx;
+	char	(*serials)[RES_NAMELEN];
+	char	(*metrics)[RES_NAMELEN];
+	int	nserials;
+	int	nmetrics;
+	int	maxserials; // room, grown as need be
+	int	maxmetrics;
+	int	lastrun;    // highest run number in the file
+	int	lastmetric; // index of the last metric added, a cache
+	//
+	// Row context, from res_frame().
+	//
+	int	run;
+	int	serial;
+	unsigned frame;
+	__int64	time;	    // milliseconds since 1970, UTC
+	//
+	// The block being gathered.
+	//
+	int	nrows;
+	__int64	*ctime;
+	int	*crun;
+	unsigned *cframe;
+	float	*cvalue;
+	unsigned short *cserial;
+	unsigned short *croi;
+	unsigned short *cmetric;
+	__int64	rows;	    // written to the file this session
+};
+
+/*
+ * Selection of rows; -1, NULL or 0 for any.
+ */
+struct resfilter {
+	int	run;
+	const char *serial;
+	const char *metric;
+	int	roi;
+	__int64	from;	    // timestamps, inclusive
+	__int64	to;
+};
+
+struct resrow {
+	int	run;
+	const char *serial;
+	unsigned frame;
+	__int64	time;
+	int	roi;
+	const char *metric;
+	float	value;
+};
+
+#define RES_BYNONE	0
+#define RES_BYRUN	1
+#define RES_BYSERIAL	2
+#define RES_BYROI	3
+
+struct resagg {
+	__int64	count;
+	double	sum;
+	double	sumsq;
+	double	min;
+	double	max;
+};
+
+typedef void (*res_fn_t)(void *ctx, const struct resrow *row);
+
+int	res_open(struct results *r, const char *path);
+void	res_close(struct results *r);
+int	res_newRun(struct results *r);
+int	res_frame(struct results *r, int run, const char *serial, unsigned frame);
+int	res_add(struct results *r, const char *metric, int roi, double value);
+int	res_flush(struct results *r);
+__int64	res_scan(const char *path, const struct resfilter *flt, res_fn_t fn, void *ctx);
+int	res_aggregate(const char *path, const struct resfilter *flt, int by, struct resagg *out, int nout);
+int	res_report(const char *args);
@@ -0,0 +1,201 @@
+/*
+ *	ring.cpp
+ *
+ *	Pre-trigger capture through the frame buffers as a ring.
+ *	See ring.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+#include "seqfile.h"
+
+
+/*
+ * Start capturing through all frame buffers, over and over,
+ * awaiting the trigger. PXERNOMODE if there aren't enough
+ * frame buffers for the window and the spares.
+ */
+int ring_arm(struct ring *r, int unitmap, int pre, int post, int gpin)
+{
+	int	err;
+
+	memset(r, 0, sizeof(*r));
+	r->nbufs = pxd_imageZdim();
+	if (pre < 0 || post < 0 || pre + 1 + post + RING_SPARE > r->nbufs)
+		return(PXERNOMODE);
+	r->unitmap = unitmap;
+	r->pre = pre;
+	r->post = post;
+	r->gpin = gpin;
+	for (int u = 0; u < RING_MAXUNITS; u++)
+		if (unitmap & (1 << u))
+			r->armfield[u] = pxd_capturedFieldCount(1 << u);
+	//
+	// No number of images: capture wraps around
+	// the buffers until stopped.
+	//
+	err = pxd_goLiveSeq(unitmap, 1, r->nbufs, 1, 0, 1);
+	if (err < 0)
+		return(err);
+	for (int i = 0; i < RING_MAXGPIN; i++)
+		if (gpin & (1 << i))
+			r->lasttrig[i] = pxd_getGPTrigger(unitmap, i);
+	r->state = RING_ARMED;
+	return(0);
+}
+
+/*
+ * Trigger now; the frame last captured is the trigger frame.
+ */
+void ring_trigger(struct ring *r)
+{
+	int	fpf = max(pxd_videoFieldsPerFrame(), 1);
+
+	if (r->state != RING_ARMED)
+		return;
+	for (int u = 0; u < RING_MAXUNITS; u++) {
+		if (!(r->unitmap & (1 << u)))
+			continue;
+		int frames = (int)((pxd_capturedFieldCount(1 << u) - r->armfield[u]) / fpf);
+		r->trigbuf[u] = r->lastbuf[u] = pxd_capturedBuffer(1 << u);
+		r->npre[u] = max(0, min(r->pre, frames - 1));
+		r->after[u] = 0;
+	}
+	r->trigtime = GetTickCount();
+	r->state = RING_AFTER;
+}
+
+/*
+ * Count the frames captured since the last poll, per unit.
+ */
+static void ring_count(struct ring *r)
+{
+	for (int u = 0; u < RING_MAXUNITS; u++) {
+		if (!(r->unitmap & (1 << u)))
+			continue;
+		pxbuffer_t b = pxd_capturedBuffer(1 << u);
+		r->after[u] += (int)((b - r->lastbuf[u] + r->nbufs) % r->nbufs);
+		r->lastbuf[u] = b;
+	}
+}
+
+/*
+ * Check for the trigger, and for the end of the frames after it.
+ * To be called often, at least a few times per frame.
+ * Returns the state.
+ */
+int ring_poll(struct ring *r)
+{
+	if (r->state == RING_ARMED && r->gpin) {
+		int	rising = 0;
+		for (int i = 0; i < RING_MAXGPIN; i++) {
+			if (!(r->gpin & (1 << i)))
+				continue;
+			ulong n = pxd_getGPTrigger(r->unitmap, i);
+			rising |= n != r->lasttrig[i];
+			r->lasttrig[i] = n;
+		}
+		if (rising)
+			ring_trigger(r);
+	}
+	if (r->state != RING_AFTER)
+		return(r->state);
+	ring_count(r);
+	if (!r->stopping) {
+		for (int u = 0; u < RING_MAXUNITS; u++)
+			if ((r->unitmap & (1 << u)) && r->after[u] < r->post)
+				return(r->state);
+		pxd_goUnLive(r->unitmap);
+		r->stopping = 1;
+	}
+	if (pxd_goneLive(r->unitmap, 0))
+		return(r->state);
+	//
+	// Stopped; a frame or two past the window may have been
+	// captured meanwhile. Should there have been more, such
+	// as when polling was held up, they have overwritten the
+	// oldest of the frames before the trigger.
+	//
+	ring_count(r);
+	for (int u = 0; u < RING_MAXUNITS; u++)
+		if (r->unitmap & (1 << u))
+			r->npre[u] = max(0, min(r->npre[u], r->nbufs - 1 - r->after[u]));
+	r->state = RING_DONE;
+	return(r->state);
+}
+
+void ring_stop(struct ring *r)
+{
+	if (r->state == RING_ARMED || r->state == RING_AFTER)
+		pxd_goUnLive(r->unitmap);
+	r->state = RING_IDLE;
+}
+
+/*
+ * The window's frame buffers of a unit, oldest first.
+ * Returns their number; 0 until done.
+ */
+int ring_window(const struct ring *r, int unit, pxbuffer_t *bufs, int maxbufs)
+{
+	int	n = 0;
+
+	if (r->state != RING_DONE || !(r->unitmap & (1 << unit)))
+		return(0);
+	for (int d = -r->npre[unit]; d <= r->post && n < maxbufs; d++)
+		bufs[n++] = (pxbuffer_t)(((r->trigbuf[unit] - 1 + d) % r->nbufs + r->nbufs) % r->nbufs + 1);
+	return(n);
+}
+
+/*
+ * Save the window of a unit in simple binary format, as by
+ * SaveBinary1: the frames one after the other, oldest first,
+ * as uchar or ushort pixels as per pxd_imageBdim(). The frames
+ * are only read from the frame buffers now. Direct bypasses
+ * the file cache; see seqfile.h.
+ */
+int ring_save(const struct ring *r, int unit, const char *path, int direct)
+{
+	pxbuffer_t *bufs;
+	int	nbufs;
+	size_t	npix = (size_t)pxd_imageXdim() * pxd_imageYdim() * pxd_imageCdim();
+	int	wide = pxd_imageBdim() > 8;
+	const char *cs = pxd_imageCdim() == 1 ? "Grey" : "RGB";
+	void	*buffer;
+	struct	seqfile sf;
+	int	err = 0;
+
+	if (r->state != RING_DONE)
+		return(PXERNOMODE);
+	bufs = (pxbuffer_t*)malloc(r->nbufs * sizeof(pxbuffer_t));
+	buffer = malloc(npix * (wide ? 2 : 1));
+	if (!bufs || !buffer) {
+		free(bufs);
+		free(buffer);
+		return(PXERMALLOC);
+	}
+	nbufs = ring_window(r, unit, bufs, r->nbufs);
+	err = sf_open(&sf, path, direct);
+	if (err < 0) {
+		free(bufs);
+		free(buffer);
+		return(err);
+	}
+	for (int i = 0; i < nbufs && err >= 0; i++) {
+		if (wide)
+			err = pxd_readushort(1 << unit, bufs[i], 0, 0, -1, -1, (ushort*)buffer, npix, cs);
+		else
+			err = pxd_readuchar(1 << unit, bufs[i], 0, 0, -1, -1, (uchar*)buffer, npix, cs);
+		if (err >= 0)
+			err = sf_write(&sf, buffer, npix * (wide ? 2 : 1));
+	}
+	if (sf_close(&sf) < 0 && err >= 0)
+		err = PXERDOSIO;
+	free(bufs);
+	free(buffer);
+	return(err < 0 ? err : nbufs);
+}
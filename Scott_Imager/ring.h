@@ -0,0 +1,64 @@
+#pragma once
+/*
+ *	ring.h
+ *
+ *	Pre-trigger capture: continuous capture through the frame
+ *	buffers as a ring, until a trigger, keeping the frames before
+ *	and after it; for intermittent defects such as dust or flicker.
+ *
+ *	Once armed, capture runs through all of the grabber's frame
+ *	buffers, over and over; nothing is read to the host. On a
+ *	rising general purpose input, or ring_trigger(), the buffer
+ *	last captured is taken as the trigger frame, and capture goes
+ *	on for post more frames, then stops. The pre frames before
+ *	the trigger frame, it, and the post frames after are then
+ *	the window, still in the frame buffers, to be saved or
+ *	analysed; only then are they read.
+ *
+ *	Inputs are polled by ring_poll(), e.g. from a timer, by the
+ *	count of triggers the grabber latches on each input rather
+ *	than by its level, so that a pulse shorter than the polling
+ *	interval is not missed. With capture stopped a little after
+ *	the post frames, a few spare frame buffers are needed beyond
+ *	the window.
+ */
+
+extern "C" {
+#include "xcliball.h"
+}
+
+#define RING_IDLE	0
+#define RING_ARMED	1   // capturing, awaiting the trigger
+#define RING_AFTER	2   // triggered, capturing the post frames
+#define RING_DONE	3   // stopped, the window is in the frame buffers
+
+#define RING_SPARE	2   // frame buffers beyond the window, for the stop's latency
+#define RING_MAXUNITS	4
+#define RING_MAXGPIN	4   // G.P. trigger inputs
+
+struct ring {
+	int	unitmap;
+	int	pre;	    // frames kept before the trigger frame
+	int	post;	    // and after
+	int	gpin;	    // G.P. inputs to trigger upon, a bitmap; 0: only ring_trigger()
+	int	state;
+	int	nbufs;	    // pxd_imageZdim()
+	ulong	lasttrig[RING_MAXGPIN];	// pxd_getGPTrigger, per input, when last polled
+	int	stopping;   // pxd_goUnLive done, awaiting the end of capture
+	DWORD	trigtime;   // GetTickCount, at the trigger
+	//
+	// Per unit.
+	//
+	pxvbtime_t armfield[RING_MAXUNITS];	// pxd_capturedFieldCount, when armed
+	pxbuffer_t trigbuf[RING_MAXUNITS];	// the trigger frame
+	pxbuffer_t lastbuf[RING_MAXUNITS];	// last captured
+	int	npre[RING_MAXUNITS];		// frames before the trigger, at most pre
+	int	after[RING_MAXUNITS];		// frames captured after the trigger
+};
+
+int	ring_arm(struct ring *r, int unitmap, int pre, int post, int gpin);
+void	ring_trigger(struct ring *r);
+int	ring_poll(struct ring *r);
+void	ring_stop(struct ring *r);
+int	ring_window(const struct ring *r, int unit, pxbuffer_t *bufs, int maxbufs);
+int	ring_save(const struct ring *r, int unit, const char *path, int direct);
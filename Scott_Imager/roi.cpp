@@ -0,0 +1,377 @@
+/*
+ *	roi.cpp
+ *
+ *	Automatic placement and tracking of slanted edge ROIs.
+ *	See roi.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "roi.h"
+#include "workers.h"
+
+#define ROI_MINCOHERENCE 0.8	// of the structure tensor; 1: one orientation only
+#define ROI_MINSLANT	1.0	// degrees
+#define ROI_MAXSLANT	30.0
+#define ROI_MINENERGY	0.1	// relative to the strongest tile
+#define ROI_LOSTENERGY	0.3	// relative to detection
+#define ROI_LOSTFRAC	4	// redetect if more than 1/4 are lost
+#define ROI_ITERATIONS	3
+#define ROI_SEARCH	4	// most edge movement per frame: 1/4 of the ROI side
+
+
+int roi_alloc(struct roiset *r, int maxrois, int size)
+{
+	memset(r, 0, sizeof(*r));
+	r->rois = (struct roi*)calloc(maxrois, sizeof(struct roi));
+	if (!r->rois)
+		return(PXERMALLOC);
+	r->maxrois = maxrois;
+	r->size = size;
+	return(0);
+}
+
+void roi_free(struct roiset *r)
+{
+	if (r->rois)
+		free(r->rois);
+	memset(r, 0, sizeof(*r));
+}
+
+/*
+ * Forget the ROIs; the next frame does a full detection.
+ */
+void roi_reset(struct roiset *r)
+{
+	r->nrois = 0;
+	r->tracking = 0;
+}
+
+/*
+ * Gradient structure tensor, and gradient energy centroid,
+ * of a square, which must be at least one pixel in from the
+ * frame's edges. Given an edge, the centroid only counts
+ * gradients across that edge, so ignores others meeting it.
+ */
+struct tensor {
+	double	gxx, gyy, gxy;
+	double	cx, cy;	    // energy centroid
+	int	npix;
+};
+
+static void roi_tensor(const struct hostframe *f, int x0, int y0, int size, const struct roi *r, struct tensor *t)
+{
+	double	e = 0, ex = 0, ey = 0;
+	double	nx = 0, ny = 0;
+
+	if (r) {
+		nx = cos(r->angle * 3.14159265358979 / 180);
+		ny = sin(r->angle * 3.14159265358979 / 180);
+	}
+	t->gxx = t->gyy = t->gxy = 0;
+	for (int y = y0; y < y0 + size; y++) {
+		for (int x = x0; x < x0 + size; x++) {
+			double gx = frame_mono(f, x + 1, y) - frame_mono(f, x - 1, y);
+			double gy = frame_mono(f, x, y + 1) - frame_mono(f, x, y - 1);
+			double gn = gx * nx + gy * ny;
+			double w = r ? gn * gn : gx * gx + gy * gy;
+			t->gxx += gx * gx;
+			t->gyy += gy * gy;
+			t->gxy += gx * gy;
+			e += w;
+			ex += w * x;
+			ey += w * y;
+		}
+	}
+	t->npix = size * size;
+	t->cx = e > 0 ? ex / e : x0 + (size - 1) / 2.0;
+	t->cy = e > 0 ? ey / e : y0 + (size - 1) / 2.0;
+}
+
+/*
+ * Describe a tensor's edge; returns 1 if it's a usable slanted edge.
+ */
+static int roi_edge(const struct tensor *t, struct roi *r)
+{
+	double	tr = t->gxx + t->gyy;
+	double	coherence;
+
+	if (tr <= 0)
+		return(0);
+	coherence = sqrt((t->gxx - t->gyy) * (t->gxx - t->gyy) + 4 * t->gxy * t->gxy) / tr;
+	r->energy = tr / t->npix;
+	r->angle = 0.5 * atan2(2 * t->gxy, t->gxx - t->gyy) * 180 / 3.14159265358979;
+	r->slant = fmod(fabs(r->angle), 90.0);
+	r->slant = min(r->slant, 90.0 - r->slant);
+	return(coherence >= ROI_MINCOHERENCE && r->slant >= ROI_MINSLANT && r->slant <= ROI_MAXSLANT);
+}
+
+static int roi_clamp(int v, int size, int dim)
+{
+	return(min(max(v, 1), dim - 1 - size));
+}
+
+/*
+ * Centre a square on its edge's centroid. Across the edge
+ * that puts the edge in the middle; along it, the square
+ * moves away from where the edge ends, e.g. at a corner.
+ * Repeated as the square's content changes as it moves.
+ * Returns the final tensor.
+ */
+static void roi_centre(const struct roi *r, int size, const struct hostframe *f,
+		       int *x0, int *y0, struct tensor *t)
+{
+	for (int iter = 0; iter < ROI_ITERATIONS; iter++) {
+		roi_tensor(f, *x0, *y0, size, r, t);
+		int nx = roi_clamp((int)floor(t->cx - (size - 1) / 2.0 + 0.5), size, f->xdim);
+		int ny = roi_clamp((int)floor(t->cy - (size - 1) / 2.0 + 0.5), size, f->ydim);
+		if (nx == *x0 && ny == *y0)
+			return;
+		*x0 = nx;
+		*y0 = ny;
+	}
+	roi_tensor(f, *x0, *y0, size, r, t);
+}
+
+/*
+ * Detection: one tile per task.
+ */
+struct tilectx {
+	const struct hostframe *f;
+	int	size;
+	int	ntx;
+	struct	roi *tiles;
+};
+
+static void roi_tileFn(void *ctx, int index)
+{
+	struct	tilectx *c = (struct tilectx*)ctx;
+	struct	roi *r = &c->tiles[index];
+	struct	tensor t;
+	int	x0 = roi_clamp(1 + (index % c->ntx) * c->size, c->size, c->f->xdim);
+	int	y0 = roi_clamp(1 + (index / c->ntx) * c->size, c->size, c->f->ydim);
+
+	memset(r, 0, sizeof(*r));
+	roi_tensor(c->f, x0, y0, c->size, NULL, &t);
+	if (!roi_edge(&t, r))
+		return;
+	roi_centre(r, c->size, c->f, &x0, &y0, &t);
+	r->valid = roi_edge(&t, r);
+	r->x0 = r->xd = x0;
+	r->y0 = r->yd = y0;
+	r->energy0 = r->energy;
+	r->found = r->valid;
+	r->offset = r->offset0 = (t.cx - (x0 + (c->size - 1) / 2.0)) * cos(r->angle * 3.14159265358979 / 180)
+			       + (t.cy - (y0 + (c->size - 1) / 2.0)) * sin(r->angle * 3.14159265358979 / 180);
+}
+
+static int cmproi(const void *a, const void *b)
+{
+	double d = ((const struct roi*)b)->energy - ((const struct roi*)a)->energy;
+	return(d > 0 ? 1 : d < 0 ? -1 : 0);
+}
+
+static int roi_detect(struct roiset *r, const struct hostframe *f)
+{
+	struct	tilectx c;
+	int	ntiles;
+
+	r->nrois = 0;
+	r->dx = r->dy = 0;
+	r->detections++;
+	c.f = f;
+	c.size = r->size;
+	c.ntx = (f->xdim - 2) / r->size;
+	ntiles = c.ntx * ((f->ydim - 2) / r->size);
+	if (ntiles <= 0)
+		return(0);
+	c.tiles = (struct roi*)malloc(ntiles * sizeof(struct roi));
+	if (!c.tiles)
+		return(PXERMALLOC);
+	wrk_parallel(ntiles, roi_tileFn, &c);
+
+	//
+	// Strongest first; skip weak edges and
+	// ROIs overlapping a stronger one by half.
+	//
+	qsort(c.tiles, ntiles, sizeof(struct roi), cmproi);
+	for (int i = 0; i < ntiles && r->nrois < r->maxrois; i++) {
+		struct roi *t = &c.tiles[i];
+		int k;
+		if (!t->valid || t->energy < ROI_MINENERGY * c.tiles[0].energy)
+			continue;
+		for (k = 0; k < r->nrois; k++)
+			if (abs(r->rois[k].x0 - t->x0) < r->size / 2 && abs(r->rois[k].y0 - t->y0) < r->size / 2)
+				break;
+		if (k == r->nrois)
+			r->rois[r->nrois++] = *t;
+	}
+	free(c.tiles);
+	return(r->nrois);
+}
+
+/*
+ * Tracking. The chart is taken to move as a whole, by less than
+ * a quarter of an ROI between frames. Each ROI's edge position
+ * across the edge only gives the movement along its normal, but
+ * edges of differing orientations together give the translation.
+ */
+struct trackctx {
+	const struct hostframe *f;
+	int	size;
+	struct	roi *rois;
+	int	dx;	    // whole pixels moved since detection
+	int	dy;
+};
+
+/*
+ * Place one ROI with the chart, measure its edge's offset across
+ * the edge from the ROI's centre, and check the edge is still
+ * there; one ROI per task.
+ */
+static void roi_measureFn(void *ctx, int index)
+{
+	struct	trackctx *c = (struct trackctx*)ctx;
+	struct	roi *r = &c->rois[index];
+	struct	roi e = *r;
+	struct	tensor t;
+	double	a = r->angle * 3.14159265358979 / 180;
+
+	if (!r->valid)
+		return;
+	r->x0 = roi_clamp(r->xd + c->dx, c->size, c->f->xdim);
+	r->y0 = roi_clamp(r->yd + c->dy, c->size, c->f->ydim);
+	roi_tensor(c->f, r->x0, r->y0, c->size, r, &t);
+	r->offset = (t.cx - (r->x0 + (c->size - 1) / 2.0)) * cos(a)
+		  + (t.cy - (r->y0 + (c->size - 1) / 2.0)) * sin(a);
+	r->found = roi_edge(&t, &e) && e.energy >= ROI_LOSTENERGY * r->energy0
+		&& fabs(r->offset - r->offset0) < c->size / ROI_SEARCH;
+	r->energy = e.energy;
+}
+
+static void roi_track(struct roiset *r, const struct hostframe *f)
+{
+	struct	trackctx c = { f, r->size, r->rois };
+	int	iter;
+
+	c.dx = (int)floor(r->dx + 0.5);
+	c.dy = (int)floor(r->dy + 0.5);
+	for (iter = 0; iter < ROI_ITERATIONS; iter++) {
+		double	m[3] = { 0, 0, 0 }, v[2] = { 0, 0 };
+		double	det, ex, ey;
+
+		wrk_parallel(r->nrois, roi_measureFn, &c);
+		//
+		// Least squares translation from the offsets along
+		// each normal; slightly damped, so a chart of edges
+		// all alike in orientation stays put along them.
+		//
+		for (int i = 0; i < r->nrois; i++) {
+			struct roi *o = &r->rois[i];
+			double a = o->angle * 3.14159265358979 / 180;
+			double nx = cos(a), ny = sin(a), d;
+			if (!o->valid || !o->found)
+				continue;
+			d = o->offset - o->offset0 + (c.dx - r->dx) * nx + (c.dy - r->dy) * ny;
+			m[0] += nx * nx;
+			m[1] += nx * ny;
+			m[2] += ny * ny;
+			v[0] += nx * d;
+			v[1] += ny * d;
+		}
+		det = 0.01 * (m[0] + m[2]);
+		m[0] += det;
+		m[2] += det;
+		det = m[0] * m[2] - m[1] * m[1];
+		if (det <= 0)
+			break;
+		ex = (m[2] * v[0] - m[1] * v[1]) / det;
+		ey = (m[0] * v[1] - m[1] * v[0]) / det;
+		r->dx += ex;
+		r->dy += ey;
+		//
+		// Done once the ROIs would stay in place.
+		//
+		if ((int)floor(r->dx + 0.5) == c.dx && (int)floor(r->dy + 0.5) == c.dy)
+			break;
+		c.dx = (int)floor(r->dx + 0.5);
+		c.dy = (int)floor(r->dy + 0.5);
+	}
+	if (iter == ROI_ITERATIONS)
+		wrk_parallel(r->nrois, roi_measureFn, &c);
+	for (int i = 0; i < r->nrois; i++)
+		r->rois[i].valid = r->rois[i].valid && r->rois[i].found;
+}
+
+/*
+ * Place, or follow, the ROIs on a new frame.
+ * Detection is left for the next whole frame, if this
+ * one is partial. Returns the number of valid ROIs.
+ */
+int roi_update(struct roiset *r, const struct hostframe *f)
+{
+	int	n = 0;
+
+	if (f->xdim < r->size + 2 || f->ydim < r->size + 2)
+		return(0);
+	r->lost = 0;
+	if (r->tracking) {
+		roi_track(r, f);
+		for (int i = 0; i < r->nrois; i++)
+			if (!r->rois[i].valid)
+				r->lost++;
+		if (r->lost * ROI_LOSTFRAC > r->nrois)
+			r->tracking = 0;
+	}
+	if (!r->tracking && !f->partial) {
+		int err = roi_detect(r, f);
+		if (err < 0)
+			return(err);
+		r->tracking = err > 0;
+	}
+	for (int i = 0; i < r->nrois; i++)
+		n += r->rois[i].valid;
+	return(n);
+}
+
+/*
+ * The rectangles to read of the next frame, to go on tracking:
+ * each ROI, widened by the most it may move. Returns 0 while
+ * not tracking, i.e. when the next frame is to be read whole.
+ */
+int roi_rects(const struct roiset *r, int margin, struct framerect *rects, int maxrects)
+{
+	int	n = 0;
+	int	dx = (int)floor(r->dx + 0.5);
+	int	dy = (int)floor(r->dy + 0.5);
+
+	if (!r->tracking)
+		return(0);
+	margin += r->size / ROI_SEARCH;
+	for (int i = 0; i < r->nrois && n < maxrects; i++) {
+		const struct roi *o = &r->rois[i];
+		if (!o->valid)
+			continue;
+		rects[n].x0 = o->xd + dx - margin;
+		rects[n].y0 = o->yd + dy - margin;
+		rects[n].x1 = o->xd + dx + r->size + margin;
+		rects[n].y1 = o->yd + dy + r->size + margin;
+		n++;
+	}
+	return(n);
+}
+
+int roi_format(const struct roiset *r, char *buf, size_t bufsize)
+{
+	int	n = 0;
+
+	for (int i = 0; i < r->nrois; i++)
+		n += r->rois[i].valid;
+	return(_snprintf(buf, bufsize, "rois: %d edges, %d lost, moved %.1f,%.1f px, %d detections",
+		n, r->lost, r->dx, r->dy, r->detections));
+}
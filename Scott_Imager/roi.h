@@ -0,0 +1,60 @@
+#pragma once
+/*
+ *	roi.h
+ *
+ *	Automatic placement and tracking of slanted edge ROIs.
+ *
+ *	On the first frame, or when too many ROIs have been lost, the
+ *	frame is tiled and each tile's gradient structure tensor gives
+ *	its edge strength, coherence (one dominant orientation) and
+ *	orientation. Tiles with a strong, coherent edge slanted a few
+ *	degrees from the pixel axes become ROIs, centred on the edge.
+ *
+ *	On later frames the chart is taken to have moved as a whole.
+ *	Each ROI's edge is located across the edge, from the centroid
+ *	of gradient energy across it, at the ROI's previous place; the
+ *	offsets of edges of differing orientations together give the
+ *	chart's translation, by least squares. The ROIs move with it
+ *	and their edges are re-checked; a few thousand pixels per ROI
+ *	rather than a full frame detection. While tracking, only the
+ *	ROIs need be read of each frame; see roi_rects().
+ *
+ *	ROIs are in frame pixel coordinates, not those of the display
+ *	window.
+ */
+
+#include "frame.h"
+
+struct roi {
+	int	x0;	    // top left, pixels
+	int	y0;
+	double	angle;	    // edge normal, degrees from x
+	double	slant;	    // edge's angle from the nearest pixel axis, degrees
+	double	energy;	    // gradient energy per pixel
+	double	energy0;    // at detection
+	double	offset;	    // edge's distance across itself from the ROI centre, pixels
+	double	offset0;    // at detection
+	int	xd;	    // top left, at detection
+	int	yd;
+	int	found;	    // edge found where last measured
+	int	valid;
+};
+
+struct roiset {
+	int	size;	    // ROI side, pixels
+	int	maxrois;
+	int	nrois;
+	struct	roi *rois;
+	int	tracking;
+	double	dx;	    // chart movement since detection, pixels
+	double	dy;
+	int	lost;	    // ROIs lost in the last frame
+	int	detections; // full detections done
+};
+
+int	roi_alloc(struct roiset *r, int maxrois, int size);
+void	roi_free(struct roiset *r);
+void	roi_reset(struct roiset *r);
+int	roi_update(struct roiset *r, const struct hostframe *f);
+int	roi_rects(const struct roiset *r, int margin, struct framerect *rects, int maxrects);
+int	roi_format(const struct roiset *r, char *buf, size_t bufsize);
@@ -0,0 +1,209 @@
+/*
+ *	seqfile.cpp
+ *
+ *	Sequential writer for recorded frames.
+ *	See seqfile.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "xcliball.h"
+}
+#include "seqfile.h"
+#include "metrics.h"
+
+static	int	    metbytes = -1;
+static	int	    metwaits = -1;
+
+
+static void sf_release(struct seqfile *sf)
+{
+	for (int i = 0; i < SF_INFLIGHT; i++) {
+		if (sf->bufs[i])
+			VirtualFree(sf->bufs[i], 0, MEM_RELEASE);
+		if (sf->ov[i].hEvent)
+			CloseHandle(sf->ov[i].hEvent);
+	}
+	if (sf->h != INVALID_HANDLE_VALUE && sf->h)
+		CloseHandle(sf->h);
+	sf->h = INVALID_HANDLE_VALUE;
+}
+
+/*
+ * Create the file, unbuffered if direct and the
+ * volume allows, else buffered.
+ */
+int sf_open(struct seqfile *sf, const char *path, int direct)
+{
+	memset(sf, 0, sizeof(*sf));
+	sf->h = INVALID_HANDLE_VALUE;
+	metbytes = met_counter("scott_writer_bytes_total", NULL, "Bytes written by the sequence writer");
+	metwaits = met_histogram("scott_writer_wait_ms", NULL, "Waits for a buffer's write to finish", met_millis, MET_NMILLIS);
+	sf->path[sizeof(sf->path) - 1] = 0;
+	strncpy(sf->path, path, sizeof(sf->path) - 1);
+	for (int i = 0; i < SF_INFLIGHT; i++) {
+		sf->bufs[i] = (char*)VirtualAlloc(NULL, SF_BUFSIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		sf->ov[i].hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (!sf->bufs[i] || !sf->ov[i].hEvent) {
+			sf_release(sf);
+			return(PXERMALLOC);
+		}
+	}
+	if (direct)
+		sf->h = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL);
+	sf->direct = sf->h != INVALID_HANDLE_VALUE;
+	if (!sf->direct)
+		sf->h = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (sf->h == INVALID_HANDLE_VALUE) {
+		sf_release(sf);
+		return(PXERNOFILE);
+	}
+	return(0);
+}
+
+/*
+ * Wait for a buffer's write, if any.
+ */
+static int sf_wait(struct seqfile *sf, int i)
+{
+	DWORD	n;
+	LARGE_INTEGER pf, t0, t1;
+	BOOL	ok;
+
+	if (!sf->busy[i])
+		return(0);
+	sf->busy[i] = 0;
+	QueryPerformanceCounter(&t0);
+	ok = GetOverlappedResult(sf->h, &sf->ov[i], &n, TRUE);
+	QueryPerformanceCounter(&t1);
+	QueryPerformanceFrequency(&pf);
+	met_observe(metwaits, (t1.QuadPart - t0.QuadPart) * 1.0E3 / pf.QuadPart);
+	if (!ok || n != sf->size[i])
+		return(PXERDOSIO);
+	return(0);
+}
+
+/*
+ * Go on with buffered writes, the volume having refused an
+ * unbuffered one; what was written so far is kept.
+ */
+static int sf_buffered(struct seqfile *sf)
+{
+	LARGE_INTEGER li;
+	int	err = 0;
+
+	for (int i = 0; i < SF_INFLIGHT; i++) {
+		int e = sf_wait(sf, i);
+		if (err >= 0)
+			err = e;
+	}
+	CloseHandle(sf->h);
+	sf->direct = 0;
+	sf->h = CreateFile(sf->path, GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	li.QuadPart = (LONGLONG)sf->offset;
+	if (sf->h == INVALID_HANDLE_VALUE || !SetFilePointerEx(sf->h, li, NULL, FILE_BEGIN))
+		return(PXERDOSIO);
+	return(err);
+}
+
+/*
+ * Write the current buffer, of size bytes, and go on to
+ * the next, once its own write is done.
+ */
+static int sf_flush(struct seqfile *sf, size_t size)
+{
+	int	i = sf->cur;
+	DWORD	n;
+
+	if (sf->direct) {
+		sf->ov[i].Offset = (DWORD)sf->offset;
+		sf->ov[i].OffsetHigh = (DWORD)(sf->offset >> 32);
+		sf->size[i] = (DWORD)size;
+		ResetEvent(sf->ov[i].hEvent);
+		if (WriteFile(sf->h, sf->bufs[i], (DWORD)size, NULL, &sf->ov[i]))
+			sf->busy[i] = 1;
+		else {
+			DWORD	e = GetLastError();
+			if (e == ERROR_IO_PENDING)
+				sf->busy[i] = 1;
+			else if (e != ERROR_INVALID_PARAMETER)
+				return(PXERDOSIO);
+			else {
+				int err = sf_buffered(sf);
+				if (err < 0)
+					return(err);
+			}
+		}
+	}
+	if (!sf->direct && (!WriteFile(sf->h, sf->bufs[i], (DWORD)size, &n, NULL) || n != size))
+		return(PXERDOSIO);
+	met_add(metbytes, size);
+	sf->offset += size;
+	sf->fill = 0;
+	sf->cur = (i + 1) % SF_INFLIGHT;
+	return(sf_wait(sf, sf->cur));
+}
+
+int sf_write(struct seqfile *sf, const void *data, size_t bytes)
+{
+	const char *p = (const char*)data;
+
+	while (bytes && sf->err >= 0) {
+		size_t	n = min(bytes, SF_BUFSIZE - sf->fill);
+		memcpy(sf->bufs[sf->cur] + sf->fill, p, n);
+		sf->fill += n;
+		p += n;
+		bytes -= n;
+		if (sf->fill == SF_BUFSIZE)
+			sf->err = sf_flush(sf, SF_BUFSIZE);
+	}
+	return(sf->err);
+}
+
+/*
+ * Write what remains, and close. Unbuffered, the last
+ * buffer is written padded to whole sectors; the file is
+ * then reopened buffered to cut the padding off. That is
+ * so also if the padded buffer was written buffered, the
+ * unbuffered write having been refused.
+ */
+int sf_close(struct seqfile *sf)
+{
+	unsigned __int64 length = sf->offset + sf->fill;
+	int	direct = sf->direct;
+	int	err = sf->err;
+
+	if (err >= 0 && sf->fill) {
+		size_t	size = sf->fill;
+		if (sf->direct) {
+			size = (size + SF_ALIGN - 1) / SF_ALIGN * SF_ALIGN;
+			memset(sf->bufs[sf->cur] + sf->fill, 0, size - sf->fill);
+		}
+		err = sf_flush(sf, size);
+	}
+	for (int i = 0; i < SF_INFLIGHT; i++) {
+		int e = sf_wait(sf, i);
+		if (err >= 0)
+			err = e;
+	}
+	sf_release(sf);
+	if (direct && length % SF_ALIGN) {
+		HANDLE	h = CreateFile(sf->path, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		LARGE_INTEGER li;
+		li.QuadPart = (LONGLONG)length;
+		if (h == INVALID_HANDLE_VALUE
+		 || !SetFilePointerEx(h, li, NULL, FILE_BEGIN) || !SetEndOfFile(h))
+			err = err < 0 ? err : PXERDOSIO;
+		if (h != INVALID_HANDLE_VALUE)
+			CloseHandle(h);
+	}
+	return(err);
+}
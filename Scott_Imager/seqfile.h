@@ -0,0 +1,41 @@
+#pragma once
+/*
+ *	seqfile.h
+ *
+ *	Sequential writer for recorded frames.
+ *
+ *	Data is gathered into a few large, page aligned buffers, each
+ *	written whole while the next is being filled. Direct files are
+ *	opened unbuffered, bypassing the file cache, so that hours of
+ *	recording don't evict the analysis' working set, and written
+ *	with several overlapped writes in flight to keep the disk busy.
+ *	Unbuffered writes must be whole sectors at sector offsets; the
+ *	last buffer is padded, and the padding cut off once closed.
+ *	Where the volume doesn't allow unbuffered writes, such as some
+ *	network shares, or direct isn't asked for, buffered synchronous
+ *	writes of the same buffers are used; also from the first write
+ *	refused as an invalid parameter, as where the volume's sectors
+ *	are larger than SF_ALIGN.
+ */
+
+#define SF_ALIGN	4096		// of unbuffered writes; a multiple of any sector size
+#define SF_BUFSIZE	(1024 * 1024)	// per buffer, a multiple of SF_ALIGN
+#define SF_INFLIGHT	4		// buffers, i.e. writes in flight at most
+
+struct seqfile {
+	HANDLE	h;
+	int	direct;			// unbuffered and overlapped
+	char	*bufs[SF_INFLIGHT];
+	OVERLAPPED ov[SF_INFLIGHT];
+	int	busy[SF_INFLIGHT];	// write in flight
+	DWORD	size[SF_INFLIGHT];	// of it
+	int	cur;			// buffer being filled
+	size_t	fill;			// bytes in it
+	unsigned __int64 offset;	// of the current buffer in the file
+	int	err;			// first error, sticky
+	char	path[_MAX_PATH];
+};
+
+int	sf_open(struct seqfile *sf, const char *path, int direct);
+int	sf_write(struct seqfile *sf, const void *data, size_t bytes);
+int	sf_close(struct seqfile *sf);
@@ -0,0 +1,297 @@
+/*
+ *	serve.cpp
+ *
+ *	Capture service, and a reader of its frames.
+ *	See serve.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "serve.h"
+#include "shring.h"
+#include "place.h"
+
+/*
+ * Frames in the shared ring. More allow readers to
+ * fall further behind, briefly, without missing frames.
+ */
+#if !defined(SERVE_SLOTS)
+#define SERVE_SLOTS	16
+#endif
+/*
+ * The simulated source, used without the frame grabber.
+ */
+#if !defined(SERVE_SIMFPS)
+#define SERVE_SIMFPS	30
+#define SERVE_SIMXDIM	1280
+#define SERVE_SIMYDIM	960
+#define SERVE_SIMBITS	12
+#endif
+
+#define SERVE_MAXUNITS	32
+
+
+static double serve_millis(void)
+{
+	LARGE_INTEGER	pf = { 0,0 };
+	LARGE_INTEGER	pc = { 0,0 };
+
+	QueryPerformanceFrequency(&pf);
+	QueryPerformanceCounter(&pc);
+	if (pf.QuadPart == 0)
+		return(0);
+	return((pc.QuadPart * 1.0E3) / pf.QuadPart);
+}
+
+/*
+ * Diagonal bands, moving a little each frame, so a
+ * reader can see frames are neither torn nor repeated.
+ */
+static void serve_simFrame(ushort *pix, int xdim, int ydim, int bits, LONGLONG n)
+{
+	ushort	mask = (ushort)((1 << bits) - 1);
+
+	for (int y = 0; y < ydim; y++)
+		for (int x = 0; x < xdim; x++)
+			*pix++ = (ushort)((x + y + n * 8) & mask);
+}
+
+/*
+ * Read each unit's newly captured buffer into the ring. Buffers
+ * are read straight into the slot; the one copy from the frame
+ * grabber's memory is needed in any case. A buffer overwritten
+ * while read, as may happen if readers hold the host busy, is
+ * abandoned rather than published torn.
+ */
+static void serve_capture(struct shrserver *srv, int unitmap, pxvbtime_t *last)
+{
+	const char *cs = srv->hdr->cdim == 1 ? "Grey" : "RGB";
+
+	for (int u = 0; u < SERVE_MAXUNITS; u++) {
+		pxvbtime_t field;
+		pxbuffer_t buf;
+		LONGLONG seq;
+		ushort	*pix;
+		int	err;
+
+		if (!(unitmap & (1 << u)))
+			continue;
+		field = pxd_capturedFieldCount(1 << u);
+		if (field == last[u])
+			continue;
+		last[u] = field;
+		buf = pxd_capturedBuffer(1 << u);
+		field = pxd_buffersFieldCount(1 << u, buf);
+		pix = shr_claim(srv, &seq);
+		if (!pix)
+			continue;
+		err = pxd_readushort(1 << u, buf, 0, 0, -1, -1, pix, (int)srv->hdr->npix, (char*)cs);
+		if (err < 0 || pxd_buffersFieldCount(1 << u, buf) != field) {
+			if (err < 0)
+				printf("serve: pxd_readushort: %s\n", pxd_mesgErrorCode(err));
+			shr_abandon(srv, seq);
+			continue;
+		}
+		shr_publish(srv, seq, u, buf, field);
+	}
+}
+
+static void serve_status(struct shrserver *srv, LONGLONG *lastpub, double secs)
+{
+	struct	shrheader *h = srv->hdr;
+
+	printf("serve: %lld published, %.1f/s, %lld dropped\n",
+		(long long)h->published, (h->published - *lastpub) / secs, (long long)h->dropped);
+	for (int i = 0; i < SHR_MAXREADERS; i++) {
+		struct	shrreader *r = &h->readers[i];
+		if (r->pid)
+			printf("  reader %d: pid %ld, %lld behind, %lld missed\n",
+				i, (long)r->pid, (long long)(h->published - r->cursor), (long long)r->missed);
+	}
+	*lastpub = h->published;
+}
+
+/*
+ * Run the service until stopped; args as in serve.h.
+ * The frame grabber is opened by openfn, then captures
+ * continuously into all its buffers, giving time to read
+ * each before it is overwritten.
+ */
+int serve_run(const char *args, int (*openfn)(void), int unitmap)
+{
+	struct	shrserver srv;
+	int	sim = args && strstr(args, "sim");
+	HANDLE	waits[2] = { NULL, NULL };
+	int	nwaits = 1;
+	pxvbtime_t last[SERVE_MAXUNITS];
+	LONGLONG lastpub = 0, n = 0;
+	double	t0, tstatus, tnext;
+	int	err;
+
+	if (args && strstr(args, "stop")) {
+		HANDLE	stop = OpenEvent(EVENT_MODIFY_STATE, FALSE, SERVE_STOP);
+		if (!stop) {
+			printf("serve: not running\n");
+			return(1);
+		}
+		SetEvent(stop);
+		CloseHandle(stop);
+		return(0);
+	}
+	waits[0] = CreateEvent(NULL, TRUE, FALSE, SERVE_STOP);
+	if (!waits[0] || GetLastError() == ERROR_ALREADY_EXISTS) {
+		printf("serve: already running\n");
+		if (waits[0])
+			CloseHandle(waits[0]);
+		return(1);
+	}
+	place_plan(1, 0, HIGH_PRIORITY_CLASS);
+	place_self(PLACE_CAPTURE, "serve");
+
+	if (sim)
+		err = shr_create(&srv, SHR_NAME, SERVE_SIMXDIM, SERVE_SIMYDIM, 1, SERVE_SIMBITS, SERVE_SLOTS);
+	else {
+		err = openfn();
+		if (err < 0) {
+			printf("serve: pxd_PIXCIopen: %s\n", pxd_mesgErrorCode(err));
+			CloseHandle(waits[0]);
+			return(1);
+		}
+		err = shr_create(&srv, SHR_NAME, pxd_imageXdim(), pxd_imageYdim(), pxd_imageCdim(), pxd_imageBdim(), SERVE_SLOTS);
+	}
+	if (err >= 0 && !sim) {
+		//
+		// Without the captured field event, poll.
+		//
+		waits[1] = pxd_eventCapturedFieldCreate(unitmap);
+		nwaits = waits[1] ? 2 : 1;
+		for (int u = 0; u < SERVE_MAXUNITS; u++)
+			last[u] = (unitmap & (1 << u)) ? pxd_capturedFieldCount(1 << u) : 0;
+		err = pxd_goLiveSeq(unitmap, 1, pxd_imageZdim(), 1, 0, 1);
+		if (err < 0)
+			printf("serve: pxd_goLiveSeq: %s\n", pxd_mesgErrorCode(err));
+	}
+	else if (err < 0)
+		printf("serve: shared memory: %s\n", pxd_mesgErrorCode(err));
+	if (err >= 0) {
+		printf("serve: %s, %dx%dx%d, %d bits, %d frames of %.1f MB shared as %s\n",
+			sim ? "simulated" : "live", srv.hdr->xdim, srv.hdr->ydim, srv.hdr->cdim, srv.hdr->bits,
+			srv.hdr->nslots, srv.hdr->slotsize / 1048576.0, SHR_NAME);
+		printf("serve: stop with -serve stop\n");
+	}
+
+	t0 = tstatus = tnext = serve_millis();
+	while (err >= 0) {
+		double	now = serve_millis();
+		DWORD	timeout;
+		DWORD	r;
+
+		if (sim)
+			timeout = tnext > now ? (DWORD)(tnext - now) : 0;
+		else
+			timeout = nwaits == 2 ? 100 : 1;
+		r = WaitForMultipleObjects(nwaits, waits, FALSE, timeout);
+		if (r == WAIT_OBJECT_0 || r == WAIT_FAILED)
+			break;
+		now = serve_millis();
+		if (!sim)
+			serve_capture(&srv, unitmap, last);
+		else if (now >= tnext) {
+			LONGLONG seq;
+			ushort	*pix = shr_claim(&srv, &seq);
+			if (pix) {
+				serve_simFrame(pix, srv.hdr->xdim, srv.hdr->ydim, srv.hdr->bits, ++n);
+				shr_publish(&srv, seq, 0, (pxbuffer_t)(1 + n % 4), (pxvbtime_t)n);
+			}
+			tnext += 1000.0 / SERVE_SIMFPS;
+		}
+		if (now - tstatus >= 1000) {
+			shr_reap(&srv);
+			serve_status(&srv, &lastpub, (now - tstatus) / 1000);
+			tstatus = now;
+		}
+	}
+
+	if (srv.hdr)
+		printf("serve: stopped after %.1f s\n", (serve_millis() - t0) / 1000);
+	if (!sim) {
+		pxd_goUnLive(unitmap);
+		if (waits[1])
+			pxd_eventCapturedFieldClose(unitmap, waits[1]);
+		pxd_PIXCIclose();
+	}
+	shr_destroy(&srv);
+	place_forget(GetCurrentThread());
+	CloseHandle(waits[0]);
+	return(err < 0 ? 1 : 0);
+}
+
+/*
+ * Read the service's frames for a number of seconds, as a
+ * second process would, touching each frame's pixels in
+ * place; report the frames read, missed and their latency.
+ */
+int serve_attach(const char *args)
+{
+	struct	shrclient c;
+	int	secs = args ? atoi(args) : 0;
+	double	t0, tstatus, maxlat = 0, sumlat = 0, level = 0;
+	LONGLONG freq, frames = 0, lastframes = 0;
+	LARGE_INTEGER li;
+	int	err;
+
+	if (secs <= 0)
+		secs = 10;
+	err = shr_attach(&c, SHR_NAME);
+	if (err < 0) {
+		printf("attach: %s\n", err == PXERNOMODE ? "too many readers" : "no service running");
+		return(1);
+	}
+	QueryPerformanceFrequency(&li);
+	freq = li.QuadPart;
+	printf("attach: reader %d, %dx%dx%d, %d bits\n",
+		c.reader, c.hdr->xdim, c.hdr->ydim, c.hdr->cdim, c.hdr->bits);
+
+	t0 = tstatus = serve_millis();
+	while (serve_millis() - t0 < secs * 1000.0) {
+		const struct shrslot *slot = shr_next(&c, 1000);
+		double	now;
+
+		if (!slot) {
+			if (!c.hdr->serverpid) {
+				printf("attach: service stopped\n");
+				break;
+			}
+		}
+		else {
+			const ushort *pix = shr_pixels(slot);
+			unsigned __int64 sum = 0;
+			double	lat;
+			for (size_t i = 0; i < c.hdr->npix; i += c.hdr->xdim)
+				sum += pix[i];
+			QueryPerformanceCounter(&li);
+			lat = (li.QuadPart - slot->qpc) * 1000.0 / freq;
+			sumlat += lat;
+			maxlat = lat > maxlat ? lat : maxlat;
+			level = (double)sum * c.hdr->xdim / c.hdr->npix;
+			frames++;
+		}
+		now = serve_millis();
+		if (now - tstatus >= 1000) {
+			printf("attach: %.1f frames/s, %lld missed, latency %.3f ms mean, %.3f max, level %.0f\n",
+				(frames - lastframes) * 1000.0 / (now - tstatus),
+				(long long)c.hdr->readers[c.reader].missed,
+				frames ? sumlat / frames : 0.0, maxlat, level);
+			lastframes = frames;
+			tstatus = now;
+		}
+	}
+	printf("attach: %lld frames read, %lld missed\n",
+		(long long)frames, (long long)c.hdr->readers[c.reader].missed);
+	shr_detach(&c);
+	return(0);
+}
@@ -0,0 +1,25 @@
+#pragma once
+/*
+ *	serve.h
+ *
+ *	Capture service: one process owns the frame grabber and
+ *	publishes each captured frame to a ring in shared memory,
+ *	from which any number of local processes, up to
+ *	SHR_MAXREADERS, read the same live stream; see shring.h.
+ *	From the command line:
+ *
+ *	    Scott_Imager -serve [sim]	run the service; sim: without
+ *					the frame grabber, on a moving
+ *					synthetic pattern
+ *	    Scott_Imager -serve stop	stop it
+ *	    Scott_Imager -attach [secs]	read the stream, reporting the
+ *					frames read and missed, and
+ *					the latency
+ *
+ *	Results are printed on the console.
+ */
+
+#define SERVE_STOP	SHR_NAME ".stop"	// event, set to stop the service
+
+int	serve_run(const char *args, int (*openfn)(void), int unitmap);
+int	serve_attach(const char *args);
@@ -0,0 +1,265 @@
+/*
+ *	session.cpp
+ *
+ *	Warm start, attaching to a resident capture service.
+ *	See session.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "session.h"
+#include "serve.h"
+#include "bench.h"
+
+#define SESS_MAXRUNS	100
+
+static	HANDLE	service = NULL;		// process of the service last started
+
+
+/*
+ * Start the service in a process of its own, this same
+ * program run with -serve, not waiting for it.
+ */
+static int sess_start(const char *serveargs, HANDLE *process)
+{
+	char	path[_MAX_PATH];
+	char	cmd[_MAX_PATH + 80];
+	STARTUPINFO si;
+	PROCESS_INFORMATION pi;
+
+	if (!GetModuleFileName(NULL, path, sizeof(path)))
+		return(PXERNOFILE);
+	cmd[sizeof(cmd) - 1] = 0;
+	_snprintf(cmd, sizeof(cmd) - 1, "\"%s\" -serve %s", path, serveargs);
+	memset(&si, 0, sizeof(si));
+	si.cb = sizeof(si);
+	if (!CreateProcess(path, cmd, NULL, NULL, FALSE, DETACHED_PROCESS, NULL, NULL, &si, &pi))
+		return(PXERNOFILE);
+	CloseHandle(pi.hThread);
+	*process = pi.hProcess;
+	return(0);
+}
+
+/*
+ * Attach to the running service, waiting up to timeout millis.
+ * If serveargs isn't NULL and there's no service, start one with
+ * them, e.g. "" or "sim", and wait for it. PXERNOFILE if there's
+ * no service, or it couldn't start, as without a frame grabber.
+ */
+int sess_open(struct session *s, const char *serveargs, DWORD timeout)
+{
+	double	t0 = bench_millis();
+	HANDLE	process = NULL;
+	int	err;
+
+	memset(s, 0, sizeof(*s));
+	err = shr_attach(&s->c, SHR_NAME);
+	if (err == PXERNOFILE && serveargs) {
+		err = sess_start(serveargs, &process);
+		if (err >= 0) {
+			s->started = 1;
+			//
+			// Until the service has created the ring; it may
+			// instead end, failing to open the frame grabber.
+			//
+			do {
+				err = shr_attach(&s->c, SHR_NAME);
+				if (err != PXERNOFILE || WaitForSingleObject(process, 1) != WAIT_TIMEOUT)
+					break;
+			} while (bench_millis() - t0 < timeout);
+			if (service)
+				CloseHandle(service);
+			service = process;	// for sess_stop to wait on
+		}
+	}
+	s->openms = bench_millis() - t0;
+	return(err);
+}
+
+/*
+ * The next frame, held until the next call or
+ * sess_close; NULL if none within timeout millis.
+ */
+const struct shrslot *sess_frame(struct session *s, DWORD timeout)
+{
+	return(shr_next(&s->c, timeout));
+}
+
+/*
+ * Detach, leaving the service running for the next job.
+ */
+void sess_close(struct session *s)
+{
+	shr_detach(&s->c);
+}
+
+/*
+ * The running service's process: the one started, if still
+ * running, else as named in the ring's header; NULL if neither.
+ */
+static HANDLE sess_service(void)
+{
+	HANDLE	map, process = NULL;
+	const struct shrheader *h;
+
+	if (service && WaitForSingleObject(service, 0) == WAIT_TIMEOUT)
+		process = service;
+	else if (service)
+		CloseHandle(service);
+	service = NULL;
+	if (process)
+		return(process);
+	map = OpenFileMapping(FILE_MAP_READ, FALSE, SHR_NAME);
+	if (!map)
+		return(NULL);
+	h = (const struct shrheader*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, sizeof(*h));
+	if (h && h->magic == SHR_MAGIC && h->serverpid)
+		process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)h->serverpid);
+	if (h)
+		UnmapViewOfFile(h);
+	CloseHandle(map);
+	return(process);
+}
+
+/*
+ * Stop the resident service, if any, and wait up to timeout
+ * millis for its process to end, so that everything it held,
+ * from the frame grabber to its stop event, is free for the
+ * next. Failing the process, until the stop event is gone,
+ * the service releasing it last.
+ */
+int sess_stop(DWORD timeout)
+{
+	HANDLE	stop = OpenEvent(EVENT_MODIFY_STATE, FALSE, SERVE_STOP);
+	HANDLE	process = sess_service();
+	double	t0 = bench_millis();
+	int	err = 0;
+
+	if (!stop) {
+		if (process)
+			CloseHandle(process);
+		return(0);
+	}
+	SetEvent(stop);
+	CloseHandle(stop);
+	if (process) {
+		if (WaitForSingleObject(process, timeout) != WAIT_OBJECT_0)
+			err = PXERROR;
+		CloseHandle(process);
+		return(err);
+	}
+	while (bench_millis() - t0 < timeout) {
+		stop = OpenEvent(SYNCHRONIZE, FALSE, SERVE_STOP);
+		if (!stop)
+			return(0);
+		CloseHandle(stop);
+		Sleep(1);
+	}
+	return(PXERROR);
+}
+
+/*
+ * Time one job: start, or attach, to first frame.
+ */
+static int sess_job(const char *serveargs, double *openms, double *firstms)
+{
+	struct	session s;
+	double	t0 = bench_millis();
+	int	err;
+
+	err = sess_open(&s, serveargs, 30000);
+	if (err >= 0 && !sess_frame(&s, 5000))
+		err = PXERTIMEOUT;
+	*openms = s.openms;
+	*firstms = bench_millis() - t0;
+	sess_close(&s);
+	return(err);
+}
+
+static void sess_summary(const char *name, double *openms, double *firstms, int n)
+{
+	double	sum[2] = { 0, 0 }, lo[2] = { 1e30, 1e30 }, hi[2] = { 0, 0 };
+
+	for (int i = 0; i < n; i++) {
+		double	v[2] = { openms[i], firstms[i] };
+		for (int k = 0; k < 2; k++) {
+			sum[k] += v[k];
+			lo[k] = v[k] < lo[k] ? v[k] : lo[k];
+			hi[k] = v[k] > hi[k] ? v[k] : hi[k];
+		}
+	}
+	printf("  %-5s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", name,
+		sum[0] / n, lo[0], hi[0], sum[1] / n, lo[1], hi[1]);
+}
+
+/*
+ * Start to first frame, cold and warm; args as in
+ * session.h. Stops any service already running.
+ */
+int sess_measure(const char *args)
+{
+	const char *serveargs = args && strstr(args, "sim") ? "sim" : "";
+	int	n = 5;
+	double	openms[2][SESS_MAXRUNS], firstms[2][SESS_MAXRUNS];
+	int	done[2] = { 0, 0 };
+	int	err = 0;
+
+	for (const char *p = args; p && *p; p++) {
+		if (*p >= '1' && *p <= '9') {
+			n = min(atoi(p), SESS_MAXRUNS);
+			break;
+		}
+	}
+	printf("startup: %d jobs each, cold and warm%s\n", n, *serveargs ? ", simulated" : "");
+	if (sess_stop(10000) < 0) {
+		printf("startup: the running service won't stop\n");
+		return(1);
+	}
+	//
+	// Cold: each job starts the service, opening the frame
+	// grabber, then stops it, as each launch used to.
+	//
+	for (int i = 0; i < n && err >= 0; i++) {
+		err = sess_job(serveargs, &openms[0][i], &firstms[0][i]);
+		if (err >= 0 && sess_stop(10000) < 0)
+			err = PXERROR;
+		if (err >= 0)
+			done[0]++;
+	}
+	//
+	// Warm: the service stays, each job attaches.
+	//
+	if (err >= 0) {
+		struct	session s;
+		err = sess_open(&s, serveargs, 30000);
+		sess_close(&s);
+	}
+	for (int i = 0; i < n && err >= 0; i++) {
+		err = sess_job(NULL, &openms[1][i], &firstms[1][i]);
+		if (err >= 0)
+			done[1]++;
+	}
+	sess_stop(10000);
+	if (err < 0)
+		printf("startup: %s\n", pxd_mesgErrorCode(err));
+
+	printf("  %-5s %10s %10s %10s %10s %10s %10s\n", "",
+		"open ms", "min", "max", "first ms", "min", "max");
+	if (done[0])
+		sess_summary("cold", openms[0], firstms[0], done[0]);
+	if (done[1])
+		sess_summary("warm", openms[1], firstms[1], done[1]);
+	if (done[0] && done[1]) {
+		double	cold = 0, warm = 0;
+		for (int i = 0; i < done[0]; i++)
+			cold += firstms[0][i] / done[0];
+		for (int i = 0; i < done[1]; i++)
+			warm += firstms[1][i] / done[1];
+		printf("  warm start to first frame %.0fx quicker\n", warm > 0 ? cold / warm : 0.0);
+	}
+	return(err < 0 ? 1 : 0);
+}
@@ -0,0 +1,37 @@
+#pragma once
+/*
+ *	session.h
+ *
+ *	Warm start, for scripted runs of many short jobs: rather than
+ *	each job opening the frame grabber, loading its format, and
+ *	going live before its first frame, a capture service (see
+ *	serve.h) stays resident with the frame grabber open and live,
+ *	and each job attaches to it, reading its first frame within
+ *	about a frame period.
+ *
+ *	sess_open attaches to the running service; if asked, and none
+ *	is running, it first starts one, in a process of its own which
+ *	outlives the job, so that only the first job pays the cold
+ *	start. Frames are then read in place, as from shr_next.
+ *
+ *	From the command line,
+ *
+ *	    Scott_Imager -startup [sim] [n]
+ *
+ *	measures start to first frame n times each, cold, starting and
+ *	stopping the service each time, and warm, attaching to it.
+ */
+
+#include "shring.h"
+
+struct session {
+	struct	shrclient c;
+	int	started;		// the service was started by sess_open
+	double	openms;			// time taken by sess_open
+};
+
+int	sess_open(struct session *s, const char *serveargs, DWORD timeout);
+const struct shrslot *sess_frame(struct session *s, DWORD timeout);
+void	sess_close(struct session *s);
+int	sess_stop(DWORD timeout);
+int	sess_measure(const char *args);
@@ -0,0 +1,348 @@
+/*
+ *	shring.cpp
+ *
+ *	Ring of captured frames in shared memory.
+ *	See shring.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shring.h"
+
+#define SHR_PAGE	4096
+
+
+static void shr_eventName(char *buf, size_t bufsize, const char *name, int reader)
+{
+	buf[bufsize - 1] = 0;
+	_snprintf(buf, bufsize - 1, "%s.reader%d", name, reader);
+}
+
+/*
+ * Whether a process is still running. One which can't be
+ * opened for want of access is taken to be; only an unknown
+ * process id, or an ended process, is not.
+ */
+static int shr_alive(LONG pid)
+{
+	HANDLE	p = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+	int	alive;
+
+	if (!p)
+		return(GetLastError() != ERROR_INVALID_PARAMETER);
+	alive = WaitForSingleObject(p, 0) == WAIT_TIMEOUT;
+	CloseHandle(p);
+	return(alive);
+}
+
+/*
+ * Create the ring, for frames of the given dimensions.
+ * PXERNOMODE if there is already a server of that name.
+ * The mapping of a server since gone may outlive it, kept
+ * by a reader yet to detach; it is then taken over, and
+ * started afresh, if large enough. The readers attached keep
+ * their places, and read on from the first frame.
+ */
+int shr_create(struct shrserver *s, const char *name, int xdim, int ydim, int cdim, int bits, int nslots)
+{
+	size_t	npix = (size_t)xdim * ydim * cdim;
+	size_t	slotsize = (SHR_SLOTHDR + npix * sizeof(ushort) + SHR_PAGE - 1) / SHR_PAGE * SHR_PAGE;
+	size_t	slot0 = (sizeof(struct shrheader) + SHR_PAGE - 1) / SHR_PAGE * SHR_PAGE;
+	unsigned __int64 size = slot0 + (unsigned __int64)slotsize * nslots;
+	struct	shrheader *h;
+	int	existed;
+
+	memset(s, 0, sizeof(*s));
+	if (nslots < 2)
+		return(PXERNOMODE);
+	s->map = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, name);
+	if (!s->map)
+		return(PXERMALLOC);
+	existed = GetLastError() == ERROR_ALREADY_EXISTS;
+	s->hdr = h = (struct shrheader*)MapViewOfFile(s->map, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!h) {
+		shr_destroy(s);
+		return(PXERMALLOC);
+	}
+	if (existed) {
+		MEMORY_BASIC_INFORMATION mbi;
+		LONG	pid = h->serverpid;
+		if ((pid && shr_alive(pid)) || !VirtualQuery(h, &mbi, sizeof(mbi)) || mbi.RegionSize < size) {
+			s->hdr = NULL;		// not ours to mark as ended
+			UnmapViewOfFile(h);
+			shr_destroy(s);
+			return(PXERNOMODE);
+		}
+		//
+		// Readers check the magic; no frames, nor holds,
+		// until it is set again.
+		//
+		h->magic = 0;
+		MemoryBarrier();
+		h->published = 0;
+		h->dropped = 0;
+		for (int i = 0; i < SHR_MAXREADERS; i++) {
+			h->readers[i].holding = 0;
+			h->readers[i].cursor = 0;
+			h->readers[i].missed = 0;
+		}
+		for (int n = 0; n < nslots; n++)
+			((struct shrslot*)((char*)h + slot0 + (size_t)n * slotsize))->seq = SHR_WRITING;
+	}
+	for (int i = 0; i < SHR_MAXREADERS; i++) {
+		char	evname[_MAX_PATH];
+		shr_eventName(evname, sizeof(evname), name, i);
+		s->events[i] = CreateEvent(NULL, FALSE, FALSE, evname);
+		if (!s->events[i]) {
+			shr_destroy(s);
+			return(PXERMALLOC);
+		}
+	}
+	//
+	// A new mapping starts zeroed: no frames, no readers.
+	// The magic goes last; readers check it.
+	//
+	h->xdim = xdim;
+	h->ydim = ydim;
+	h->cdim = cdim;
+	h->bits = bits;
+	h->nslots = nslots;
+	h->npix = npix;
+	h->slotsize = slotsize;
+	h->slot0 = slot0;
+	h->serverpid = (LONG)GetCurrentProcessId();
+	InterlockedIncrement(&h->generation);
+	MemoryBarrier();
+	h->magic = SHR_MAGIC;
+	return(0);
+}
+
+/*
+ * The slot for the next frame, to read it into; NULL if the
+ * slot is held by a reader, the frame then being dropped.
+ */
+ushort *shr_claim(struct shrserver *s, LONGLONG *seq)
+{
+	struct	shrheader *h = s->hdr;
+	LONGLONG n = h->published + 1;
+	struct	shrslot *slot = shr_slot(h, n);
+	LONGLONG old = InterlockedExchange64(&slot->seq, SHR_WRITING);
+
+	//
+	// Having marked the slot as being written, check for
+	// readers holding it; a reader marks its hold, then
+	// checks the slot. Either sees the other.
+	//
+	for (int i = 0; i < SHR_MAXREADERS; i++) {
+		LONGLONG held = h->readers[i].pid ? h->readers[i].holding : 0;
+		if (held && held % h->nslots == n % h->nslots) {
+			InterlockedExchange64(&slot->seq, old);
+			InterlockedIncrement64(&h->dropped);
+			return(NULL);
+		}
+	}
+	*seq = n;
+	return((ushort*)shr_pixels(slot));
+}
+
+/*
+ * Publish the frame claimed, and wake the readers.
+ */
+void shr_publish(struct shrserver *s, LONGLONG seq, int unit, pxbuffer_t buf, pxvbtime_t fieldcount)
+{
+	struct	shrheader *h = s->hdr;
+	struct	shrslot *slot = shr_slot(h, seq);
+	LARGE_INTEGER qpc;
+
+	QueryPerformanceCounter(&qpc);
+	slot->unit = unit;
+	slot->buf = buf;
+	slot->fieldcount = fieldcount;
+	slot->qpc = qpc.QuadPart;
+	InterlockedExchange64(&slot->seq, seq);
+	InterlockedExchange64(&h->published, seq);
+	for (int i = 0; i < SHR_MAXREADERS; i++)
+		if (h->readers[i].pid)
+			SetEvent(s->events[i]);
+}
+
+/*
+ * Give up the frame claimed, e.g. having been overwritten
+ * while read from the frame grabber. No reader wants the
+ * slot's number, so readers count it as missed.
+ */
+void shr_abandon(struct shrserver *s, LONGLONG seq)
+{
+	InterlockedExchange64(&shr_slot(s->hdr, seq)->seq, -seq);
+}
+
+/*
+ * Free the places of readers whose process has ended
+ * without detaching, and so their holds.
+ */
+void shr_reap(struct shrserver *s)
+{
+	for (int i = 0; i < SHR_MAXREADERS; i++) {
+		struct	shrreader *r = &s->hdr->readers[i];
+		LONG	pid = r->pid;
+		if (!pid || shr_alive(pid))
+			continue;
+		InterlockedExchange64(&r->holding, 0);
+		InterlockedCompareExchange(&r->pid, 0, pid);
+	}
+}
+
+void shr_destroy(struct shrserver *s)
+{
+	if (s->hdr) {
+		s->hdr->serverpid = 0;
+		UnmapViewOfFile(s->hdr);
+	}
+	if (s->map)
+		CloseHandle(s->map);
+	for (int i = 0; i < SHR_MAXREADERS; i++)
+		if (s->events[i])
+			CloseHandle(s->events[i]);
+	memset(s, 0, sizeof(*s));
+}
+
+/*
+ * Attach to a server's ring as a reader, from the
+ * next frame on. PXERNOFILE if there's no server,
+ * PXERNOMODE if there are too many readers.
+ */
+int shr_attach(struct shrclient *c, const char *name)
+{
+	char	evname[_MAX_PATH];
+	LONG	pid = (LONG)GetCurrentProcessId();
+
+	memset(c, 0, sizeof(*c));
+	c->reader = -1;
+	c->map = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, name);
+	if (!c->map)
+		return(PXERNOFILE);
+	c->hdr = (struct shrheader*)MapViewOfFile(c->map, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!c->hdr || c->hdr->magic != SHR_MAGIC) {
+		shr_detach(c);
+		return(PXERNOFILE);
+	}
+	for (int i = 0; i < SHR_MAXREADERS && c->reader < 0; i++) {
+		struct shrreader *r = &c->hdr->readers[i];
+		if (InterlockedCompareExchange(&r->pid, pid, 0) != 0)
+			continue;
+		r->missed = 0;
+		InterlockedExchange64(&r->holding, 0);
+		InterlockedExchange64(&r->cursor, c->hdr->published);
+		c->generation = c->hdr->generation;
+		c->reader = i;
+	}
+	if (c->reader < 0) {
+		shr_detach(c);
+		return(PXERNOMODE);
+	}
+	shr_eventName(evname, sizeof(evname), name, c->reader);
+	c->event = OpenEvent(SYNCHRONIZE, FALSE, evname);
+	if (!c->event) {
+		shr_detach(c);
+		return(PXERNOFILE);
+	}
+	return(0);
+}
+
+/*
+ * The next frame after the last read which is still in the
+ * ring, waiting up to timeout millis for one; NULL if none.
+ * The frame is held, and may be read in place, until released
+ * or the next call. After a server restart, the first frame
+ * of the new ring, whose geometry may differ; see the header.
+ */
+const struct shrslot *shr_next(struct shrclient *c, DWORD timeout)
+{
+	struct	shrheader *h = c->hdr;
+	struct	shrreader *r = &h->readers[c->reader];
+	DWORD	t0 = GetTickCount();
+
+	shr_release(c);
+	for (;;) {
+		LONGLONG pub;
+		LONGLONG want;
+		LONGLONG v;
+		struct	shrslot *slot;
+
+		if (h->magic != SHR_MAGIC) {
+			if (GetTickCount() - t0 >= timeout)
+				return(NULL);
+			Sleep(1);	// a restarted server is taking the ring over
+			continue;
+		}
+		MemoryBarrier();
+		if (h->generation != c->generation) {
+			c->generation = h->generation;
+			InterlockedExchange64(&r->cursor, 0);
+		}
+		pub = h->published;
+		want = r->cursor + 1;
+		if (want > pub + 1) {
+			InterlockedExchange64(&r->cursor, 0);	// the ring was started afresh
+			continue;
+		}
+		if (want > pub) {
+			if (WaitForSingleObject(c->event, timeout) != WAIT_OBJECT_0)
+				return(NULL);
+			continue;
+		}
+		if (want < pub - h->nslots + 1) {
+			r->missed += pub - h->nslots + 1 - want;
+			want = pub - h->nslots + 1;
+		}
+		//
+		// Hold, then check the slot still has the frame;
+		// while the server is writing a slot, it may yet
+		// back off, seeing another reader's hold.
+		//
+		InterlockedExchange64(&r->holding, want);
+		slot = shr_slot(h, want);
+		for (DWORD t0 = GetTickCount(); (v = slot->seq) == SHR_WRITING && GetTickCount() - t0 < timeout + 1000; )
+			Sleep(0);
+		if (v == want) {
+			c->held = want;
+			return(slot);
+		}
+		InterlockedExchange64(&r->holding, 0);
+		r->missed++;
+		InterlockedExchange64(&r->cursor, want);
+	}
+}
+
+void shr_release(struct shrclient *c)
+{
+	struct	shrreader *r;
+
+	if (!c->held)
+		return;
+	r = &c->hdr->readers[c->reader];
+	InterlockedExchange64(&r->cursor, c->held);
+	InterlockedExchange64(&r->holding, 0);
+	c->held = 0;
+}
+
+void shr_detach(struct shrclient *c)
+{
+	if (c->hdr && c->reader >= 0) {
+		struct shrreader *r = &c->hdr->readers[c->reader];
+		InterlockedExchange64(&r->holding, 0);
+		InterlockedExchange(&r->pid, 0);
+	}
+	if (c->hdr)
+		UnmapViewOfFile(c->hdr);
+	if (c->map)
+		CloseHandle(c->map);
+	if (c->event)
+		CloseHandle(c->event);
+	memset(c, 0, sizeof(*c));
+	c->reader = -1;
+}
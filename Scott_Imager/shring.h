@@ -0,0 +1,108 @@
+#pragma once
+/*
+ *	shring.h
+ *
+ *	Ring of captured frames in shared memory, written by one
+ *	process, the capture service, and read in place by several
+ *	other local processes.
+ *
+ *	Frames are numbered from 1, and frame n is held in slot n %
+ *	nslots; the header holds the number of the frame last
+ *	published. The server reads each frame from the frame grabber
+ *	straight into its slot and publishes it, without locks: the
+ *	slot's number is cleared while written, then set, then the
+ *	header's. Readers find the frames after their cursor, and
+ *	read them in place, without a copy, while holding them; the
+ *	server won't overwrite a held slot, and drops the new frame
+ *	instead. Frames not held are overwritten as the ring wraps;
+ *	a reader too slow to keep up misses them, and counts them.
+ *	The server wakes each reader through an event of its own.
+ *
+ *	A restarted server takes over the mapping left by one that
+ *	died: it clears the magic, starts the ring afresh, bumps the
+ *	generation, and sets the magic again. Readers check the magic
+ *	on attaching and on each shr_next(), waiting while it is
+ *	clear, and start again from the new ring's first frame when
+ *	the generation has changed.
+ *
+ *	Pixels are ushort, interleaved as for hostframe.
+ */
+
+extern "C" {
+#include "xcliball.h"
+}
+
+#define SHR_NAME	"Local\\ScottImager"	// of the mapping; events are named after it
+#define SHR_MAGIC	0x31524853U
+#define SHR_MAXREADERS	8
+#define SHR_SLOTHDR	64			// bytes before each slot's pixels
+#define SHR_WRITING	0			// slot number while being written
+
+struct shrslot {
+	volatile LONGLONG seq;		// number of the frame held; SHR_WRITING while written
+	int	unit;
+	pxbuffer_t buf;
+	pxvbtime_t fieldcount;		// pxd_buffersFieldCount
+	LONGLONG qpc;			// QueryPerformanceCounter, when published
+};
+
+struct shrreader {
+	volatile LONG pid;		// of the reader's process; 0: free
+	volatile LONGLONG holding;	// frame being read in place; 0: none
+	volatile LONGLONG cursor;	// last frame read
+	volatile LONGLONG missed;	// overwritten before read
+};
+
+struct shrheader {
+	unsigned magic;
+	int	xdim;
+	int	ydim;
+	int	cdim;
+	int	bits;
+	int	nslots;
+	size_t	npix;			// per frame, xdim*ydim*cdim
+	size_t	slotsize;		// bytes, incl. SHR_SLOTHDR, page aligned
+	size_t	slot0;			// offset of the first slot
+	volatile LONG serverpid;
+	volatile LONG generation;	// servers to have started the ring
+	volatile LONGLONG published;	// last frame published
+	volatile LONGLONG dropped;	// not published, their slot being held
+	struct	shrreader readers[SHR_MAXREADERS];
+};
+
+struct shrserver {
+	HANDLE	map;
+	struct	shrheader *hdr;
+	HANDLE	events[SHR_MAXREADERS];	// to wake each reader
+};
+
+struct shrclient {
+	HANDLE	map;
+	struct	shrheader *hdr;
+	HANDLE	event;
+	int	reader;			// index in readers
+	LONGLONG held;			// frame held, 0: none
+	LONG	generation;		// of the ring as last read
+};
+
+int	shr_create(struct shrserver *s, const char *name, int xdim, int ydim, int cdim, int bits, int nslots);
+ushort	*shr_claim(struct shrserver *s, LONGLONG *seq);
+void	shr_publish(struct shrserver *s, LONGLONG seq, int unit, pxbuffer_t buf, pxvbtime_t fieldcount);
+void	shr_abandon(struct shrserver *s, LONGLONG seq);
+void	shr_reap(struct shrserver *s);
+void	shr_destroy(struct shrserver *s);
+
+int	shr_attach(struct shrclient *c, const char *name);
+const struct shrslot *shr_next(struct shrclient *c, DWORD timeout);
+void	shr_release(struct shrclient *c);
+void	shr_detach(struct shrclient *c);
+
+static inline struct shrslot *shr_slot(const struct shrheader *h, LONGLONG seq)
+{
+	return((struct shrslot*)((char*)h + h->slot0 + (size_t)(seq % h->nslots) * h->slotsize));
+}
+
+static inline const ushort *shr_pixels(const struct shrslot *slot)
+{
+	return((const ushort*)((const char*)slot + SHR_SLOTHDR));
+}
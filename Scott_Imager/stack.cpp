@@ -0,0 +1,129 @@
+/*
+ *	stack.cpp
+ *
+ *	Temporal frame averaging.
+ *	See stack.h.
+ */
+#include <windows.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <math.h>
+
+#include "stack.h"
+#include "kernels.h"
+#include "hostmem.h"
+
+
+int stk_alloc(struct framestack *s, size_t npix, int nframes, double clip)
+{
+	memset(s, 0, sizeof(*s));
+	s->npix = npix;
+	s->nframes = max(1, nframes);
+	s->clip = clip;
+	s->sum = (uint*)mem_alloc(npix * sizeof(uint));
+	if (!s->sum) {
+		stk_free(s);
+		return(PXERMALLOC);
+	}
+	if (clip > 0) {
+		s->sumsq = (ULONGLONG*)mem_alloc(npix * sizeof(ULONGLONG));
+		s->count = (ushort*)mem_alloc(npix * sizeof(ushort));
+		s->lo = (ushort*)mem_alloc(npix * sizeof(ushort));
+		s->hi = (ushort*)mem_alloc(npix * sizeof(ushort));
+		if (!s->sumsq || !s->count || !s->lo || !s->hi) {
+			stk_free(s);
+			return(PXERMALLOC);
+		}
+	}
+	stk_reset(s);
+	return(0);
+}
+
+void stk_free(struct framestack *s)
+{
+	mem_free(s->sum);
+	mem_free(s->sumsq);
+	mem_free(s->count);
+	mem_free(s->lo);
+	mem_free(s->hi);
+	memset(s, 0, sizeof(*s));
+}
+
+static void stk_clear(struct framestack *s)
+{
+	memset(s->sum, 0, s->npix * sizeof(uint));
+	if (s->clip > 0) {
+		memset(s->sumsq, 0, s->npix * sizeof(ULONGLONG));
+		memset(s->count, 0, s->npix * sizeof(ushort));
+	}
+	s->n = 0;
+}
+
+/*
+ * Discard any partial stack, and forget the previous
+ * stack's statistics; e.g. after the scene has changed.
+ */
+void stk_reset(struct framestack *s)
+{
+	if (!s->sum)
+		return;
+	stk_clear(s);
+	if (s->clip > 0) {
+		memset(s->lo, 0, s->npix * sizeof(ushort));
+		memset(s->hi, 0xFF, s->npix * sizeof(ushort));
+	}
+}
+
+/*
+ * Finish a clipped stack: compute each pixel's mean over the
+ * accepted values, and from their deviation the range to be
+ * accepted in the next stack. A minimum tolerance avoids
+ * rejecting everything where the noise happens to be zero,
+ * such as at saturation. Pixels where every value was rejected
+ * keep the previous mean and accept all values in the next stack.
+ */
+static void stk_endClip(struct framestack *s, ushort *dst)
+{
+	for (size_t i = 0; i < s->npix; i++) {
+		if (s->count[i]) {
+			double m = (double)s->sum[i] / s->count[i];
+			double v = (double)s->sumsq[i] / s->count[i] - m * m;
+			double t = max(s->clip * sqrt(max(v, 0.0)), 2.0);
+			dst[i] = (ushort)(m + 0.5);
+			s->lo[i] = (ushort)max(m - t, 0.0);
+			s->hi[i] = (ushort)min(m + t, 65535.0);
+		}
+		else {
+			dst[i] = (ushort)(((uint)s->lo[i] + s->hi[i]) / 2);
+			s->lo[i] = 0;
+			s->hi[i] = 0xFFFF;
+		}
+	}
+}
+
+/*
+ * Add a frame to the stack.
+ * Returns 1 once nframes have been added, with the
+ * averaged frame in out; the next frame starts a new stack.
+ */
+int stk_add(struct framestack *s, const struct hostframe *f, struct hostframe *out)
+{
+	if (!s->sum || f->npix != s->npix || out->npix != s->npix)
+		return(0);
+	if (s->clip > 0)
+		kern_accumulateClip(s->sum, s->sumsq, s->count, f->pix, s->lo, s->hi, s->npix);
+	else
+		kern_accumulate(s->sum, f->pix, s->npix);
+	if (++s->n < s->nframes)
+		return(0);
+
+	if (s->clip > 0)
+		stk_endClip(s, out->pix);
+	else
+		kern_average(out->pix, s->sum, s->npix, s->n);
+	out->unit = f->unit;
+	out->buf = f->buf;
+	out->fieldcount = f->fieldcount;
+	stk_clear(s);
+	return(1);
+}
@@ -0,0 +1,35 @@
+#pragma once
+/*
+ *	stack.h
+ *
+ *	Temporal frame averaging.
+ *
+ *	Consecutive frames are accumulated into 32 bit sums; each
+ *	nframes frames yield one averaged frame for analysis, reducing
+ *	temporal noise by sqrt(nframes) without keeping the raw frames.
+ *
+ *	Optionally, pixel values further than clip standard deviations
+ *	from the previous stack's mean are rejected as outliers
+ *	(e.g. cosmic ray hits, flicker). This is done in one pass as
+ *	frames arrive, rather than by re-reading the raw frames;
+ *	the first stack, having no predecessor, is not clipped.
+ */
+
+#include "frame.h"
+
+struct framestack {
+	size_t	npix;
+	int	nframes;    // frames per stack
+	double	clip;	    // in standard deviations, 0: no clipping
+	int	n;	    // frames accumulated so far
+	uint	*sum;
+	ULONGLONG *sumsq;   // only if clipping
+	ushort	*count;	    // only if clipping
+	ushort	*lo;	    // only if clipping: accepted range
+	ushort	*hi;
+};
+
+int	stk_alloc(struct framestack *s, size_t npix, int nframes, double clip);
+void	stk_free(struct framestack *s);
+void	stk_reset(struct framestack *s);
+int	stk_add(struct framestack *s, const struct hostframe *f, struct hostframe *out);
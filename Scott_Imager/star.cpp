@@ -0,0 +1,487 @@
+/*
+ *	star.cpp
+ *
+ *	Resolution from Siemens star targets.
+ *	See star.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <math.h>
+
+#include "star.h"
+#include "results.h"
+#include "workers.h"
+#include "lsq.h"
+
+#define STAR_RMIN	4	// innermost ring; the star is unresolved there anyway
+#define STAR_DETECT	0.6	// detection circle radius, relative to the star's
+
+
+int star_alloc(struct stars *s, int maxstars, int radius, int cycles, int sectors, double threshold)
+{
+	memset(s, 0, sizeof(*s));
+	s->radius = radius;
+	s->rmin = STAR_RMIN;
+	s->cycles = cycles;
+	s->sectors = sectors;
+	s->nang = (8 * cycles + sectors - 1) / sectors * sectors;
+	s->nrings = radius - STAR_RMIN + 1;
+	s->threshold = threshold;
+	s->list = (struct star*)calloc(maxstars, sizeof(struct star));
+	s->coef = (float*)malloc(3 * s->nang * sizeof(float));
+	float *contrast = (float*)malloc((size_t)maxstars * s->nrings * sectors * sizeof(float));
+	double *limit = (double*)malloc(maxstars * sectors * sizeof(double));
+	if (!s->list || !s->coef || !contrast || !limit) {
+		free(contrast);
+		free(limit);
+		star_free(s);
+		return(PXERMALLOC);
+	}
+	s->maxstars = maxstars;
+	for (int i = 0; i < maxstars; i++) {
+		s->list[i].contrast = contrast + (size_t)i * s->nrings * sectors;
+		s->list[i].limit = limit + i * sectors;
+	}
+
+	//
+	// Each sector's fit of m + a*cos(k*t) + b*sin(k*t),
+	// as coefficients per sample: rows of the pseudo inverse.
+	//
+	int	per = s->nang / sectors;
+	for (int sec = 0; sec < sectors; sec++) {
+		double m[9] = { 0 }, r[3] = { 0 };
+		for (int j = 0; j < per; j++) {
+			double t = 2 * 3.14159265358979 * (sec * per + j) / s->nang;
+			double v[3] = { 1, cos(cycles * t), sin(cycles * t) };
+			lsq_add(m, r, v, 0, 3);
+		}
+		for (int j = 0; j < per; j++) {
+			double t = 2 * 3.14159265358979 * (sec * per + j) / s->nang;
+			double mm[9], c[3] = { 1, cos(cycles * t), sin(cycles * t) };
+			memcpy(mm, m, sizeof(mm));
+			lsq_solve(mm, c, 3);
+			for (int k = 0; k < 3; k++)
+				s->coef[3 * (sec * per + j) + k] = (float)c[k];
+		}
+	}
+	return(0);
+}
+
+static void star_freeLuts(struct stars *s)
+{
+	for (int p = 0; p < STAR_PHASES * STAR_PHASES; p++) {
+		free(s->luts[p].off);
+		free(s->luts[p].w);
+		memset(&s->luts[p], 0, sizeof(s->luts[p]));
+	}
+	s->xdim = s->cdim = 0;
+}
+
+void star_free(struct stars *s)
+{
+	star_freeLuts(s);
+	if (s->list) {
+		free(s->list[0].contrast);
+		free(s->list[0].limit);
+		free(s->list);
+	}
+	free(s->coef);
+	memset(s, 0, sizeof(*s));
+}
+
+/*
+ * Forget the stars; the next frame does a full detection.
+ */
+void star_reset(struct stars *s)
+{
+	s->nstars = 0;
+	s->tracking = 0;
+}
+
+/*
+ * Build the lookup table for one centre phase, if not already.
+ * Tables are discarded when the line length changes.
+ */
+static int star_lut(struct stars *s, const struct hostframe *f, int phase)
+{
+	struct	starlut *l = &s->luts[phase];
+	int	n = s->nrings * s->nang;
+	int	line = f->xdim * f->cdim;
+
+	if (s->xdim != f->xdim || s->cdim != f->cdim) {
+		star_freeLuts(s);
+		s->xdim = f->xdim;
+		s->cdim = f->cdim;
+	}
+	if (l->ready)
+		return(0);
+	l->off = (int*)malloc(n * sizeof(int));
+	l->w = (float*)malloc(4 * n * sizeof(float));
+	if (!l->off || !l->w) {
+		free(l->off);
+		free(l->w);
+		l->off = NULL;
+		l->w = NULL;
+		return(PXERMALLOC);
+	}
+	double fx = (phase % STAR_PHASES + 0.5) / STAR_PHASES;
+	double fy = (phase / STAR_PHASES + 0.5) / STAR_PHASES;
+	for (int ri = 0; ri < s->nrings; ri++) {
+		for (int a = 0; a < s->nang; a++) {
+			double t = 2 * 3.14159265358979 * a / s->nang;
+			double x = fx + (s->rmin + ri) * cos(t), y = fy + (s->rmin + ri) * sin(t);
+			int ix = (int)floor(x), iy = (int)floor(y), i = ri * s->nang + a;
+			double ax = x - ix, ay = y - iy;
+			l->off[i] = iy * line + ix * f->cdim;
+			l->w[4 * i + 0] = (float)((1 - ax) * (1 - ay));
+			l->w[4 * i + 1] = (float)(ax * (1 - ay));
+			l->w[4 * i + 2] = (float)((1 - ax) * ay);
+			l->w[4 * i + 3] = (float)(ax * ay);
+		}
+	}
+	l->ready = 1;
+	return(0);
+}
+
+static int star_phase(const struct star *st)
+{
+	int px = min((int)((st->x - floor(st->x)) * STAR_PHASES), STAR_PHASES - 1);
+	int py = min((int)((st->y - floor(st->y)) * STAR_PHASES), STAR_PHASES - 1);
+	return(py * STAR_PHASES + px);
+}
+
+static double sampleAt(const struct hostframe *f, double x, double y)
+{
+	int	ix = (int)floor(x), iy = (int)floor(y);
+	double	ax = x - ix, ay = y - iy;
+
+	return((1 - ay) * ((1 - ax) * frame_mono(f, ix, iy) + ax * frame_mono(f, ix + 1, iy))
+		   + ay * ((1 - ax) * frame_mono(f, ix, iy + 1) + ax * frame_mono(f, ix + 1, iy + 1)));
+}
+
+/*
+ * Count light/dark transitions around a circle,
+ * with hysteresis against noise.
+ */
+static int star_crossings(const struct stars *s, const struct hostframe *f, double cx, double cy, double r)
+{
+	int	n = s->nang, state = 0, start = -1, count = 0;
+	double	*v = (double*)_alloca(n * sizeof(double));
+	double	sum = 0, sumsq = 0, sd;
+
+	for (int a = 0; a < n; a++) {
+		double t = 2 * 3.14159265358979 * a / n;
+		v[a] = sampleAt(f, cx + r * cos(t), cy + r * sin(t));
+		sum += v[a];
+		sumsq += v[a] * v[a];
+	}
+	sum /= n;
+	sd = sqrt(max(sumsq / n - sum * sum, 0.0));
+	if (sd < 8)
+		return(0);
+	for (int a = 0; a < n && start < 0; a++) {
+		if (fabs(v[a] - sum) > 0.3 * sd) {
+			start = a;
+			state = v[a] > sum;
+		}
+	}
+	for (int i = 1; i <= n && start >= 0; i++) {
+		double d = v[(start + i) % n] - sum;
+		if ((state && d < -0.3 * sd) || (!state && d > 0.3 * sd)) {
+			state = !state;
+			count++;
+		}
+	}
+	return(count);
+}
+
+static int star_isStar(const struct stars *s, int crossings)
+{
+	return(crossings >= 3 * s->cycles / 2 && crossings <= 5 * s->cycles / 2);
+}
+
+/*
+ * Refine a centre as the point nearest, in the least squares
+ * sense, to all the spoke edges: each pixel's edge line, normal
+ * to its gradient, weighted by the squared gradient.
+ */
+static int star_refine(const struct stars *s, const struct hostframe *f, double *cx, double *cy)
+{
+	double	x = *cx, y = *cy;
+	int	r1 = (int)(0.8 * s->radius);
+
+	for (int iter = 0; iter < 3; iter++) {
+		double a00 = 0, a01 = 0, a11 = 0, b0 = 0, b1 = 0;
+		int x0 = max((int)x - r1, 1), x1 = min((int)x + r1, f->xdim - 2);
+		int y0 = max((int)y - r1, 1), y1 = min((int)y + r1, f->ydim - 2);
+		for (int py = y0; py <= y1; py++) {
+			for (int px = x0; px <= x1; px++) {
+				double dx = px - x, dy = py - y, d2 = dx * dx + dy * dy;
+				if (d2 < s->rmin * s->rmin || d2 > r1 * r1)
+					continue;
+				double gx = frame_mono(f, px + 1, py) - frame_mono(f, px - 1, py);
+				double gy = frame_mono(f, px, py + 1) - frame_mono(f, px, py - 1);
+				a00 += gx * gx;
+				a01 += gx * gy;
+				a11 += gy * gy;
+				b0 += gx * gx * px + gx * gy * py;
+				b1 += gx * gy * px + gy * gy * py;
+			}
+		}
+		double det = a00 * a11 - a01 * a01;
+		if (det <= 1e-9 * (a00 + a11) * (a00 + a11))
+			return(-1);
+		double nx = (a11 * b0 - a01 * b1) / det, ny = (a00 * b1 - a01 * b0) / det;
+		if (fabs(nx - *cx) > s->radius / 2 || fabs(ny - *cy) > s->radius / 2)
+			return(-1);
+		x = nx;
+		y = ny;
+	}
+	if (x < s->radius + 2 || y < s->radius + 2 || x > f->xdim - 3 - s->radius || y > f->ydim - 3 - s->radius)
+		return(-1);
+	*cx = x;
+	*cy = y;
+	return(0);
+}
+
+/*
+ * Candidate centres on a coarse grid, in parallel over its rows.
+ * Any circle enclosing the centre and within the star crosses
+ * each spoke once; the grid is fine enough that some candidate
+ * is within half the detection circle's radius of the centre.
+ */
+struct gridctx {
+	const struct stars *s;
+	const struct hostframe *f;
+	int	step;
+	int	nx;
+	int	*crossings;
+};
+
+static void star_gridFn(void *ctx, int index)
+{
+	struct	gridctx *g = (struct gridctx*)ctx;
+
+	for (int i = 0; i < g->nx; i++)
+		g->crossings[index * g->nx + i] = star_crossings(g->s, g->f,
+					g->s->radius + 2 + i * g->step, g->s->radius + 2 + index * g->step,
+					STAR_DETECT * g->s->radius);
+}
+
+static int star_detect(struct stars *s, const struct hostframe *f)
+{
+	struct	gridctx g;
+	int	ny;
+
+	s->nstars = 0;
+	g.s = s;
+	g.f = f;
+	g.step = max((int)(STAR_DETECT * s->radius / 2), 2);
+	g.nx = (f->xdim - 2 * s->radius - 5) / g.step + 1;
+	ny = (f->ydim - 2 * s->radius - 5) / g.step + 1;
+	if (g.nx <= 0 || ny <= 0)
+		return(0);
+	g.crossings = (int*)malloc(g.nx * ny * sizeof(int));
+	if (!g.crossings)
+		return(PXERMALLOC);
+	wrk_parallel(ny, star_gridFn, &g);
+	for (int j = 0; j < ny; j++) {
+		for (int i = 0; i < g.nx && s->nstars < s->maxstars; i++) {
+			double x = s->radius + 2 + i * g.step, y = s->radius + 2 + j * g.step;
+			int k;
+			if (!star_isStar(s, g.crossings[j * g.nx + i]))
+				continue;
+			for (k = 0; k < s->nstars; k++)
+				if (fabs(s->list[k].x - x) < s->radius && fabs(s->list[k].y - y) < s->radius)
+					break;
+			if (k < s->nstars)
+				continue;
+			if (star_refine(s, f, &x, &y) < 0)
+				continue;
+			if (!star_isStar(s, star_crossings(s, f, x, y, STAR_DETECT * s->radius)))
+				continue;
+			for (k = 0; k < s->nstars; k++)
+				if (fabs(s->list[k].x - x) < s->radius && fabs(s->list[k].y - y) < s->radius)
+					break;
+			if (k < s->nstars)
+				continue;
+			s->list[s->nstars].x = x;
+			s->list[s->nstars].y = y;
+			s->list[s->nstars].valid = 1;
+			s->nstars++;
+		}
+	}
+	free(g.crossings);
+	return(s->nstars);
+}
+
+/*
+ * Follow one star from the previous frame, and measure it;
+ * in parallel over stars.
+ */
+struct starctx {
+	struct	stars *s;
+	const struct hostframe *f;
+	int	track;
+};
+
+static void star_starFn(void *ctx, int index)
+{
+	struct	starctx *c = (struct starctx*)ctx;
+	struct	stars *s = c->s;
+	const struct hostframe *f = c->f;
+	struct	star *st = &s->list[index];
+
+	if (c->track) {
+		st->valid = star_refine(s, f, &st->x, &st->y) == 0
+			 && star_isStar(s, star_crossings(s, f, st->x, st->y, STAR_DETECT * s->radius));
+		return;
+	}
+	if (!st->valid)
+		return;
+
+	//
+	// Sample the rings through the table for the centre's phase,
+	// reducing each sector to its sinusoid's modulation.
+	//
+	const struct starlut *l = &s->luts[star_phase(st)];
+	const ushort *p = f->pix + ((size_t)floor(st->y) * f->xdim + (size_t)floor(st->x)) * f->cdim + (f->cdim == 3 ? 1 : 0);
+	int	dx = f->cdim, dy = f->xdim * f->cdim;
+	int	per = s->nang / s->sectors;
+
+	for (int ri = 0; ri < s->nrings; ri++) {
+		for (int sec = 0; sec < s->sectors; sec++) {
+			double m = 0, a = 0, b = 0;
+			for (int j = 0, i = ri * s->nang + sec * per; j < per; j++, i++) {
+				const ushort *q = p + l->off[i];
+				const float *w = l->w + 4 * i;
+				double v = w[0] * q[0] + w[1] * q[dx] + w[2] * q[dy] + w[3] * q[dy + dx];
+				const float *k = s->coef + 3 * (sec * per + j);
+				m += k[0] * v;
+				a += k[1] * v;
+				b += k[2] * v;
+			}
+			st->contrast[ri * s->sectors + sec] = m > 0 ? (float)(sqrt(a * a + b * b) / m) : 0;
+		}
+	}
+
+	//
+	// Per sector, the MTF relative to the outermost tenth of the
+	// rings, and where, scanning inwards, it first drops below
+	// the threshold.
+	//
+	int	nref = max(s->nrings / 10, 1);
+	for (int sec = 0; sec < s->sectors; sec++) {
+		double ref = 0;
+		st->limit[sec] = 0;
+		for (int ri = s->nrings - nref; ri < s->nrings; ri++)
+			ref = max(ref, (double)st->contrast[ri * s->sectors + sec]);
+		if (ref <= 0)
+			continue;
+		for (int ri = s->nrings - 2; ri >= 0; ri--) {
+			double lo = st->contrast[ri * s->sectors + sec] / ref;
+			if (lo >= s->threshold)
+				continue;
+			double hi = st->contrast[(ri + 1) * s->sectors + sec] / ref;
+			double r = s->rmin + ri + (hi > lo ? (s->threshold - lo) / (hi - lo) : 0);
+			st->limit[sec] = s->cycles / (2 * 3.14159265358979 * r);
+			break;
+		}
+	}
+}
+
+/*
+ * Measure one frame.
+ */
+int star_measure(struct stars *s, const struct hostframe *f)
+{
+	struct	starctx c;
+	double	cx = (f->xdim - 1) / 2.0, cy = (f->ydim - 1) / 2.0;
+	int	err;
+
+	c.s = s;
+	c.f = f;
+	if (s->tracking) {
+		c.track = 1;
+		wrk_parallel(s->nstars, star_starFn, &c);
+		for (int i = 0; i < s->nstars; i++)
+			if (!s->list[i].valid)
+				s->tracking = 0;
+	}
+	if (!s->tracking) {
+		err = star_detect(s, f);
+		if (err < 0)
+			return(err);
+		s->tracking = err > 0;
+	}
+	for (int i = 0; i < s->nstars; i++) {
+		struct star *st = &s->list[i];
+		st->field = sqrt((st->x - cx) * (st->x - cx) + (st->y - cy) * (st->y - cy)) / sqrt(cx * cx + cy * cy);
+		err = star_lut(s, f, star_phase(st));
+		if (err < 0)
+			return(err);
+	}
+	c.track = 0;
+	wrk_parallel(s->nstars, star_starFn, &c);
+	return(0);
+}
+
+/*
+ * Summarize, for display: mean and worst sector limits
+ * of the stars nearest the centre and furthest into the field.
+ */
+int star_format(const struct stars *s, char *buf, size_t bufsize)
+{
+	const struct star *in = NULL, *out = NULL;
+	double	mean[2] = { 0, 0 }, worst[2] = { 0, 0 };
+
+	for (int i = 0; i < s->nstars; i++) {
+		const struct star *st = &s->list[i];
+		if (!st->valid)
+			continue;
+		if (!in || st->field < in->field)
+			in = st;
+		if (!out || st->field > out->field)
+			out = st;
+	}
+	if (!in)
+		return(_snprintf(buf, bufsize, "star: none"));
+	for (int k = 0; k < 2; k++) {
+		const struct star *st = k ? out : in;
+		int n = 0;
+		worst[k] = 1e9;
+		for (int sec = 0; sec < s->sectors; sec++) {
+			double l = st->limit[sec] ? st->limit[sec] : s->cycles / (2 * 3.14159265358979 * s->rmin);
+			mean[k] += l;
+			worst[k] = min(worst[k], l);
+			n++;
+		}
+		mean[k] /= n;
+	}
+	return(_snprintf(buf, bufsize, "star: %d  @%.2f limit %.3f (worst %.3f) cy/px  @%.2f limit %.3f (worst %.3f) cy/px",
+		s->nstars, in->field, mean[0], worst[0], out->field, mean[1], worst[1]));
+}
+
+/*
+ * Record each star's resolution limit per sector, where reached;
+ * the ROI is star * sectors + sector.
+ */
+int star_record(const struct stars *s, struct results *r)
+{
+	int	err = 0;
+
+	for (int i = 0; i < s->nstars && err >= 0; i++) {
+		const struct star *st = &s->list[i];
+		if (!st->valid)
+			continue;
+		for (int sec = 0; sec < s->sectors && err >= 0; sec++)
+			if (st->limit[sec])
+				err = res_add(r, "star.limit", i * s->sectors + sec, st->limit[sec]);
+	}
+	return(err);
+}
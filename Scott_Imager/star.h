@@ -0,0 +1,69 @@
+#pragma once
+/*
+ *	star.h
+ *
+ *	Resolution from Siemens star targets.
+ *
+ *	Star centres are found by circling candidate points: a circle
+ *	about a point near a star's centre crosses every spoke once.
+ *	Each centre is then refined as the least squares intersection
+ *	of the spoke edges, the lines normal to the gradient.
+ *
+ *	Contrast is then sampled on concentric circles, through polar
+ *	lookup tables of pixel offsets and bilinear weights, and fitted
+ *	per angular sector with a sinusoid of the star's cycles per turn,
+ *	through precomputed least squares coefficients. The tables depend
+ *	only on the star geometry, the frame's line length and the
+ *	centre's quarter pixel phase, so are built once and cached;
+ *	repeated frames cost only the sampling and reduction.
+ *
+ *	Per sector, contrast relative to the outermost rings gives an
+ *	MTF against spatial frequency cycles/(2*pi*r); the resolution
+ *	limit is the frequency where it first falls below a threshold.
+ */
+
+#include "frame.h"
+
+struct	results;
+
+#define STAR_PHASES	4	// centre phases tabulated, per pixel per axis
+
+struct star {
+	double	x;	    // centre, pixels
+	double	y;
+	double	field;	    // distance from the image centre, relative to the half diagonal
+	int	valid;
+	float	*contrast;  // per ring, per sector: modulation
+	double	*limit;	    // per sector: resolution limit, cycles/pixel; 0 if not reached
+};
+
+struct starlut {
+	int	ready;
+	int	*off;	    // per sample: pixel offset from the centre's pixel
+	float	*w;	    // per sample: 4 bilinear weights
+};
+
+struct stars {
+	int	radius;	    // outermost ring, pixels
+	int	rmin;	    // innermost ring
+	int	cycles;	    // spoke pairs per turn
+	int	sectors;
+	int	nang;	    // samples per ring
+	int	nrings;
+	double	threshold;  // MTF defining the resolution limit
+	int	maxstars;
+	int	nstars;
+	struct	star *list;
+	float	*coef;	    // per angle: least squares coefficients of its sector's fit
+	int	xdim;	    // frame geometry the tables are for
+	int	cdim;
+	struct	starlut luts[STAR_PHASES * STAR_PHASES];
+	int	tracking;
+};
+
+int	star_alloc(struct stars *s, int maxstars, int radius, int cycles, int sectors, double threshold);
+void	star_free(struct stars *s);
+void	star_reset(struct stars *s);
+int	star_measure(struct stars *s, const struct hostframe *f);
+int	star_format(const struct stars *s, char *buf, size_t bufsize);
+int	star_record(const struct stars *s, struct results *r);
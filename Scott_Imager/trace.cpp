@@ -0,0 +1,229 @@
+/*
+ *	trace.cpp
+ *
+ *	Tracing of spans, as Chrome trace-event JSON.
+ *	See trace.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "xcliball.h"
+}
+#include "trace.h"
+
+#if TRACE
+
+struct traceevent {
+	const char *name;
+	LONGLONG t0, t1;		// QueryPerformanceCounter
+};
+
+struct tracebuf {
+	DWORD	tid;
+	HANDLE	thread;			// the owner, to tell when it has ended
+	char	name[TRACE_NAMELEN];
+	volatile LONG gen;		// of the reset the events are since
+	volatile LONG count;		// events filled, written by the owner only
+	volatile LONG dropped;
+	struct	traceevent events[TRACE_EVENTS];
+};
+
+static	struct	    tracebuf *volatile bufs[TRACE_MAXTHREADS];
+static	volatile LONG nbufs = 0;
+static	volatile LONG tracegen = 0;	// resets so far
+static	CRITICAL_SECTION tracesect;
+static	volatile LONG traceinit = 0;
+static	__declspec(thread) struct tracebuf *mine = NULL;
+static	__declspec(thread) int	    untraced = 0;	// no buffer to be had
+
+
+LONGLONG trace_now(void)
+{
+	LARGE_INTEGER	pc;
+
+	QueryPerformanceCounter(&pc);
+	return(pc.QuadPart);
+}
+
+/*
+ * A buffer whose thread has ended; with stale, only one
+ * holding no spans since the last reset, so none are lost.
+ */
+static struct tracebuf *trace_ended(int stale)
+{
+	for (LONG i = 0; i < nbufs; i++) {
+		struct	tracebuf *b = bufs[i];
+		if (stale && b->gen == tracegen && b->count)
+			continue;
+		if (WaitForSingleObject(b->thread, 0) == WAIT_OBJECT_0)
+			return(b);
+	}
+	return(NULL);
+}
+
+/*
+ * The calling thread's buffer, taken on first use: one left
+ * by an ended thread, if empty, else a new one, else any left
+ * by an ended thread. Taking one is rare, so serialized.
+ */
+static struct tracebuf *trace_buf(void)
+{
+	struct	tracebuf *b;
+
+	if (mine || untraced)
+		return(mine);
+	if (InterlockedCompareExchange(&traceinit, 1, 0) == 0) {
+		InitializeCriticalSection(&tracesect);
+		InterlockedExchange(&traceinit, 2);
+	}
+	while (traceinit != 2)
+		Sleep(0);
+	EnterCriticalSection(&tracesect);
+	b = trace_ended(1);
+	if (!b && nbufs < TRACE_MAXTHREADS) {
+		b = (struct tracebuf*)VirtualAlloc(NULL, sizeof(*b), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (b) {
+			bufs[nbufs] = b;
+			InterlockedIncrement(&nbufs);
+		}
+	}
+	if (!b)
+		b = trace_ended(0);
+	if (b) {
+		//
+		// Emptied before being renamed, so a concurrent
+		// write sees neither the old spans under the
+		// new name, nor the other way around.
+		//
+		InterlockedExchange(&b->count, 0);
+		b->dropped = 0;
+		b->gen = tracegen;
+		if (b->thread)
+			CloseHandle(b->thread);
+		b->thread = OpenThread(SYNCHRONIZE, FALSE, GetCurrentThreadId());
+		b->tid = GetCurrentThreadId();
+		b->name[sizeof(b->name) - 1] = 0;
+		_snprintf(b->name, sizeof(b->name) - 1, "thread %lu", (unsigned long)b->tid);
+	}
+	LeaveCriticalSection(&tracesect);
+	untraced = !b;
+	mine = b;
+	return(b);
+}
+
+/*
+ * Start afresh, e.g. at the start of a run. Each buffer
+ * is emptied by its owner, at its next span.
+ */
+void trace_reset(void)
+{
+	InterlockedIncrement(&tracegen);
+}
+
+/*
+ * Record a span, from t0 until now.
+ */
+void trace_span(const char *name, LONGLONG t0)
+{
+	struct	tracebuf *b = trace_buf();
+	LONG	n;
+
+	if (!b)
+		return;
+	if (b->gen != tracegen) {
+		InterlockedExchange(&b->count, 0);
+		b->dropped = 0;
+		InterlockedExchange(&b->gen, tracegen);
+	}
+	n = b->count;
+	if (n >= TRACE_EVENTS) {
+		b->dropped++;
+		return;
+	}
+	b->events[n].name = name;
+	b->events[n].t0 = t0;
+	b->events[n].t1 = trace_now();
+	InterlockedExchange(&b->count, n + 1);
+}
+
+/*
+ * Name the calling thread, in the trace.
+ */
+void trace_thread(const char *name)
+{
+	struct	tracebuf *b = trace_buf();
+
+	if (!b)
+		return;
+	b->name[sizeof(b->name) - 1] = 0;
+	strncpy(b->name, name, sizeof(b->name) - 1);
+}
+
+/*
+ * Write all spans since the last reset, timed from the
+ * earliest. The number of spans written, or PXERNOFILE.
+ */
+int trace_write(const char *path)
+{
+	FILE	*fp = fopen(path, "w");
+	LARGE_INTEGER pf;
+	LONGLONG origin = 0;
+	LONG	n = nbufs;
+	LONG	gen = tracegen;
+	DWORD	pid = GetCurrentProcessId();
+	int	total = 0, dropped = 0, threads = 0;
+	const char *sep = "";
+
+	if (!fp)
+		return(PXERNOFILE);
+	QueryPerformanceFrequency(&pf);
+	//
+	// Spans are recorded as they end, so an enclosing
+	// span follows those within; the earliest start
+	// may be anywhere.
+	//
+	for (LONG i = 0; i < n; i++) {
+		struct	tracebuf *b = bufs[i];
+		LONG	count = b->count;
+		if (b->gen != gen)
+			continue;
+		for (LONG e = 0; e < count; e++)
+			if (!origin || b->events[e].t0 < origin)
+				origin = b->events[e].t0;
+	}
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (LONG i = 0; i < n; i++) {
+		struct	tracebuf *b = bufs[i];
+		LONG	count;
+		if (b->gen != gen)
+			continue;
+		count = b->count;
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+			sep, (unsigned long)pid, (unsigned long)b->tid, b->name);
+		sep = ",\n";
+		for (LONG e = 0; e < count; e++) {
+			const struct traceevent *ev = &b->events[e];
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%lu,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+				ev->name, (unsigned long)pid, (unsigned long)b->tid,
+				(ev->t0 - origin) * 1.0E6 / pf.QuadPart, (ev->t1 - ev->t0) * 1.0E6 / pf.QuadPart);
+		}
+		total += count;
+		dropped += b->dropped;
+		threads++;
+	}
+	fprintf(fp, "\n]}\n");
+	if (fclose(fp) != 0)
+		return(PXERDOSIO);
+	printf("trace: %d spans on %d threads written to %s", total, threads, path);
+	if (dropped)
+		printf(", %d dropped, buffers being full", dropped);
+	printf("\n");
+	return(total);
+}
+
+#endif
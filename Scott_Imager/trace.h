@@ -0,0 +1,60 @@
+#pragma once
+/*
+ *	trace.h
+ *
+ *	Tracing of where time goes: capture, readout, correction,
+ *	each analysis stage, display and saving, as spans on each
+ *	thread's timeline, written as Chrome trace-event JSON to be
+ *	viewed in chrome://tracing or Perfetto.
+ *
+ *	Each thread records its spans in a buffer of its own, taken
+ *	on its first span, without locks; a full buffer drops further
+ *	spans, and counts them. The buffer of a thread that has ended
+ *	is taken over by the next new thread. Writing the trace reads
+ *	every buffer as far as filled, and may be done while threads
+ *	still trace. Resetting, at the start of each run, empties the
+ *	buffers, each by its owner at its next span.
+ *
+ *	Tracing is compiled in with TRACE defined as 1, e.g. in the
+ *	project's preprocessor definitions; otherwise the macros
+ *	below compile to nothing, or to the statement traced. Span
+ *	names are kept by pointer, so must be literals.
+ *
+ *	    TRACE_SPAN("name", statement);
+ *
+ *	    TRACE_BEGIN(t);
+ *	    ...
+ *	    TRACE_END(t, "name");
+ *
+ *	    TRACE_RESET();
+ */
+
+#if !defined(TRACE)
+#define TRACE	    0
+#endif
+
+#define TRACE_EVENTS	    65536	// per thread
+#define TRACE_MAXTHREADS    128
+#define TRACE_NAMELEN	    32
+
+#if TRACE
+LONGLONG trace_now(void);
+void	trace_span(const char *name, LONGLONG t0);
+void	trace_thread(const char *name);
+void	trace_reset(void);
+int	trace_write(const char *path);
+
+#define TRACE_BEGIN(t)		LONGLONG t = trace_now()
+#define TRACE_END(t, name)	trace_span(name, t)
+#define TRACE_SPAN(name, stmt)	do { LONGLONG trace_t0 = trace_now(); stmt; trace_span(name, trace_t0); } while (0)
+#define TRACE_THREAD(name)	trace_thread(name)
+#define TRACE_RESET()		trace_reset()
+#define TRACE_WRITE(path)	trace_write(path)
+#else
+#define TRACE_BEGIN(t)
+#define TRACE_END(t, name)
+#define TRACE_SPAN(name, stmt)	do { stmt; } while (0)
+#define TRACE_THREAD(name)
+#define TRACE_RESET()
+#define TRACE_WRITE(path)	0
+#endif
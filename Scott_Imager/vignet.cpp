@@ -0,0 +1,221 @@
+/*
+ *	vignet.cpp
+ *
+ *	Relative illumination, or vignetting, from flat field frames.
+ *	See vignet.h.
+ */
+#define _CRT_SECURE_NO_DEPRECATE    1
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "vignet.h"
+#include "results.h"
+#include "workers.h"
+#include "lsq.h"
+
+#define VIG_BANDS	64	// horizontal bands, each summed by one task
+
+
+int vig_alloc(struct vignet *v, int gx, int gy)
+{
+	memset(v, 0, sizeof(*v));
+	v->gx = gx;
+	v->gy = gy;
+	v->nbands = VIG_BANDS;
+	v->cellx = (int*)malloc((gx + 1 + gy + 1) * sizeof(int));
+	v->cellpix = (double*)malloc(gx * gy * sizeof(double));
+	v->rel = (double*)malloc(gx * gy * sizeof(double));
+	v->partial = (unsigned __int64*)malloc(VIG_BANDS * gx * gy * sizeof(unsigned __int64));
+	if (!v->cellx || !v->cellpix || !v->rel || !v->partial) {
+		vig_free(v);
+		return(PXERMALLOC);
+	}
+	v->celly = v->cellx + gx + 1;
+	return(0);
+}
+
+void vig_free(struct vignet *v)
+{
+	free(v->cellx);
+	free(v->cellpix);
+	free(v->rel);
+	free(v->partial);
+	memset(v, 0, sizeof(*v));
+}
+
+/*
+ * Cell edges for the frame's geometry: cellx in components
+ * along a line, celly in lines.
+ */
+static void vig_geometry(struct vignet *v, const struct hostframe *f)
+{
+	if (v->xdim == f->xdim && v->ydim == f->ydim && v->cdim == f->cdim)
+		return;
+	v->xdim = f->xdim;
+	v->ydim = f->ydim;
+	v->cdim = f->cdim;
+	for (int c = 0; c <= v->gx; c++)
+		v->cellx[c] = (int)((long long)f->xdim * c / v->gx) * f->cdim;
+	for (int c = 0; c <= v->gy; c++)
+		v->celly[c] = (int)((long long)f->ydim * c / v->gy);
+	for (int cy = 0; cy < v->gy; cy++)
+		for (int cx = 0; cx < v->gx; cx++)
+			v->cellpix[cy * v->gx + cx] = (double)(v->cellx[cx + 1] - v->cellx[cx])
+						    * (v->celly[cy + 1] - v->celly[cy]);
+}
+
+/*
+ * Sum one band of lines into the band's own partial grid.
+ * Each line is summed cell by cell into 32 bits, which
+ * suffices for cells narrower than 65536 components, and
+ * only then added into the 64 bit partial.
+ */
+struct bandctx {
+	struct	vignet *v;
+	const struct hostframe *f;
+};
+
+static void vig_bandFn(void *ctx, int index)
+{
+	struct	bandctx *c = (struct bandctx*)ctx;
+	struct	vignet *v = c->v;
+	const struct hostframe *f = c->f;
+	unsigned __int64 *acc = v->partial + (size_t)index * v->gx * v->gy;
+	int	y0 = (int)((long long)f->ydim * index / v->nbands);
+	int	y1 = (int)((long long)f->ydim * (index + 1) / v->nbands);
+	int	cy = 0;
+
+	memset(acc, 0, v->gx * v->gy * sizeof(*acc));
+	for (int y = y0; y < y1; y++) {
+		const ushort *line = f->pix + (size_t)y * f->xdim * f->cdim;
+		while (y >= v->celly[cy + 1])
+			cy++;
+		unsigned __int64 *row = acc + cy * v->gx;
+		for (int cx = 0; cx < v->gx; cx++) {
+			uint s = 0;
+			for (int i = v->cellx[cx]; i < v->cellx[cx + 1]; i++)
+				s += line[i];
+			row[cx] += s;
+		}
+	}
+}
+
+/*
+ * Measure one frame.
+ */
+int vig_measure(struct vignet *v, const struct hostframe *f)
+{
+	struct	bandctx c;
+	int	n = v->gx * v->gy;
+	double	hx = (f->xdim - 1) / 2.0, hy = (f->ydim - 1) / 2.0;
+	double	norm = sqrt(hx * hx + hy * hy);
+	double	m[16], r[4], sum = 0;
+
+	vig_geometry(v, f);
+	c.v = v;
+	c.f = f;
+	wrk_parallel(v->nbands, vig_bandFn, &c);
+
+	//
+	// Reduce the bands' partial grids to cell means.
+	//
+	for (int i = 0; i < n; i++) {
+		unsigned __int64 t = 0;
+		for (int b = 0; b < v->nbands; b++)
+			t += v->partial[(size_t)b * n + i];
+		v->rel[i] = (double)t / v->cellpix[i];
+	}
+
+	//
+	// Optical centre from a rotationally symmetric
+	// paraboloid, c0 + c1*x + c2*y + c3*r^2.
+	//
+	memset(m, 0, sizeof(m));
+	memset(r, 0, sizeof(r));
+	for (int cy = 0; cy < v->gy; cy++) {
+		for (int cx = 0; cx < v->gx; cx++) {
+			double x = ((v->cellx[cx] + v->cellx[cx + 1]) / (2.0 * f->cdim) - 0.5 - hx) / norm;
+			double y = ((v->celly[cy] + v->celly[cy + 1]) / 2.0 - 0.5 - hy) / norm;
+			double t[4] = { 1, x, y, x * x + y * y };
+			lsq_add(m, r, t, v->rel[cy * v->gx + cx], 4);
+		}
+	}
+	v->xc = hx;
+	v->yc = hy;
+	if (lsq_solve(m, r, 4) == 0 && r[3] < 0) {
+		v->xc = min(max(hx - r[1] / (2 * r[3]) * norm, 0.0), f->xdim - 1.0);
+		v->yc = min(max(hy - r[2] / (2 * r[3]) * norm, 0.0), f->ydim - 1.0);
+	}
+
+	//
+	// Radial falloff about the optical centre,
+	// b0 + b1*r^2 + b2*r^4; then normalize to b0.
+	//
+	memset(m, 0, sizeof(m));
+	memset(r, 0, sizeof(r));
+	for (int cy = 0; cy < v->gy; cy++) {
+		for (int cx = 0; cx < v->gx; cx++) {
+			double x = ((v->cellx[cx] + v->cellx[cx + 1]) / (2.0 * f->cdim) - 0.5 - v->xc) / norm;
+			double y = ((v->celly[cy] + v->celly[cy + 1]) / 2.0 - 0.5 - v->yc) / norm;
+			double r2 = x * x + y * y;
+			double t[3] = { 1, r2, r2 * r2 };
+			lsq_add(m, r, t, v->rel[cy * v->gx + cx], 3);
+		}
+	}
+	if (lsq_solve(m, r, 3) < 0 || r[0] <= 0) {
+		v->i0 = 0;
+		return(0);
+	}
+	v->i0 = r[0];
+	v->a2 = r[1] / r[0];
+	v->a4 = r[2] / r[0];
+	for (int cy = 0; cy < v->gy; cy++) {
+		for (int cx = 0; cx < v->gx; cx++) {
+			double x = ((v->cellx[cx] + v->cellx[cx + 1]) / (2.0 * f->cdim) - 0.5 - v->xc) / norm;
+			double y = ((v->celly[cy] + v->celly[cy + 1]) / 2.0 - 0.5 - v->yc) / norm;
+			double r2 = x * x + y * y;
+			double *p = &v->rel[cy * v->gx + cx];
+			*p /= v->i0;
+			double e = *p - (1 + v->a2 * r2 + v->a4 * r2 * r2);
+			sum += e * e;
+		}
+	}
+	v->rms = sqrt(sum / n);
+	v->corner = min(min(v->rel[0], v->rel[v->gx - 1]), min(v->rel[n - v->gx], v->rel[n - 1]));
+	return(0);
+}
+
+/*
+ * Summarize, for display. The falloff is also given as
+ * the model's relative illumination at the half diagonal.
+ */
+int vig_format(const struct vignet *v, char *buf, size_t bufsize)
+{
+	if (v->i0 <= 0)
+		return(_snprintf(buf, bufsize, "vignet: no fit"));
+	return(_snprintf(buf, bufsize, "vignet: centre (%.0f,%.0f) level %.0f  corner %.1f%%  r=1 %.1f%%  a2 %.4f a4 %.4f  rms %.2f%%",
+		v->xc, v->yc, v->i0, 100.0 * v->corner, 100.0 * (1 + v->a2 + v->a4), v->a2, v->a4, 100.0 * v->rms));
+}
+
+/*
+ * Record the fitted falloff.
+ */
+int vig_record(const struct vignet *v, struct results *r)
+{
+	int	err;
+
+	if (v->i0 <= 0)
+		return(0);
+	err = res_add(r, "vig.corner", 0, v->corner);
+	if (err >= 0)
+		err = res_add(r, "vig.a2", 0, v->a2);
+	if (err >= 0)
+		err = res_add(r, "vig.a4", 0, v->a4);
+	if (err >= 0)
+		err = res_add(r, "vig.rms", 0, v->rms);
+	return(err);
+}
@@ -0,0 +1,50 @@
+#pragma once
+/*
+ *	vignet.h
+ *
+ *	Relative illumination, or vignetting, from flat field frames.
+ *
+ *	The frame is reduced to the mean of each cell of a coarse grid,
+ *	in one pass over horizontal bands of the frame, each band
+ *	summing into its own partial grid. The grid is normalized to
+ *	the optical centre, taken as the peak of a quadratic fitted to
+ *	the cell means, and a radial falloff
+ *
+ *	    I(r) = I0 * (1 + a2*r^2 + a4*r^4)
+ *
+ *	fitted about that centre, with r relative to the half diagonal.
+ *	Cheap enough to run on every frame while the integrating
+ *	sphere is adjusted.
+ */
+
+#include "frame.h"
+
+struct	results;
+
+struct vignet {
+	int	gx;	    // grid cells, horizontally
+	int	gy;	    // grid cells, vertically
+	int	xdim;	    // frame geometry the tables are for
+	int	ydim;
+	int	cdim;
+	int	*cellx;	    // grid column of each component of a line
+	int	*celly;	    // grid row of each line
+	double	*cellpix;   // pixel components per cell
+	int	nbands;
+	unsigned __int64 *partial;  // per band, per cell sums
+	double	*rel;	    // per cell mean, relative to the centre
+	//
+	// Results.
+	//
+	double	xc, yc;	    // optical centre, pixels
+	double	i0;	    // centre level
+	double	a2, a4;	    // falloff
+	double	corner;	    // darkest corner cell, relative to centre
+	double	rms;	    // fit residual, relative
+};
+
+int	vig_alloc(struct vignet *v, int gx, int gy);
+void	vig_free(struct vignet *v);
+int	vig_measure(struct vignet *v, const struct hostframe *f);
+int	vig_format(const struct vignet *v, char *buf, size_t bufsize);
+int	vig_record(const struct vignet *v, struct results *r);
@@ -0,0 +1,172 @@
+/*
+ *	workers.cpp
+ *
+ *	A small pool of worker threads for data parallel analysis.
+ *	See workers.h.
+ *
+ *	wrk_parallel is not reentrant; it is intended to be called
+ *	from one thread, the pipeline's, at a time.
+ */
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" {
+#include "xcliball.h"
+}
+#include "workers.h"
+#include "place.h"
+#include "trace.h"
+#include "metrics.h"
+
+#define WRK_MAXTHREADS	64
+
+static	int	    nworkers = 0;
+static	HANDLE	    threads[WRK_MAXTHREADS];
+static	HANDLE	    startevents[WRK_MAXTHREADS];    // auto reset, one per worker
+static	HANDLE	    doneevent = NULL;
+static	volatile LONG quitting = 0;
+
+/*
+ * The job currently being run.
+ */
+static	wrk_fn_t    jobfn;
+static	void	    *jobctx;
+static	LONG	    jobcount;
+static	volatile LONG jobnext;
+static	volatile LONG jobbusy;
+static	int	    metbatches = -1;	// metrics: pool usage
+static	int	    metjobs = -1;
+static	int	    metbusy = -1;
+static	int	    metthreads = -1;
+static	LONGLONG    tickfreq = 1000000;	// QueryPerformanceFrequency
+
+
+static void wrk_run(void)
+{
+	for (;;) {
+		LONG i = InterlockedIncrement(&jobnext) - 1;
+		if (i >= jobcount)
+			break;
+		jobfn(jobctx, (int)i);
+	}
+}
+
+DWORD WINAPI WorkerThread(PVOID p)
+{
+	HANDLE	start = startevents[(int)(INT_PTR)p];
+	LONGLONG carry = 0;	// busy time not yet counted, in ticks times 10^6
+
+	TRACE_THREAD("worker");
+	for (;;) {
+		WaitForSingleObject(start, INFINITE);
+		if (quitting)
+			break;
+		LARGE_INTEGER t0, t1;
+		QueryPerformanceCounter(&t0);
+		TRACE_SPAN("worker jobs", wrk_run());
+		QueryPerformanceCounter(&t1);
+		//
+		// Counted in whole microseconds, the remainder
+		// carried over, so none is lost to truncation.
+		//
+		carry += (t1.QuadPart - t0.QuadPart) * 1000000;
+		met_add(metbusy, carry / tickfreq);
+		carry %= tickfreq;
+		if (InterlockedDecrement(&jobbusy) == 0)
+			SetEvent(doneevent);
+	}
+	return(0);
+}
+
+/*
+ * Start the pool, placed on the analysis processors.
+ * With nthreads <= 0, use one worker per such processor;
+ * the calling thread, which also takes part, isn't placed
+ * among them.
+ */
+int wrk_start(int nthreads)
+{
+	DWORD	ThreadId;
+	char	name[32];
+
+	wrk_stop();
+	metbatches = met_counter("scott_worker_batches_total", NULL, "Parallel batches run on the worker pool");
+	metjobs = met_counter("scott_worker_jobs_total", NULL, "Jobs run on the worker pool");
+	metbusy = met_counter("scott_worker_busy_microseconds_total", NULL, "Time the workers were busy");
+	metthreads = met_gauge("scott_worker_threads", NULL, "Threads of the worker pool, with the caller");
+	{
+		LARGE_INTEGER pf;
+		QueryPerformanceFrequency(&pf);
+		tickfreq = max(pf.QuadPart, 1);
+	}
+	if (nthreads <= 0)
+		nthreads = place_processors(PLACE_ANALYSIS);
+	nthreads = min(nthreads, WRK_MAXTHREADS);
+	if (nthreads <= 0)
+		return(0);
+	doneevent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!doneevent)
+		return(PXERMALLOC);
+	quitting = 0;
+	for (int w = 0; w < nthreads; w++) {
+		startevents[w] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		threads[w] = startevents[w] ? CreateThread(0, 0, WorkerThread, (PVOID)(INT_PTR)w, 0, &ThreadId) : NULL;
+		if (!threads[w]) {
+			if (startevents[w])
+				CloseHandle(startevents[w]);
+			break;
+		}
+		nworkers = w + 1;
+		name[sizeof(name) - 1] = 0;
+		_snprintf(name, sizeof(name) - 1, "worker %d", w);
+		place_thread(threads[w], PLACE_ANALYSIS, name);
+	}
+	met_set(metthreads, nworkers + 1);
+	return(nworkers);
+}
+
+void wrk_stop(void)
+{
+	quitting = 1;
+	for (int w = 0; w < nworkers; w++)
+		SetEvent(startevents[w]);
+	if (nworkers)
+		WaitForMultipleObjects(nworkers, threads, TRUE, 5000);
+	for (int w = 0; w < nworkers; w++) {
+		place_forget(threads[w]);
+		CloseHandle(threads[w]);
+		CloseHandle(startevents[w]);
+	}
+	if (doneevent)
+		CloseHandle(doneevent);
+	doneevent = NULL;
+	nworkers = 0;
+}
+
+int wrk_threads(void)
+{
+	return(nworkers + 1);
+}
+
+void wrk_parallel(int count, wrk_fn_t fn, void *ctx)
+{
+	if (count <= 0)
+		return;
+	met_add(metbatches, 1);
+	met_add(metjobs, count);
+	if (nworkers == 0 || count == 1) {
+		for (int i = 0; i < count; i++)
+			fn(ctx, i);
+		return;
+	}
+	jobfn = fn;
+	jobctx = ctx;
+	jobcount = count;
+	jobnext = 0;
+	jobbusy = nworkers;
+	for (int w = 0; w < nworkers; w++)
+		SetEvent(startevents[w]);
+	wrk_run();
+	WaitForSingleObject(doneevent, INFINITE);
+}
@@ -0,0 +1,20 @@
+#pragma once
+/*
+ *	workers.h
+ *
+ *	A small pool of worker threads for data parallel analysis.
+ *
+ *	wrk_parallel runs fn(ctx, i) for i in [0, count), spreading
+ *	the indices over the workers and the calling thread, and
+ *	returns once all have been done. Indices are handed out one
+ *	at a time, so uneven work per index (e.g. per ROI or per blob)
+ *	balances itself. Work functions must not call XCLIB, which is
+ *	only to be used from the dialog's thread.
+ */
+
+typedef void (*wrk_fn_t)(void *ctx, int index);
+
+int	wrk_start(int nthreads);
+void	wrk_stop(void);
+int	wrk_threads(void);
+void	wrk_parallel(int count, wrk_fn_t fn, void *ctx);
@@ -314,6 +314,23 @@
 #define SAVE_PROMPT     0
 #endif
 
+   /*
+    *  3.7) Option, with UPDATE_EVENT, to run the event service threads
+    *  at time critical priority, each pinned to a processor of its
+    *  own, from the highest numbered down, so that the GUI, other
+    *  programs and each other don't delay the response to a captured
+    *  field or trigger. They only note times and pass the work on:
+    *  display and parameter changes are done by a display thread, at
+    *  normal priority and unpinned, so a display pass never holds up
+    *  a time critical thread, nor does the dialog, which shares the
+    *  display's lock. The fault service thread runs at above normal
+    *  priority, unpinned. Each thread's CPU time is printed when live
+    *  capture is stopped.
+    */
+#if !defined(SERVICE_PLACEMENT)
+#define SERVICE_PLACEMENT	1
+#endif
+
 
 
 
@@ -352,6 +369,7 @@
 #include <windows.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #if SHOWIM_DRAWDIBDRAW || SHOWIM_DRAWDIBDISPLAY
 #include <vfw.h>
 #endif
@@ -395,6 +413,128 @@ void setGuiMux(HWND hDlg)
 	SendMessage(GetDlgItem(hDlg, IDBNC4), BM_SETCHECK, vidmux == 5, 0);
 }
 
+/*
+ * Shadow of the grabber's parameters.
+ * The XCLIB values are read once, by readParams(); after
+ * that the get/set utilities below work on the shadow,
+ * and the set utilities only mark which parameters changed.
+ * applyParams() sends the changes to the grabber, between
+ * frames, at most once per frame; so a scroll bar drag costs
+ * one pxd_set call per frame, not one per scroll event,
+ * and parameters changed together take effect together.
+ * The shadow and its dirty mask are guarded by paramsect,
+ * held only to copy them, never across pxd_* calls.
+ */
+struct params {
+	double	contrast;	// SV2/3/4/5/7/8
+	double	brightness;
+	double	hue;
+	double	ugain;
+	double	vgain;
+	double	gainA;		// A310/A110
+	double	offsetA;
+	double	gainB;
+	double	offsetB;
+};
+#define PARAM_CONTRAST	0x1	// pxd_setContrastBrightness
+#define PARAM_HUE	0x2	// pxd_setHueSaturation
+#define PARAM_ADC	0x4	// pxd_setAdcGainOffset
+
+static	struct params params;
+static	int	      paramModel = 0;		// pxd_infoModel, 0 until readParams()
+static	volatile LONG paramDirty = 0;		// PARAM_*, changed but not yet applied
+static	CRITICAL_SECTION paramsect;
+
+/*
+ * Which parameters the model has.
+ */
+int paramGroups(int model)
+{
+	switch (model) {
+	case PIXCI_SV2:
+	case PIXCI_SV3:
+	case PIXCI_SV4:
+	case PIXCI_SV5:
+	case PIXCI_SV7:
+	case PIXCI_SV8:
+		return(PARAM_CONTRAST | PARAM_HUE);
+	case PIXCI_A310:
+	case PIXCI_A110:
+	case PIXCI_A1107I1O:
+		return(PARAM_ADC);
+	default:
+		return(0);
+	}
+}
+
+/*
+ * Read the given parameters from XCLIB into the shadow.
+ */
+void readParamGroups(int groups)
+{
+	struct	params p;
+
+	if (groups & PARAM_CONTRAST) {
+		p.contrast = pxd_getContrast(1);
+		p.brightness = pxd_getBrightness(1);
+	}
+	if (groups & PARAM_HUE) {
+		p.hue = pxd_getHue(UNITSMAP);
+		p.ugain = pxd_getUGain(UNITSMAP);
+		p.vgain = pxd_getVGain(UNITSMAP);
+	}
+	if (groups & PARAM_ADC) {
+		p.gainA = pxd_getAdcGainA(1);
+		p.offsetA = pxd_getAdcOffsetA(1);
+		p.gainB = pxd_getAdcGainB(1);
+		p.offsetB = pxd_getAdcOffsetB(1);
+	}
+	EnterCriticalSection(&paramsect);
+	if (groups & PARAM_CONTRAST) {
+		params.contrast = p.contrast;
+		params.brightness = p.brightness;
+	}
+	if (groups & PARAM_HUE) {
+		params.hue = p.hue;
+		params.ugain = p.ugain;
+		params.vgain = p.vgain;
+	}
+	if (groups & PARAM_ADC) {
+		params.gainA = p.gainA;
+		params.offsetA = p.offsetA;
+		params.gainB = p.gainB;
+		params.offsetB = p.offsetB;
+	}
+	LeaveCriticalSection(&paramsect);
+}
+void readParams()
+{
+	paramModel = pxd_infoModel(UNITSMAP);
+	EnterCriticalSection(&paramsect);
+	paramDirty = 0;
+	LeaveCriticalSection(&paramsect);
+	readParamGroups(paramGroups(paramModel));
+}
+int getParamModel()
+{
+	if (!paramModel)
+		readParams();
+	return(paramModel);
+}
+struct params getParams()
+{
+	struct	params p;
+
+	EnterCriticalSection(&paramsect);
+	p = params;
+	LeaveCriticalSection(&paramsect);
+	return(p);
+}
+void markParams(int groups)	// with paramsect held
+{
+	paramDirty |= groups & paramGroups(paramModel);
+}
+
 /*
  * Utilities for SV2/3/4/5/7/A310/A110.
  * Get/set current brightness/offset and gain/contrast.
@@ -406,120 +546,135 @@ void setGuiMux(HWND hDlg)
  */
 int getBright()
 {
-	switch (pxd_infoModel(UNITSMAP)) {
+	int	model = getParamModel();
+	struct	params p = getParams();
+
+	switch (model) {
 	case PIXCI_SV8:
-		return(ToScroll(pxd_getBrightness(1), -100.0, 100.0));
+		return(ToScroll(p.brightness, -100.0, 100.0));
 	case PIXCI_SV7:
-		//return((int)(50+pxd_getBrightness(1)*100/(76*2)));
-		return(ToScroll(pxd_getBrightness(1), -76.22, 75.64));
+		//return((int)(50+p.brightness*100/(76*2)));
+		return(ToScroll(p.brightness, -76.22, 75.64));
 	case PIXCI_A310:
 	case PIXCI_A110:
 	case PIXCI_A1107I1O:
-		return(ToScroll(pxd_getAdcOffsetA(1), -124 / 1024., 124 / 1024.));
+		return(ToScroll(p.offsetA, -124 / 1024., 124 / 1024.));
 	default:
-		//return((int)(pxd_getBrightness(1)+50));
-		return(ToScroll(pxd_getBrightness(1), -50.0, 49.61));
+		//return((int)(p.brightness+50));
+		return(ToScroll(p.brightness, -50.0, 49.61));
 	}
 }
 void setBright(int b)
 {
-	int err = 0;
-	switch (pxd_infoModel(UNITSMAP)) {
+	int	model = getParamModel();
+
+	EnterCriticalSection(&paramsect);
+	switch (model) {
 	case PIXCI_SV8:
-		err = pxd_setContrastBrightness(UNITSMAP, pxd_getContrast(1), UnScroll(b, -100.0, 100.0));
+		params.brightness = UnScroll(b, -100.0, 100.0);
 		break;
 	case PIXCI_SV7:
-		//err = pxd_setContrastBrightness(UNITSMAP, pxd_getContrast(1), (b-50)*76*2/100);
-		err = pxd_setContrastBrightness(UNITSMAP, pxd_getContrast(1), UnScroll(b, -76.22, 75.64));
+		//params.brightness = (b-50)*76*2/100;
+		params.brightness = UnScroll(b, -76.22, 75.64);
 		break;
 	case PIXCI_A310:
 	case PIXCI_A110:
 	case PIXCI_A1107I1O:
-		err = pxd_setAdcGainOffset(UNITSMAP, 0, pxd_getAdcGainA(1), UnScroll(b, -124 / 1024., 124 / 1024.), pxd_getAdcGainB(1), pxd_getAdcOffsetB(1));
+		params.offsetA = UnScroll(b, -124 / 1024., 124 / 1024.);
 		break;
 	default:
-		//err = pxd_setContrastBrightness(UNITSMAP, pxd_getContrast(1), b-50);
-		err = pxd_setContrastBrightness(UNITSMAP, pxd_getContrast(1), UnScroll(b, -50.0, 49.61));
+		//params.brightness = b-50;
+		params.brightness = UnScroll(b, -50.0, 49.61);
 		break;
 	}
-	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_setContrastBrightness", MB_OK | MB_TASKMODAL);
+	markParams(PARAM_CONTRAST | PARAM_ADC);
+	LeaveCriticalSection(&paramsect);
 }
 int getGain()
 {
-	switch (pxd_infoModel(UNITSMAP)) {
+	int	model = getParamModel();
+	struct	params p = getParams();
+
+	switch (model) {
 	case PIXCI_SV8:
-		return(ToScroll(pxd_getContrast(1), 0.0, 200.0));
+		return(ToScroll(p.contrast, 0.0, 200.0));
 	case PIXCI_SV7:
-		//return((int)(pxd_getContrast(1)/2));
-		return(ToScroll(pxd_getContrast(1), 0.0, 199.22));
+		//return((int)(p.contrast/2));
+		return(ToScroll(p.contrast, 0.0, 199.22));
 	case PIXCI_A310:
 	case PIXCI_A110:
 	case PIXCI_A1107I1O:
-		return(ToScroll(pxd_getAdcGainA(1), 0, 6));
+		return(ToScroll(p.gainA, 0, 6));
 	default:
-		//return((int)(pxd_getContrast(1)*100./237.07));
-		return(ToScroll(pxd_getContrast(1), 0.0, 237.07));
+		//return((int)(p.contrast*100./237.07));
+		return(ToScroll(p.contrast, 0.0, 237.07));
 	}
 }
 void setGain(int b)
 {
-	int err = 0;
-	switch (pxd_infoModel(UNITSMAP)) {
+	int	model = getParamModel();
+
+	EnterCriticalSection(&paramsect);
+	switch (model) {
 	case PIXCI_SV8:
-		err = pxd_setContrastBrightness(UNITSMAP, UnScroll(b, 0.0, 200.0), pxd_getBrightness(1));
+		params.contrast = UnScroll(b, 0.0, 200.0);
 		break;
 	case PIXCI_SV7:
-		//err = pxd_setContrastBrightness(UNITSMAP, b*2, pxd_getBrightness(1)*2);
-		err = pxd_setContrastBrightness(UNITSMAP, UnScroll(b, 0.0, 199.22), pxd_getBrightness(1));
+		//params.contrast = b*2;
+		params.contrast = UnScroll(b, 0.0, 199.22);
 		break;
 	case PIXCI_A310:
 	case PIXCI_A110:
 	case PIXCI_A1107I1O:
-		err = pxd_setAdcGainOffset(UNITSMAP, 0, UnScroll(b, 0, 6), pxd_getAdcOffsetA(1), pxd_getAdcGainB(1), pxd_getAdcOffsetB(1));
+		params.gainA = UnScroll(b, 0, 6);
 		break;
 	default:
-		//err = pxd_setContrastBrightness(UNITSMAP, (b*237.07/100.), pxd_getBrightness(1));   // + 255 for rounding!
-		err = pxd_setContrastBrightness(UNITSMAP, UnScroll(b, 0.0, 237.07), pxd_getBrightness(1));
+		//params.contrast = b*237.07/100.;   // + 255 for rounding!
+		params.contrast = UnScroll(b, 0.0, 237.07);
 	}
-	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_setContrastBrightness", MB_OK | MB_TASKMODAL);
+	markParams(PARAM_CONTRAST | PARAM_ADC);
+	LeaveCriticalSection(&paramsect);
 }
 int getHue()
 {
-	switch (pxd_infoModel(UNITSMAP)) {
+	int	model = getParamModel();
+	struct	params p = getParams();
+
+	switch (model) {
 	case PIXCI_SV8:
-		return(ToScroll(pxd_getHue(UNITSMAP), -90.0, +90.0));
+		return(ToScroll(p.hue, -90.0, +90.0));
 	case PIXCI_SV7:
-		return(ToScroll(pxd_getHue(UNITSMAP), -45.0, +45.0));
+		return(ToScroll(p.hue, -45.0, +45.0));
 	case PIXCI_A310:
 	case PIXCI_A110:
 	case PIXCI_A1107I1O:
 		return(0);
 	default:
-		return(ToScroll(pxd_getHue(UNITSMAP), -90.0, +89.3));
+		return(ToScroll(p.hue, -90.0, +89.3));
 	}
 }
 void setHue(int h)
 {
-	int err = 0;
-	switch (pxd_infoModel(UNITSMAP)) {
+	int	model = getParamModel();
+
+	EnterCriticalSection(&paramsect);
+	switch (model) {
 	case PIXCI_SV8:
-		err = pxd_setHueSaturation(UNITSMAP, UnScroll(h, -90.0, +90.0), pxd_getUGain(UNITSMAP), pxd_getVGain(UNITSMAP));
+		params.hue = UnScroll(h, -90.0, +90.0);
 		break;
 	case PIXCI_SV7:
-		err = pxd_setHueSaturation(UNITSMAP, UnScroll(h, -45.0, +45.0), pxd_getUGain(UNITSMAP), pxd_getVGain(UNITSMAP));
+		params.hue = UnScroll(h, -45.0, +45.0);
 		break;
 	case PIXCI_A310:
 	case PIXCI_A110:
 	case PIXCI_A1107I1O:
 		break;
 	default:
-		err = pxd_setHueSaturation(UNITSMAP, UnScroll(h, -90.0, +89.3), pxd_getUGain(UNITSMAP), pxd_getVGain(UNITSMAP));
+		params.hue = UnScroll(h, -90.0, +89.3);
 		break;
 	}
-	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_setHueSaturation", MB_OK | MB_TASKMODAL);
+	markParams(PARAM_HUE);
+	LeaveCriticalSection(&paramsect);
 }
 
 /*
@@ -572,6 +727,145 @@ static	double	    triggerTime = 0.0;
 static	double	    triggerTimeMax = 0.0;
 static	double	    triggerTimeMin = 99E99;
 static	DWORD	    tickInit;
+/*
+ * Asynchronous faults, and errors of pxd_* calls made while
+ * capturing, queued as found and shown later, rather than by
+ * pxd_mesgFault()'s or MessageBox()'s modal dialog, which
+ * would hold up capture until dismissed.
+ */
+#define FAULTQUEUE	16
+#define FAULTTEXT	160
+static	struct {
+	int	unit;					// -1 for errors
+	char	text[FAULTTEXT];
+}		    faultQueue[FAULTQUEUE];
+static	unsigned    faultHead = 0;			// faults queued
+static	unsigned    faultTail = 0;			// faults shown
+static	unsigned    faultLost = 0;			// not queued, the queue being full
+static	CRITICAL_SECTION faultsect;
+
+
+/*
+ * Queue a fault or error, to be shown later; from any
+ * thread, never waiting on the user. Unit is -1 for
+ * errors of the functions named.
+ */
+void queueText(int unit, const char *what, const char *text)
+{
+	EnterCriticalSection(&faultsect);
+	if (faultHead - faultTail < FAULTQUEUE) {
+		char	*q = faultQueue[faultHead % FAULTQUEUE].text;
+		faultQueue[faultHead % FAULTQUEUE].unit = unit;
+		q[FAULTTEXT - 1] = 0;
+		if (what)
+			_snprintf(q, FAULTTEXT - 1, "%s: %s", what, text);
+		else
+			_snprintf(q, FAULTTEXT - 1, "%s", text);
+		faultHead++;
+	}
+	else
+		faultLost++;
+	LeaveCriticalSection(&faultsect);
+}
+void queueError(const char *what, const char *text)
+{
+	queueText(-1, what, text);
+}
+
+/*
+ * Queue any faults of the selected units.
+ */
+void queueFaults(int unitmap)
+{
+	char	text[FAULTTEXT];
+
+	for (int u = 0; u < UNITS; u++) {
+		if (!(unitmap & (1 << u)))
+			continue;
+		text[0] = 0;
+		if (pxd_mesgFaultText(1 << u, text, sizeof(text)) <= 0)
+			continue;
+		text[sizeof(text) - 1] = 0;
+		queueText(u, NULL, text);
+	}
+}
+
+/*
+ * Show the faults and errors queued, on the console;
+ * from the dialog's thread.
+ */
+void showFaults(void)
+{
+	EnterCriticalSection(&faultsect);
+	while (faultTail != faultHead) {
+		if (faultQueue[faultTail % FAULTQUEUE].unit >= 0)
+			printf("unit %d fault: %s\n", faultQueue[faultTail % FAULTQUEUE].unit, faultQueue[faultTail % FAULTQUEUE].text);
+		else
+			printf("error: %s\n", faultQueue[faultTail % FAULTQUEUE].text);
+		faultTail++;
+	}
+	if (faultLost) {
+		printf("%u more faults or errors, not queued\n", faultLost);
+		faultLost = 0;
+	}
+	LeaveCriticalSection(&faultsect);
+}
+
+
+
+/*
+ * Send changed parameters to the grabber.
+ * While capturing, this waits for the next captured field,
+ * unless forced (i.e. called just after one was captured),
+ * so that the changes are sent between frames, and
+ * at most once per frame. Errors are queued, not shown,
+ * as this may run on a service thread; the shadow is then
+ * read back, so the controls show what the grabber has.
+ */
+void applyParams(int force)
+{
+	struct	params p;
+	LONG	dirty;
+	int	err = 0;
+
+	if (!force && pxd_goneLive(UNITSMAP, 0)) {
+#if UPDATE_EVENT
+		return;     // DisplayServiceThread will do so
+#else
+		static pxvbtime_t lastfield = 0;
+		pxvbtime_t field = pxd_capturedFieldCount(1);
+		if (field == lastfield)
+			return;
+		lastfield = field;
+#endif
+	}
+	if (!paramDirty)
+		return;
+	EnterCriticalSection(&paramsect);
+	dirty = paramDirty;
+	paramDirty = 0;
+	p = params;
+	LeaveCriticalSection(&paramsect);
+
+	if (dirty & PARAM_CONTRAST) {
+		if ((err = pxd_setContrastBrightness(UNITSMAP, p.contrast, p.brightness)) < 0) {
+			readParamGroups(PARAM_CONTRAST);
+			queueError("pxd_setContrastBrightness", pxd_mesgErrorCode(err));
+		}
+	}
+	if (dirty & PARAM_HUE) {
+		if ((err = pxd_setHueSaturation(UNITSMAP, p.hue, p.ugain, p.vgain)) < 0) {
+			readParamGroups(PARAM_HUE);
+			queueError("pxd_setHueSaturation", pxd_mesgErrorCode(err));
+		}
+	}
+	if (dirty & PARAM_ADC) {
+		if ((err = pxd_setAdcGainOffset(UNITSMAP, 0, p.gainA, p.offsetA, p.gainB, p.offsetB)) < 0) {
+			readParamGroups(PARAM_ADC);
+			queueError("pxd_setAdcGainOffset", pxd_mesgErrorCode(err));
+		}
+	}
+}
 
 
 /*
@@ -630,7 +924,7 @@ void displayImage(int force)
 			windImage[u].se.x - windImage[u].nw.x,
 			windImage[u].se.y - windImage[u].nw.y, 0);
 		if (err < 0)
-			MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_renderStretchDIBits", MB_OK | MB_TASKMODAL);
+			queueError("pxd_renderStretchDIBits", pxd_mesgErrorCode(err));
 #endif
 
 		//
@@ -649,7 +943,7 @@ void displayImage(int force)
 				windImage[u].se.x - windImage[u].nw.x,
 				windImage[u].se.y - windImage[u].nw.y, 0);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_renderStretchDIBits", MB_OK | MB_TASKMODAL);
+				queueError("pxd_renderStretchDIBits", pxd_mesgErrorCode(err));
 			SetRect(&rect, windImage[u].nw.x + (windImage[u].se.x - windImage[u].nw.x) / 4,
 				windImage[u].nw.y + (windImage[u].se.y - windImage[u].nw.y) / 4,
 				windImage[u].nw.x + (windImage[u].se.x - windImage[u].nw.x) * 3 / 4,
@@ -688,7 +982,7 @@ void displayImage(int force)
 				pxd_renderDIBFree(hDIB);
 			}
 			else
-				MessageBox(NULL, "Error", "pxd_renderDIBCreate", MB_OK | MB_TASKMODAL);
+				queueError("pxd_renderDIBCreate", "failed");
 		}
 #endif
 
@@ -731,7 +1025,7 @@ void displayImage(int force)
 				pxd_renderDIBFree(hDIB);
 			}
 			else
-				MessageBox(NULL, "Error", "pxd_renderDIBCreate", MB_OK | MB_TASKMODAL);
+				queueError("pxd_renderDIBCreate", "failed");
 		}
 #endif
 
@@ -772,7 +1066,7 @@ void displayImage(int force)
 				NULL, 0, 'n', 0, 0, hDCDIB, &windDIB, // not &windImage[u]!
 				NULL, NULL);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_GDIDisplay", MB_OK | MB_TASKMODAL);
+				queueError("pxio8_GDIDisplay", pxd_mesgErrorCode(err));
 
 			//
 			// Use GDI to draw graphics over image.
@@ -808,7 +1102,7 @@ void displayImage(int force)
 		err = pxio8_GDIDisplay(NULL, pxd_defineImage(1 << u, buf, 0, 0, -1, -1, "Display"),
 			NULL, 0, 'n', 0, 0, hDC, &windImage[u], NULL, NULL);
 		if (err < 0)
-			MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_GDIDisplay", MB_OK | MB_TASKMODAL);
+			queueError("pxio8_GDIDisplay", pxd_mesgErrorCode(err));
 #endif
 
 		//
@@ -845,7 +1139,7 @@ void displayImage(int force)
 				err = pxio8_GDIDisplay(NULL, pxd_defineImage(1 << u, buf, 0, 0, -1, -1, "Display"),
 					NULL, 0, 'n', 0, 0, hDC, &windImage[u], &xy, &cursimage);
 				if (err < 0)
-					MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_GDIDisplay", MB_OK | MB_TASKMODAL);
+					queueError("pxio8_GDIDisplay", pxd_mesgErrorCode(err));
 
 				//
 				// The cursimage not contains the pixel values which were
@@ -899,7 +1193,7 @@ void displayImage(int force)
 				err = pxio8_vgadisplay(NULL, pxd_defineImage(1 << u, buf, 0, 0, -1, -1, pxd_imageCdim() == 1 ? "GREY" : "BGR"),
 					NULL, 0, 'n', 0, 0, &tempimage, NULL, NULL);
 				if (err < 0)
-					MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_vgadisplay", MB_OK | MB_TASKMODAL);
+					queueError("pxio8_vgadisplay", pxd_mesgErrorCode(err));
 
 				//
 				// Prepare to Draw Graphics.
@@ -920,7 +1214,7 @@ void displayImage(int force)
 				//
 				err = pxip8_drawbox(NULL, &tempimage, &box, 6, 3, 's', color, NULL, NULL);
 				if (err < 0)
-					MessageBox(NULL, pxd_mesgErrorCode(err), "pxip8_drawbox", MB_OK | MB_TASKMODAL);
+					queueError("pxip8_drawbox", pxd_mesgErrorCode(err));
 
 				//
 				// Display image and graphics.
@@ -930,7 +1224,7 @@ void displayImage(int force)
 				err = pxio8_GDIDisplay(NULL, &tempimage, NULL, 0, '1', 0, 0, hDC, &windImage[u],
 					NULL, NULL);
 				if (err < 0)
-					MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_GDIDisplay", MB_OK | MB_TASKMODAL);
+					queueError("pxio8_GDIDisplay", pxd_mesgErrorCode(err));
 
 				//
 				// All done with temp image and its buffer.
@@ -987,7 +1281,7 @@ void displayImage(int force)
 				}
 			}
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_DirectXDisplay", MB_OK | MB_TASKMODAL);
+				queueError("pxio8_DirectXDisplay", pxd_mesgErrorCode(err));
 		}
 #endif
 
@@ -1012,7 +1306,7 @@ void displayImage(int force)
 			pxd_renderDIBFree(hDIB);
 		}
 		else
-			MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_renderDIBCreate", MB_OK | MB_TASKMODAL);
+			queueError("pxd_renderDIBCreate", pxd_mesgErrorCode(err));
 #endif
 
 		//
@@ -1024,7 +1318,7 @@ void displayImage(int force)
 		err = pxio8_DrawDibDisplay(NULL, pxd_defineImage(1 << u, buf, 0, 0, -1, -1, "Display"),
 			NULL, 0, 'n', 0, 0, hDrawDib, hDC, &windImage[u], NULL, NULL);
 		if (err < 0)
-			MessageBox(NULL, pxd_mesgErrorCode(err), "pxio8_DrawDibDisplay", MB_OK | MB_TASKMODAL);
+			queueError("pxio8_DrawDibDisplay", pxd_mesgErrorCode(err));
 #endif
 
 
@@ -1077,7 +1371,7 @@ void displayImage(int force)
 				free(buffer);
 			}
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_readuchar", MB_OK | MB_TASKMODAL);
+				queueError("pxd_readuchar", pxd_mesgErrorCode(err));
 		}
 		ReleaseDC(hWndImage, hDC);
 
@@ -1089,7 +1383,7 @@ void displayImage(int force)
 		if (liveon) {
 			err = pxd_goSnap(1 << u, 1);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goSnap", MB_OK | MB_TASKMODAL);
+				queueError("pxd_goSnap", pxd_mesgErrorCode(err));
 		}
 #endif
 
@@ -1111,11 +1405,11 @@ void live()
 #if SHOWIG_DIRECTVIDEO
 	if ((err = pxd_renderDirectVideoLive(UNITSMAP, hWndImage, windImage[0].nw.x, windImage[0].nw.y,
 		windImage[0].se.x, windImage[0].se.y, CLR_INVALID, CLR_INVALID)) < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_renderDirectVideoLive", MB_OK | MB_TASKMODAL);
+		queueError("pxd_renderDirectVideoLive", pxd_mesgErrorCode(err));
 #elif SHOWIM_DIRECTVIDEO
 	if ((err = pxd_renderDirectVideoLive(UNITSMAP, hWndImage, windImage[0].nw.x, windImage[0].nw.y,
 		windImage[0].se.x, windImage[0].se.y, RGB(0, 0, 189), RGB(0, 0, 189))) < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_renderDirectVideoLive", MB_OK | MB_TASKMODAL);
+		queueError("pxd_renderDirectVideoLive", pxd_mesgErrorCode(err));
 	//
 	// If we are using Chroma keying, then any graphics or text
 	// written via GDI (i.e. the 'normal' method of putting
@@ -1133,15 +1427,15 @@ void live()
 #elif LIVE_LIVE
 	err = pxd_goLive(UNITSMAP, 1L);
 	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goLive", MB_OK | MB_TASKMODAL);
+		queueError("pxd_goLive", pxd_mesgErrorCode(err));
 #elif LIVE_LIVE2
 	err = pxd_goLivePair(UNITSMAP, 1L, 2L);
 	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goLivePair", MB_OK | MB_TASKMODAL);
+		queueError("pxd_goLivePair", pxd_mesgErrorCode(err));
 #elif LIVE_SNAP
 	err = pxd_goSnap(UNITSMAP, 1);
 	if (err < 0)
-		MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goSnap", MB_OK | MB_TASKMODAL);
+		queueError("pxd_goSnap", pxd_mesgErrorCode(err));
 #endif
 }
 
@@ -1174,12 +1468,88 @@ void unlive(int abort)
 
 
 
+/*
+ * The event service threads, for reporting their CPU time.
+ */
+#define SERVICETHREADS	8
+static	struct {
+	const char *name;
+	HANDLE	h;
+	DWORD_PTR mask;			// pinned to, or 0
+}		    serviceThreads[SERVICETHREADS];
+static	int	    nserviceThreads = 0;
+
+/*
+ * Place an event service thread, as per SERVICE_PLACEMENT.
+ * With pin > 0, on the pin'th highest numbered processor,
+ * if the process has more, so that at least one is left
+ * for everything else; otherwise unpinned.
+ */
+void PlaceServiceThread(HANDLE hThread, const char *name, int pin, int priority)
+{
+	DWORD_PTR mask = 0;
+
+	if (!hThread)
+		return;
+#if SERVICE_PLACEMENT
+	DWORD_PTR procmask, sysmask;
+	int	nprocs = 0;
+	if (pin && GetProcessAffinityMask(GetCurrentProcess(), &procmask, &sysmask)) {
+		for (DWORD_PTR b = 1; b; b <<= 1)
+			nprocs += (procmask & b) != 0;
+		if (nprocs > pin) {
+			int	n = 0;
+			for (DWORD_PTR b = (DWORD_PTR)1 << (sizeof(b) * 8 - 1); b && !mask; b >>= 1)
+				if ((procmask & b) && ++n == pin)
+					mask = b;
+			SetThreadAffinityMask(hThread, mask);
+		}
+	}
+	SetThreadPriority(hThread, priority);
+#endif
+	if (nserviceThreads < SERVICETHREADS) {
+		serviceThreads[nserviceThreads].name = name;
+		serviceThreads[nserviceThreads].h = hThread;
+		serviceThreads[nserviceThreads].mask = mask;
+		nserviceThreads++;
+	}
+}
+
+/*
+ * Print where each service thread's time went, as
+ * Scott_Imager's place_format() does for its threads.
+ */
+void reportServiceThreads(void)
+{
+	for (int i = 0; i < nserviceThreads; i++) {
+		FILETIME created, exited, kernel, user, now;
+		ULARGE_INTEGER k, u, c, t;
+		double	cpu, life;
+		if (!GetThreadTimes(serviceThreads[i].h, &created, &exited, &kernel, &user)) {
+			printf("thread %s: ended\n", serviceThreads[i].name);
+			continue;
+		}
+		GetSystemTimeAsFileTime(&now);
+		k.LowPart = kernel.dwLowDateTime;   k.HighPart = kernel.dwHighDateTime;
+		u.LowPart = user.dwLowDateTime;	    u.HighPart = user.dwHighDateTime;
+		c.LowPart = created.dwLowDateTime;  c.HighPart = created.dwHighDateTime;
+		t.LowPart = now.dwLowDateTime;	    t.HighPart = now.dwHighDateTime;
+		cpu = (k.QuadPart + u.QuadPart) / 1.0E4;	// 100ns -> millis
+		life = (t.QuadPart - c.QuadPart) / 1.0E4;
+		printf("thread %s: cpus 0x%llx, priority %d, cpu %.0f ms (%.1f%%), %.0f ms kernel\n",
+			serviceThreads[i].name, (unsigned long long)serviceThreads[i].mask,
+			GetThreadPriority(serviceThreads[i].h), cpu, life > 0 ? 100.0 * cpu / life : 0.0, k.QuadPart / 1.0E4);
+	}
+}
+
 /*
  * Thread to watch for end of captured field events, and advise
  * when the image should be redrawn.
  */
 #if UPDATE_EVENT
 
+static	HANDLE	    displayEvent;			// to DisplayServiceThread
+
 DWORD WINAPI CapturedFieldServiceThread(PVOID hEventR3)
 {
 	for (;;) {
@@ -1218,9 +1588,25 @@ DWORD WINAPI CapturedFieldServiceThread(PVOID hEventR3)
 
 
 		//
-		// Update image display
+		// Have the display thread apply any changed parameters,
+		// now that a frame has been captured, and update the
+		// image display; not here, at time critical priority.
 		//
+		SetEvent(displayEvent);
+	}
+	return(0);
+}
+
+/*
+ * Thread to apply changed parameters and redraw the image,
+ * once per captured field, or fewer if it falls behind.
+ */
+DWORD WINAPI DisplayServiceThread(PVOID hEventR3)
+{
+	for (;;) {
+		WaitForSingleObject((HANDLE)hEventR3, INFINITE);
 		EnterCriticalSection(&critsect);
+		applyParams(true);
 		displayImage(false);
 		LeaveCriticalSection(&critsect);
 	}
@@ -1228,7 +1614,7 @@ DWORD WINAPI CapturedFieldServiceThread(PVOID hEventR3)
 }
 
 //
-// Thread to wait for fault and display same.
+// Thread to wait for fault and queue same.
 //
 DWORD WINAPI FaultServiceThread(PVOID hEventR3)
 {
@@ -1237,9 +1623,7 @@ DWORD WINAPI FaultServiceThread(PVOID hEventR3)
 		// Wait for signal.
 		//
 		WaitForSingleObject((HANDLE)hEventR3, INFINITE);
-		EnterCriticalSection(&critsect);
-		pxd_mesgFault(UNITSMAP);
-		LeaveCriticalSection(&critsect);
+		queueFaults(UNITSMAP);
 	}
 	return(0);
 }
@@ -1356,7 +1740,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			pxd_videoFormatAsIncludedInit(0);
 			err = pxd_videoFormatAsIncluded(0);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_videoFormatAsIncluded", MB_OK | MB_TASKMODAL);
+				queueError("pxd_videoFormatAsIncluded", pxd_mesgErrorCode(err));
 		}
 #endif
 
@@ -1429,32 +1813,35 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 		HANDLE  Event;
 		DWORD   ThreadId;
 
+		displayEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
 		Event = pxd_eventCapturedFieldCreate(0x1);
-		if (!Event)
+		if (!Event || !displayEvent)
 			MessageBox(NULL, "Can't create image update display event!", "XCLIBEX2", MB_OK | MB_TASKMODAL);
-		else
-			CreateThread(0, 0x1000, CapturedFieldServiceThread, Event, 0, &ThreadId);
+		else {
+			PlaceServiceThread(CreateThread(0, 0x1000, DisplayServiceThread, displayEvent, 0, &ThreadId), "display", 0, THREAD_PRIORITY_NORMAL);
+			PlaceServiceThread(CreateThread(0, 0x1000, CapturedFieldServiceThread, Event, 0, &ThreadId), "captured field", 1, THREAD_PRIORITY_TIME_CRITICAL);
+		}
 
 #if SNAP_STATISTICS
 		Event = pxd_eventFieldCreate(0x1);
 		if (!Event)
 			MessageBox(NULL, "Can't create video field event!", "XCLIBEX2", MB_OK | MB_TASKMODAL);
 		else
-			CreateThread(0, 0x1000, FieldServiceThread, Event, 0, &ThreadId);
+			PlaceServiceThread(CreateThread(0, 0x1000, FieldServiceThread, Event, 0, &ThreadId), "field", 2, THREAD_PRIORITY_TIME_CRITICAL);
 		//
 		// The pxd_eventGPTriggerCreate, for async triggers, isn't available
 		// on all boards. And it is used only for the sake of gathering statistics.
 		// So, no error message if pxd_eventGPTriggerCreate() fails.
 		Event = pxd_eventGPTriggerCreate(0x1, 0, 0);
 		if (Event)
-			CreateThread(0, 0x1000, GPTriggerServiceThread, Event, 0, &ThreadId);
+			PlaceServiceThread(CreateThread(0, 0x1000, GPTriggerServiceThread, Event, 0, &ThreadId), "trigger", 3, THREAD_PRIORITY_TIME_CRITICAL);
 #endif
 
 		Event = pxd_eventFaultCreate(UNITSMAP, 0);
 		if (!Event)
 			MessageBox(NULL, "Can't create fault monitoring event!", "XCLIBEX2", MB_OK | MB_TASKMODAL);
 		else
-			CreateThread(0, 0x1000, FaultServiceThread, Event, 0, &ThreadId);
+			PlaceServiceThread(CreateThread(0, 0x1000, FaultServiceThread, Event, 0, &ThreadId), "fault", 0, THREAD_PRIORITY_ABOVE_NORMAL);
 
 		// Timer pops every 1 second to display the optional status and statistics messages;
 		// when using events the timer is not needed to display video images
@@ -1527,6 +1914,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 		// frame grabber model. Note that the pxd_infoModel()
 		// for the SV5, SV5A, SV5B, and SV5L is the same.
 		//
+		readParams();
 		switch (pxd_infoModel(UNITSMAP)) {
 		case PIXCI_SV2:
 			EnableWindow(GetDlgItem(hDlg, IDBNC2), FALSE);
@@ -1665,7 +2053,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 		//
 #if SHOWIG_DIRECTVIDEO | SHOWIM_DIRECTVIDEO
 		if ((err = pxd_renderDirectVideoInit(UNITSMAP, hWnd)) < 0)
-			MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_renderDirectVideoInit", MB_OK | MB_TASKMODAL);
+			queueError("pxd_renderDirectVideoInit", pxd_mesgErrorCode(err));
 #endif
 
 		//
@@ -1701,7 +2089,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			if (liveon) {
 				err = pxd_goUnLive(UNITSMAP);
 				if (err < 0)
-					MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goUnLive", MB_OK | MB_TASKMODAL);
+					queueError("pxd_goUnLive", pxd_mesgErrorCode(err));
 				liveon = FALSE;
 				return(TRUE);
 			}
@@ -1715,7 +2103,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 
 				err = pxd_goSnap(UNITSMAP, 1);
 				if (err < 0)
-					MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goSnap", MB_OK | MB_TASKMODAL);
+					queueError("pxd_goSnap", pxd_mesgErrorCode(err));
 
 #if defined(SNAP_STATISTICS)
 				snapTime = 0;
@@ -1777,7 +2165,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			// instead click Unlive button twice.
 			err = pxd_goAbortLive(UNITSMAP);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_goAbortLive", MB_OK | MB_TASKMODAL);
+				queueError("pxd_goAbortLive", pxd_mesgErrorCode(err));
 			liveon = FALSE;
 			return(TRUE);
 
@@ -1794,6 +2182,11 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				unlive((t - unliveclick) < 2000);
 				unliveclick = t;
 			}
+			//
+			// Where the service threads' time went.
+			//
+			if (liveon)
+				reportServiceThreads();
 			liveon = FALSE;
 			return(TRUE);
 
@@ -1802,7 +2195,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			err = pxd_setVidMux(UNITSMAP, 1);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_setVidMux", MB_OK | MB_TASKMODAL);
+				queueError("pxd_setVidMux", pxd_mesgErrorCode(err));
 			setGuiMux(hDlg);
 			return(TRUE);
 
@@ -1811,7 +2204,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			err = pxd_setVidMux(UNITSMAP, 2);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_setVidMux", MB_OK | MB_TASKMODAL);
+				queueError("pxd_setVidMux", pxd_mesgErrorCode(err));
 			setGuiMux(hDlg);
 			return(TRUE);
 
@@ -1820,7 +2213,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			err = pxd_setVidMux(UNITSMAP, 3);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_setVidMux", MB_OK | MB_TASKMODAL);
+				queueError("pxd_setVidMux", pxd_mesgErrorCode(err));
 			setGuiMux(hDlg);
 			return(TRUE);
 
@@ -1829,7 +2222,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			err = pxd_setVidMux(UNITSMAP, 4);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_setVidMux", MB_OK | MB_TASKMODAL);
+				queueError("pxd_setVidMux", pxd_mesgErrorCode(err));
 			setGuiMux(hDlg);
 			return(TRUE);
 
@@ -1838,7 +2231,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			err = pxd_setVidMux(UNITSMAP, 5);
 			if (err < 0)
-				MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_setVidMux", MB_OK | MB_TASKMODAL);
+				queueError("pxd_setVidMux", pxd_mesgErrorCode(err));
 			setGuiMux(hDlg);
 			return(TRUE);
 
@@ -1888,11 +2281,11 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 #if 1
 					err = pxd_saveTiff(1 << u, pathname, 1, 0, 0, -1, -1, 0, 0);
 					if (err < 0)
-						MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_saveTiff", MB_OK | MB_TASKMODAL);
+						queueError("pxd_saveTiff", pxd_mesgErrorCode(err));
 #else
 					err = pxd_saveBmp(1 << u, pathname, 1, 0, 0, -1, -1, 0, 0);
 					if (err < 0)
-						MessageBox(NULL, pxd_mesgErrorCode(err), "pxd_saveBmp", MB_OK | MB_TASKMODAL);
+						queueError("pxd_saveBmp", pxd_mesgErrorCode(err));
 #endif
 				}
 				MessageBeep(0xFFFFFFFF);
@@ -1923,6 +2316,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			}
 			setGain(g);
+			applyParams(false);
 			SetScrollPos(GetDlgItem(hDlg, IDGAINSCROLL), SB_CTL, getGain(), TRUE);
 			return(TRUE);
 		}
@@ -1942,6 +2336,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			}
 			setBright(g);
+			applyParams(false);
 			SetScrollPos(GetDlgItem(hDlg, IDOFFSETSCROLL), SB_CTL, getBright(), TRUE);
 			return(TRUE);
 		}
@@ -1961,6 +2356,7 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 				return(FALSE);
 			}
 			setHue(g);
+			applyParams(false);
 			SetScrollPos(GetDlgItem(hDlg, IDHUESCROLL), SB_CTL, getHue(), TRUE);
 			return(TRUE);
 		}
@@ -2029,19 +2425,15 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 		// can't be reported by functions such as pxd_goLive()
 		// which initiate capture and return immediately.
 		//
-		// Should there be a fault and pxd_mesgFault() pop up a dialog,
-		// the Windows TIMER will continue in a new thread. Thus the
-		// 'faulting' variable and logic to limit to one dialog at a time.
+		// Faults are queued, here or by FaultServiceThread,
+		// and shown on the console, rather than by pxd_mesgFault(),
+		// whose dialog would hold up capture until dismissed.
 		//
 		if (pxd_infoUnits()) {	 // implies whether library is open
 #if UPDATE_TIMER
-			static int faulting = 0;
-			if (!faulting) {
-				faulting++;
-				pxd_mesgFault(UNITSMAP);
-				faulting--;
-			}
+			queueFaults(UNITSMAP);
 #endif
+			showFaults();
 			//
 			// Show
 			//	spatial resolution
@@ -2120,8 +2512,11 @@ PIXCIDialogProc1(HWND hDlg, UINT wMsg, WPARAM wParam, LPARAM lParam)
 			}
 		}
 		//
+		// Apply any changed parameters, between frames.
 		// If using the timer to update image display, do so.
 		//
+		if (pxd_infoUnits())
+			applyParams(false);
 #if UPDATE_TIMER
 		displayImage(false);
 #endif
@@ -2229,6 +2624,8 @@ int APIENTRY WinMain(
 	// Launch dialog.
 	//
 	InitializeCriticalSection(&critsect);
+	InitializeCriticalSection(&faultsect);
+	InitializeCriticalSection(&paramsect);
 	hDlg = CreateDialogParam(hInstance, "PIXCISVXDIALOG", NULL, (DLGPROC)PIXCIDialogProc, NULL);
 	if (!hDlg) {
 		MessageBox(NULL, "Missing Dialog Resource - Compilation or Link Error!", "XCLIBEX2", MB_OK | MB_TASKMODAL);